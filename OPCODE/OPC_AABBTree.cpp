@@ -358,7 +358,426 @@ void AABBTreeNode::_Refit(AABBTreeBuilder* builder)
 	if(Neg)	Neg->_Refit(builder);
 }
 
+// Binned SAH build [complete trees]
+//
+// Each primitive's box and center are computed once, up-front, and stored next to its index: they move with it
+// when indices are partitioned, so nodes read them in sequence. A node bins its primitives by center along the
+// largest axis of the centers' bounds, picks the bin boundary with the lowest SAH cost, and partitions its
+// primitives in place. The children's boxes are gathered from the bins, and their center bounds while partitioning.
+//
+// The descendants of a node with N primitives always take 2*N-2 consecutive slots of the pool: the two children
+// first, then the positive subtree, then the negative one. A subtree's nodes don't depend on the build order, so
+// subtrees can be built by different threads and the tree is the same whatever the number of threads.
+
+//! Number of bins. Nodes with fewer primitives use one bin per primitive.
+#define SAH_NB_BINS				16
+//! Nodes with at least that many primitives are binned by several tasks
+#define SAH_PARALLEL_BINNING	65536
+//! Minimal number of primitives binned by a task
+#define SAH_BINNING_CHUNK		16384
+//! Maximal number of tasks binning a node
+#define SAH_MAX_BINNING_TASKS	64
+//! Subtrees with at most that many primitives are built by a single task. Larger meshes use N/SAH_NB_SUBTREES.
+#define SAH_MIN_SUBTREE			4096
+#define SAH_NB_SUBTREES			64
+
+namespace Opcode
+{
+	//! Min/max bounds of a set of boxes or points
+	struct SAHBounds
+	{
+		inline_	void	SetEmpty()							{ mMin.Set(MAX_FLOAT, MAX_FLOAT, MAX_FLOAT); mMax.Set(MIN_FLOAT, MIN_FLOAT, MIN_FLOAT);	}
+		inline_	void	Add(const Point& p)					{ mMin.Min(p);			mMax.Max(p);			}
+		inline_	void	Add(const SAHBounds& bounds)		{ mMin.Min(bounds.mMin);	mMax.Max(bounds.mMax);	}
+		//! Half the surface area, enough to compare costs
+		inline_	float	HalfArea()					const	{ Point d = mMax - mMin;	return d.x*d.y + d.y*d.z + d.z*d.x;	}
+
+				Point	mMin;
+				Point	mMax;
+	};
+
+	struct SAHPrimitive
+	{
+				SAHBounds	mBox;		//!< Primitive's box
+				Point		mCenter;	//!< Center of the primitive's box
+	};
+
+	struct SAHBin
+	{
+				SAHBounds	mBox;		//!< Boxes of the primitives in the bin
+				udword		mCount;		//!< Number of primitives in the bin
+	};
+
+	struct SAHBins
+	{
+				void		Reset(udword nb_bins);
+				void		Add(const SAHBins& bins, udword nb_bins);
+
+				SAHBin		mBins[SAH_NB_BINS];
+	};
+
+	//! A subtree left to a single task
+	struct SAHSubtree
+	{
+				AABBTreeNode*	mNode;
+				AABBTreeNode*	mDescendants;
+				SAHBounds		mCenters;
+				udword			mNbInvalidSplits;
+	};
+
+	struct SAHBuildContext
+	{
+							SAHBuildContext(AABBTreeBuilder* builder);
+							~SAHBuildContext();
+
+				bool		AddSubtree(AABBTreeNode* node, AABBTreeNode* descendants, const SAHBounds& centers);
+				void		Bin(const dTriIndex* primitives, udword nb_prims, udword axis, float origin, float scale, udword nb_bins, bool parallel, SAHBins& bins);
+				void		BinRange(const dTriIndex* primitives, udword nb_prims, udword axis, float origin, float scale, udword nb_bins, SAHBins& bins)	const;
+
+		static	void		PrepareTask(void* context, udword index);
+		static	void		BinTask(void* context, udword index);
+
+		AABBTreeBuilder*		mBuilder;
+		const dTriIndex*		mIndices;			//!< The tree's indices
+		SAHPrimitive*			mPrimitives;		//!< Box and center of the primitive at each position of mIndices
+		ubyte*					mBinIndices;		//!< Bin of the primitive at each position, for the node being split
+		// Parallel build
+		AABBTreeBuildScheduler*	mScheduler;			//!< Null for a serial build
+		udword					mSubtreeSize;		//!< Nodes with at most that many primitives are deferred to a task, 0 for a serial build
+		SAHSubtree*				mSubtrees;
+		udword					mNbSubtrees;
+		udword					mMaxNbSubtrees;
+		SAHBins*				mTaskBins;			//!< One set of bins per binning task
+		SAHBounds*				mTaskBounds;		//!< Box and centers bounds found by each prepare task
+		// Current parallel job
+		const dTriIndex*		mJobPrimitives;
+		udword					mJobNbPrims;
+		udword					mJobNbTasks;
+		udword					mJobAxis;
+		float					mJobOrigin;
+		float					mJobScale;
+	};
+}
 
+void SAHBins::Reset(udword nb_bins)
+{
+	for(udword i=0;i<nb_bins;i++)
+	{
+		mBins[i].mBox.SetEmpty();
+		mBins[i].mCount = 0;
+	}
+}
+
+void SAHBins::Add(const SAHBins& bins, udword nb_bins)
+{
+	for(udword i=0;i<nb_bins;i++)
+	{
+		mBins[i].mBox.Add(bins.mBins[i].mBox);
+		mBins[i].mCount += bins.mBins[i].mCount;
+	}
+}
+
+SAHBuildContext::SAHBuildContext(AABBTreeBuilder* builder) :
+	mBuilder		(builder),
+	mIndices		(null),
+	mPrimitives		(null),
+	mBinIndices		(null),
+	mScheduler		(null),
+	mSubtreeSize	(0),
+	mSubtrees		(null),
+	mNbSubtrees		(0),
+	mMaxNbSubtrees	(0),
+	mTaskBins		(null),
+	mTaskBounds		(null),
+	mJobPrimitives	(null),
+	mJobNbPrims		(0),
+	mJobNbTasks		(0),
+	mJobAxis		(0),
+	mJobOrigin		(0.0f),
+	mJobScale		(0.0f)
+{
+}
+
+SAHBuildContext::~SAHBuildContext()
+{
+	DELETEARRAY(mTaskBounds);
+	DELETEARRAY(mTaskBins);
+	DELETEARRAY(mSubtrees);
+	DELETEARRAY(mBinIndices);
+	DELETEARRAY(mPrimitives);
+}
+
+bool SAHBuildContext::AddSubtree(AABBTreeNode* node, AABBTreeNode* descendants, const SAHBounds& centers)
+{
+	if(mNbSubtrees==mMaxNbSubtrees)
+	{
+		udword NewMax = mMaxNbSubtrees ? mMaxNbSubtrees*2 : SAH_NB_SUBTREES*2;
+		SAHSubtree* NewSubtrees = new SAHSubtree[NewMax];
+		CHECKALLOC(NewSubtrees);
+		if(mNbSubtrees)	CopyMemory(NewSubtrees, mSubtrees, mNbSubtrees*sizeof(SAHSubtree));
+		DELETEARRAY(mSubtrees);
+		mSubtrees		= NewSubtrees;
+		mMaxNbSubtrees	= NewMax;
+	}
+	SAHSubtree& Subtree		= mSubtrees[mNbSubtrees++];
+	Subtree.mNode			= node;
+	Subtree.mDescendants	= descendants;
+	Subtree.mCenters		= centers;
+	Subtree.mNbInvalidSplits= 0;
+	return true;
+}
+
+//! Maps a center coordinate to its bin. Partitioning reads back the stored bins, so this is computed once per node.
+static inline_ udword SAHBinIndex(float center, float origin, float scale, udword nb_bins)
+{
+	// Compare as floats first, so that huge or invalid values never reach the conversion
+	float Bin = (center - origin) * scale;
+	if(!(Bin>0.0f))					return 0;
+	if(Bin>=float(nb_bins-1))		return nb_bins-1;
+	return udword(Bin);
+}
+
+void SAHBuildContext::BinRange(const dTriIndex* primitives, udword nb_prims, udword axis, float origin, float scale, udword nb_bins, SAHBins& bins) const
+{
+	bins.Reset(nb_bins);
+	udword Offset = udword(primitives - mIndices);
+	const SAHPrimitive* Prims = &mPrimitives[Offset];
+	ubyte* BinIndices = &mBinIndices[Offset];
+	for(udword i=0;i<nb_prims;i++)
+	{
+		udword BinIndex = SAHBinIndex(Prims[i].mCenter[axis], origin, scale, nb_bins);
+		BinIndices[i] = ubyte(BinIndex);
+		SAHBin& Bin = bins.mBins[BinIndex];
+		Bin.mBox.Add(Prims[i].mBox);
+		Bin.mCount++;
+	}
+}
+
+void SAHBuildContext::BinTask(void* context, udword index)
+{
+	SAHBuildContext* Context = (SAHBuildContext*)context;
+	udword Begin	= udword((uqword(Context->mJobNbPrims) * index) / Context->mJobNbTasks);
+	udword End		= udword((uqword(Context->mJobNbPrims) * (index+1)) / Context->mJobNbTasks);
+	Context->BinRange(Context->mJobPrimitives + Begin, End - Begin, Context->mJobAxis, Context->mJobOrigin, Context->mJobScale, SAH_NB_BINS, Context->mTaskBins[index]);
+}
+
+void SAHBuildContext::PrepareTask(void* context, udword index)
+{
+	SAHBuildContext* Context = (SAHBuildContext*)context;
+	udword Begin	= udword((uqword(Context->mJobNbPrims) * index) / Context->mJobNbTasks);
+	udword End		= udword((uqword(Context->mJobNbPrims) * (index+1)) / Context->mJobNbTasks);
+
+	SAHBounds& Box		= Context->mTaskBounds[index*2+0];
+	SAHBounds& Centers	= Context->mTaskBounds[index*2+1];
+	Box.SetEmpty();
+	Centers.SetEmpty();
+	// Indices are still the identity permutation here
+	for(udword i=Begin;i<End;i++)
+	{
+		SAHPrimitive& Prim = Context->mPrimitives[i];
+		Context->mBuilder->ComputePrimitiveBounds(i, Prim.mBox.mMin, Prim.mBox.mMax);
+		Prim.mCenter = (Prim.mBox.mMin + Prim.mBox.mMax) * 0.5f;
+		Box.Add(Prim.mBox);
+		Centers.Add(Prim.mCenter);
+	}
+}
+
+void SAHBuildContext::Bin(const dTriIndex* primitives, udword nb_prims, udword axis, float origin, float scale, udword nb_bins, bool parallel, SAHBins& bins)
+{
+	udword NbTasks = 1;
+	if(parallel && mScheduler && nb_prims>=SAH_PARALLEL_BINNING)
+	{
+		NbTasks = nb_prims / SAH_BINNING_CHUNK;
+		if(NbTasks>SAH_MAX_BINNING_TASKS)	NbTasks = SAH_MAX_BINNING_TASKS;
+	}
+
+	if(NbTasks==1)
+	{
+		BinRange(primitives, nb_prims, axis, origin, scale, nb_bins, bins);
+		return;
+	}
+
+	// Large nodes have SAH_NB_BINS bins, as BinTask() assumes
+	mJobPrimitives	= primitives;
+	mJobNbPrims		= nb_prims;
+	mJobNbTasks		= NbTasks;
+	mJobAxis		= axis;
+	mJobOrigin		= origin;
+	mJobScale		= scale;
+	mScheduler->Run(BinTask, this, NbTasks);
+
+	// Merge in task order, which keeps the result independent of the scheduling
+	bins = mTaskBins[0];
+	for(udword i=1;i<NbTasks;i++)	bins.Add(mTaskBins[i], nb_bins);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Recursive SAH hierarchy building in a top-down fashion. The node's box is already computed.
+ *	\param		context		[in] the SAH build context
+ *	\param		descendants	[in] the 2*N-2 pool nodes reserved for the node's descendants
+ *	\param		centers		[in] bounds of the node's primitive centers
+ *	\param		subtree		[in] the subtree being built by a task, or null for the top of the tree
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AABBTreeNode::_BuildHierarchySAH(SAHBuildContext* context, AABBTreeNode* descendants, const SAHBounds& centers, SAHSubtree* subtree)
+{
+	// Stop at leaves
+	if(mNbPrimitives==1)	return;
+
+	// In a parallel build, the top of the tree hands smaller subtrees out to tasks
+	if(!subtree && mNbPrimitives<=context->mSubtreeSize)
+	{
+		if(context->AddSubtree(this, descendants, centers))	return;
+	}
+
+	// Split, then recurse. The bins live in SplitSAH()'s frame only, which keeps deep recursions cheap.
+	SAHBounds PosCenters, NegCenters;
+	udword NbPos = SplitSAH(context, descendants, centers, subtree, PosCenters, NegCenters);
+
+	AABBTreeNode* Pos = (AABBTreeNode*)GetPos();
+	AABBTreeNode* Neg = (AABBTreeNode*)GetNeg();
+	Pos->_BuildHierarchySAH(context, &descendants[2], PosCenters, subtree);
+	Neg->_BuildHierarchySAH(context, &descendants[NbPos*2], NegCenters, subtree);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Splits the node with the binned SAH and creates its children.
+ *	The list of indices is reorganized: positive primitives first, then negative ones.
+ *	\param		context		[in] the SAH build context
+ *	\param		descendants	[in] the pool nodes reserved for the node's descendants
+ *	\param		centers		[in] bounds of the node's primitive centers
+ *	\param		subtree		[in] the subtree being built by a task, or null for the top of the tree
+ *	\param		pos_centers	[out] bounds of the positive child's primitive centers
+ *	\param		neg_centers	[out] bounds of the negative child's primitive centers
+ *	\return		the number of primitives assigned to the positive child
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+udword AABBTreeNode::SplitSAH(SAHBuildContext* context, AABBTreeNode* descendants, const SAHBounds& centers, SAHSubtree* subtree, SAHBounds& pos_centers, SAHBounds& neg_centers)
+{
+	// 1) Bin primitives along the largest axis of their centers' bounds
+	Point Extents = centers.mMax - centers.mMin;
+	udword Axis = Extents.LargestAxis();
+	udword NbBins = mNbPrimitives<SAH_NB_BINS ? mNbPrimitives : SAH_NB_BINS;
+
+	SAHBins Bins;
+	udword BestBin = 0;
+	if(Extents[Axis]>0.0f)
+	{
+		context->Bin(mNodePrimitives, mNbPrimitives, Axis, centers.mMin[Axis], float(NbBins) / Extents[Axis], NbBins, !subtree, Bins);
+
+		// 2) Find the cheapest split. Both end bins hold a primitive, so there's always one.
+		// Sweep from the right, cost of the bins above each boundary
+		float RightCosts[SAH_NB_BINS];
+		SAHBounds Box;	Box.SetEmpty();
+		udword Count = 0;
+		for(udword i=NbBins-1;i>0;i--)
+		{
+			Box.Add(Bins.mBins[i].mBox);
+			Count += Bins.mBins[i].mCount;
+			RightCosts[i] = Count ? float(Count) * Box.HalfArea() : -1.0f;
+		}
+
+		// Sweep from the left. Boundary i splits bins [0, i) from [i, NbBins).
+		float BestCost = MAX_FLOAT;
+		Box.SetEmpty();
+		Count = 0;
+		for(udword i=1;i<NbBins;i++)
+		{
+			Box.Add(Bins.mBins[i-1].mBox);
+			Count += Bins.mBins[i-1].mCount;
+			if(!Count || RightCosts[i]<0.0f)	continue;
+
+			float Cost = float(Count) * Box.HalfArea() + RightCosts[i];
+			if(Cost<BestCost)
+			{
+				BestCost	= Cost;
+				BestBin		= i;
+			}
+		}
+	}
+
+	// 3) Partition primitives: positive child gets the bins below the boundary
+	udword Offset = udword(mNodePrimitives - context->mIndices);
+	SAHPrimitive* Prims = &context->mPrimitives[Offset];
+	udword NbPos;
+	SAHBounds PosBox, NegBox;
+	PosBox.SetEmpty();	NegBox.SetEmpty();	pos_centers.SetEmpty();	neg_centers.SetEmpty();
+	if(BestBin)
+	{
+		for(udword i=0;i<NbBins;i++)
+		{
+			if(i<BestBin)	PosBox.Add(Bins.mBins[i].mBox);
+			else			NegBox.Add(Bins.mBins[i].mBox);
+		}
+
+		// Position i hasn't been swapped yet when it's tested, so its bin index is still valid
+		const ubyte* BinIndices = &context->mBinIndices[Offset];
+		NbPos = 0;
+		for(udword i=0;i<mNbPrimitives;i++)
+		{
+			if(BinIndices[i]<BestBin)
+			{
+				pos_centers.Add(Prims[i].mCenter);
+
+				udword Index			= mNodePrimitives[i];
+				mNodePrimitives[i]		= mNodePrimitives[NbPos];
+				mNodePrimitives[NbPos]	= Index;
+				SAHPrimitive Tmp		= Prims[i];
+				Prims[i]				= Prims[NbPos];
+				Prims[NbPos]			= Tmp;
+				NbPos++;
+			}
+			else neg_centers.Add(Prims[i].mCenter);
+		}
+	}
+	else
+	{
+		// All centers are the same. The tree must be complete, so make an arbitrary 50-50 split.
+		if(subtree)	subtree->mNbInvalidSplits++;
+		else		context->mBuilder->IncreaseNbInvalidSplits();
+		NbPos = mNbPrimitives>>1;
+
+		for(udword i=0;i<mNbPrimitives;i++)
+		{
+			if(i<NbPos)	{ PosBox.Add(Prims[i].mBox);	pos_centers.Add(Prims[i].mCenter);	}
+			else		{ NegBox.Add(Prims[i].mBox);	neg_centers.Add(Prims[i].mCenter);	}
+		}
+	}
+	ASSERT(NbPos && NbPos<mNbPrimitives);
+
+	// 4) Create children in the reserved slots
+	AABBTreeNode* Pos = &descendants[0];
+	AABBTreeNode* Neg = &descendants[1];
+	// Set last bit to tell it shouldn't be freed, as in Subdivide()
+	mPos = size_t(Pos)|1;
+#ifndef OPC_NO_NEG_VANILLA_TREE
+	mNeg = size_t(Neg)|1;
+#endif
+	Pos->mNodePrimitives	= &mNodePrimitives[0];
+	Pos->mNbPrimitives		= NbPos;
+	Pos->mBV.SetMinMax(PosBox.mMin, PosBox.mMax);
+	Neg->mNodePrimitives	= &mNodePrimitives[NbPos];
+	Neg->mNbPrimitives		= mNbPrimitives - NbPos;
+	Neg->mBV.SetMinMax(NegBox.mMin, NegBox.mMax);
+
+	return NbPos;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Builds one of the subtrees deferred by the top of a parallel SAH build.
+ *	\param		context		[in] the SAH build context
+ *	\param		index		[in] index of the subtree
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AABBTreeNode::_BuildSAHTask(void* context, udword index)
+{
+	SAHBuildContext* Context = (SAHBuildContext*)context;
+	SAHSubtree& Subtree = Context->mSubtrees[index];
+	Subtree.mNode->_BuildHierarchySAH(Context, Subtree.mDescendants, Subtree.mCenters, &Subtree);
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
@@ -430,7 +849,11 @@ bool AABBTree::Build(AABBTreeBuilder* builder)
 	}
 
 	// Build the hierarchy
-	_BuildHierarchy(builder);
+	if(mPool && (builder->mSettings.mRules & SPLIT_SAH))
+	{
+		if(!BuildSAH(builder))	return false;
+	}
+	else _BuildHierarchy(builder);
 
 	// Get back total number of nodes
 	mTotalNbNodes	= builder->GetCount();
@@ -441,6 +864,74 @@ bool AABBTree::Build(AABBTreeBuilder* builder)
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Builds the hierarchy of a complete tree with the binned SAH. The pool must already be allocated.
+ *	If the builder has a scheduler with more than one thread, primitive boxes, large nodes and subtrees are processed in parallel.
+ *	The resulting tree doesn't depend on the number of threads.
+ *	\param		builder		[in] the tree builder
+ *	\return		true if success
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool AABBTree::BuildSAH(AABBTreeBuilder* builder)
+{
+	udword NbPrims = builder->mNbPrimitives;
+
+	SAHBuildContext Context(builder);
+	Context.mIndices	= mIndices;
+	Context.mPrimitives = new SAHPrimitive[NbPrims];
+	CHECKALLOC(Context.mPrimitives);
+	Context.mBinIndices = new ubyte[NbPrims];
+	CHECKALLOC(Context.mBinIndices);
+	Context.mTaskBounds = new SAHBounds[SAH_MAX_BINNING_TASKS*2];
+	CHECKALLOC(Context.mTaskBounds);
+
+	// Only go parallel when there are threads to use and more than one subtree
+	if(builder->mScheduler && builder->mScheduler->GetNbThreads()>1 && NbPrims>SAH_MIN_SUBTREE)
+	{
+		Context.mScheduler		= builder->mScheduler;
+		Context.mSubtreeSize	= MAX(SAH_MIN_SUBTREE, NbPrims/SAH_NB_SUBTREES);
+		Context.mTaskBins		= new SAHBins[SAH_MAX_BINNING_TASKS];
+		CHECKALLOC(Context.mTaskBins);
+	}
+
+	// 1) Compute the box and center of each primitive, and the root bounds
+	udword NbTasks = 1;
+	if(Context.mScheduler)
+	{
+		NbTasks = (NbPrims + SAH_BINNING_CHUNK - 1) / SAH_BINNING_CHUNK;
+		if(NbTasks>SAH_MAX_BINNING_TASKS)	NbTasks = SAH_MAX_BINNING_TASKS;
+	}
+	Context.mJobNbPrims	= NbPrims;
+	Context.mJobNbTasks	= NbTasks;
+	if(NbTasks>1)	Context.mScheduler->Run(SAHBuildContext::PrepareTask, &Context, NbTasks);
+	else			SAHBuildContext::PrepareTask(&Context, 0);
+
+	SAHBounds Box		= Context.mTaskBounds[0];
+	SAHBounds Centers	= Context.mTaskBounds[1];
+	for(udword i=1;i<NbTasks;i++)
+	{
+		Box.Add(Context.mTaskBounds[i*2+0]);
+		Centers.Add(Context.mTaskBounds[i*2+1]);
+	}
+	mBV.SetMinMax(Box.mMin, Box.mMax);
+
+	// 2) Build the top of the tree. A parallel build stops at subtrees and leaves them to tasks.
+	_BuildHierarchySAH(&Context, mPool, Centers, null);
+
+	// 3) Build the subtrees
+	if(Context.mNbSubtrees)
+	{
+		Context.mScheduler->Run(_BuildSAHTask, &Context, Context.mNbSubtrees);
+		for(udword i=0;i<Context.mNbSubtrees;i++)
+			builder->SetNbInvalidSplits(builder->GetNbInvalidSplits() + Context.mSubtrees[i].mNbInvalidSplits);
+	}
+
+	// The root and its 2*N-2 descendants, counted as Subdivide() does
+	builder->SetCount(NbPrims*2 - 1);
+	return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Computes the depth of the tree.
@@ -72,6 +72,10 @@
 				size_t				mNeg;		/* "Negative" child */
 #endif
 
+	struct SAHBounds;
+	struct SAHSubtree;
+	struct SAHBuildContext;
+
 	typedef		void				(*CullingCallback)		(udword nb_primitives, udword* node_primitives, BOOL need_clipping, void* user_data);
 
 	class OPCODE_API AABBTreeNode
@@ -91,6 +95,9 @@
 				bool				Subdivide(AABBTreeBuilder* builder);
 				void				_BuildHierarchy(AABBTreeBuilder* builder);
 				void				_Refit(AABBTreeBuilder* builder);
+				udword				SplitSAH(SAHBuildContext* context, AABBTreeNode* descendants, const SAHBounds& centers, SAHSubtree* subtree, SAHBounds& pos_centers, SAHBounds& neg_centers);
+				void				_BuildHierarchySAH(SAHBuildContext* context, AABBTreeNode* descendants, const SAHBounds& centers, SAHSubtree* subtree);
+		static	void				_BuildSAHTask(void* context, udword index);
 	};
 
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -128,6 +135,8 @@
 				bool				Refit(AABBTreeBuilder* builder);
 				bool				Refit2(AABBTreeBuilder* builder);
 		private:
+				bool				BuildSAH(AABBTreeBuilder* builder);
+
 				dTriIndex*				mIndices;			//!< Indices in the app list. Indices are reorganized during build (permutation).
 				AABBTreeNode*		mPool;				//!< Linear pool of nodes for complete trees. Null otherwise. [Opcode 1.3]
 		// Stats
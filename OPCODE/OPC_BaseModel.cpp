@@ -49,6 +49,7 @@ OPCODECREATE::OPCODECREATE()
 #endif // __MESHMERIZER_H__
 	mKeepOriginal		= false;
 	mCanRemap			= false;
+	mScheduler			= null;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
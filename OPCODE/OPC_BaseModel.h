@@ -35,6 +35,7 @@
 #endif // __MESHMERIZER_H__
 		bool					mKeepOriginal;	//!< true => keep a copy of the original tree (debug purpose)
 		bool					mCanRemap;		//!< true => allows OPCODE to reorganize client arrays
+		AABBTreeBuildScheduler*	mScheduler;		//!< Runs the parallel parts of the SAH build, or null (serial build)
 
 		// (*) This pointer is saved internally and used by OPCODE until collision structures are released,
 		// so beware of the object's lifetime.
@@ -175,6 +175,7 @@ bool Model::Build(const OPCODECREATE& create)
 		TB.mIMesh			= create.mIMesh;
 		TB.mSettings		= create.mSettings;
 		TB.mNbPrimitives	= NbTris;
+		TB.mScheduler		= create.mScheduler;
 		if(!mSource->Build(&TB))	return false;
 	}
 
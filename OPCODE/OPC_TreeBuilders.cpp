@@ -144,6 +144,26 @@ bool AABBTreeOfTrianglesBuilder::ComputeGlobalBox(const dTriIndex* primitives, u
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Computes the bounds of a single triangle. This gives the same corners as ComputeGlobalBox() without the center/extents round trip.
+ *	\param		index		[in] index of the triangle
+ *	\param		min			[out] minimum corner
+ *	\param		max			[out] maximum corner
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AABBTreeOfTrianglesBuilder::ComputePrimitiveBounds(udword index, Point& min, Point& max) const
+{
+	VertexPointers VP;
+	ConversionArea VC;
+	mIMesh->GetTriangle(VP, index, VC);
+
+	min = *VP.Vertex[0];
+	max = *VP.Vertex[0];
+	min.Min(*VP.Vertex[1]).Min(*VP.Vertex[2]);
+	max.Max(*VP.Vertex[1]).Max(*VP.Vertex[2]);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Computes the splitting value along a given axis for a given primitive.
@@ -31,6 +31,8 @@
 		SPLIT_FIFTY				= (1<<4),		//!< Arbitrary 50-50 split
 		// Node split
 		SPLIT_GEOM_CENTER		= (1<<5),		//!< Split at geometric center (else split in the middle)
+		// Whole tree
+		SPLIT_SAH				= (1<<6),		//!< Binned surface area heuristic, complete trees only. Overrides the other rules.
 		//
 		SPLIT_FORCE_DWORD		= 0x7fffffff
 	};
@@ -44,6 +46,29 @@
 		udword	mRules;		//!< Building/Splitting rules (a combination of SplittingRules flags)
 	};
 
+	//! A build task, called with the index of the task
+	typedef void	(*BuildTask)	(void* context, udword index);
+
+	//! Runs independent build tasks, possibly in parallel. Used by the SAH build.
+	class OPCODE_API AABBTreeBuildScheduler
+	{
+		public:
+		virtual								~AABBTreeBuildScheduler()	{}
+
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Runs a set of tasks and returns when all of them are done.
+		 *	\param		task		[in] the task function
+		 *	\param		context		[in] passed to the task function
+		 *	\param		nb_tasks	[in] number of tasks, the task function is called for each index in [0, nb_tasks)
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		virtual						void	Run(BuildTask task, void* context, udword nb_tasks)	= 0;
+
+		//! Returns the number of tasks that may run at once
+		virtual						udword	GetNbThreads()	const	= 0;
+	};
+
 	class OPCODE_API AABBTreeBuilder
 	{
 		public:
@@ -51,6 +76,7 @@
 													AABBTreeBuilder() :
 														mNbPrimitives(0),
 														mNodeBase(null),
+														mScheduler(null),
 														mCount(0),
 														mNbInvalidSplits(0)		{}
 		//! Destructor
@@ -67,6 +93,23 @@
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		virtual						bool			ComputeGlobalBox(const dTriIndex* primitives, udword nb_prims, AABB& global_box)	const	= 0;
 
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Computes the bounds of a single primitive. Used by the SAH build, which may call it from several threads at once.
+		 *	\param		index			[in] index of the primitive
+		 *	\param		min				[out] minimum corner of the primitive's AABB
+		 *	\param		max				[out] maximum corner of the primitive's AABB
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		virtual						void			ComputePrimitiveBounds(udword index, Point& min, Point& max)	const
+													{
+														dTriIndex Index = index;
+														AABB Box;
+														ComputeGlobalBox(&Index, 1, Box);
+														Box.GetMin(min);
+														Box.GetMax(max);
+													}
+
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		/**
 		 *	Computes the splitting value along a given axis for a given primitive.
@@ -114,6 +157,7 @@
 									BuildSettings	mSettings;			//!< Splitting rules & split limit [Opcode 1.3]
 									udword			mNbPrimitives;		//!< Total number of primitives.
 									void*			mNodeBase;			//!< Address of node pool [Opcode 1.3]
+									AABBTreeBuildScheduler*	mScheduler;	//!< Runs the parallel parts of the SAH build, or null
 		// Stats
 		inline_						void			SetCount(udword nb)				{ mCount=nb;				}
 		inline_						void			IncreaseCount(udword nb)		{ mCount+=nb;				}
@@ -167,6 +211,7 @@
 		virtual										~AABBTreeOfTrianglesBuilder()													{}
 
 		override(AABBTreeBuilder)	bool			ComputeGlobalBox(const dTriIndex* primitives, udword nb_prims, AABB& global_box)	const;
+		override(AABBTreeBuilder)	void			ComputePrimitiveBounds(udword index, Point& min, Point& max)					const;
 		override(AABBTreeBuilder)	float			GetSplittingValue(udword index, udword axis)									const;
 		override(AABBTreeBuilder)	float			GetSplittingValue(const dTriIndex* primitives, udword nb_prims, const AABB& global_box, udword axis)	const;
 		override(AABBTreeBuilder)	Point			GetSplittingValues(udword index) const;
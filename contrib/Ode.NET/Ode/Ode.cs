@@ -68,8 +68,10 @@ namespace Ode.NET
 			FirstSpaceClass,
 			SimpleSpaceClass = FirstSpaceClass,
 			HashSpaceClass,
+			SweepAndPruneSpaceClass,
 			QuadTreeSpaceClass,
-			LastSpaceClass = QuadTreeSpaceClass,
+			DynamicTreeSpaceClass,
+			LastSpaceClass = DynamicTreeSpaceClass,
 			FirstUserClass,
 			LastUserClass = FirstUserClass + MaxUserClasses - 1,
 			NumClasses,
@@ -693,6 +695,9 @@ namespace Ode.NET
 		[DllImport("ode", EntryPoint = "dDQfromW"), SuppressUnmanagedCodeSecurity]
 		public static extern void DQfromW(dReal[] dq, ref Vector3 w, ref Quaternion q);
 
+		[DllImport("ode", EntryPoint = "dDynamicTreeSpaceCreate"), SuppressUnmanagedCodeSecurity]
+		public static extern IntPtr DynamicTreeSpaceCreate(IntPtr space);
+
 		[DllImport("ode", EntryPoint = "dFactorCholesky"), SuppressUnmanagedCodeSecurity]
 		public static extern int FactorCholesky(ref dReal A00, int n);
 
@@ -26,6 +26,7 @@
 #include <ode/common.h>
 #include <ode/collision_space.h>
 #include <ode/contact.h>
+#include <ode/threading.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -295,6 +296,7 @@ ODE_API dSpaceID dGeomGetSpace (dGeomID);
  *  @li dSimpleSpaceClass
  *  @li dHashSpaceClass
  *  @li dQuadTreeSpaceClass
+ *  @li dDynamicTreeSpaceClass
  *  @li dFirstUserClass
  *  @li dLastUserClass
  *
@@ -792,6 +794,45 @@ ODE_API void dGeomGetOffsetQuaternion (dGeomID geom, dQuaternion result);
 ODE_API int dCollide (dGeomID o1, dGeomID o2, int flags, dContactGeom *contact,
 	      int skip);
 
+/**
+ * @brief Generates contact information for an array of geom pairs.
+ *
+ * Gives the same contacts as calling dCollide() for each pair, but the pairs
+ * are grouped by the class specific collision function and each group is run
+ * back to back, optionally split across the threads of a threading
+ * implementation.
+ *
+ * @param pairs The geom pairs to test, e.g. as stored by dSpaceCollectPairs().
+ * @param pair_count The number of pairs.
+ * @param flags The flags for each pair, as for dCollide(). The lower 16 bits
+ * give the maximum number of contacts per pair.
+ * @param contacts An array of dContactGeom structures with room for the
+ * maximum number of contacts of every pair. The contacts of pair i start at
+ * element i times the maximum number of contacts per pair.
+ * @param skip The byte offset from one dContactGeom to the next, as for
+ * dCollide().
+ * @param contact_counts An array of @a pair_count elements receiving the
+ * number of contacts generated for each pair.
+ * @param functions_info The threading functions to post the collisions with,
+ * as for dWorldSetStepThreadingImplementation(), or NULL.
+ * @param impl The threading implementation to post the collisions to, or NULL
+ * to collide the pairs in the calling thread.
+ * @param thread_count The number of threaded calls to split the pairs into.
+ *
+ * @returns The total number of contacts generated.
+ *
+ * @remarks When the pairs are collided in parallel they must not contain
+ * spaces, and the threads of the implementation need ODE data allocated
+ * for the colliders of the pairs (see dAllocateODEDataForThread).
+ *
+ * @sa dCollide
+ * @ingroup collide
+ */
+ODE_API int dCollideBatch (const dGeomPair *pairs, int pair_count, int flags, 
+  dContactGeom *contacts, int skip, int *contact_counts,
+  const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+  unsigned thread_count);
+
 /**
  * @brief Determines which pairs of geoms in a space may potentially intersect,
  * and calls the callback function for each candidate pair.
@@ -822,6 +863,85 @@ ODE_API int dCollide (dGeomID o1, dGeomID o2, int flags, dContactGeom *contact,
 ODE_API void dSpaceCollide (dSpaceID space, void *data, dNearCallback *callback);
 
 
+/**
+ * @brief Determines which pairs of geoms in a space may potentially intersect,
+ * splitting the search across the threads of a threading implementation.
+ *
+ * The space is cleaned on the calling thread and the pair search is then 
+ * split into blocks of work that are picked up by @a thread_count threaded 
+ * calls. Each call passes its own data pointer @c thread_data[i] to the 
+ * callback, so the callback is never entered concurrently with the same data, 
+ * but it is entered concurrently with different data. The function returns 
+ * after all the pairs have been reported.
+ *
+ * @param space The space to test.
+ * @param functions_info The threading functions to post the calls with, as
+ * for dWorldSetStepThreadingImplementation(), or NULL.
+ * @param impl The threading implementation to post the calls to. If NULL, 
+ * all the pairs are reported on the calling thread with @c thread_data[0].
+ * @param thread_data An array of @a thread_count user data pointers. May be 
+ * NULL, in which case the callback receives NULL data.
+ * @param thread_count The number of threaded calls to split the search into.
+ * @param callback A callback function of type @ref dNearCallback.
+ *
+ * @remarks The same pairs are reported as by dSpaceCollide(), but in an 
+ * unspecified order. The callback must be safe to run in several threads at 
+ * once; in particular, creating contact joints needs a separate joint group 
+ * per thread or external locking. Threads of the implementation must have 
+ * collision data allocated with dAllocateODEDataForThread() if the callback 
+ * calls dCollide(). Spaces inside the space may be passed to dSpaceCollide2()
+ * from only one thread at a time.
+ *
+ * @sa dSpaceCollide
+ * @sa dSpaceCollideParallelBatched
+ * @ingroup collide
+ */
+ODE_API void dSpaceCollideParallel (dSpaceID space, 
+  const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+  void *const *thread_data, unsigned thread_count, dNearCallback *callback);
+
+
+/**
+ * @brief Same as dSpaceCollideParallel(), but each thread gathers the pairs 
+ * it finds and reports them in batches.
+ *
+ * @param space The space to test.
+ * @param functions_info The threading functions to post the calls with, or NULL.
+ * @param impl The threading implementation to post the calls to, or NULL.
+ * @param thread_data An array of @a thread_count user data pointers, or NULL.
+ * @param thread_count The number of threaded calls to split the search into.
+ * @param callback A callback function of type @ref dNearBatchCallback.
+ *
+ * @sa dSpaceCollideParallel
+ * @ingroup collide
+ */
+ODE_API void dSpaceCollideParallelBatched (dSpaceID space, 
+  const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+  void *const *thread_data, unsigned thread_count, dNearBatchCallback *callback);
+
+
+/**
+ * @brief Determines which pairs of geoms in a space may potentially intersect,
+ * and stores them in an array instead of calling a callback.
+ *
+ * The pairs are the ones dSpaceCollide() would pass to its callback. They 
+ * can then be processed in any order, e.g. sorted by geom class or split into
+ * chunks for several threads.
+ *
+ * @param space The space to test.
+ * @param pairs The array to store the pairs in. May be NULL if @a capacity 
+ * is zero.
+ * @param capacity The number of pairs the array can hold.
+ * @returns The number of pairs found. If it is larger than @a capacity, only
+ * the first @a capacity pairs have been stored and the call can be repeated 
+ * with a larger array.
+ *
+ * @sa dSpaceCollide
+ * @ingroup collide
+ */
+ODE_API int dSpaceCollectPairs (dSpaceID space, dGeomPair *pairs, int capacity);
+
+
 /**
  * @brief Determines which geoms from one space may potentially intersect with 
  * geoms from another space, and calls the callback function for each candidate 
@@ -865,6 +985,48 @@ ODE_API void dSpaceCollide (dSpaceID space, void *data, dNearCallback *callback)
 ODE_API void dSpaceCollide2 (dGeomID space1, dGeomID space2, void *data, dNearCallback *callback);
 
 
+/**
+ * @brief Casts an array of rays into a space and finds the closest hit of each.
+ *
+ * Each ray is traced through the space structure once. The candidate geoms are
+ * collided with the ray as with dCollide(), and every hit shortens the ray for
+ * the rest of its search. The dynamic tree space visits its nodes nearest
+ * first and skips the ones beyond the closest hit. The hash space walks the
+ * cells the ray crosses at each of its levels, nearest first, and tests each
+ * geom found there once; when the cells would outnumber its geoms, it tests
+ * the AABBs of all of them instead, as the other spaces do. Contained spaces
+ * are searched recursively, and disabled geoms are skipped.
+ *
+ * @param space The space to cast the rays into.
+ * @param origins The ray origins, three values per ray.
+ * @param dirs The ray directions, three values per ray. They need not be unit
+ * length. A ray with a zero direction hits nothing.
+ * @param max_length The length of every ray.
+ * @param ray_count The number of rays.
+ * @param hits An array of @a ray_count records receiving the closest hit of
+ * each ray. The geom of a record is NULL when the ray hit nothing.
+ * @param functions_info The threading functions to post the rays with, as
+ * for dWorldSetStepThreadingImplementation(), or NULL.
+ * @param impl The threading implementation to post the rays to, or NULL to
+ * cast them in the calling thread.
+ * @param thread_count The number of threaded calls to split the rays into.
+ *
+ * @returns The number of rays that hit a geom.
+ *
+ * @remarks The space is cleaned on the calling thread and must not be changed
+ * until the function returns. When the rays are cast in parallel, the threads
+ * of the implementation need ODE data allocated for the colliders of the
+ * geoms (see dAllocateODEDataForThread).
+ *
+ * @sa dCreateRay
+ * @ingroup collide
+ */
+ODE_API int dSpaceRaycastBatch (dSpaceID space, const dReal *origins, const dReal *dirs,
+  dReal max_length, int ray_count, dRaycastHit *hits, 
+  const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+  unsigned thread_count);
+
+
 /* ************************************************************************ */
 /* standard classes */
 
@@ -891,14 +1053,86 @@ enum {
   dHashSpaceClass,
   dSweepAndPruneSpaceClass, /* SAP */
   dQuadTreeSpaceClass,
-  dLastSpaceClass = dQuadTreeSpaceClass,
+  dDynamicTreeSpaceClass,
+  dLastSpaceClass = dDynamicTreeSpaceClass,
 
+  /* the user classes follow the space classes, so adding a space class
+     changes their numbers and dGeomNumClasses */
   dFirstUserClass,
   dLastUserClass = dFirstUserClass + dMaxUserClasses - 1,
   dGeomNumClasses
 };
 
 
+/**
+ * @brief Collision statistics gathered while enabled.
+ *
+ * The collider arrays have an entry per class specific collision function,
+ * at the classes in the order the function takes its geoms. E.g. a box and
+ * a trimesh are counted at [dTriMeshClass][dBoxClass] whichever order they
+ * are passed to dCollide() in, as the trimesh collider handles the pair.
+ *
+ * @sa dSetCollisionStatisticsEnabled
+ * @ingroup collide
+ */
+typedef struct dCollisionStatistics {
+  duint64 aabb_tests;        /* geom pairs tested by the spaces */
+  duint64 near_callbacks;    /* geom pairs passed on to the near callbacks */
+  double space_collide_time; /* in the dSpaceCollide*() calls, in seconds */
+  duint64 collider_calls[dGeomNumClasses][dGeomNumClasses];
+  duint64 collider_contacts[dGeomNumClasses][dGeomNumClasses];
+  double collider_time[dGeomNumClasses][dGeomNumClasses];  /* in seconds */
+} dCollisionStatistics;
+
+/**
+ * @brief Enables or disables gathering of the collision statistics.
+ *
+ * While enabled, the spaces count the geom pairs they test and report,
+ * dCollide() and dCollideBatch() count and time the collision functions they
+ * call, and the dSpaceCollide*() functions are timed, the near callbacks
+ * included.
+ * The totals are kept in a few shards that threads add to atomically, so
+ * calls made from several threads at a time are summed without locking.
+ * While disabled, gathering costs a flag test per pair.
+ *
+ * @remarks The times are measured with the ODE stopwatch, which uses the
+ * monotonic clock where the system has one. dCollide() times its single
+ * call, so the time includes the cost of reading the clock twice;
+ * dCollideBatch() times each run of a collision function as a whole. A
+ * dSpaceCollide*() call made from the near callback of another one is timed
+ * in both.
+ *
+ * @param enabled Non-zero to enable the statistics. They are disabled by
+ * default.
+ * @sa dGetCollisionStatistics
+ * @ingroup collide
+ */
+ODE_API void dSetCollisionStatisticsEnabled (int enabled);
+
+/**
+ * @brief Tells whether the collision statistics are being gathered.
+ * @ingroup collide
+ */
+ODE_API int dGetCollisionStatisticsEnabled (void);
+
+/**
+ * @brief Copies the collision statistics gathered since the last reset.
+ *
+ * @remarks Calls still running in other threads have not added all their
+ * counts yet.
+ *
+ * @sa dResetCollisionStatistics
+ * @ingroup collide
+ */
+ODE_API void dGetCollisionStatistics (dCollisionStatistics *stats);
+
+/**
+ * @brief Sets all the collision statistics to zero.
+ * @ingroup collide
+ */
+ODE_API void dResetCollisionStatistics (void);
+
+
 /**
  * @defgroup collide_sphere Sphere Class
  * @ingroup collide
@@ -1118,6 +1352,30 @@ typedef struct dxHeightfieldData* dHeightfieldDataID;
 typedef dReal dHeightfieldGetHeight( void* p_user_data, int x, int z );
 
 
+/**
+ * @brief Tile callback prototype
+ *
+ * Used by the tiled heightfield data type to bring a tile of samples
+ * into memory.
+ *
+ * @param p_user_data User data specified when creating the dHeightfieldDataID
+ * @param tile_x The index of the tile along the local x axis. The tile
+ * holds samples tile_x * tileSamples to ( tile_x + 1 ) * tileSamples - 1.
+ * @param tile_z The index of the tile along the local z axis.
+ * @param tile_buffer Storage for tileSamples * tileSamples heights owned
+ * by the heightfield data.
+ *
+ * @return A pointer to the tileSamples * tileSamples raw heights of the tile,
+ * stored row by row with x varying fastest. Either tile_buffer after filling
+ * it, or heights the user keeps in memory (e.g. a memory mapped file) for the
+ * lifetime of the heightfield data. Samples past the last row or column of
+ * the heightfield are not read.
+ *
+ * @ingroup collide
+ */
+typedef const dReal *dHeightfieldGetTile( void* p_user_data, int tile_x, int tile_z, dReal *tile_buffer );
+
+
 
 /**
  * @brief Creates a heightfield geom.
@@ -1410,6 +1668,77 @@ ODE_API void dGeomHeightfieldDataBuildDouble( dHeightfieldDataID d,
 				dReal width, dReal depth, int widthSamples, int depthSamples,
 				dReal scale, dReal offset, dReal thickness, int bWrap );
 
+/**
+ * @brief Configures a dHeightfieldDataID to load height data by tiles.
+ *
+ * Before a dHeightfieldDataID can be used by a geom it must be
+ * configured to specify the format of the height data.
+ * This call specifies that the heightfield data is split into square tiles
+ * of samples which are requested from the given callback when a collision
+ * first reads them. At most maxResidentTiles tiles are kept in memory, the
+ * least recently used one is dropped when another has to be loaded.
+ * Collisions only read the tiles under the AABB of the other geom, and
+ * none at all where the tile bounds show the geom is above the terrain.
+ *
+ * @param d A new dHeightfieldDataID created by dGeomHeightfieldDataCreate
+ *
+ * @param pUserData User data passed to the callback.
+ * @param pCallback The callback loading a tile. Collisions running in
+ * parallel may call it from several threads at once, for different tiles,
+ * and the callback must not use the heightfield data it loads the tile for.
+ *
+ * @param pTileBounds The minimum and the maximum raw height of every tile,
+ * in pairs, row by row with tile x index varying fastest. The array is copied.
+ * @param tileSamples The number of samples along each side of a tile.
+ * @param maxResidentTiles The number of tiles kept in memory. Should cover
+ * the tiles under the largest geom colliding with the heightfield, and be
+ * no less than the number of threads colliding with it at a time, as a
+ * thread loading a tile waits for a slot no other thread loads into.
+ *
+ * @param width Specifies the total 'width' of the heightfield along
+ * the geom's local x axis.
+ * @param depth Specifies the total 'depth' of the heightfield along
+ * the geom's local z axis.
+ *
+ * @param widthSamples Specifies the number of vertices to sample
+ * along the width of the heightfield. Each vertex has a corresponding
+ * height value which forms the overall shape.
+ * Naturally this value must be at least two or more.
+ * @param depthSamples Specifies the number of vertices to sample
+ * along the depth of the heightfield.
+ *
+ * @param scale A uniform scale applied to all raw height data.
+ * @param offset An offset applied to the scaled height data.
+ *
+ * @param thickness A value subtracted from the lowest height
+ * value which in effect adds an additional cuboid to the base of the
+ * heightfield. This is used to prevent geoms from looping under the
+ * desired terrain and not registering as a collision. Note that the
+ * thickness is not affected by the scale or offset parameters.
+ *
+ * @param bWrap If non-zero the heightfield will infinitely tile in both
+ * directions along the local x and z axes. If zero the heightfield is
+ * bounded from zero to width in the local x axis, and zero to depth in
+ * the local z axis.
+ *
+ * @ingroup collide
+ */
+ODE_API void dGeomHeightfieldDataBuildTiled( dHeightfieldDataID d,
+				void* pUserData, dHeightfieldGetTile* pCallback,
+				const dReal* pTileBounds, int tileSamples, int maxResidentTiles,
+				dReal width, dReal depth, int widthSamples, int depthSamples,
+				dReal scale, dReal offset, dReal thickness, int bWrap );
+
+/**
+ * @brief Returns the number of tiles of tiled height data held in memory.
+ *
+ * @param d A dHeightfieldDataID configured by dGeomHeightfieldDataBuildTiled
+ * @return The number of loaded tiles, zero for other kinds of height data.
+ *
+ * @ingroup collide
+ */
+ODE_API int dGeomHeightfieldDataGetResidentTileCount( dHeightfieldDataID d );
+
 /**
  * @brief Manually set the minimum and maximum height bounds.
  *
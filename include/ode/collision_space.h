@@ -49,10 +49,111 @@ struct dContactGeom;
 typedef void dNearCallback (void *data, dGeomID o1, dGeomID o2);
 
 
+/**
+ * @brief A pair of geoms that may be near each other.
+ * @ingroup collide
+ */
+typedef struct dGeomPair {
+  dGeomID o1;
+  dGeomID o2;
+} dGeomPair;
+
+/**
+ * @brief User callback for batched geom-geom collision testing.
+ *
+ * @param data  The user data object of the thread that found the pairs.
+ * @param pairs The geom pairs found, valid only for the duration of the call.
+ * @param count The number of pairs.
+ *
+ * @ingroup collide
+ * @see dSpaceCollideParallelBatched
+ */
+typedef void dNearBatchCallback (void *data, const dGeomPair *pairs, int count);
+
+/**
+ * @brief The closest hit of a ray, as returned by dSpaceRaycastBatch().
+ * @ingroup collide
+ */
+typedef struct dRaycastHit {
+  dReal pos[3];		/* where the ray hit the geom */
+  dReal normal[3];	/* surface normal of the geom at pos */
+  dReal depth;		/* distance from the ray origin to pos */
+  dGeomID geom;		/* the geom hit, or NULL if the ray hit nothing */
+} dRaycastHit;
+
+
 ODE_API dSpaceID dSimpleSpaceCreate (dSpaceID space);
 ODE_API dSpaceID dHashSpaceCreate (dSpaceID space);
 ODE_API dSpaceID dQuadTreeSpaceCreate (dSpaceID space, const dVector3 Center, const dVector3 Extents, int Depth);
 
+/**
+ * @brief User callback for the geoms found by a space query.
+ *
+ * @param data The user data object, as passed to the query.
+ * @param o    A geom whose AABB meets the query.
+ *
+ * @ingroup collide
+ * @see dDynamicTreeSpaceQueryAABB
+ */
+typedef void dSpaceQueryCallback (void *data, dGeomID o);
+
+/**
+ * @brief Creates a dynamic AABB tree space.
+ *
+ * The geoms are kept in a balanced binary tree of bounding boxes. The box of
+ * a geom is its AABB enlarged by a margin, so the tree is only updated when
+ * a geom moves out of its box. This suits large unbounded worlds, where most
+ * of the geoms do not move. Geoms with infinite AABBs are kept out of the
+ * tree and tested against all the others.
+ *
+ * @param space The space to insert the new space into, or 0.
+ * @ingroup collide
+ * @see dDynamicTreeSpaceSetMargin
+ */
+ODE_API dSpaceID dDynamicTreeSpaceCreate (dSpaceID space);
+
+/**
+ * @brief Sets the margin the geom AABBs are enlarged by in a dynamic tree space.
+ *
+ * A larger margin updates the tree less often for moving geoms, but gives
+ * looser boxes to test. The geoms placed already keep their boxes until they
+ * move out of them. The default is 0.1.
+ *
+ * @ingroup collide
+ */
+ODE_API void dDynamicTreeSpaceSetMargin (dSpaceID space, dReal margin);
+ODE_API dReal dDynamicTreeSpaceGetMargin (dSpaceID space);
+
+/**
+ * @brief Reports the enabled geoms of a dynamic tree space whose AABBs
+ * overlap a box.
+ *
+ * @param space The dynamic tree space.
+ * @param aabb The box, as minx, maxx, miny, maxy, minz, maxz.
+ * @param data Passed to the callback.
+ * @param callback Called for every geom found. It must not modify the space.
+ * @returns The number of geoms found.
+ * @ingroup collide
+ */
+ODE_API int dDynamicTreeSpaceQueryAABB (dSpaceID space, const dReal aabb[6],
+  void *data, dSpaceQueryCallback *callback);
+
+/**
+ * @brief Reports the enabled geoms of a dynamic tree space whose AABBs are
+ * hit by a segment.
+ *
+ * The segment is origin + t * dir, for t from 0 to @a length, so the length
+ * is in units of @a dir.
+ *
+ * @param space The dynamic tree space.
+ * @param data Passed to the callback.
+ * @param callback Called for every geom found. It must not modify the space.
+ * @returns The number of geoms found.
+ * @ingroup collide
+ */
+ODE_API int dDynamicTreeSpaceQueryRay (dSpaceID space, const dVector3 origin,
+  const dVector3 dir, dReal length, void *data, dSpaceQueryCallback *callback);
+
 
 /* SAP */
 /* Order XZY or ZXY usually works best, if your Y is up. */
@@ -63,6 +164,11 @@ ODE_API dSpaceID dQuadTreeSpaceCreate (dSpaceID space, const dVector3 Center, co
 #define dSAP_AXES_ZXY  ((2)|(0<<2)|(1<<4))
 #define dSAP_AXES_ZYX  ((2)|(1<<2)|(0<<4))
 
+/* Keep the sorted AABB endpoints and the overlapping pairs between the collide
+   calls, and update them for the geoms that moved. Faster when few geoms move
+   far per step. Combine with the axis order, e.g. dSAP_AXES_XZY|dSAP_INCREMENTAL. */
+#define dSAP_INCREMENTAL (1<<6)
+
 ODE_API dSpaceID dSweepAndPruneSpaceCreate( dSpaceID space, int axisorder );
 
 
@@ -161,6 +267,7 @@ ODE_API dGeomID dSpaceGetGeom (dSpaceID, int i);
  *  @li dHashSpaceClass
  *  @li dSweepAndPruneSpaceClass
  *  @li dQuadTreeSpaceClass
+ *  @li dDynamicTreeSpaceClass
  *  @li dFirstUserClass
  *  @li dLastUserClass
  *
@@ -104,6 +104,15 @@ ODE_API void dGeomTriMeshDataBuildSimple1(dTriMeshDataID g,
 
 /* Preprocess the trimesh data to remove mark unnecessary edges and vertices */
 ODE_API void dGeomTriMeshDataPreprocess(dTriMeshDataID g);
+
+/*
+ * Let the following dGeomTriMeshDataBuild* calls build the collision tree
+ * with up to thread_count threads of the threading implementation, called
+ * through functions_info as in dWorldSetStepThreadingImplementation() (NULL
+ * and 1 build it serially, which is the default). The tree does not depend
+ * on the number of threads. Only the OPCODE trimesh builds in parallel.
+ */
+ODE_API void dGeomTriMeshDataSetBuildThreading(dTriMeshDataID g, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, unsigned thread_count);
 /* Get and set the internal preprocessed trimesh data buffer, for loading and saving */
 ODE_API void dGeomTriMeshDataGetBuffer(dTriMeshDataID g, unsigned char** buf, int* bufLen);
 ODE_API void dGeomTriMeshDataSetBuffer(dTriMeshDataID g, unsigned char* buf);
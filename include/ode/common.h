@@ -178,6 +178,7 @@ struct dxGeom;		/* geometry (collision object) */
 struct dxJoint;
 struct dxJointNode;
 struct dxJointGroup;
+struct dxContactBuffer;
 struct dxWorldProcessThreadingManager;
 
 typedef struct dxWorld *dWorldID;
@@ -186,6 +187,7 @@ typedef struct dxBody *dBodyID;
 typedef struct dxGeom *dGeomID;
 typedef struct dxJoint *dJointID;
 typedef struct dxJointGroup *dJointGroupID;
+typedef struct dxContactBuffer *dContactBufferID;
 typedef struct dxWorldProcessThreadingManager *dWorldStepThreadingManagerID;
 
 /* error numbers */
@@ -340,6 +342,43 @@ typedef struct dJointFeedback {
 } dJointFeedback;
 
 
+/* QuickStep solver statistics of a single island */
+
+typedef struct dQuickStepIslandStatistics {
+  unsigned int bodies;		/* number of bodies in the island */
+  unsigned int rows;		/* number of constraint rows solved */
+  unsigned int iterations;	/* number of SOR iterations performed */
+  dReal residual;		/* largest constraint force change in the last iteration */
+} dQuickStepIslandStatistics;
+
+
+/* Statistics of the last world step. The times are in seconds from the
+ * dStopwatch clock (the monotonic clock where the system has one); the times
+ * of the stages are summed over all the islands and threads that ran them. */
+
+typedef struct dWorldStepStatistics {
+  double step_time;		/* wall time of the whole step */
+  double islands_time;		/* building the islands and estimating their memory */
+  double stage0_bodies_time;	/* stage 0: body inertia, gravity and gyroscopic torques */
+  double stage0_joints_time;	/* stage 0: joint constraint dimensions */
+  double stage1_time;		/* stage 1: constraint memory and joint ordering */
+  double stage2a_time;		/* stage 2a: Jacobians and constraint parameters */
+  double stage2b_time;		/* stage 2b: mass weighted Jacobians and right hand side terms */
+  double stage2c_time;		/* stage 2c: system matrix and right hand side */
+  double stage3_time;		/* stage 3: constraint forces and velocity update */
+  double lcp_time;		/* solving the LCP (the SOR loop for QuickStep) */
+  double integration_time;	/* position and orientation update */
+  unsigned int islands;		/* number of islands stepped */
+  unsigned int rows;		/* constraint rows of all the islands */
+  unsigned int max_island_rows;	/* constraint rows of the largest island */
+  unsigned int allowed_threads;	/* limit on the threads for island processing
+				 * (the world's maximum, capped by the threading
+				 * implementation); not the threads that ran */
+  size_t islands_memory_estimate;	/* bytes estimated to be required to build the islands */
+  size_t stepper_memory_estimate;	/* bytes estimated to be required to step the largest island */
+} dWorldStepStatistics;
+
+
 /* private functions that must be implemented by the collision library:
  * (1) indicate that a geom has moved, (2) get the next geom in a body list.
  * these functions are called whenever the position of geoms connected to a
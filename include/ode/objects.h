@@ -464,6 +464,159 @@ ODE_API void dWorldSetQuickStepW (dWorldID, dReal over_relaxation);
  */
 ODE_API dReal dWorldGetQuickStepW (dWorldID);
 
+/**
+ * @brief Enable or disable solving rows of a single island in parallel with QuickStep.
+ * @ingroup world
+ * @remarks
+ * When enabled, the constraint rows of each island are partitioned into
+ * batches of rows that do not share any bodies (by greedy coloring of the
+ * body graph). The batches are swept one after another and rows within 
+ * a batch are solved concurrently via the world's threading implementation.
+ * This lets a single large island use several threads. Rows are not 
+ * randomly reordered in this mode so the results differ slightly from
+ * the serial solver. Small islands are always solved serially.
+ * The mode only takes effect if island stepping is allowed to use more
+ * than one thread (see @c dWorldSetStepIslandsProcessingMaxThreadCount).
+ * @param enabled 1 to enable, 0 to disable. The default is 0.
+ * @see dWorldGetQuickStepParallelSOR
+ */
+ODE_API void dWorldSetQuickStepParallelSOR (dWorldID, int enabled);
+
+/**
+ * @brief Get whether rows of a single island are solved in parallel with QuickStep.
+ * @ingroup world
+ * @returns 1 if enabled, 0 otherwise
+ * @see dWorldSetQuickStepParallelSOR
+ */
+ODE_API int dWorldGetQuickStepParallelSOR (dWorldID);
+
+/**
+ * @brief Enable or disable warm starting of the QuickStep solver.
+ * @ingroup world
+ * @remarks
+ * When enabled, the SOR iterations start from the constraint forces that were
+ * computed for the joints on the previous step rather than from zero. 
+ * Contact joints are usually recreated every step, so the forces of the contact
+ * joints are kept in a per-world cache as the joints are destroyed (e.g. with
+ * @c dJointGroupEmpty) and are assigned to the new contact joints created with
+ * @c dJointCreateContact which have the same geoms, the same features
+ * (@c side1, @c side2), a close normal and a position within 
+ * the distance set with @c dWorldSetContactWarmStartingDistance.
+ * This lets stable stacks and resting contacts be solved with considerably
+ * fewer iterations.
+ * The contact joints start from the cached forces as they are, the other
+ * joints from their forces scaled with the factor set with
+ * @c dWorldSetQuickStepWarmStartingFactor.
+ * @param enabled 1 to enable, 0 to disable. The default is 0.
+ * @returns 1
+ * @see dWorldGetQuickStepWarmStarting
+ * @see dWorldSetContactWarmStartingDistance
+ */
+ODE_API int dWorldSetQuickStepWarmStarting (dWorldID, int enabled);
+
+/**
+ * @brief Get whether warm starting of the QuickStep solver is enabled.
+ * @ingroup world
+ * @returns 1 if enabled, 0 otherwise
+ * @see dWorldSetQuickStepWarmStarting
+ */
+ODE_API int dWorldGetQuickStepWarmStarting (dWorldID);
+
+/**
+ * @brief Set the factor the constraint forces of the joints other than
+ * contact joints are scaled with when they are reused by warm starting.
+ * @ingroup world
+ * @remarks
+ * Starting motor-driven joints from slightly less than their previous forces
+ * keeps them from jerking. The forces of the contact joints taken from the
+ * contact cache are not scaled.
+ * @param factor The default is 0.9; 1 reuses the forces as they are.
+ * @see dWorldSetQuickStepWarmStarting
+ */
+ODE_API void dWorldSetQuickStepWarmStartingFactor (dWorldID, dReal factor);
+
+/**
+ * @brief Get the factor the reused constraint forces of the joints other
+ * than contact joints are scaled with.
+ * @ingroup world
+ * @returns the factor
+ */
+ODE_API dReal dWorldGetQuickStepWarmStartingFactor (dWorldID);
+
+/**
+ * @brief Set the convergence tolerance of the QuickStep method.
+ * @ingroup world
+ * @remarks
+ * The SOR iterations of an island stop early as soon as no constraint force
+ * of the island changes by more than the tolerance during an iteration. 
+ * The number of iterations set with @c dWorldSetQuickStepNumIterations 
+ * remains the upper limit. This way islands at rest cost a few iterations
+ * while the hard ones still get the full iteration budget.
+ * @param tolerance The default is 0, which disables the early exit.
+ * @see dWorldGetQuickStepIslandStatistics
+ */
+ODE_API void dWorldSetQuickStepTolerance (dWorldID, dReal tolerance);
+
+/**
+ * @brief Get the convergence tolerance of the QuickStep method.
+ * @ingroup world
+ * @returns the tolerance
+ */
+ODE_API dReal dWorldGetQuickStepTolerance (dWorldID);
+
+/**
+ * @brief Get the number of islands processed by the last @c dWorldQuickStep call.
+ * @ingroup world
+ * @see dWorldGetQuickStepIslandStatistics
+ */
+ODE_API unsigned int dWorldGetQuickStepIslandCount (dWorldID);
+
+/**
+ * @brief Get the solver statistics of an island processed by the last 
+ * @c dWorldQuickStep call.
+ * @ingroup world
+ * @remarks
+ * The statistics include the number of SOR iterations performed for the island
+ * and the residual, i.e. the largest change of a constraint force during 
+ * the last iteration.
+ * @param island The island index, less than @c dWorldGetQuickStepIslandCount.
+ * @param stats The structure to be filled.
+ */
+ODE_API void dWorldGetQuickStepIslandStatistics (dWorldID, unsigned int island, dQuickStepIslandStatistics *stats);
+
+/**
+ * @brief Enable or disable the collection of step statistics.
+ * @ingroup world
+ * @remarks
+ * When enabled, @c dWorldStep and @c dWorldQuickStep measure the time spent
+ * building the islands, in each stage of the stepper, in the LCP solver and in
+ * the integration, and count the islands, constraint rows, threads and
+ * memory of the step. Measuring adds a little overhead to every stage
+ * of every island.
+ * @param enabled 1 to enable, 0 to disable. The default is 0.
+ * @see dWorldGetStepStatistics
+ */
+ODE_API void dWorldSetStepStatisticsEnabled (dWorldID, int enabled);
+
+/**
+ * @brief Get whether the collection of step statistics is enabled.
+ * @ingroup world
+ * @returns 1 if enabled, 0 otherwise
+ */
+ODE_API int dWorldGetStepStatisticsEnabled (dWorldID);
+
+/**
+ * @brief Get the statistics of the last @c dWorldStep or @c dWorldQuickStep
+ * call.
+ * @ingroup world
+ * @remarks
+ * The statistics are all zero for steps made while the collection
+ * was disabled.
+ * @param stats The structure to be filled.
+ * @see dWorldSetStepStatisticsEnabled
+ */
+ODE_API void dWorldGetStepStatistics (dWorldID, dWorldStepStatistics *stats);
+
 /* World contact parameter functions */
 
 /**
@@ -503,6 +656,23 @@ ODE_API void dWorldSetContactSurfaceLayer (dWorldID, dReal depth);
  */
 ODE_API dReal dWorldGetContactSurfaceLayer (dWorldID);
 
+/**
+ * @brief Set the maximum distance a contact may move between steps for
+ * its constraint forces to be reused with warm starting.
+ * @ingroup world
+ * @param distance The default value is 0.01.
+ * @see dWorldSetQuickStepWarmStarting
+ */
+ODE_API void dWorldSetContactWarmStartingDistance (dWorldID, dReal distance);
+
+/**
+ * @brief Get the maximum distance a contact may move between steps for
+ * its constraint forces to be reused with warm starting.
+ * @ingroup world
+ * @returns the distance
+ */
+ODE_API dReal dWorldGetContactWarmStartingDistance (dWorldID);
+
 
 /**
  * @defgroup disable Automatic Enabling and Disabling
@@ -1753,6 +1923,62 @@ ODE_API void dJointGroupDestroy (dJointGroupID);
  */
 ODE_API void dJointGroupEmpty (dJointGroupID);
 
+/**
+ * @brief Create a contact buffer.
+ * @ingroup joints
+ *
+ * A contact buffer stages contacts for dJointGroupAddContactsBatch(). It
+ * lets a thread of a parallel collision pass collect its contacts
+ * without creating joints, which must happen on one thread at a time.
+ * Each thread should use a buffer of its own.
+ */
+ODE_API dContactBufferID dContactBufferCreate (void);
+
+/**
+ * @brief Destroy a contact buffer.
+ * @ingroup joints
+ */
+ODE_API void dContactBufferDestroy (dContactBufferID);
+
+/**
+ * @brief Stage a contact to be created as a joint attached to the given bodies.
+ * @ingroup joints
+ * @param body1 The first body, or 0 for the static environment.
+ * @param body2 The second body, or 0 for the static environment.
+ * @remarks The contact is copied. The buffer may be filled concurrently with
+ * other buffers.
+ */
+ODE_API void dContactBufferAdd (dContactBufferID, const dContact *, dBodyID body1, dBodyID body2);
+
+/**
+ * @brief Return the number of contacts staged in a contact buffer.
+ * @ingroup joints
+ */
+ODE_API int dContactBufferGetCount (dContactBufferID);
+
+/**
+ * @brief Remove all the contacts staged in a contact buffer.
+ * @ingroup joints
+ */
+ODE_API void dContactBufferEmpty (dContactBufferID);
+
+/**
+ * @brief Create contact joints for all the contacts staged in contact buffers.
+ * @ingroup joints
+ *
+ * The joints are created in the joint group, in buffer order, and attached to
+ * the bodies they were staged with, as dJointCreateContact() and dJointAttach()
+ * would do for each contact. Afterwards the buffers are empty.
+ *
+ * @param group The joint group to create the joints in. Must not be 0.
+ * @param buffers An array of @a buffer_count contact buffers.
+ * @param buffer_count The number of buffers.
+ * @returns The number of joints created.
+ * @remarks The buffers must not be used by other threads during the call.
+ */
+ODE_API int dJointGroupAddContactsBatch (dWorldID, dJointGroupID group,
+  dContactBufferID const *buffers, int buffer_count);
+
 /**
  * @brief Return the number of bodies attached to the joint
  * @ingroup joints
@@ -102,6 +102,26 @@ public:
     { dWorldSetQuickStepW (get_id(), over_relaxation); }
   dReal getQuickStepW() const
     { return dWorldGetQuickStepW (get_id()); }
+  void setQuickStepParallelSOR(int enabled)
+    { dWorldSetQuickStepParallelSOR (get_id(), enabled); }
+  int getQuickStepParallelSOR() const
+    { return dWorldGetQuickStepParallelSOR (get_id()); }
+  int setQuickStepWarmStarting(int enabled)
+    { return dWorldSetQuickStepWarmStarting (get_id(), enabled); }
+  int getQuickStepWarmStarting() const
+    { return dWorldGetQuickStepWarmStarting (get_id()); }
+  void setQuickStepWarmStartingFactor(dReal factor)
+    { dWorldSetQuickStepWarmStartingFactor (get_id(), factor); }
+  dReal getQuickStepWarmStartingFactor() const
+    { return dWorldGetQuickStepWarmStartingFactor (get_id()); }
+  void setQuickStepTolerance(dReal tolerance)
+    { dWorldSetQuickStepTolerance (get_id(), tolerance); }
+  dReal getQuickStepTolerance() const
+    { return dWorldGetQuickStepTolerance (get_id()); }
+  unsigned int getQuickStepIslandCount() const
+    { return dWorldGetQuickStepIslandCount (get_id()); }
+  void getQuickStepIslandStatistics(unsigned int island, dQuickStepIslandStatistics *stats) const
+    { dWorldGetQuickStepIslandStatistics (get_id(), island, stats); }
 
   void  setAutoDisableLinearThreshold (dReal threshold) 
     { dWorldSetAutoDisableLinearThreshold (get_id(), threshold); }
@@ -152,6 +172,10 @@ public:
     { dWorldSetContactSurfaceLayer (get_id(), depth); }
   dReal getContactSurfaceLayer() const
     { return dWorldGetContactSurfaceLayer (get_id()); }
+  void setContactWarmStartingDistance(dReal distance)
+    { dWorldSetContactWarmStartingDistance (get_id(), distance); }
+  dReal getContactWarmStartingDistance() const
+    { return dWorldGetContactWarmStartingDistance (get_id()); }
 
   void impulseToForce (dReal stepsize, dReal ix, dReal iy, dReal iz, 
 		       dVector3 force)
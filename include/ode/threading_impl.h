@@ -63,6 +63,26 @@ typedef struct dxThreadingThreadPool *dThreadingThreadPoolID;
  */
 ODE_API dThreadingImplementationID dThreadingAllocateMultiThreadedImplementation();
 
+/**
+ * @brief Allocates built-in multi-threaded threading implementation object 
+ * with a work-stealing job scheduler.
+ *
+ * The implementation is used the same way as the one returned by 
+ * @c dThreadingAllocateMultiThreadedImplementation. Each serving thread keeps
+ * its own queue of jobs and takes jobs from other threads' queues when its own
+ * one is empty, so that large numbers of small jobs do not contend for a single 
+ * shared job list. On platforms where the scheduler is not available 
+ * the function allocates the ordinary multi-threaded implementation.
+ * 
+ * @returns ID of object allocated or NULL on failure
+ * 
+ * @ingroup threading
+ * @see dThreadingAllocateMultiThreadedImplementation
+ * @see dThreadingThreadPoolServeMultiThreadedImplementation
+ * @see dThreadingFreeImplementation
+ */
+ODE_API dThreadingImplementationID dThreadingAllocateMultiThreadedWorkStealingImplementation();
+
 /**
  * @brief Retrieves the functions record of a built-in threading implementation.
  *
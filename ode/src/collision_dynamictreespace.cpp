@@ -0,0 +1,1067 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+dynamic AABB tree space. the geoms are the leaves of a binary tree of
+bounding boxes. the leaf boxes are the geom AABBs enlarged by a margin, so
+a geom is only moved in the tree when its AABB leaves the enlarged box. the
+tree is kept balanced with rotations as leaves are inserted and removed.
+
+geoms with infinite AABBs (e.g. planes) are kept out of the tree, in a list
+that is tested against everything.
+
+*/
+
+#include <ode/common.h>
+#include <ode/collision_space.h>
+#include <ode/collision.h>
+#include "config.h"
+#include "matrix.h"
+#include "collision_kernel.h"
+#include "collision_space_internal.h"
+
+#include <algorithm>
+
+#define dMIN(A,B)  ((A)>(B) ? (B) : (A))
+#define dMAX(A,B)  ((B)>(A) ? (B) : (A))
+
+
+#define GEOM_ENABLED(g) (((g)->gflags & GEOM_ENABLE_TEST_MASK) == GEOM_ENABLE_TEST_VALUE)
+
+// HACK: the leaf node index is kept in the 'next_ex' member of dxGeom, and
+// the index in the list of infinite geoms in 'tome_ex', plus one so that
+// zero means none
+#define GEOM_SET_LEAF_IDX(g,idx) { (g)->next_ex = (dxGeom*)(size_t)((idx) + 1); }
+#define GEOM_GET_LEAF_IDX(g) ((int)((size_t)(g)->next_ex) - 1)
+#define GEOM_SET_INF_IDX(g,idx) { (g)->tome_ex = (dxGeom**)(size_t)((idx) + 1); }
+#define GEOM_GET_INF_IDX(g) ((int)((size_t)(g)->tome_ex) - 1)
+
+enum
+{
+    dxDTREE_NULL_NODE = -1,
+    dxDTREE_STACK_SIZE = 256,	// local stack size of the traversals, the tree height is logarithmic
+    dxDTREE_PAIR_STACK_SIZE = 1024,	// local stack size of the node pairs in the tree self collision
+    dxDTREE_REBUILD_MIN = 64,	// fewer new geoms than this are always inserted one by one
+};
+
+#define dxDTREE_DEFAULT_MARGIN REAL(0.1)
+
+
+// a traversal stack that starts in local storage and moves to the heap if it
+// outgrows it, which a degenerate tree may make it do
+template <class T, int LocalSize>
+class dxDTreeStack
+{
+public:
+    dxDTreeStack(): m_items(m_local), m_top(0), m_capacity(LocalSize) {}
+    ~dxDTreeStack()
+    {
+        if ( m_items != m_local )
+            dFree( m_items, m_capacity * sizeof(T) );
+    }
+
+    bool empty() const { return m_top == 0; }
+    void push( const T& item )
+    {
+        if ( m_top == m_capacity )
+            grow();
+        m_items[ m_top++ ] = item;
+    }
+    T pop() { return m_items[ --m_top ]; }
+
+private:
+    void grow()
+    {
+        T* items = (T*)dAlloc( 2 * m_capacity * sizeof(T) );
+        memcpy( items, m_items, m_top * sizeof(T) );
+        if ( m_items != m_local )
+            dFree( m_items, m_capacity * sizeof(T) );
+        m_items = items;
+        m_capacity *= 2;
+    }
+
+    dxDTreeStack( const dxDTreeStack& );
+    dxDTreeStack& operator=( const dxDTreeStack& );
+
+    T m_local[ LocalSize ];
+    T* m_items;
+    int m_top, m_capacity;
+};
+
+typedef dxDTreeStack<int, dxDTREE_STACK_SIZE> dxDTreeNodeStack;
+
+struct dxDTreeNodePair
+{
+    int a, b;
+
+    static dxDTreeNodePair make( int a, int b ) { dxDTreeNodePair p; p.a = a; p.b = b; return p; }
+};
+
+struct dxDTreeRayEntry
+{
+    int node;
+    dReal entry;	// where the segment enters the node
+};
+
+
+static inline bool BoundsOverlap( const dReal* b0, const dReal* b1 )
+{
+    return b0[0] <= b1[1] && b1[0] <= b0[1] &&
+        b0[2] <= b1[3] && b1[2] <= b0[3] &&
+        b0[4] <= b1[5] && b1[4] <= b0[5];
+}
+
+static inline bool BoundsContain( const dReal* outer, const dReal* inner )
+{
+    return outer[0] <= inner[0] && inner[1] <= outer[1] &&
+        outer[2] <= inner[2] && inner[3] <= outer[3] &&
+        outer[4] <= inner[4] && inner[5] <= outer[5];
+}
+
+static inline bool BoundsInfinite( const dReal* b )
+{
+    for ( int i = 0; i < 6; ++i )
+        if ( b[i] == dInfinity || b[i] == -dInfinity )
+            return true;
+    return false;
+}
+
+static inline void BoundsUnion( dReal* out, const dReal* b0, const dReal* b1 )
+{
+    for ( int i = 0; i < 6; i += 2 ) {
+        out[i] = dMIN( b0[i], b1[i] );
+        out[i+1] = dMAX( b0[i+1], b1[i+1] );
+    }
+}
+
+// half the surface area, the cost of a box in the insertion heuristic
+static inline dReal BoundsArea( const dReal* b )
+{
+    dReal dx = b[1] - b[0], dy = b[3] - b[2], dz = b[5] - b[4];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static inline dReal UnionArea( const dReal* b0, const dReal* b1 )
+{
+    dReal u[6];
+    BoundsUnion( u, b0, b1 );
+    return BoundsArea( u );
+}
+
+
+struct dxDynamicTreeSpace : public dxSpace
+{
+    dxDynamicTreeSpace( dSpaceID _space );
+    ~dxDynamicTreeSpace();
+
+    // dxSpace
+    virtual void add( dxGeom* g );
+    virtual void remove( dxGeom* g );
+    virtual void cleanGeoms();
+    virtual void collide( void *data, dNearCallback *callback );
+    virtual void collide2( void *data, dxGeom *geom, dNearCallback *callback );
+    virtual int prepareCollideParallel();
+    virtual void collideParallelItems( int begin, int end, void *data, dNearCallback *callback );
+    virtual dReal raycast( const dReal* origin, const dReal* dir, dReal length, void *data, dxRaycastCallback *callback );
+
+    void setMargin( dReal margin ) { Margin = margin; }
+    dReal getMargin() const { return Margin; }
+
+    int queryAABB( const dReal* bounds, void *data, dSpaceQueryCallback *callback );
+    int queryRay( const dReal* origin, const dReal* dir, dReal length, void *data, dSpaceQueryCallback *callback );
+
+private:
+
+    //! A tree node, a leaf holds a geom and has no children
+    struct Node
+    {
+        dReal bounds[6];	//!< enlarged geom AABB of a leaf, union of the children otherwise
+        int parent;		//!< next free node for a free node
+        int child1;
+        int child2;
+        int height;		//!< 0 for a leaf, -1 for a free node
+        dxGeom* geom;
+
+        bool isLeaf() const { return child1 == dxDTREE_NULL_NODE; }
+    };
+
+    //! Orders leaves by the centers of their boxes along an axis
+    struct CenterLess
+    {
+        const Node* nodes;
+        int axis;
+
+        bool operator()( int l0, int l1 ) const
+        {
+            const dReal* b0 = nodes[ l0 ].bounds;
+            const dReal* b1 = nodes[ l1 ].bounds;
+            return b0[axis] + b0[axis+1] < b1[axis] + b1[axis+1];
+        }
+    };
+
+    int AllocateNode();
+    void FreeNode( int idx );
+    void InsertLeaf( int leaf );
+    void RemoveLeaf( int leaf );
+    int Balance( int idx );
+    void FixUpwards( int idx );
+    void Rebuild();
+    int BuildRange( int* leaves, int count );
+    void UpdateGeom( dxGeom* g, bool insert );
+    void ListInfinite( dxGeom* g );
+    void UnlistInfinite( dxGeom* g );
+    void CollideTree( void *data, dNearCallback *callback, dxSpaceCollideCounters& counters );
+    void CollideLeaf( int leaf, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters );
+    void CollideBounds( const dReal* bounds, dxGeom* geom, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters );
+
+    dArray< Node > Nodes;
+    int Root;
+    int FreeList;	// first free node
+    dArray< dxGeom* > InfList;	// geoms with infinite AABBs
+    dArray< int > CollideLeaves;	// enabled leaves, for the parallel pair search
+    dArray< int > TmpLeaves;	// all the leaves in Rebuild()
+    int LeafCount;
+    dReal Margin;	// the leaf boxes are the geom AABBs enlarged by this much
+};
+
+
+dxDynamicTreeSpace::dxDynamicTreeSpace( dSpaceID _space ) : dxSpace( _space )
+{
+    type = dDynamicTreeSpaceClass;
+    Root = dxDTREE_NULL_NODE;
+    FreeList = dxDTREE_NULL_NODE;
+    LeafCount = 0;
+    Margin = dxDTREE_DEFAULT_MARGIN;
+}
+
+dxDynamicTreeSpace::~dxDynamicTreeSpace()
+{
+    CHECK_NOT_LOCKED(this);
+    // the geoms are removed here, as dxSpace destructor can't call remove() of this class
+    if ( cleanup ) {
+        // note that destroying each geom will call remove()
+        for ( ; first; dGeomDestroy( first ) ) {}
+    }
+    else {
+        for ( ; first; remove( first ) ) {}
+    }
+}
+
+//------------------------------------------------------------------------------
+// Tree maintenance
+//------------------------------------------------------------------------------
+
+int dxDynamicTreeSpace::AllocateNode()
+{
+    int idx;
+    if ( FreeList != dxDTREE_NULL_NODE ) {
+        idx = FreeList;
+        FreeList = Nodes[ idx ].parent;
+    }
+    else {
+        idx = Nodes.size();
+        Nodes.setSize( idx + 1 );
+    }
+
+    Node& node = Nodes[ idx ];
+    node.parent = dxDTREE_NULL_NODE;
+    node.child1 = dxDTREE_NULL_NODE;
+    node.child2 = dxDTREE_NULL_NODE;
+    node.height = 0;
+    node.geom = 0;
+    return idx;
+}
+
+void dxDynamicTreeSpace::FreeNode( int idx )
+{
+    Node& node = Nodes[ idx ];
+    node.parent = FreeList;
+    node.height = -1;
+    node.geom = 0;
+    FreeList = idx;
+}
+
+// the sibling of the new leaf is found going down the tree towards the
+// child whose box grows the least, for as long as this is cheaper than
+// pairing the leaf with the whole subtree
+void dxDynamicTreeSpace::InsertLeaf( int leaf )
+{
+    if ( Root == dxDTREE_NULL_NODE ) {
+        Root = leaf;
+        Nodes[ leaf ].parent = dxDTREE_NULL_NODE;
+        return;
+    }
+
+    const dReal* leafBounds = Nodes[ leaf ].bounds;
+    int idx = Root;
+    while ( !Nodes[ idx ].isLeaf() ) {
+        const Node& node = Nodes[ idx ];
+        const dReal area = BoundsArea( node.bounds );
+        const dReal combinedArea = UnionArea( node.bounds, leafBounds );
+
+        // cost of a new parent for this node and the leaf
+        const dReal cost = 2 * combinedArea;
+        // minimum cost of pushing the leaf further down
+        const dReal inheritanceCost = 2 * ( combinedArea - area );
+
+        const Node& c1 = Nodes[ node.child1 ];
+        dReal cost1 = UnionArea( c1.bounds, leafBounds ) + inheritanceCost;
+        if ( !c1.isLeaf() )
+            cost1 -= BoundsArea( c1.bounds );
+
+        const Node& c2 = Nodes[ node.child2 ];
+        dReal cost2 = UnionArea( c2.bounds, leafBounds ) + inheritanceCost;
+        if ( !c2.isLeaf() )
+            cost2 -= BoundsArea( c2.bounds );
+
+        if ( cost < cost1 && cost < cost2 )
+            break;
+
+        idx = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    const int sibling = idx;
+    const int oldParent = Nodes[ sibling ].parent;
+    // the allocation may move the nodes
+    const int newParent = AllocateNode();
+
+    Node& parentNode = Nodes[ newParent ];
+    parentNode.parent = oldParent;
+    BoundsUnion( parentNode.bounds, Nodes[ sibling ].bounds, Nodes[ leaf ].bounds );
+    parentNode.height = Nodes[ sibling ].height + 1;
+    parentNode.child1 = sibling;
+    parentNode.child2 = leaf;
+    Nodes[ sibling ].parent = newParent;
+    Nodes[ leaf ].parent = newParent;
+
+    if ( oldParent != dxDTREE_NULL_NODE ) {
+        if ( Nodes[ oldParent ].child1 == sibling )
+            Nodes[ oldParent ].child1 = newParent;
+        else
+            Nodes[ oldParent ].child2 = newParent;
+    }
+    else {
+        Root = newParent;
+    }
+
+    FixUpwards( oldParent );
+}
+
+void dxDynamicTreeSpace::RemoveLeaf( int leaf )
+{
+    if ( leaf == Root ) {
+        Root = dxDTREE_NULL_NODE;
+        return;
+    }
+
+    const int parent = Nodes[ leaf ].parent;
+    const int grandParent = Nodes[ parent ].parent;
+    const int sibling = Nodes[ parent ].child1 == leaf ? Nodes[ parent ].child2 : Nodes[ parent ].child1;
+
+    // the sibling takes the place of the parent
+    Nodes[ sibling ].parent = grandParent;
+    if ( grandParent != dxDTREE_NULL_NODE ) {
+        if ( Nodes[ grandParent ].child1 == parent )
+            Nodes[ grandParent ].child1 = sibling;
+        else
+            Nodes[ grandParent ].child2 = sibling;
+    }
+    else {
+        Root = sibling;
+    }
+    FreeNode( parent );
+
+    FixUpwards( grandParent );
+}
+
+// rebalances and refits the nodes from idx up to the root
+void dxDynamicTreeSpace::FixUpwards( int idx )
+{
+    while ( idx != dxDTREE_NULL_NODE ) {
+        idx = Balance( idx );
+
+        Node& node = Nodes[ idx ];
+        const Node& c1 = Nodes[ node.child1 ];
+        const Node& c2 = Nodes[ node.child2 ];
+        node.height = 1 + dMAX( c1.height, c2.height );
+        BoundsUnion( node.bounds, c1.bounds, c2.bounds );
+
+        idx = node.parent;
+    }
+}
+
+// if the subtrees of node A differ in height by more than one, the higher
+// child is rotated up in place of A, and A takes its higher grandchild.
+// returns the node in place of A.
+int dxDynamicTreeSpace::Balance( int iA )
+{
+    Node& A = Nodes[ iA ];
+    if ( A.isLeaf() || A.height < 2 )
+        return iA;
+
+    const int iB = A.child1;
+    const int iC = A.child2;
+    Node& B = Nodes[ iB ];
+    Node& C = Nodes[ iC ];
+
+    const int balance = C.height - B.height;
+
+    // rotate C up
+    if ( balance > 1 ) {
+        const int iF = C.child1;
+        const int iG = C.child2;
+        Node& F = Nodes[ iF ];
+        Node& G = Nodes[ iG ];
+
+        C.child1 = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+
+        if ( C.parent != dxDTREE_NULL_NODE ) {
+            if ( Nodes[ C.parent ].child1 == iA )
+                Nodes[ C.parent ].child1 = iC;
+            else
+                Nodes[ C.parent ].child2 = iC;
+        }
+        else {
+            Root = iC;
+        }
+
+        if ( F.height > G.height ) {
+            C.child2 = iF;
+            A.child2 = iG;
+            G.parent = iA;
+            BoundsUnion( A.bounds, B.bounds, G.bounds );
+            BoundsUnion( C.bounds, A.bounds, F.bounds );
+            A.height = 1 + dMAX( B.height, G.height );
+            C.height = 1 + dMAX( A.height, F.height );
+        }
+        else {
+            C.child2 = iG;
+            A.child2 = iF;
+            F.parent = iA;
+            BoundsUnion( A.bounds, B.bounds, F.bounds );
+            BoundsUnion( C.bounds, A.bounds, G.bounds );
+            A.height = 1 + dMAX( B.height, F.height );
+            C.height = 1 + dMAX( A.height, G.height );
+        }
+
+        return iC;
+    }
+
+    // rotate B up
+    if ( balance < -1 ) {
+        const int iD = B.child1;
+        const int iE = B.child2;
+        Node& D = Nodes[ iD ];
+        Node& E = Nodes[ iE ];
+
+        B.child1 = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+
+        if ( B.parent != dxDTREE_NULL_NODE ) {
+            if ( Nodes[ B.parent ].child1 == iA )
+                Nodes[ B.parent ].child1 = iB;
+            else
+                Nodes[ B.parent ].child2 = iB;
+        }
+        else {
+            Root = iB;
+        }
+
+        if ( D.height > E.height ) {
+            B.child2 = iD;
+            A.child1 = iE;
+            E.parent = iA;
+            BoundsUnion( A.bounds, C.bounds, E.bounds );
+            BoundsUnion( B.bounds, A.bounds, D.bounds );
+            A.height = 1 + dMAX( C.height, E.height );
+            B.height = 1 + dMAX( A.height, D.height );
+        }
+        else {
+            B.child2 = iE;
+            A.child1 = iD;
+            D.parent = iA;
+            BoundsUnion( A.bounds, C.bounds, D.bounds );
+            BoundsUnion( B.bounds, A.bounds, E.bounds );
+            A.height = 1 + dMAX( C.height, D.height );
+            B.height = 1 + dMAX( A.height, E.height );
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+// builds the tree again top down, splitting the leaves at the median of
+// their centers along the axis the centers spread the most
+void dxDynamicTreeSpace::Rebuild()
+{
+    TmpLeaves.setSize( 0 );
+    const int nodeCount = Nodes.size();
+    for ( int i = 0; i < nodeCount; ++i ) {
+        if ( Nodes[ i ].height == 0 )
+            TmpLeaves.push( i );
+        else if ( Nodes[ i ].height > 0 )
+            FreeNode( i );
+    }
+
+    Root = dxDTREE_NULL_NODE;
+    if ( TmpLeaves.size() != 0 ) {
+        Root = BuildRange( TmpLeaves.data(), TmpLeaves.size() );
+        Nodes[ Root ].parent = dxDTREE_NULL_NODE;
+    }
+}
+
+int dxDynamicTreeSpace::BuildRange( int* leaves, int count )
+{
+    if ( count == 1 )
+        return leaves[0];
+
+    dReal centers[6] = { dInfinity, -dInfinity, dInfinity, -dInfinity, dInfinity, -dInfinity };
+    for ( int i = 0; i < count; ++i ) {
+        const dReal* b = Nodes[ leaves[i] ].bounds;
+        for ( int j = 0; j < 6; j += 2 ) {
+            const dReal c = b[j] + b[j+1];
+            if ( c < centers[j] ) centers[j] = c;
+            if ( c > centers[j+1] ) centers[j+1] = c;
+        }
+    }
+
+    CenterLess less;
+    less.nodes = Nodes.data();
+    less.axis = 0;
+    for ( int j = 2; j < 6; j += 2 )
+        if ( centers[j+1] - centers[j] > centers[less.axis+1] - centers[less.axis] )
+            less.axis = j;
+
+    const int half = count / 2;
+    std::nth_element( leaves, leaves + half, leaves + count, less );
+
+    const int child1 = BuildRange( leaves, half );
+    const int child2 = BuildRange( leaves + half, count - half );
+
+    const int idx = AllocateNode();
+    Node& node = Nodes[ idx ];
+    node.child1 = child1;
+    node.child2 = child2;
+    node.height = 1 + dMAX( Nodes[ child1 ].height, Nodes[ child2 ].height );
+    BoundsUnion( node.bounds, Nodes[ child1 ].bounds, Nodes[ child2 ].bounds );
+    Nodes[ child1 ].parent = idx;
+    Nodes[ child2 ].parent = idx;
+    return idx;
+}
+
+void dxDynamicTreeSpace::ListInfinite( dxGeom* g )
+{
+    GEOM_SET_INF_IDX( g, InfList.size() );
+    InfList.push( g );
+}
+
+void dxDynamicTreeSpace::UnlistInfinite( dxGeom* g )
+{
+    int idx = GEOM_GET_INF_IDX( g );
+    dxGeom* last = InfList[ InfList.size() - 1 ];
+    InfList[ idx ] = last;
+    GEOM_SET_INF_IDX( last, idx );
+    InfList.setSize( InfList.size() - 1 );
+    g->tome_ex = 0;
+}
+
+// places a geom whose AABB has been recomputed. new leaves are only
+// inserted if asked, for a rebuild to place them otherwise.
+void dxDynamicTreeSpace::UpdateGeom( dxGeom* g, bool insert )
+{
+    const dReal* aabb = g->aabb;
+    int leaf = GEOM_GET_LEAF_IDX( g );
+
+    if ( BoundsInfinite( aabb ) ) {
+        if ( leaf != dxDTREE_NULL_NODE ) {
+            RemoveLeaf( leaf );
+            FreeNode( leaf );
+            LeafCount--;
+            g->next_ex = 0;
+        }
+        if ( GEOM_GET_INF_IDX( g ) < 0 )
+            ListInfinite( g );
+        return;
+    }
+
+    if ( GEOM_GET_INF_IDX( g ) >= 0 )
+        UnlistInfinite( g );
+
+    if ( leaf != dxDTREE_NULL_NODE ) {
+        // small motions stay within the enlarged box
+        if ( BoundsContain( Nodes[ leaf ].bounds, aabb ) )
+            return;
+        RemoveLeaf( leaf );
+    }
+    else {
+        leaf = AllocateNode();
+        Nodes[ leaf ].geom = g;
+        GEOM_SET_LEAF_IDX( g, leaf );
+        LeafCount++;
+    }
+
+    dReal* bounds = Nodes[ leaf ].bounds;
+    for ( int i = 0; i < 6; i += 2 ) {
+        bounds[i] = aabb[i] - Margin;
+        bounds[i+1] = aabb[i+1] + Margin;
+    }
+    if ( insert )
+        InsertLeaf( leaf );
+}
+
+//------------------------------------------------------------------------------
+// Space
+//------------------------------------------------------------------------------
+
+void dxDynamicTreeSpace::add( dxGeom* g )
+{
+    CHECK_NOT_LOCKED (this);
+    dAASSERT(g);
+    dUASSERT(g->tome_ex == 0 && g->next_ex == 0, "geom is already in a space");
+
+    // the geom is placed by cleanGeoms(), as it is dirty
+    dxSpace::add(g);
+}
+
+void dxDynamicTreeSpace::remove( dxGeom* g )
+{
+    CHECK_NOT_LOCKED(this);
+    dAASSERT(g);
+    dUASSERT(g->parent_space == this,"object is not in this space");
+
+    int leaf = GEOM_GET_LEAF_IDX( g );
+    if ( leaf != dxDTREE_NULL_NODE ) {
+        RemoveLeaf( leaf );
+        FreeNode( leaf );
+        LeafCount--;
+        g->next_ex = 0;
+    }
+    if ( GEOM_GET_INF_IDX( g ) >= 0 )
+        UnlistInfinite( g );
+
+    dxSpace::remove(g);
+}
+
+void dxDynamicTreeSpace::cleanGeoms()
+{
+    // compute the AABBs of all dirty geoms, and clear the dirty flags.
+    // the dirty geoms are at the front of the list.
+    lock_count++;
+
+    dxGeom *g;
+    int newCount = 0;
+    for ( g = first; g && ( g->gflags & GEOM_DIRTY ); g = g->next ) {
+        if ( IS_SPACE(g) ) {
+            ((dxSpace*)g)->cleanGeoms();
+        }
+        g->recomputeAABB();
+        if ( GEOM_GET_LEAF_IDX( g ) < 0 && !BoundsInfinite( g->aabb ) )
+            newCount++;
+    }
+
+    // inserting many geoms one by one gives a worse tree than building it
+    // again, e.g. when the space is filled
+    const bool rebuild = newCount >= dxDTREE_REBUILD_MIN && newCount > LeafCount / 2;
+
+    for ( g = first; g && ( g->gflags & GEOM_DIRTY ); g = g->next ) {
+        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+        UpdateGeom( g, !rebuild );
+    }
+
+    if ( rebuild )
+        Rebuild();
+
+    lock_count--;
+}
+
+void dxDynamicTreeSpace::collide( void *data, dNearCallback *callback )
+{
+    dAASSERT (callback);
+
+    lock_count++;
+
+    int itemCount = prepareCollideParallel();
+
+    dxSpaceCollideCounters counters;
+    CollideTree( data, callback, counters );
+
+    // the infinite AABBs as in the parallel pair search
+    collideParallelItems( CollideLeaves.size(), itemCount, data, callback );
+
+    lock_count--;
+}
+
+// reports the pairs of overlapping leaves, descending the pairs of
+// overlapping nodes of the tree with itself
+void dxDynamicTreeSpace::CollideTree( void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
+{
+    if ( Root == dxDTREE_NULL_NODE )
+        return;
+
+    dxDTreeStack<dxDTreeNodePair, dxDTREE_PAIR_STACK_SIZE> stack;
+    stack.push( dxDTreeNodePair::make( Root, Root ) );
+    while ( !stack.empty() ) {
+        const dxDTreeNodePair pair = stack.pop();
+        const int ia = pair.a, ib = pair.b;
+        const Node& a = Nodes[ ia ];
+
+        if ( ia == ib ) {
+            if ( !a.isLeaf() ) {
+                stack.push( dxDTreeNodePair::make( a.child1, a.child1 ) );
+                stack.push( dxDTreeNodePair::make( a.child2, a.child2 ) );
+                stack.push( dxDTreeNodePair::make( a.child1, a.child2 ) );
+            }
+            continue;
+        }
+
+        const Node& b = Nodes[ ib ];
+        if ( !BoundsOverlap( a.bounds, b.bounds ) )
+            continue;
+
+        if ( a.isLeaf() && b.isLeaf() ) {
+            if ( GEOM_ENABLED(a.geom) && GEOM_ENABLED(b.geom) )
+                collideAABBs( a.geom, b.geom, data, callback, counters );
+        }
+        else if ( b.isLeaf() || ( !a.isLeaf() && a.height >= b.height ) ) {
+            // descend the taller node
+            stack.push( dxDTreeNodePair::make( a.child1, ib ) );
+            stack.push( dxDTreeNodePair::make( a.child2, ib ) );
+        }
+        else {
+            stack.push( dxDTreeNodePair::make( ia, b.child1 ) );
+            stack.push( dxDTreeNodePair::make( ia, b.child2 ) );
+        }
+    }
+}
+
+// Work items are the enabled leaves, followed by the infinite AABBs. The item
+// of a leaf reports its pairs with the leaves at higher node indices. The
+// item of an infinite AABB collides it with the infinite ones after it and
+// with all the enabled leaves.
+int dxDynamicTreeSpace::prepareCollideParallel()
+{
+    cleanGeoms();
+
+    CollideLeaves.setSize( 0 );
+    for ( dxGeom *g = first; g; g = g->next ) {
+        int leaf = GEOM_GET_LEAF_IDX( g );
+        if ( leaf != dxDTREE_NULL_NODE && GEOM_ENABLED(g) )
+            CollideLeaves.push( leaf );
+    }
+
+    return CollideLeaves.size() + InfList.size();
+}
+
+void dxDynamicTreeSpace::collideParallelItems( int begin, int end, void *data, dNearCallback *callback )
+{
+    const int leafCount = CollideLeaves.size();
+    const int leafEnd = dMIN( end, leafCount );
+    dxSpaceCollideCounters counters;
+
+    for ( int i = begin; i < leafEnd; ++i )
+        CollideLeaf( CollideLeaves[ i ], data, callback, counters );
+
+    const int infSize = InfList.size();
+    for ( int m = dMAX( begin - leafCount, 0 ); m < end - leafCount; ++m ) {
+        dxGeom* g1 = InfList[ m ];
+        if ( !GEOM_ENABLED(g1) )
+            continue;
+
+        // collide infinite ones
+        for ( int n = m + 1; n < infSize; ++n ) {
+            dxGeom* g2 = InfList[ n ];
+            if ( GEOM_ENABLED(g2) )
+                collideAABBs( g1, g2, data, callback, counters );
+        }
+
+        // collide infinite ones with the leaves
+        for ( int n = 0; n < leafCount; ++n )
+            collideAABBs( g1, Nodes[ CollideLeaves[ n ] ].geom, data, callback, counters );
+    }
+}
+
+// reports the pairs of a leaf with the leaves at higher indices whose
+// AABBs overlap its own
+void dxDynamicTreeSpace::CollideLeaf( int leaf, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
+{
+    dxGeom* geom = Nodes[ leaf ].geom;
+    const dReal* bounds = geom->aabb;
+
+    dxDTreeNodeStack stack;
+    stack.push( Root );
+    while ( !stack.empty() ) {
+        const Node& node = Nodes[ stack.pop() ];
+        if ( !BoundsOverlap( node.bounds, bounds ) )
+            continue;
+
+        if ( node.isLeaf() ) {
+            if ( &node - Nodes.data() > leaf && GEOM_ENABLED(node.geom) )
+                collideAABBs( geom, node.geom, data, callback, counters );
+        }
+        else {
+            stack.push( node.child1 );
+            stack.push( node.child2 );
+        }
+    }
+}
+
+// reports the pairs of a geom with the enabled geoms of the space whose AABBs
+// overlap the given bounds
+void dxDynamicTreeSpace::CollideBounds( const dReal* bounds, dxGeom* geom, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
+{
+    const int infSize = InfList.size();
+    for ( int i = 0; i < infSize; ++i ) {
+        dxGeom* g = InfList[ i ];
+        if ( GEOM_ENABLED(g) )
+            collideAABBs( g, geom, data, callback, counters );
+    }
+
+    if ( Root == dxDTREE_NULL_NODE )
+        return;
+
+    dxDTreeNodeStack stack;
+    stack.push( Root );
+    while ( !stack.empty() ) {
+        const Node& node = Nodes[ stack.pop() ];
+        if ( !BoundsOverlap( node.bounds, bounds ) )
+            continue;
+
+        if ( node.isLeaf() ) {
+            if ( GEOM_ENABLED(node.geom) )
+                collideAABBs( node.geom, geom, data, callback, counters );
+        }
+        else {
+            stack.push( node.child1 );
+            stack.push( node.child2 );
+        }
+    }
+}
+
+void dxDynamicTreeSpace::collide2( void *data, dxGeom *geom, dNearCallback *callback )
+{
+    dAASSERT (geom && callback);
+
+    lock_count++;
+
+    cleanGeoms();
+    geom->recomputeAABB();
+
+    dxSpaceCollideCounters counters;
+    CollideBounds( geom->aabb, geom, data, callback, counters );
+
+    lock_count--;
+}
+
+int dxDynamicTreeSpace::queryAABB( const dReal* bounds, void *data, dSpaceQueryCallback *callback )
+{
+    lock_count++;
+    cleanGeoms();
+
+    int reported = 0;
+    const int infSize = InfList.size();
+    for ( int i = 0; i < infSize; ++i ) {
+        dxGeom* g = InfList[ i ];
+        if ( GEOM_ENABLED(g) && BoundsOverlap( g->aabb, bounds ) ) {
+            callback( data, g );
+            reported++;
+        }
+    }
+
+    if ( Root != dxDTREE_NULL_NODE ) {
+        dxDTreeNodeStack stack;
+        stack.push( Root );
+        while ( !stack.empty() ) {
+            const Node& node = Nodes[ stack.pop() ];
+            if ( !BoundsOverlap( node.bounds, bounds ) )
+                continue;
+
+            if ( node.isLeaf() ) {
+                dxGeom* g = node.geom;
+                if ( GEOM_ENABLED(g) && BoundsOverlap( g->aabb, bounds ) ) {
+                    callback( data, g );
+                    reported++;
+                }
+            }
+            else {
+                stack.push( node.child1 );
+                stack.push( node.child2 );
+            }
+        }
+    }
+
+    lock_count--;
+    return reported;
+}
+
+int dxDynamicTreeSpace::queryRay( const dReal* origin, const dReal* dir, dReal length, void *data, dSpaceQueryCallback *callback )
+{
+    lock_count++;
+    cleanGeoms();
+
+    dReal invDir[3], entry;
+    rayInverseDirection( dir, invDir );
+
+    int reported = 0;
+    const int infSize = InfList.size();
+    for ( int i = 0; i < infSize; ++i ) {
+        dxGeom* g = InfList[ i ];
+        if ( GEOM_ENABLED(g) && segmentHitsAABB( origin, dir, invDir, length, g->aabb, &entry ) ) {
+            callback( data, g );
+            reported++;
+        }
+    }
+
+    if ( Root != dxDTREE_NULL_NODE ) {
+        dxDTreeNodeStack stack;
+        stack.push( Root );
+        while ( !stack.empty() ) {
+            const Node& node = Nodes[ stack.pop() ];
+            if ( !segmentHitsAABB( origin, dir, invDir, length, node.bounds, &entry ) )
+                continue;
+
+            if ( node.isLeaf() ) {
+                dxGeom* g = node.geom;
+                if ( GEOM_ENABLED(g) && segmentHitsAABB( origin, dir, invDir, length, g->aabb, &entry ) ) {
+                    callback( data, g );
+                    reported++;
+                }
+            }
+            else {
+                stack.push( node.child1 );
+                stack.push( node.child2 );
+            }
+        }
+    }
+
+    lock_count--;
+    return reported;
+}
+
+// The nearer child is visited first, so that its hits shorten the segment
+// before the farther child is reached, which is then often skipped.
+dReal dxDynamicTreeSpace::raycast( const dReal* origin, const dReal* dir, dReal length, void *data, dxRaycastCallback *callback )
+{
+    dReal invDir[3], entry;
+    rayInverseDirection( dir, invDir );
+
+    const int infSize = InfList.size();
+    for ( int i = 0; i < infSize; ++i ) {
+        dxGeom* g = InfList[ i ];
+        if ( GEOM_ENABLED(g) && segmentHitsAABB( origin, dir, invDir, length, g->aabb, &entry ) )
+            length = callback( data, g, length );
+    }
+
+    if ( Root == dxDTREE_NULL_NODE || !segmentHitsAABB( origin, dir, invDir, length, Nodes[ Root ].bounds, &entry ) )
+        return length;
+
+    dxDTreeStack<dxDTreeRayEntry, dxDTREE_STACK_SIZE> stack;
+    dxDTreeRayEntry e;
+    e.node = Root;
+    e.entry = entry;
+    stack.push( e );
+    while ( !stack.empty() ) {
+        e = stack.pop();
+        if ( e.entry > length )
+            continue;
+
+        const Node& node = Nodes[ e.node ];
+        if ( node.isLeaf() ) {
+            dxGeom* g = node.geom;
+            if ( GEOM_ENABLED(g) && segmentHitsAABB( origin, dir, invDir, length, g->aabb, &entry ) )
+                length = callback( data, g, length );
+            continue;
+        }
+
+        dReal entry1, entry2;
+        const bool hit1 = segmentHitsAABB( origin, dir, invDir, length, Nodes[ node.child1 ].bounds, &entry1 );
+        const bool hit2 = segmentHitsAABB( origin, dir, invDir, length, Nodes[ node.child2 ].bounds, &entry2 );
+        int near = node.child1, far = node.child2;
+        if ( hit1 && hit2 && entry2 < entry1 ) {
+            near = node.child2; far = node.child1;
+            dReal t = entry1; entry1 = entry2; entry2 = t;
+        }
+
+        if ( hit1 && hit2 ) {
+            e.node = far; e.entry = entry2;
+            stack.push( e );
+            e.node = near; e.entry = entry1;
+            stack.push( e );
+        }
+        else if ( hit1 ) {
+            e.node = node.child1; e.entry = entry1;
+            stack.push( e );
+        }
+        else if ( hit2 ) {
+            e.node = node.child2; e.entry = entry2;
+            stack.push( e );
+        }
+    }
+
+    return length;
+}
+
+
+//------------------------------------------------------------------------------
+// API
+//------------------------------------------------------------------------------
+
+dSpaceID dDynamicTreeSpaceCreate( dSpaceID space )
+{
+    return new dxDynamicTreeSpace( space );
+}
+
+void dDynamicTreeSpaceSetMargin( dSpaceID space, dReal margin )
+{
+    dAASSERT( space );
+    dUASSERT( space->type == dDynamicTreeSpaceClass, "argument must be a dynamic tree space" );
+    dUASSERT( margin >= 0, "the margin must not be negative" );
+    ((dxDynamicTreeSpace*)space)->setMargin( margin );
+}
+
+dReal dDynamicTreeSpaceGetMargin( dSpaceID space )
+{
+    dAASSERT( space );
+    dUASSERT( space->type == dDynamicTreeSpaceClass, "argument must be a dynamic tree space" );
+    return ((dxDynamicTreeSpace*)space)->getMargin();
+}
+
+int dDynamicTreeSpaceQueryAABB( dSpaceID space, const dReal aabb[6], void *data, dSpaceQueryCallback *callback )
+{
+    dAASSERT( space && aabb && callback );
+    dUASSERT( space->type == dDynamicTreeSpaceClass, "argument must be a dynamic tree space" );
+    return ((dxDynamicTreeSpace*)space)->queryAABB( aabb, data, callback );
+}
+
+int dDynamicTreeSpaceQueryRay( dSpaceID space, const dVector3 origin, const dVector3 dir, dReal length,
+                               void *data, dSpaceQueryCallback *callback )
+{
+    dAASSERT( space && origin && dir && callback );
+    dUASSERT( space->type == dDynamicTreeSpaceClass, "argument must be a dynamic tree space" );
+    dUASSERT( length >= 0, "the length must not be negative" );
+    return ((dxDynamicTreeSpace*)space)->queryRay( origin, dir, length, data, callback );
+}
@@ -30,6 +30,8 @@ for geometry objects
 #include <ode/common.h>
 #include <ode/rotation.h>
 #include <ode/objects.h>
+#include <ode/threading_impl.h>
+#include <ode/timer.h>
 #include "config.h"
 #include "matrix.h"
 #include "odemath.h"
@@ -39,6 +41,8 @@ for geometry objects
 #include "collision_transform.h"
 #include "collision_trimesh_internal.h"
 #include "collision_space_internal.h"
+#include "threading_base.h"
+#include "threadingutils.h"
 #include "odeou.h"
 
 #ifdef dLIBCCD_ENABLED
@@ -55,50 +59,145 @@ for geometry objects
 
 // this struct records the parameters passed to dCollideSpaceGeom()
 
-#if dATOMICS_ENABLED 
-static volatile atomicptr s_cachedPosR = 0; // dxPosR *
-#endif // dATOMICS_ENABLED
+// geoms and the dxPosR records of geoms without a body come from process
+// wide pools. geoms may be created and destroyed from several threads, so
+// the pools are protected with a spin lock. Recently freed objects are kept
+// in atomic slots in front of the pools and are taken again without the
+// lock, as the temporary geoms colliders create on each call are.
+static dxSizeClassPool s_geomPool;
+static dxObjectPool s_posrPool;
+static volatile atomicord32 s_geomPoolLock = 0;
+
+// one freed geom of each size class
+static volatile atomicptr s_cachedGeoms[dSIZECLASSPOOL_CLASS_COUNT];
+
+// freed dxPosR records. Each slot has a cache line of its own and a thread
+// starts at the slot its stack address selects, so threads do not contend
+// when each creates and destroys its own temporary geoms.
+#define dPOSR_CACHE_SLOTS 8
+#define dPOSR_CACHE_LINE_SIZE 64
+
+struct dxPosrCacheSlot
+{
+    volatile atomicptr posr; // dxPosR *
+    char pad[dPOSR_CACHE_LINE_SIZE - sizeof(atomicptr)];
+};
+
+static dxPosrCacheSlot s_cachedPosR[dPOSR_CACHE_SLOTS];
+
+static inline void dLockGeomPools()
+{
+    while (!ThrsafeCompareExchange(&s_geomPoolLock, 0, 1))
+    {
+        // spin, the lock is only held for a free list operation
+    }
+}
+
+static inline void dUnlockGeomPools()
+{
+    ThrsafeExchange(&s_geomPoolLock, 0);
+}
 
 static inline dxPosR* dAllocPosr()
 {
-    dxPosR *retPosR;
+    const unsigned firstSlot = dGetThreadSlot(dPOSR_CACHE_SLOTS);
+    for (unsigned i = 0; i != dPOSR_CACHE_SLOTS; ++i)
+    {
+        dxPosrCacheSlot &slot = s_cachedPosR[(firstSlot + i) % dPOSR_CACHE_SLOTS];
+        if (slot.posr != 0)
+        {
+            dxPosR *retPosR = (dxPosR *)ThrsafeExchangePointer(&slot.posr, 0);
+            if (retPosR != NULL)
+            {
+                return retPosR;
+            }
+        }
+    }
 
-#if dATOMICS_ENABLED
-    retPosR = (dxPosR *)AtomicExchangePointer(&s_cachedPosR, NULL);
+    dLockGeomPools();
 
-    if (!retPosR)
-#endif
+    if (s_posrPool.getObjectSize() == 0)
     {
-        retPosR = (dxPosR*) dAlloc (sizeof(dxPosR));
+        s_posrPool.initialize(sizeof(dxPosR));
     }
+    dxPosR *retPosR = (dxPosR *)s_posrPool.alloc();
 
+    dUnlockGeomPools();
     return retPosR;
 }
 
 static inline void dFreePosr(dxPosR *oldPosR)
 {
-#if dATOMICS_ENABLED
-    if (!AtomicCompareExchangePointer(&s_cachedPosR, NULL, (atomicptr)oldPosR))
-#endif
+    const unsigned firstSlot = dGetThreadSlot(dPOSR_CACHE_SLOTS);
+    for (unsigned i = 0; i != dPOSR_CACHE_SLOTS; ++i)
     {
-        dFree(oldPosR, sizeof(dxPosR));
+        dxPosrCacheSlot &slot = s_cachedPosR[(firstSlot + i) % dPOSR_CACHE_SLOTS];
+        if (slot.posr == 0 && ThrsafeCompareExchangePointer(&slot.posr, 0, (atomicptr)oldPosR))
+        {
+            return;
+        }
     }
+
+    dLockGeomPools();
+    s_posrPool.free(oldPosR);
+    dUnlockGeomPools();
 }
 
 /*extern */void dClearPosrCache(void)
 {
-#if dATOMICS_ENABLED
     // No threads should be accessing ODE at this time already,
-    // hence variable may be read directly.
-    dxPosR *existingPosR = (dxPosR *)s_cachedPosR;
+    // hence the caches and the pools may be accessed directly. Slabs of
+    // pools with geoms still alive are kept.
+    for (unsigned i = 0; i != dPOSR_CACHE_SLOTS; ++i)
+    {
+        if (s_cachedPosR[i].posr != 0)
+        {
+            s_posrPool.free((void *)s_cachedPosR[i].posr);
+            s_cachedPosR[i].posr = 0;
+        }
+    }
+    for (int sizeClass = 0; sizeClass != dSIZECLASSPOOL_CLASS_COUNT; ++sizeClass)
+    {
+        if (s_cachedGeoms[sizeClass] != 0)
+        {
+            s_geomPool.free((void *)s_cachedGeoms[sizeClass], (sizeClass + 1) * dSIZECLASSPOOL_GRANULARITY);
+            s_cachedGeoms[sizeClass] = 0;
+        }
+    }
+    s_posrPool.purge();
+    s_geomPool.purge();
+}
 
-    if (existingPosR)
+void *dxGeom::operator new (size_t size)
+{
+    const int sizeClass = dxSizeClassPool::getSizeClass(size);
+    if (sizeClass >= 0 && s_cachedGeoms[sizeClass] != 0)
     {
-        dFree(existingPosR, sizeof(dxPosR));
+        void *ptr = (void *)ThrsafeExchangePointer(&s_cachedGeoms[sizeClass], 0);
+        if (ptr != NULL)
+        {
+            return ptr;
+        }
+    }
 
-        s_cachedPosR = 0;
+    dLockGeomPools();
+    void *ptr = s_geomPool.alloc(size);
+    dUnlockGeomPools();
+    return ptr;
+}
+
+void dxGeom::operator delete (void *ptr, size_t size)
+{
+    const int sizeClass = dxSizeClassPool::getSizeClass(size);
+    if (sizeClass >= 0 && s_cachedGeoms[sizeClass] == 0
+        && ThrsafeCompareExchangePointer(&s_cachedGeoms[sizeClass], 0, (atomicptr)ptr))
+    {
+        return;
     }
-#endif
+
+    dLockGeomPools();
+    s_geomPool.free(ptr, size);
+    dUnlockGeomPools();
 }
 
 struct SpaceGeomColliderData {
@@ -283,6 +382,151 @@ void dSetColliderOverride (int i, int j, dColliderFn *fn)
     colliders[j][i].reverse = 1;
 }
 
+//****************************************************************************
+// collision statistics
+
+// the statistics are kept in shards with their own cache lines, a thread
+// adds to the shard dGetThreadSlot() selects with atomic additions. The
+// spaces count into locals and add them once per pass, dCollide() adds its
+// call, and dCollideBatch() its runs of calls of the same collider. Times are
+// kept in nanoseconds, in 64 bits so that they do not wrap on 32-bit targets.
+#define dCOLLISION_STATISTICS_SHARDS 8
+
+struct dxCollisionStatisticsShard
+{
+    volatile duint64 aabb_tests;
+    volatile duint64 near_callbacks;
+    volatile duint64 space_collide_time;
+    volatile duint64 collider_calls[dGeomNumClasses][dGeomNumClasses];
+    volatile duint64 collider_contacts[dGeomNumClasses][dGeomNumClasses];
+    volatile duint64 collider_time[dGeomNumClasses][dGeomNumClasses];
+    char pad[64];
+};
+
+static dxCollisionStatisticsShard s_collisionStatistics[dCOLLISION_STATISTICS_SHARDS];
+static int s_collisionStatisticsEnabled = 0;
+
+static inline dxCollisionStatisticsShard &dGetCollisionStatisticsShard()
+{
+    return s_collisionStatistics[dGetThreadSlot(dCOLLISION_STATISTICS_SHARDS)];
+}
+
+static inline duint64 dStopwatchNanoseconds(dStopwatch *s)
+{
+    return (duint64)(dStopwatchTime(s) * 1e9 + 0.5);
+}
+
+bool dxGetCollisionStatisticsEnabled ()
+{
+    return s_collisionStatisticsEnabled != 0;
+}
+
+void dxAddSpaceCollideStatistics (duint64 aabbTests, duint64 nearCallbacks)
+{
+    if (s_collisionStatisticsEnabled) {
+        dxCollisionStatisticsShard &shard = dGetCollisionStatisticsShard();
+        ThrsafeAddUint64(&shard.aabb_tests, aabbTests);
+        if (nearCallbacks != 0) ThrsafeAddUint64(&shard.near_callbacks, nearCallbacks);
+    }
+}
+
+dxSpaceCollideTimer::dxSpaceCollideTimer():
+    m_enabled(s_collisionStatisticsEnabled != 0)
+{
+    if (m_enabled) {
+        dStopwatchReset(&m_stopwatch);
+        dStopwatchStart(&m_stopwatch);
+    }
+}
+
+dxSpaceCollideTimer::~dxSpaceCollideTimer()
+{
+    if (m_enabled) {
+        dStopwatchStop(&m_stopwatch);
+        ThrsafeAddUint64(&dGetCollisionStatisticsShard().space_collide_time, dStopwatchNanoseconds(&m_stopwatch));
+    }
+}
+
+// times a run of calls of the same collider entry and adds the run to the
+// statistics when the entry changes or the timer is destroyed. Used by
+// dCollide() for its single call and by dCollideBatch() for its runs.
+class dxColliderTimer
+{
+public:
+    dxColliderTimer(): m_class1(-1), m_class2(-1), m_calls(0), m_contacts(0) {}
+    ~dxColliderTimer() { Switch(-1, -1); }
+
+    // class1 and class2 are in the order the collider takes the geoms
+    void Switch(int class1, int class2)
+    {
+        if (class1 != m_class1 || class2 != m_class2) {
+            if (m_class1 != -1) {
+                dStopwatchStop(&m_stopwatch);
+                AddRun();
+            }
+            m_class1 = class1;
+            m_class2 = class2;
+            m_calls = 0;
+            m_contacts = 0;
+            if (class1 != -1) {
+                dStopwatchReset(&m_stopwatch);
+                dStopwatchStart(&m_stopwatch);
+            }
+        }
+    }
+
+    void Count(int contacts) { m_calls++; m_contacts += contacts; }
+
+private:
+    void AddRun()
+    {
+        dxCollisionStatisticsShard &shard = dGetCollisionStatisticsShard();
+        ThrsafeAddUint64(&shard.collider_calls[m_class1][m_class2], m_calls);
+        if (m_contacts != 0) ThrsafeAddUint64(&shard.collider_contacts[m_class1][m_class2], m_contacts);
+        ThrsafeAddUint64(&shard.collider_time[m_class1][m_class2], dStopwatchNanoseconds(&m_stopwatch));
+    }
+
+    dStopwatch  m_stopwatch;
+    int         m_class1, m_class2;
+    size_t      m_calls, m_contacts;
+};
+
+void dSetCollisionStatisticsEnabled (int enabled)
+{
+    s_collisionStatisticsEnabled = enabled != 0;
+}
+
+int dGetCollisionStatisticsEnabled (void)
+{
+    return s_collisionStatisticsEnabled;
+}
+
+void dGetCollisionStatistics (dCollisionStatistics *stats)
+{
+    dAASSERT(stats);
+
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned i = 0; i != dCOLLISION_STATISTICS_SHARDS; ++i) {
+        const dxCollisionStatisticsShard &shard = s_collisionStatistics[i];
+        stats->aabb_tests += shard.aabb_tests;
+        stats->near_callbacks += shard.near_callbacks;
+        stats->space_collide_time += shard.space_collide_time * 1e-9;
+        for (int c1 = 0; c1 != dGeomNumClasses; ++c1) {
+            for (int c2 = 0; c2 != dGeomNumClasses; ++c2) {
+                stats->collider_calls[c1][c2] += shard.collider_calls[c1][c2];
+                stats->collider_contacts[c1][c2] += shard.collider_contacts[c1][c2];
+                stats->collider_time[c1][c2] += shard.collider_time[c1][c2] * 1e-9;
+            }
+        }
+    }
+}
+
+void dResetCollisionStatistics (void)
+{
+    // counts added while resetting may be lost
+    memset((void *)s_collisionStatistics, 0, sizeof(s_collisionStatistics));
+}
+
 /*
 *	NOTE!
 *	If it is necessary to add special processing mode without contact generation
@@ -314,6 +558,12 @@ int dCollide (dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int skip
     dColliderEntry *ce = &colliders[o1->type][o2->type];
     int count = 0;
     if (ce->fn) {
+        dxColliderTimer timer;
+        if (s_collisionStatisticsEnabled) {
+            if (ce->reverse) timer.Switch(o2->type, o1->type);
+            else timer.Switch(o1->type, o2->type);
+        }
+
         if (ce->reverse) {
             count = (*ce->fn) (o2,o1,flags,contact,skip);
             for (int i=0; i<count; i++) {
@@ -332,10 +582,228 @@ int dCollide (dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int skip
         else {
             count = (*ce->fn) (o1,o2,flags,contact,skip);
         }
+        timer.Count(count);
     }
     return count;
 }
 
+//****************************************************************************
+// batched narrowphase
+
+enum
+{
+    dxCOLLIDE_BATCH_BLOCK_SIZE = 32,	// pairs taken by a thread at a time
+};
+
+struct dxCollideBatchThreading:
+    public dxThreadingBase
+{
+    dxCollideBatchThreading(const dThreadingFunctionsInfo *functions, dThreadingImplementationID impl)
+    {
+        AssignThreadingImpl(functions, impl);
+    }
+};
+
+struct dxCollideBatchCallContext
+{
+    dxCollideBatchCallContext(const dGeomPair *pairs, const int *order, int orderCount, 
+        int flags, dContactGeom *contacts, int skip, int *contactCounts):
+        m_pairs(pairs), m_order(order), m_orderCount(orderCount), 
+        m_blockCount((unsigned int)(orderCount + (dxCOLLIDE_BATCH_BLOCK_SIZE - 1)) / dxCOLLIDE_BATCH_BLOCK_SIZE),
+        m_blockIndex(0), m_flags(flags), m_contacts(contacts), m_skip(skip), m_contactCounts(contactCounts)
+    {
+    }
+
+    static int ThreadedCollideGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static int ThreadedCollide_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    void CollideBlocks();
+    void CollideRange(int begin, int end);
+
+    const dGeomPair         *m_pairs;
+    const int               *m_order;
+    int                     m_orderCount;
+    unsigned int            m_blockCount;
+    volatile unsigned int   m_blockIndex;
+    int                     m_flags;
+    dContactGeom            *m_contacts;
+    int                     m_skip;
+    int                     *m_contactCounts;
+};
+
+int dxCollideBatchCallContext::ThreadedCollideGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxCollideBatchCallContext::ThreadedCollide_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<dxCollideBatchCallContext *>(callContext)->CollideBlocks();
+    return true;
+}
+
+void dxCollideBatchCallContext::CollideBlocks()
+{
+    const unsigned int blockCount = m_blockCount;
+
+    unsigned int blockIndex;
+    while ((blockIndex = ThrsafeIncrementIntUpToLimit(&m_blockIndex, blockCount)) != blockCount) {
+        const int blockBegin = (int)blockIndex * dxCOLLIDE_BATCH_BLOCK_SIZE;
+        const int blockEnd = blockBegin + (int)dxCOLLIDE_BATCH_BLOCK_SIZE < m_orderCount 
+            ? blockBegin + (int)dxCOLLIDE_BATCH_BLOCK_SIZE : m_orderCount;
+        CollideRange(blockBegin, blockEnd);
+    }
+}
+
+// the pairs in the order are grouped by collider entry, so runs of the same
+// collider function are called back to back
+void dxCollideBatchCallContext::CollideRange(int begin, int end)
+{
+    const int flags = m_flags, skip = m_skip;
+    const int maxContacts = flags & NUMC_MASK;
+
+    // each run of a collider entry is timed as a whole
+    dxColliderTimer timer;
+    const bool gatherStatistics = s_collisionStatisticsEnabled != 0;
+
+    for (int i = begin; i != end; ++i) {
+        const int pairIndex = m_order[i];
+        dxGeom *o1 = m_pairs[pairIndex].o1, *o2 = m_pairs[pairIndex].o2;
+        dContactGeom *contact = CONTACT(m_contacts, pairIndex * maxContacts * skip);
+
+        const dColliderEntry *ce = &colliders[o1->type][o2->type];
+        if (gatherStatistics) {
+            if (ce->reverse) timer.Switch(o2->type, o1->type);
+            else timer.Switch(o1->type, o2->type);
+        }
+
+        int count;
+        if (ce->reverse) {
+            count = (*ce->fn) (o2,o1,flags,contact,skip);
+            for (int c = 0; c != count; ++c) {
+                dContactGeom *cg = CONTACT(contact,skip*c);
+                cg->normal[0] = -cg->normal[0];
+                cg->normal[1] = -cg->normal[1];
+                cg->normal[2] = -cg->normal[2];
+                dxGeom *tmp = cg->g1;
+                cg->g1 = cg->g2;
+                cg->g2 = tmp;
+                int tmpint = cg->side1;
+                cg->side1 = cg->side2;
+                cg->side2 = tmpint;
+            }
+        }
+        else {
+            count = (*ce->fn) (o1,o2,flags,contact,skip);
+        }
+        timer.Count(count);
+        m_contactCounts[pairIndex] = count;
+    }
+}
+
+int dCollideBatch (const dGeomPair *pairs, int pair_count, int flags, 
+                   dContactGeom *contacts, int skip, int *contact_counts,
+                   const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+                   unsigned thread_count)
+{
+    dAASSERT(pair_count >= 0 && (pairs || pair_count == 0));
+    dAASSERT(pair_count == 0 || (contacts && contact_counts));
+    dUASSERT(colliders_initialized,"Please call ODE initialization (dInitODE() or similar) before using the library");
+    dUASSERT((flags & NUMC_MASK) > 0, "no contacts requested"); 
+    dUASSERT(skip >= (int)sizeof(dContactGeom), "skip is too small");
+    dUASSERT(!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+
+    if ((flags & NUMC_MASK) == 0 || pair_count == 0) return 0;
+
+    const bool threaded = impl != NULL && thread_count > 1 
+        && pair_count > dxCOLLIDE_BATCH_BLOCK_SIZE;
+
+    // Bucket the pairs by collider entry, with the reversed entries next to
+    // the direct ones of the same function. The pairs dCollide() would skip
+    // get no bucket. The geom poses are updated here as geoms may be shared
+    // by pairs collided by different threads; the AABBs too, for colliders
+    // that look at them.
+    int bucketStart[dGeomNumClasses * dGeomNumClasses + 1];
+    memset(bucketStart, 0, sizeof(bucketStart));
+
+    int *keys = (int *)dAlloc(sizeof(int) * pair_count * 2);
+    int *order = keys + pair_count;
+    for (int i = 0; i != pair_count; ++i) {
+        dxGeom *o1 = pairs[i].o1, *o2 = pairs[i].o2;
+        dAASSERT(o1 && o2);
+        dUASSERT(o1->type >= 0 && o1->type < dGeomNumClasses,"bad o1 class number");
+        dUASSERT(o2->type >= 0 && o2->type < dGeomNumClasses,"bad o2 class number");
+
+        contact_counts[i] = 0;
+        keys[i] = -1;
+        if (o1 == o2 || (o1->body == o2->body && o1->body)) continue;
+
+        const dColliderEntry *ce = &colliders[o1->type][o2->type];
+        if (ce->fn == 0) continue;
+
+        if (threaded) {
+            dUASSERT(!IS_SPACE(o1) && !IS_SPACE(o2), "spaces can't be collided in parallel");
+            o1->recomputeAABB();
+            o2->recomputeAABB();
+        }
+        else {
+            o1->recomputePosr();
+            o2->recomputePosr();
+        }
+
+        keys[i] = ce->reverse ? o2->type * dGeomNumClasses + o1->type : o1->type * dGeomNumClasses + o2->type;
+        bucketStart[keys[i] + 1]++;
+    }
+
+    for (int b = 0; b != dGeomNumClasses * dGeomNumClasses; ++b) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    const int orderCount = bucketStart[dGeomNumClasses * dGeomNumClasses];
+    for (int i = 0; i != pair_count; ++i) {
+        if (keys[i] >= 0) {
+            order[bucketStart[keys[i]]++] = i;
+        }
+    }
+
+    dxCollideBatchCallContext callContext(pairs, order, orderCount, flags, contacts, skip, contact_counts);
+
+    unsigned collideThreadCount = thread_count < callContext.m_blockCount ? thread_count : callContext.m_blockCount;
+    bool collided = false;
+
+    if (threaded && collideThreadCount > 1) {
+        dxCollideBatchThreading threading(functions_info, impl);
+
+        if (threading.PreallocateResourcesForThreadedCalls(1 + collideThreadCount)) {
+            dCallWaitID pcwGroupCallWait = threading.AllocThreadedCallWait();
+
+            if (pcwGroupCallWait != NULL) {
+                dCallReleaseeID groupReleasee;
+                threading.PostThreadedCall(NULL, &groupReleasee, collideThreadCount, NULL, pcwGroupCallWait, 
+                    &dxCollideBatchCallContext::ThreadedCollideGroup_Callback, (void *)&callContext, 0, "Collide Batch Group");
+
+                threading.PostThreadedCallsGroup(NULL, collideThreadCount, groupReleasee, 
+                    &dxCollideBatchCallContext::ThreadedCollide_Callback, (void *)&callContext, "Collide Batch");
+
+                threading.WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "Collide Batch Wait");
+                threading.FreeThreadedCallWait(pcwGroupCallWait);
+                collided = true;
+            }
+        }
+    }
+
+    if (!collided) {
+        callContext.CollideRange(0, orderCount);
+    }
+
+    dFree(keys, sizeof(int) * pair_count * 2);
+
+    int total = 0;
+    for (int i = 0; i != pair_count; ++i) {
+        total += contact_counts[i];
+    }
+    return total;
+}
+
 //****************************************************************************
 // dxGeom
 
@@ -367,6 +835,7 @@ dxGeom::dxGeom (dSpaceID _space, int is_placeable)
     dSetZero (aabb,6);
     category_bits = ~0;
     collide_bits = ~0;
+    contact_cache_serial = 0;
 
     // put this geom in a space if required
     if (_space) dSpaceAdd (_space,this);
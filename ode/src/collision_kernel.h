@@ -110,10 +110,16 @@ struct dxGeom : public dBase {
     dxSpace *parent_space;// the space this geom is contained in, 0 if none
     dReal aabb[6];	// cached AABB for this space
     unsigned long category_bits,collide_bits;
+    unsigned contact_cache_serial;	// tells the geom from others at its address in contact caches, 0 until it is used
 
     dxGeom (dSpaceID _space, int is_placeable);
     virtual ~dxGeom();
 
+    // geoms and spaces of all classes are allocated from a shared pool
+    void *operator new (size_t size);
+    void *operator new (size_t, void *p) { return p; }
+    void operator delete (void *ptr, size_t size);
+
     // Set or clear GEOM_ZERO_SIZED flag
     void updateZeroSizedFlag(bool is_zero_sized) { gflags = is_zero_sized ? (gflags | GEOM_ZERO_SIZED) : (gflags & ~GEOM_ZERO_SIZED); }
     // Get parent space TLS kind
@@ -199,6 +205,10 @@ struct dxGeom : public dBase {
 #define dSPACE_TLS_KIND_MANUAL_VALUE 0
 #endif
 
+// the callback of dxSpace::raycast(). it returns the length the rest of the
+// search is limited to.
+typedef dReal dxRaycastCallback (void *data, dxGeom *geom, dReal length);
+
 struct dxSpace : public dxGeom {
     int count;			// number of geoms in this space
     dxGeom *first;		// first geom in list
@@ -243,6 +253,25 @@ struct dxSpace : public dxGeom {
 
     virtual void collide (void *data, dNearCallback *callback)=0;
     virtual void collide2 (void *data, dxGeom *geom, dNearCallback *callback)=0;
+
+    virtual int prepareCollideParallel();
+    // clean the space and build whatever the pair search needs, then return
+    // the number of work items the search is split into. this runs on the
+    // calling thread with the space locked. the default is a single item
+    // that runs collide().
+
+    virtual void collideParallelItems (int begin, int end, void *data, dNearCallback *callback);
+    // report the pairs found by work items begin..end-1. disjoint ranges may
+    // be processed concurrently after prepareCollideParallel(); every pair
+    // is reported by exactly one item.
+
+    virtual dReal raycast (const dReal *origin, const dReal *dir, dReal length,
+        void *data, dxRaycastCallback *callback);
+    // report the enabled geoms whose AABBs the segment origin + t * dir,
+    // t in [0,length], hits, and return the length the search ended with.
+    // each call of the callback may shorten the segment, so a closest hit
+    // search can stop early. the space must be clean; it is not changed, so
+    // several segments may be cast at once. the default tests every geom.
 };
 
 
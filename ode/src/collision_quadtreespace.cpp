@@ -57,10 +57,11 @@ public:
 
     void Create(const dReal MinX, const dReal MaxX, const dReal MinZ, const dReal MaxZ, Block* Parent, int Depth, Block*& Blocks);
 
-    void Collide(void* UserData, dNearCallback* Callback);
-    void Collide(dGeomID g1, dGeomID g2, void* UserData, dNearCallback* Callback);
+    void Collide(void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters);
+    void Collide(dGeomID g1, dGeomID g2, void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters);
+    void CollideGeoms(void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters);
 
-    void CollideLocal(dGeomID g2, void* UserData, dNearCallback* Callback);
+    void CollideLocal(dGeomID g2, void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters);
 
     void AddObject(dGeomID Object);
     void DelObject(dGeomID Object);
@@ -174,18 +175,12 @@ void Block::Create(const dReal MinX, const dReal MaxX, const dReal MinZ, const d
     else mChildren = 0;
 }
 
-void Block::Collide(void* UserData, dNearCallback* Callback){
+void Block::Collide(void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters){
 #ifdef DRAWBLOCKS
     DrawBlock(this);
 #endif
     // Collide the local list
-    dxGeom* g = mFirst;
-    while (g){
-        if (GEOM_ENABLED(g)){
-            Collide(g, g->next_ex, UserData, Callback);
-        }
-        g = g->next_ex;
-    }
+    CollideGeoms(UserData, Callback, Counters);
 
     // Recurse for children
     if (mChildren){
@@ -194,20 +189,32 @@ void Block::Collide(void* UserData, dNearCallback* Callback){
             if (CurrentChild.mGeomCount <= 1){	// Early out
                 continue;
             }
-            CurrentChild.Collide(UserData, Callback);
+            CurrentChild.Collide(UserData, Callback, Counters);
         }
     }
 }
 
+// Collides the local geoms with each other and with the geoms of the children,
+// without recursing for the children's own geoms
+void Block::CollideGeoms(void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters){
+    dxGeom* g = mFirst;
+    while (g){
+        if (GEOM_ENABLED(g)){
+            Collide(g, g->next_ex, UserData, Callback, Counters);
+        }
+        g = g->next_ex;
+    }
+}
+
 // Note: g2 is assumed to be in this Block
-void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callback){
+void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters){
 #ifdef DRAWBLOCKS
     DrawBlock(this);
 #endif
     // Collide against local list
     while (g2){
         if (GEOM_ENABLED(g2)){
-            collideAABBs (g1, g2, UserData, Callback);
+            collideAABBs (g1, g2, UserData, Callback, Counters);
         }
         g2 = g2->next_ex;
     }
@@ -232,17 +239,17 @@ void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callb
                     g1->aabb[AXIS1 * 2 + 0] >= CurrentChild.mMaxZ ||
                     g1->aabb[AXIS1 * 2 + 1] < CurrentChild.mMinZ) continue;
             }
-            CurrentChild.Collide(g1, CurrentChild.mFirst, UserData, Callback);
+            CurrentChild.Collide(g1, CurrentChild.mFirst, UserData, Callback, Counters);
         }
     }
 }
 
-void Block::CollideLocal(dxGeom* g2, void* UserData, dNearCallback* Callback){
+void Block::CollideLocal(dxGeom* g2, void* UserData, dNearCallback* Callback, dxSpaceCollideCounters& Counters){
     // Collide against local list
     dxGeom* g1 = mFirst;
     while (g1){
         if (GEOM_ENABLED(g1)){
-            collideAABBs (g1, g2, UserData, Callback);
+            collideAABBs (g1, g2, UserData, Callback, Counters);
         }
         g1 = g1->next_ex;
     }
@@ -333,6 +340,7 @@ Block* Block::GetBlockChild(const dReal* AABB){
 
 struct dxQuadTreeSpace : public dxSpace{
     Block* Blocks;	// Blocks[0] is the root
+    int BlockCount;
 
     dArray<dxGeom*> DirtyList;
 
@@ -350,6 +358,8 @@ struct dxQuadTreeSpace : public dxSpace{
     void cleanGeoms();
     void collide(void* UserData, dNearCallback* Callback);
     void collide2(void* UserData, dxGeom* g1, dNearCallback* Callback);
+    int prepareCollideParallel();
+    void collideParallelItems(int begin, int end, void* UserData, dNearCallback* Callback);
 
     // Temp data
     Block* CurrentBlock;	// Only used while enumerating
@@ -379,6 +389,7 @@ dxQuadTreeSpace::dxQuadTreeSpace(dSpaceID _space, const dVector3 Center, const d
     type = dQuadTreeSpaceClass;
 
     size_t BlockCount = numNodes(Depth);
+    this->BlockCount = (int)BlockCount;
 
     Blocks = (Block*)dAlloc(BlockCount * sizeof(Block));
     Block* Blocks = this->Blocks + 1;	// This pointer gets modified!
@@ -555,12 +566,33 @@ void dxQuadTreeSpace::collide(void* UserData, dNearCallback* Callback){
     lock_count++;
     cleanGeoms();
 
-    Blocks[0].Collide(UserData, Callback);
+    dxSpaceCollideCounters Counters;
+    Blocks[0].Collide(UserData, Callback, Counters);
 
     lock_count--;
 }
 
 
+// Work item i collides the geoms of Blocks[i], so every block is
+// processed independently
+int dxQuadTreeSpace::prepareCollideParallel(){
+    cleanGeoms();
+
+    return BlockCount;
+}
+
+void dxQuadTreeSpace::collideParallelItems(int begin, int end, void* UserData, dNearCallback* Callback){
+    dxSpaceCollideCounters Counters;
+    for (int i = begin; i < end; i++){
+        Block &CurrentBlock = Blocks[i];
+        if (CurrentBlock.mGeomCount <= 1){	// Early out
+            continue;
+        }
+        CurrentBlock.CollideGeoms(UserData, Callback, Counters);
+    }
+}
+
+
 struct DataCallback {
     void *data;
     dNearCallback *callback;
@@ -580,22 +612,23 @@ void dxQuadTreeSpace::collide2(void* UserData, dxGeom* g2, dNearCallback* Callba
     cleanGeoms();
     g2->recomputeAABB();
 
+    dxSpaceCollideCounters Counters;
     if (g2->parent_space == this){
         // The block the geom is in
         Block* CurrentBlock = (Block*)g2->tome_ex;
 
         // Collide against block and its children
         DataCallback dc = {UserData, Callback};
-        CurrentBlock->Collide(g2, CurrentBlock->mFirst, &dc, swap_callback);
+        CurrentBlock->Collide(g2, CurrentBlock->mFirst, &dc, swap_callback, Counters);
 
         // Collide against parents
         while ((CurrentBlock = CurrentBlock->mParent))
-            CurrentBlock->CollideLocal(g2, UserData, Callback);
+            CurrentBlock->CollideLocal(g2, UserData, Callback, Counters);
 
     }
     else {
         DataCallback dc = {UserData, Callback};
-        Blocks[0].Collide(g2, Blocks[0].mFirst, &dc, swap_callback);
+        Blocks[0].Collide(g2, Blocks[0].mFirst, &dc, swap_callback, Counters);
     }
 
     lock_count--;
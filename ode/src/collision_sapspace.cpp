@@ -30,9 +30,13 @@
  *
  *  This version does complete radix sort, not "classical" SAP. So, we
  *  have no temporal coherence, but are able to handle any movement
- *  velocities equally well.
+ *  velocities equally well. The incremental mode (dSAP_INCREMENTAL) is
+ *  the classical one, for scenes where the geoms move little per step.
  */
 
+#include <algorithm>
+#include <string.h>
+
 #include <ode/common.h>
 #include <ode/collision_space.h>
 #include <ode/collision.h>
@@ -42,6 +46,9 @@
 #include "collision_kernel.h"
 #include "collision_space_internal.h"
 
+#define dMIN(A,B)  ((A)>(B) ? (B) : (A))
+#define dMAX(A,B)  ((B)>(A) ? (B) : (A))
+
 // Reference counting helper for radix sort global data.
 //static void RadixSortRef();
 //static void RadixSortDeref();
@@ -147,38 +154,37 @@ struct dxSAPSpace : public dxSpace
     virtual void cleanGeoms();
     virtual void collide( void *data, dNearCallback *callback );
     virtual void collide2( void *data, dxGeom *geom, dNearCallback *callback );
+    virtual int prepareCollideParallel();
+    virtual void collideParallelItems( int begin, int end, void *data, dNearCallback *callback );
 
 private:
 
-    //--------------------------------------------------------------------------
-    // Local Declarations
-    //--------------------------------------------------------------------------
-
-    //! A generic couple structure
-    struct Pair
-    {
-        uint32 id0;	//!< First index of the pair
-        uint32 id1;	//!< Second index of the pair
-
-        // Default and Value Constructor
-        Pair() {}
-        Pair( uint32 i0, uint32 i1 ) : id0( i0 ), id1( i1 ) {}
-    };
-
     //--------------------------------------------------------------------------
     // Helpers
     //--------------------------------------------------------------------------
 
     /**
-    *	Complete box pruning.
-    *  Returns a list of overlapping pairs of boxes, each box of the pair
-    *  belongs to the same set.
+    *	Box pruning for a range of boxes.
+    *  Reports the pairs of overlapping boxes whose first box is at
+    *  the given positions of the sorted list.
     *
-    *	@param	count	[in] number of boxes.
-    *	@param	geoms	[in] geoms of boxes.
-    *	@param	pairs	[out] array of overlapping pairs.
+    *	@param	begin	[in] first sorted position.
+    *	@param	end	[in] one past the last sorted position.
+    *	@param	counters	[in/out] pair counts of the pass.
     */
-    void BoxPruning( int count, const dxGeom** geoms, dArray< Pair >& pairs );
+    void BoxPruning( int begin, int end, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters );
+
+    //! A geom of the collide2() query list, with its minimum along the first axis
+    struct QueryEntry
+    {
+        dReal min;
+        dxGeom* geom;
+    };
+    static bool QueryEntryLess( const QueryEntry& e0, const QueryEntry& e1 ) { return e0.min < e1.min; }
+    static bool QueryEntryValueLess( const QueryEntry& e, dReal value ) { return e.min < value; }
+    static bool QueryValueEntryLess( dReal value, const QueryEntry& e ) { return value < e.min; }
+
+    void BuildQueryList();
 
 
     //--------------------------------------------------------------------------
@@ -207,10 +213,181 @@ private:
     // NOTE: this is float not dReal because of the OPCODE radix sorter
     dArray< float > poslist;
     RaixSortContext	sortContext;
+    const uint32* SortedList; // poslist order, valid after prepareCollideParallel()
+
+    // The geoms sorted by their minimums along the first axis for collide2(),
+    // kept until the space changes. Infinite geoms, and those much larger
+    // than the average, are kept apart so they don't widen the searches.
+    dArray< QueryEntry > QueryList;
+    dArray< dxGeom* > QueryBigList;
+    dReal QueryMaxExtent;	// largest extent along the first axis in QueryList
+    bool QueryListValid;
+    int QueryCalls;	// collide2() calls since the space changed
+};
+
+// --------------------------------------------------------------------------
+//  Incremental SAP space code
+// --------------------------------------------------------------------------
+
+/*
+*  The incremental SAP space keeps the AABB endpoints of its geoms sorted
+*  along the first two axes of the axis order, as well as the set of pairs
+*  that overlap along both, across the collide calls. Dirty geoms move their
+*  endpoints with insertion sort and each swap of a minimum with a maximum
+*  endpoint adds or removes the pair of their geoms. The third axis is only
+*  tested when the pairs are reported, so that geoms moving along it (e.g.
+*  resting on the ground) don't churn the pairs. When the geoms move so far
+*  that the swaps would cost more than sorting, the lists are rebuilt.
+*  Geoms with infinite AABBs are kept out of the sorted lists and query them
+*  instead.
+*/
+
+//! The set of overlapping pairs of proxies, hashed for lookup and kept
+//! contiguous for iteration
+class dxSAPPairSet
+{
+public:
+    struct Pair
+    {
+        uint32 id0;	//!< Smaller proxy index of the pair
+        uint32 id1;	//!< Larger proxy index of the pair
+    };
+
+    dxSAPPairSet() : mMask( 0 ) {}
+
+    int size() const { return mPairs.size(); }
+    const Pair& operator[]( int i ) const { return mPairs[ i ]; }
+
+    void clear();
+    void add( uint32 id0, uint32 id1 );
+    void remove( uint32 id0, uint32 id1 );
+    void removeAt( int index );
+
+private:
+    static uint32 Hash( uint32 id0, uint32 id1 ) { return ( id0 * 0x9E3779B1U ) ^ ( id1 * 0x85EBCA77U ); }
+    int FindSlot( uint32 id0, uint32 id1 ) const;
+    int FindSlotOfIndex( int index ) const;
+    void FreeSlot( uint32 slot );
+    void Grow();
+
+    dArray< Pair > mPairs;
+    dArray< uint32 > mTable;	// pair index + 1 for every slot, 0 if empty
+    uint32 mMask;
+};
+
+struct dxSAPIncrementalSpace : public dxSpace
+{
+    // Constructor / Destructor
+    dxSAPIncrementalSpace( dSpaceID _space, int axisorder );
+    ~dxSAPIncrementalSpace();
+
+    // dxSpace
+    virtual void add(dxGeom* g);
+    virtual void remove(dxGeom* g);
+    // computeAABB() is dxSpace's union of the geoms, which are all in its list
+    virtual void cleanGeoms();
+    virtual void collide( void *data, dNearCallback *callback );
+    virtual void collide2( void *data, dxGeom *geom, dNearCallback *callback );
+    virtual int prepareCollideParallel();
+    virtual void collideParallelItems( int begin, int end, void *data, dNearCallback *callback );
+
+private:
+
+    //--------------------------------------------------------------------------
+    // Local Declarations
+    //--------------------------------------------------------------------------
+
+    enum
+    {
+        PROXY_FREE,		//!< Unused
+        PROXY_NEW,		//!< Not placed yet
+        PROXY_SORTED,	//!< Endpoints in the sorted lists
+        PROXY_INFINITE,	//!< Infinite AABB, in InfList
+        PROXY_REMOVED	//!< Geom removed, endpoints not dropped yet
+    };
+
+    //! Space data of a geom
+    struct Proxy
+    {
+        dxGeom* geom;
+        dReal bounds[6];	//!< AABB the endpoints are sorted by
+        uint32 pos[4];	//!< Endpoint positions in the sorted lists: min/max of each sorted axis
+        uint32 state;
+        uint32 listIdx;	//!< Index into InfList, or into the active list while rebuilding
+    };
+
+    //! An AABB open in the sweep, with its bounds along the second sorted axis
+    struct ActiveProxy
+    {
+        dReal min1;
+        dReal max1;
+        uint32 idx;
+    };
+
+    //! An AABB endpoint along one axis
+    struct Endpoint
+    {
+        dReal value;
+        uint32 data;	//!< Proxy index * 2, plus 1 for a maximum
+    };
+
+    //--------------------------------------------------------------------------
+    // Helpers
+    //--------------------------------------------------------------------------
+
+    // Endpoints are ordered by value, with minimums before maximums of the
+    // same value, so that touching AABBs overlap
+    static bool EndpointLess( const Endpoint& e0, const Endpoint& e1 )
+    {
+        return e0.value < e1.value || ( e0.value == e1.value && ( e0.data & 1 ) < ( e1.data & 1 ) );
+    }
+    struct EndpointOrder
+    {
+        bool operator()( const Endpoint& e0, const Endpoint& e1 ) const { return EndpointLess( e0, e1 ); }
+    };
+    static bool EndpointValueLess( const Endpoint& e, dReal value ) { return e.value < value; }
+    static bool ValueEndpointLess( dReal value, const Endpoint& e ) { return value < e.value; }
+
+    uint32 AllocateProxy( dxGeom* g );
+    void UnlistInfinite( uint32 idx );
+    void UpdateProxy( uint32 idx, bool sort );
+    void InsertProxy( uint32 idx );
+    void SortEndpoint( int axis, uint32 pos );
+    void DropUnsortedProxies();
+    void Rebuild();
+    bool SortedOverlap( const dReal* b0, const dReal* b1 ) const;
+    void CollideBounds( const dReal* bounds, dxGeom* geom, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters );
+
+    //--------------------------------------------------------------------------
+    // Implementation Data
+    //--------------------------------------------------------------------------
+
+    dArray< Proxy > Proxies;
+    dArray< uint32 > FreeProxies;	// indices of unused proxies
+    dArray< uint32 > InfList;		// proxies with infinite AABBs
+    dArray< uint32 > TmpList;		// dirty proxies in cleanGeoms()
+    dArray< ActiveProxy > ActiveList;	// open AABBs of the sweep in Rebuild()
+
+    dArray< Endpoint > Endpoints[2];	// sorted endpoints of each sorted axis
+    dReal MaxExtent[2];	// largest AABB size along each sorted axis, never shrinks until a rebuild
+
+    dxSAPPairSet Pairs;	// pairs of sorted proxies overlapping along both sorted axes
+
+    uint32 SortedCount;	// number of sorted proxies
+    bool DropRequired;	// some proxies left the sorted lists
+    uint32 SwapCount;	// endpoint swaps made by the last update, or the rebuild estimate of them
+    dReal SwapsPerUpdate;	// swaps per moved proxy seen by the last update
+
+    // Sorted axes, the pairs are found along the first one when rebuilding,
+    // and the unsorted one. Stored *2, as indices into the AABB.
+    uint32 sortedidx[2];
+    uint32 ax2idx;
 };
 
 // Creation
 dSpaceID dSweepAndPruneSpaceCreate( dxSpace* space, int axisorder ) {
+    if ( axisorder & dSAP_INCREMENTAL )
+        return new dxSAPIncrementalSpace( space, axisorder );
     return new dxSAPSpace( space, axisorder );
 }
 
@@ -226,12 +403,17 @@ dSpaceID dSweepAndPruneSpaceCreate( dxSpace* space, int axisorder ) {
 #define GEOM_GET_GEOM_IDX(g) ((int)(size_t)(g)->tome_ex)
 #define GEOM_INVALID_IDX (-1)
 
+// Geoms longer along the first axis than this many times the average are
+// tested by every collide2() call rather than kept in the sorted query list
+#define dxSAP_QUERY_BIG_EXTENT REAL(16.0)
+
 
 /*
 *  A bit of repetitive work - similar to collideAABBs, but doesn't check
 *  if AABBs intersect (because SAP returns pairs with overlapping AABBs).
+*  The callers count the AABB tests.
 */
-static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallback *callback )
+static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
 {
     dIASSERT( (g1->gflags & GEOM_AABB_BAD)==0 );
     dIASSERT( (g2->gflags & GEOM_AABB_BAD)==0 );
@@ -254,6 +436,7 @@ static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallba
     if (g2->AABBTest (g1,bounds1) == 0) return;
 
     // the objects might actually intersect - call the space callback function
+    counters.near_callbacks++;
     callback (data,g1,g2);
 }
 
@@ -273,6 +456,12 @@ dxSAPSpace::dxSAPSpace( dSpaceID _space, int axisorder ) : dxSpace( _space )
     ax0idx = ( ( axisorder ) & 3 ) << 1;
     ax1idx = ( ( axisorder >> 2 ) & 3 ) << 1;
     ax2idx = ( ( axisorder >> 4 ) & 3 ) << 1;
+
+    SortedList = NULL;
+
+    QueryMaxExtent = 0;
+    QueryListValid = false;
+    QueryCalls = 0;
 }
 
 dxSAPSpace::~dxSAPSpace()
@@ -346,6 +535,12 @@ void dxSAPSpace::remove( dxGeom* g )
         GEOM_SET_GEOM_IDX(g,GEOM_INVALID_IDX);
         GeomList.setSize( geomSize-1 );
     }
+    QueryListValid = false;
+    QueryCalls = 0;
+    // the list index left above is -1, not 0, and add() would take the geom
+    // for one that is still in a space
+    g->next_ex = 0;
+    g->tome_ex = 0;
 
     dxSpace::remove(g);
 }
@@ -391,6 +586,9 @@ void dxSAPSpace::cleanGeoms()
     // remove from dirty list, place into geom list
     lock_count++;
 
+    QueryListValid = false;
+    QueryCalls = 0;
+
     int geomSize = GeomList.size();
     GeomList.setSize( geomSize + dirtySize ); // ensure space in geom list
 
@@ -418,6 +616,17 @@ void dxSAPSpace::collide( void *data, dNearCallback *callback )
 
     lock_count++;
 
+    int itemCount = prepareCollideParallel();
+    collideParallelItems( 0, itemCount, data, callback );
+
+    lock_count--;
+}
+
+// Work items are the positions of the sorted list of normal AABBs, followed
+// by the infinite AABBs. The item of an infinite AABB collides it with the
+// infinite ones after it and with all the normal ones.
+int dxSAPSpace::prepareCollideParallel()
+{
     cleanGeoms();
 
     // by now all geoms are in GeomList, and DirtyList must be empty
@@ -439,121 +648,896 @@ void dxSAPSpace::collide( void *data, dNearCallback *callback )
             TmpGeomList.push( g );
     }
 
-    // do SAP on normal AABBs
-    dArray< Pair > overlapBoxes;
+    // sort normal AABBs along the primary axis
     int tmp_geom_count = TmpGeomList.size();
     if ( tmp_geom_count > 0 )
     {
         // Size the poslist (+1 for infinity end cap)
         poslist.setSize( tmp_geom_count + 1 );
 
-        // Generate a list of overlapping boxes
-        BoxPruning( tmp_geom_count, (const dxGeom**)TmpGeomList.data(), overlapBoxes );
-    }
+        //  NOTE: uses floats instead of dReals because that's what radix sort wants.
+        //  The positions are clamped to the end cap, and the sort is stable,
+        //  so the end cap is always last.
+        for( int i = 0; i < tmp_geom_count; ++i ) {
+            const dReal amin = TmpGeomList[i]->aabb[ ax0idx ];
+            poslist[ i ] = amin < (dReal)FLT_MAX ? (float)amin : FLT_MAX;
+        }
+        poslist[ tmp_geom_count ] = FLT_MAX;
 
-    // collide overlapping
-    int overlapCount = overlapBoxes.size();
-    for( int j = 0; j < overlapCount; ++j )
-    {
-        const Pair& pair = overlapBoxes[ j ];
-        dxGeom* g1 = TmpGeomList[ pair.id0 ];
-        dxGeom* g2 = TmpGeomList[ pair.id1 ];
-        collideGeomsNoAABBs( g1, g2, data, callback );
+        SortedList = sortContext.RadixSort( poslist.data(), tmp_geom_count + 1 );
+        dIASSERT( SortedList[ tmp_geom_count ] == (uint32)tmp_geom_count );
     }
 
-    int infSize = TmpInfGeomList.size();
+    return tmp_geom_count + TmpInfGeomList.size();
+}
+
+void dxSAPSpace::collideParallelItems( int begin, int end, void *data, dNearCallback *callback )
+{
     int normSize = TmpGeomList.size();
+    dxSpaceCollideCounters counters;
+
+    // do SAP on normal AABBs
+    if ( begin < normSize )
+        BoxPruning( begin, dMIN( end, normSize ), data, callback, counters );
+
+    int infSize = TmpInfGeomList.size();
     int m, n;
 
-    for ( m = 0; m < infSize; ++m )
+    for ( m = dMAX( begin - normSize, 0 ); m < end - normSize; ++m )
     {
         dxGeom* g1 = TmpInfGeomList[ m ];
 
         // collide infinite ones
         for( n = m+1; n < infSize; ++n ) {
             dxGeom* g2 = TmpInfGeomList[n];
-            collideGeomsNoAABBs( g1, g2, data, callback );
+            counters.aabb_tests++;
+            collideGeomsNoAABBs( g1, g2, data, callback, counters );
         }
 
         // collide infinite ones with normal ones
         for( n = 0; n < normSize; ++n ) {
             dxGeom* g2 = TmpGeomList[n];
-            collideGeomsNoAABBs( g1, g2, data, callback );
+            counters.aabb_tests++;
+            collideGeomsNoAABBs( g1, g2, data, callback, counters );
         }
     }
-
-    lock_count--;
 }
 
+// A single collide2() call after the space changed tests all the geoms, as
+// sorting them would cost more. Calls repeated until the space changes use
+// the sorted query list, and only test the geoms whose minimums along the
+// first axis are within the bounds of the geom, widened by the largest extent.
 void dxSAPSpace::collide2( void *data, dxGeom *geom, dNearCallback *callback )
 {
     dAASSERT (geom && callback);
 
-    // TODO: This is just a simple N^2 implementation
-
     lock_count++;
 
     cleanGeoms();
     geom->recomputeAABB();
 
-    // intersect bounding boxes
+    dxSpaceCollideCounters counters;
+
+    if ( !QueryListValid && QueryCalls++ == 0 ) {
+        // intersect bounding boxes
+        int geom_count = GeomList.size();
+        for ( int i = 0; i < geom_count; ++i ) {
+            dxGeom* g = GeomList[i];
+            if ( GEOM_ENABLED(g) )
+                collideAABBs (g,geom,data,callback,counters);
+        }
+    }
+    else {
+        if ( !QueryListValid )
+            BuildQueryList();
+
+        int bigCount = QueryBigList.size();
+        for ( int i = 0; i < bigCount; ++i ) {
+            dxGeom* g = QueryBigList[i];
+            if ( GEOM_ENABLED(g) )
+                collideAABBs (g,geom,data,callback,counters);
+        }
+
+        const QueryEntry* queryBegin = QueryList.data();
+        const QueryEntry* queryEnd = queryBegin + QueryList.size();
+        dReal lo = geom->aabb[ ax0idx ] - QueryMaxExtent;
+        dReal hi = geom->aabb[ ax0idx + 1 ];
+        if ( lo != -dInfinity )
+            queryBegin = std::lower_bound( queryBegin, queryEnd, lo, QueryEntryValueLess );
+        if ( hi != dInfinity )
+            queryEnd = std::upper_bound( queryBegin, queryEnd, hi, QueryValueEntryLess );
+
+        for ( const QueryEntry* e = queryBegin; e < queryEnd; ++e ) {
+            dxGeom* g = e->geom;
+            if ( GEOM_ENABLED(g) )
+                collideAABBs (g,geom,data,callback,counters);
+        }
+    }
+
+    lock_count--;
+}
+
+void dxSAPSpace::BuildQueryList()
+{
+    QueryList.setSize( 0 );
+    QueryBigList.setSize( 0 );
+
     int geom_count = GeomList.size();
+    dReal extentSum = 0;
+    int finiteCount = 0;
+    for ( int i = 0; i < geom_count; ++i ) {
+        const dReal* aabb = GeomList[i]->aabb;
+        if ( aabb[ ax0idx ] != -dInfinity && aabb[ ax0idx + 1 ] != dInfinity ) {
+            extentSum += aabb[ ax0idx + 1 ] - aabb[ ax0idx ];
+            finiteCount++;
+        }
+    }
+
+    const dReal bigExtent = finiteCount ? extentSum / finiteCount * dxSAP_QUERY_BIG_EXTENT : 0;
+    QueryMaxExtent = 0;
     for ( int i = 0; i < geom_count; ++i ) {
         dxGeom* g = GeomList[i];
-        if ( GEOM_ENABLED(g) )
-            collideAABBs (g,geom,data,callback);
+        const dReal* aabb = g->aabb;
+        if ( aabb[ ax0idx ] == -dInfinity || aabb[ ax0idx + 1 ] == dInfinity ||
+            aabb[ ax0idx + 1 ] - aabb[ ax0idx ] > bigExtent ) {
+            QueryBigList.push( g );
+        }
+        else {
+            QueryEntry e;
+            e.min = aabb[ ax0idx ];
+            e.geom = g;
+            QueryList.push( e );
+            QueryMaxExtent = dMAX( QueryMaxExtent, aabb[ ax0idx + 1 ] - aabb[ ax0idx ] );
+        }
+    }
+
+    std::sort( QueryList.data(), QueryList.data() + QueryList.size(), QueryEntryLess );
+    QueryListValid = true;
+}
+
+
+void dxSAPSpace::BoxPruning( int begin, int end, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
+{
+    // The sorted list ends with the end cap, so every scan stops at the end
+    // of the list at the latest.
+    const dxGeom* const* geoms = (const dxGeom* const*)TmpGeomList.data();
+    const uint32* const Sorted = SortedList;
+    const uint32 EndCap = (uint32)TmpGeomList.size();
+
+    for ( int i = begin; i < end; ++i )
+    {
+        const uint32 id0 = Sorted[ i ];
+        const dReal* aabb0 = geoms[ id0 ]->aabb;
+
+        const dReal idx0ax0max = aabb0[ax0idx+1];
+        const dReal idx0ax1max = aabb0[ax1idx+1];
+        const dReal idx0ax2max = aabb0[ax2idx+1];
+
+        // The boxes that start at or after this one along the primary axis
+        // and before it ends
+        uint32 id1;
+        for ( const uint32* RunningAddress = Sorted + i + 1; 
+              ( id1 = *RunningAddress ) != EndCap && poslist[ id1 ] <= idx0ax0max; 
+              ++RunningAddress )
+        {
+            const dReal* aabb1 = geoms[ id1 ]->aabb;
+
+            // Intersection?
+            counters.aabb_tests++;
+            if ( idx0ax1max >= aabb1[ax1idx] && aabb1[ax1idx+1] >= aabb0[ax1idx] )
+                if ( idx0ax2max >= aabb1[ax2idx] && aabb1[ax2idx+1] >= aabb0[ax2idx] )
+                {
+                    collideGeomsNoAABBs( (dxGeom*)geoms[ id0 ], (dxGeom*)geoms[ id1 ], data, callback, counters );
+                }
+        }
     }
+}
+
+
+//==============================================================================
+//  Incremental SAP space
+//==============================================================================
+
+// HACK: the proxy index is kept in the 'next_ex' member of dxGeom, plus one
+// so that zero means no proxy
+#define GEOM_SET_PROXY_IDX(g,idx) { (g)->next_ex = (dxGeom*)(size_t)((idx) + 1); }
+#define GEOM_GET_PROXY_IDX(g) ((uint32)((size_t)(g)->next_ex - 1))
+
+enum
+{
+    dxSAP_INCREMENTAL_INSERT_MAX = 64,	// more new geoms than this are placed with a rebuild
+    dxSAP_INCREMENTAL_SWAP_MAX = 48,		// more expected swaps per sorted geom than this cause a rebuild
+    dxSAP_INCREMENTAL_NO_POS = 0xFFFFFFFF	// endpoint position of a proxy that is not sorted yet
+};
+
+static inline bool BoundsOverlap( const dReal* b0, const dReal* b1 )
+{
+    return b0[0] <= b1[1] && b1[0] <= b0[1] &&
+        b0[2] <= b1[3] && b1[2] <= b0[3] &&
+        b0[4] <= b1[5] && b1[4] <= b0[5];
+}
+
+static inline bool BoundsInfinite( const dReal* b )
+{
+    for ( int i = 0; i < 6; ++i )
+        if ( b[i] == dInfinity || b[i] == -dInfinity )
+            return true;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// Pair set
+//------------------------------------------------------------------------------
+
+void dxSAPPairSet::clear()
+{
+    mPairs.setSize( 0 );
+    if ( mTable.size() )
+        memset( mTable.data(), 0, mTable.size() * sizeof( uint32 ) );
+}
+
+int dxSAPPairSet::FindSlot( uint32 id0, uint32 id1 ) const
+{
+    if ( !mTable.size() )
+        return -1;
+
+    for ( uint32 slot = Hash( id0, id1 ) & mMask; mTable[ slot ] != 0; slot = ( slot + 1 ) & mMask ) {
+        const Pair& pair = mPairs[ mTable[ slot ] - 1 ];
+        if ( pair.id0 == id0 && pair.id1 == id1 )
+            return (int)slot;
+    }
+    return -1;
+}
+
+int dxSAPPairSet::FindSlotOfIndex( int index ) const
+{
+    const Pair& pair = mPairs[ index ];
+    uint32 slot = Hash( pair.id0, pair.id1 ) & mMask;
+    while ( mTable[ slot ] != (uint32)index + 1 )
+        slot = ( slot + 1 ) & mMask;
+    return (int)slot;
+}
+
+void dxSAPPairSet::add( uint32 id0, uint32 id1 )
+{
+    if ( id0 > id1 ) { uint32 tmp = id0; id0 = id1; id1 = tmp; }
+
+    // keep the table at most half full
+    if ( ( mPairs.size() + 1 ) * 2 > mTable.size() )
+        Grow();
+
+    uint32 slot = Hash( id0, id1 ) & mMask;
+    for ( ; mTable[ slot ] != 0; slot = ( slot + 1 ) & mMask ) {
+        const Pair& pair = mPairs[ mTable[ slot ] - 1 ];
+        if ( pair.id0 == id0 && pair.id1 == id1 )
+            return;
+    }
+
+    Pair pair;
+    pair.id0 = id0;
+    pair.id1 = id1;
+    mPairs.push( pair );
+    mTable[ slot ] = mPairs.size();
+}
+
+void dxSAPPairSet::remove( uint32 id0, uint32 id1 )
+{
+    if ( id0 > id1 ) { uint32 tmp = id0; id0 = id1; id1 = tmp; }
+
+    int slot = FindSlot( id0, id1 );
+    if ( slot >= 0 )
+        removeAt( mTable[ slot ] - 1 );
+}
+
+void dxSAPPairSet::removeAt( int index )
+{
+    FreeSlot( FindSlotOfIndex( index ) );
+
+    // move the last pair into the hole
+    int last = mPairs.size() - 1;
+    if ( index != last ) {
+        mTable[ FindSlotOfIndex( last ) ] = index + 1;
+        mPairs[ index ] = mPairs[ last ];
+    }
+    mPairs.setSize( last );
+}
+
+void dxSAPPairSet::FreeSlot( uint32 slot )
+{
+    // shift back the following entries that can't be found past an empty slot
+    uint32 hole = slot;
+    for ( uint32 next = ( hole + 1 ) & mMask; mTable[ next ] != 0; next = ( next + 1 ) & mMask ) {
+        const Pair& pair = mPairs[ mTable[ next ] - 1 ];
+        uint32 home = Hash( pair.id0, pair.id1 ) & mMask;
+        // the entry stays if its home slot is after the hole
+        if ( ( ( next - home ) & mMask ) < ( ( next - hole ) & mMask ) )
+            continue;
+        mTable[ hole ] = mTable[ next ];
+        hole = next;
+    }
+    mTable[ hole ] = 0;
+}
+
+void dxSAPPairSet::Grow()
+{
+    int tableSize = mTable.size() ? mTable.size() * 2 : 64;
+    mTable.setSize( tableSize );
+    memset( mTable.data(), 0, tableSize * sizeof( uint32 ) );
+    mMask = (uint32)tableSize - 1;
+
+    int pairCount = mPairs.size();
+    for ( int i = 0; i < pairCount; ++i ) {
+        uint32 slot = Hash( mPairs[ i ].id0, mPairs[ i ].id1 ) & mMask;
+        while ( mTable[ slot ] != 0 )
+            slot = ( slot + 1 ) & mMask;
+        mTable[ slot ] = i + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Space
+//------------------------------------------------------------------------------
+
+dxSAPIncrementalSpace::dxSAPIncrementalSpace( dSpaceID _space, int axisorder ) : dxSpace( _space )
+{
+    type = dSweepAndPruneSpaceClass;
+
+    // Init AABB to infinity
+    aabb[0] = -dInfinity;
+    aabb[1] = dInfinity;
+    aabb[2] = -dInfinity;
+    aabb[3] = dInfinity;
+    aabb[4] = -dInfinity;
+    aabb[5] = dInfinity;
+
+    for ( int axis = 0; axis < 2; ++axis )
+        MaxExtent[ axis ] = 0;
+
+    SortedCount = 0;
+    DropRequired = false;
+    SwapCount = 0;
+    SwapsPerUpdate = 0;
+
+    sortedidx[0] = ( ( axisorder ) & 3 ) << 1;
+    sortedidx[1] = ( ( axisorder >> 2 ) & 3 ) << 1;
+    ax2idx = ( ( axisorder >> 4 ) & 3 ) << 1;
+}
+
+dxSAPIncrementalSpace::~dxSAPIncrementalSpace()
+{
+    CHECK_NOT_LOCKED(this);
+    // the geoms are removed here, as dxSpace destructor can't call remove() of this class
+    if ( cleanup ) {
+        // note that destroying each geom will call remove()
+        for ( ; first; dGeomDestroy( first ) ) {}
+    }
+    else {
+        for ( ; first; remove( first ) ) {}
+    }
+}
+
+uint32 dxSAPIncrementalSpace::AllocateProxy( dxGeom* g )
+{
+    uint32 idx;
+    int freeCount = FreeProxies.size();
+    if ( freeCount ) {
+        idx = FreeProxies[ freeCount - 1 ];
+        FreeProxies.setSize( freeCount - 1 );
+    }
+    else {
+        idx = Proxies.size();
+        Proxies.setSize( idx + 1 );
+    }
+
+    Proxy& proxy = Proxies[ idx ];
+    proxy.geom = g;
+    proxy.state = PROXY_NEW;
+    return idx;
+}
+
+void dxSAPIncrementalSpace::UnlistInfinite( uint32 idx )
+{
+    uint32 listIdx = Proxies[ idx ].listIdx;
+    uint32 lastIdx = InfList[ InfList.size() - 1 ];
+    InfList[ listIdx ] = lastIdx;
+    Proxies[ lastIdx ].listIdx = listIdx;
+    InfList.setSize( InfList.size() - 1 );
+}
+
+void dxSAPIncrementalSpace::add( dxGeom* g )
+{
+    CHECK_NOT_LOCKED (this);
+    dAASSERT(g);
+    dUASSERT(g->tome_ex == 0 && g->next_ex == 0, "geom is already in a space");
+
+    // the geom is placed by cleanGeoms(), as it is dirty
+    uint32 idx = AllocateProxy( g );
+    GEOM_SET_PROXY_IDX( g, idx );
+
+    dxSpace::add(g);
+}
+
+void dxSAPIncrementalSpace::remove( dxGeom* g )
+{
+    CHECK_NOT_LOCKED(this);
+    dAASSERT(g);
+    dUASSERT(g->parent_space == this,"object is not in this space");
+
+    uint32 idx = GEOM_GET_PROXY_IDX( g );
+    Proxy& proxy = Proxies[ idx ];
+    proxy.geom = 0;
+
+    if ( proxy.state == PROXY_SORTED ) {
+        // the endpoints and the pairs are dropped in the next cleanGeoms()
+        proxy.state = PROXY_REMOVED;
+        SortedCount--;
+        DropRequired = true;
+    }
+    else {
+        if ( proxy.state == PROXY_INFINITE )
+            UnlistInfinite( idx );
+        proxy.state = PROXY_FREE;
+        FreeProxies.push( idx );
+    }
+    g->next_ex = 0;
+
+    dxSpace::remove(g);
+}
+
+void dxSAPIncrementalSpace::cleanGeoms()
+{
+    // compute the AABBs of all dirty geoms, and clear the dirty flags.
+    // the dirty geoms are at the front of the list.
+    lock_count++;
+
+    if ( DropRequired )
+        DropUnsortedProxies();
+
+    TmpList.setSize( 0 );
+    int newCount = 0;
+    for ( dxGeom *g = first; g && ( g->gflags & GEOM_DIRTY ); g = g->next ) {
+        if ( IS_SPACE(g) ) {
+            ((dxSpace*)g)->cleanGeoms();
+        }
+        g->recomputeAABB();
+        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+
+        uint32 idx = GEOM_GET_PROXY_IDX( g );
+        if ( Proxies[ idx ].state == PROXY_NEW )
+            newCount++;
+        TmpList.push( idx );
+    }
+
+    // inserting many geoms one by one, or moving geoms far past many others,
+    // costs more than sorting them all
+    int dirtyCount = TmpList.size();
+    if ( newCount > (int)dxSAP_INCREMENTAL_INSERT_MAX || newCount > (int)SortedCount ||
+        SwapsPerUpdate * dirtyCount > (dReal)dxSAP_INCREMENTAL_SWAP_MAX * SortedCount ) {
+        for ( int i = 0; i < dirtyCount; ++i )
+            UpdateProxy( TmpList[ i ], false );
+        Rebuild();
+        if ( dirtyCount > newCount )
+            SwapsPerUpdate = (dReal)SwapCount / ( dirtyCount - newCount );
+    }
+    else if ( dirtyCount ) {
+        SwapCount = 0;
+        for ( int i = 0; i < dirtyCount; ++i )
+            UpdateProxy( TmpList[ i ], true );
+        if ( dirtyCount > newCount )
+            SwapsPerUpdate = (dReal)SwapCount / ( dirtyCount - newCount );
+    }
+
+    // geoms that got infinite AABBs left their endpoints behind
+    if ( DropRequired )
+        DropUnsortedProxies();
 
     lock_count--;
 }
 
+void dxSAPIncrementalSpace::UpdateProxy( uint32 idx, bool sort )
+{
+    Proxy& proxy = Proxies[ idx ];
+    const dReal* aabb = proxy.geom->aabb;
+
+    if ( BoundsInfinite( aabb ) ) {
+        if ( proxy.state != PROXY_INFINITE ) {
+            if ( proxy.state == PROXY_SORTED ) {
+                SortedCount--;
+                DropRequired = true;
+            }
+            proxy.state = PROXY_INFINITE;
+            proxy.listIdx = InfList.size();
+            InfList.push( idx );
+        }
+        memcpy( proxy.bounds, aabb, sizeof( proxy.bounds ) );
+        return;
+    }
+
+    if ( proxy.state == PROXY_INFINITE ) {
+        UnlistInfinite( idx );
+        proxy.state = PROXY_NEW;
+    }
+
+    memcpy( proxy.bounds, aabb, sizeof( proxy.bounds ) );
+    for ( int axis = 0; axis < 2; ++axis ) {
+        dReal extent = aabb[ sortedidx[ axis ] + 1 ] - aabb[ sortedidx[ axis ] ];
+        if ( extent > MaxExtent[ axis ] )
+            MaxExtent[ axis ] = extent;
+    }
+
+    if ( !sort )
+        return;
+
+    if ( proxy.state == PROXY_NEW ) {
+        // the swaps of the insertion don't tell how far the geoms move
+        uint32 swapCount = SwapCount;
+        InsertProxy( idx );
+        SwapCount = swapCount;
+        return;
+    }
+
+    // move the endpoints that changed, the minimum first
+    for ( int axis = 0; axis < 2; ++axis ) {
+        for ( int i = 0; i < 2; ++i ) {
+            Endpoint& e = Endpoints[ axis ][ proxy.pos[ axis * 2 + i ] ];
+            if ( e.value != aabb[ sortedidx[ axis ] + i ] ) {
+                e.value = aabb[ sortedidx[ axis ] + i ];
+                SortEndpoint( axis, proxy.pos[ axis * 2 + i ] );
+            }
+        }
+    }
+}
+
+void dxSAPIncrementalSpace::InsertProxy( uint32 idx )
+{
+    Proxy& proxy = Proxies[ idx ];
+    proxy.state = PROXY_SORTED;
+    SortedCount++;
+
+    // the endpoints come down from past the end of the lists
+    for ( int axis = 0; axis < 2; ++axis ) {
+        dArray< Endpoint >& ends = Endpoints[ axis ];
+        uint32 pos = ends.size();
+
+        Endpoint e;
+        e.value = proxy.bounds[ sortedidx[ axis ] ];
+        e.data = idx * 2;
+        ends.push( e );
+        e.value = proxy.bounds[ sortedidx[ axis ] + 1 ];
+        e.data = idx * 2 + 1;
+        ends.push( e );
+
+        proxy.pos[ axis * 2 ] = pos;
+        proxy.pos[ axis * 2 + 1 ] = pos + 1;
+        SortEndpoint( axis, pos );
+        SortEndpoint( axis, proxy.pos[ axis * 2 + 1 ] );
+    }
+}
 
-void dxSAPSpace::BoxPruning( int count, const dxGeom** geoms, dArray< Pair >& pairs )
+// Moves the endpoint at the given position to its place in the sorted list.
+// A minimum passing a maximum changes whether the two AABBs overlap along the
+// axis: if they start to, the pair is added when their AABBs overlap along
+// the other sorted axis too, and if they stop to, the pair is removed.
+void dxSAPIncrementalSpace::SortEndpoint( int axis, uint32 pos )
 {
-    // 1) Build main list using the primary axis
-    //  NOTE: uses floats instead of dReals because that's what radix sort wants
-    for( int i = 0; i < count; ++i )
-        poslist[ i ] = (float)TmpGeomList[i]->aabb[ ax0idx ];
-    poslist[ count++ ] = FLT_MAX;
+    Endpoint* const ends = Endpoints[ axis ].data();
+    const uint32 last = Endpoints[ axis ].size() - 1;
+
+    const Endpoint e = ends[ pos ];
+    const uint32 id0 = e.data >> 1;
+    const uint32 max0 = e.data & 1;
+    const dReal* bounds0 = Proxies[ id0 ].bounds;
+    const uint32 start = pos;
+
+    // down: a minimum passing a maximum starts overlapping, a maximum passing
+    // a minimum stops
+    for ( ; pos > 0 && EndpointLess( e, ends[ pos - 1 ] ); --pos ) {
+        const Endpoint f = ends[ pos - 1 ];
+        const uint32 id1 = f.data >> 1;
+        Proxy& proxy1 = Proxies[ id1 ];
+
+        if ( ( f.data & 1 ) != max0 && id1 != id0 && proxy1.state == PROXY_SORTED ) {
+            if ( !max0 ) {
+                if ( SortedOverlap( bounds0, proxy1.bounds ) )
+                    Pairs.add( id0, id1 );
+            }
+            else
+                Pairs.remove( id0, id1 );
+        }
 
-    // 2) Sort the list
-    const uint32* Sorted = sortContext.RadixSort( poslist.data(), count );
+        ends[ pos ] = f;
+        proxy1.pos[ axis * 2 + ( f.data & 1 ) ] = pos;
+    }
 
-    // 3) Prune the list
-    const uint32* const LastSorted = Sorted + count;
-    const uint32* RunningAddress = Sorted;
+    // up: the other way round
+    for ( ; pos < last && EndpointLess( ends[ pos + 1 ], e ); ++pos ) {
+        const Endpoint f = ends[ pos + 1 ];
+        const uint32 id1 = f.data >> 1;
+        Proxy& proxy1 = Proxies[ id1 ];
 
-    Pair IndexPair;
-    while ( RunningAddress < LastSorted && Sorted < LastSorted )
-    {
-        IndexPair.id0 = *Sorted++;
+        if ( ( f.data & 1 ) != max0 && id1 != id0 && proxy1.state == PROXY_SORTED ) {
+            if ( max0 ) {
+                if ( SortedOverlap( bounds0, proxy1.bounds ) )
+                    Pairs.add( id0, id1 );
+            }
+            else
+                Pairs.remove( id0, id1 );
+        }
 
-        // empty, this loop just advances RunningAddress
-        while ( poslist[*RunningAddress++] < poslist[IndexPair.id0] ) {}
+        ends[ pos ] = f;
+        proxy1.pos[ axis * 2 + ( f.data & 1 ) ] = pos;
+    }
 
-        if ( RunningAddress < LastSorted )
-        {
-            const uint32* RunningAddress2 = RunningAddress;
+    ends[ pos ] = e;
+    Proxies[ id0 ].pos[ axis * 2 + max0 ] = pos;
+    SwapCount += pos > start ? pos - start : start - pos;
+}
 
-            const dReal idx0ax0max = geoms[IndexPair.id0]->aabb[ax0idx+1];
-            const dReal idx0ax1max = geoms[IndexPair.id0]->aabb[ax1idx+1];
-            const dReal idx0ax2max = geoms[IndexPair.id0]->aabb[ax2idx+1];
+// Drops the pairs and the endpoints of the proxies that are not sorted anymore
+void dxSAPIncrementalSpace::DropUnsortedProxies()
+{
+    for ( int i = 0; i < Pairs.size(); ) {
+        const dxSAPPairSet::Pair& pair = Pairs[ i ];
+        if ( Proxies[ pair.id0 ].state != PROXY_SORTED || Proxies[ pair.id1 ].state != PROXY_SORTED )
+            Pairs.removeAt( i );
+        else
+            ++i;
+    }
 
-            while ( poslist[ IndexPair.id1 = *RunningAddress2++ ] <= idx0ax0max )
-            {
-                const dReal* aabb0 = geoms[ IndexPair.id0 ]->aabb;
-                const dReal* aabb1 = geoms[ IndexPair.id1 ]->aabb;
+    for ( int axis = 0; axis < 2; ++axis ) {
+        dArray< Endpoint >& ends = Endpoints[ axis ];
+        int count = ends.size();
+        int kept = 0;
+        for ( int i = 0; i < count; ++i ) {
+            const Endpoint e = ends[ i ];
+            Proxy& proxy = Proxies[ e.data >> 1 ];
+            if ( proxy.state == PROXY_SORTED ) {
+                proxy.pos[ axis * 2 + ( e.data & 1 ) ] = kept;
+                ends[ kept++ ] = e;
+            }
+        }
+        ends.setSize( kept );
+    }
 
-                // Intersection?
-                if ( idx0ax1max >= aabb1[ax1idx] && aabb1[ax1idx+1] >= aabb0[ax1idx] )
-                    if ( idx0ax2max >= aabb1[ax2idx] && aabb1[ax2idx+1] >= aabb0[ax2idx] )
-                    {
-                        pairs.push( IndexPair );
-                    }
+    // the proxies of removed geoms can be reused now
+    int proxyCount = Proxies.size();
+    for ( int idx = 0; idx < proxyCount; ++idx ) {
+        if ( Proxies[ idx ].state == PROXY_REMOVED ) {
+            Proxies[ idx ].state = PROXY_FREE;
+            FreeProxies.push( idx );
+        }
+    }
+
+    DropRequired = false;
+}
+
+// Sorts the endpoints of all the proxies from scratch and finds the pairs
+// with a single sweep along the first sorted axis. How far the endpoints
+// moved in the lists is counted as the swaps an incremental update would
+// have made.
+void dxSAPIncrementalSpace::Rebuild()
+{
+    for ( int axis = 0; axis < 2; ++axis ) {
+        Endpoints[ axis ].setSize( 0 );
+        MaxExtent[ axis ] = 0;
+    }
+    Pairs.clear();
+    SortedCount = 0;
+    SwapCount = 0;
+
+    int proxyCount = Proxies.size();
+    for ( int idx = 0; idx < proxyCount; ++idx ) {
+        Proxy& proxy = Proxies[ idx ];
+        if ( proxy.state == PROXY_REMOVED ) {
+            proxy.state = PROXY_FREE;
+            FreeProxies.push( idx );
+            continue;
+        }
+        if ( proxy.state == PROXY_NEW ) {
+            proxy.state = PROXY_SORTED;
+            for ( int i = 0; i < 4; ++i )
+                proxy.pos[ i ] = dxSAP_INCREMENTAL_NO_POS;
+        }
+        if ( proxy.state != PROXY_SORTED )
+            continue;
+
+        SortedCount++;
+        for ( int axis = 0; axis < 2; ++axis ) {
+            Endpoint e;
+            e.value = proxy.bounds[ sortedidx[ axis ] ];
+            e.data = idx * 2;
+            Endpoints[ axis ].push( e );
+            e.value = proxy.bounds[ sortedidx[ axis ] + 1 ];
+            e.data = idx * 2 + 1;
+            Endpoints[ axis ].push( e );
+
+            dReal extent = e.value - proxy.bounds[ sortedidx[ axis ] ];
+            if ( extent > MaxExtent[ axis ] )
+                MaxExtent[ axis ] = extent;
+        }
+    }
+
+    for ( int axis = 0; axis < 2; ++axis ) {
+        Endpoint* ends = Endpoints[ axis ].data();
+        int count = Endpoints[ axis ].size();
+        std::sort( ends, ends + count, EndpointOrder() );
+        for ( int i = 0; i < count; ++i ) {
+            uint32& pos = Proxies[ ends[ i ].data >> 1 ].pos[ axis * 2 + ( ends[ i ].data & 1 ) ];
+            if ( pos != dxSAP_INCREMENTAL_NO_POS )
+                SwapCount += pos > (uint32)i ? pos - i : i - pos;
+            pos = i;
+        }
+    }
+
+    // every AABB is tested against the ones that are open when it starts,
+    // which only need to be compared along the second sorted axis
+    const Endpoint* ends = Endpoints[ 0 ].data();
+    int count = Endpoints[ 0 ].size();
+    const uint32 ax1idx = sortedidx[1];
+
+    ActiveList.setSize( 0 );
+    for ( int i = 0; i < count; ++i ) {
+        const uint32 idx = ends[ i ].data >> 1;
+        Proxy& proxy = Proxies[ idx ];
+
+        if ( !( ends[ i ].data & 1 ) ) {
+            const dReal min1 = proxy.bounds[ ax1idx ];
+            const dReal max1 = proxy.bounds[ ax1idx + 1 ];
+            const ActiveProxy* active = ActiveList.data();
+            int activeCount = ActiveList.size();
+            for ( int j = 0; j < activeCount; ++j ) {
+                if ( min1 <= active[ j ].max1 && active[ j ].min1 <= max1 )
+                    Pairs.add( idx, active[ j ].idx );
             }
+
+            ActiveProxy a;
+            a.min1 = min1;
+            a.max1 = max1;
+            a.idx = idx;
+            proxy.listIdx = activeCount;
+            ActiveList.push( a );
+        }
+        else {
+            const ActiveProxy& last = ActiveList[ ActiveList.size() - 1 ];
+            Proxies[ last.idx ].listIdx = proxy.listIdx;
+            ActiveList[ proxy.listIdx ] = last;
+            ActiveList.setSize( ActiveList.size() - 1 );
         }
+    }
+
+    DropRequired = false;
+}
+
+void dxSAPIncrementalSpace::collide( void *data, dNearCallback *callback )
+{
+    dAASSERT (callback);
+
+    lock_count++;
+
+    int itemCount = prepareCollideParallel();
+    collideParallelItems( 0, itemCount, data, callback );
 
-    }; // while ( RunningAddress < LastSorted && Sorted < LastSorted )
+    lock_count--;
+}
+
+// Work items are the overlapping pairs, followed by the infinite AABBs.
+// The item of an infinite AABB collides it with the infinite ones after it
+// and queries the sorted ones.
+int dxSAPIncrementalSpace::prepareCollideParallel()
+{
+    cleanGeoms();
+
+    return Pairs.size() + InfList.size();
+}
+
+void dxSAPIncrementalSpace::collideParallelItems( int begin, int end, void *data, dNearCallback *callback )
+{
+    int pairCount = Pairs.size();
+    int pairEnd = dMIN( end, pairCount );
+    dxSpaceCollideCounters counters;
+
+    for ( int i = begin; i < pairEnd; ++i ) {
+        const dxSAPPairSet::Pair& pair = Pairs[ i ];
+        const Proxy& proxy1 = Proxies[ pair.id0 ];
+        const Proxy& proxy2 = Proxies[ pair.id1 ];
+
+        // the pairs overlap along the sorted axes only
+        counters.aabb_tests++;
+        if ( proxy1.bounds[ ax2idx ] > proxy2.bounds[ ax2idx + 1 ] ||
+            proxy2.bounds[ ax2idx ] > proxy1.bounds[ ax2idx + 1 ] )
+            continue;
+
+        dxGeom* g1 = proxy1.geom;
+        dxGeom* g2 = proxy2.geom;
+        if ( GEOM_ENABLED(g1) && GEOM_ENABLED(g2) )
+            collideGeomsNoAABBs( g1, g2, data, callback, counters );
+    }
+
+    int infSize = InfList.size();
+
+    for ( int m = dMAX( begin - pairCount, 0 ); m < end - pairCount; ++m ) {
+        dxGeom* g1 = Proxies[ InfList[ m ] ].geom;
+        if ( !GEOM_ENABLED(g1) )
+            continue;
+
+        // collide infinite ones
+        for ( int n = m + 1; n < infSize; ++n ) {
+            dxGeom* g2 = Proxies[ InfList[ n ] ].geom;
+            if ( GEOM_ENABLED(g2) )
+                collideAABBs( g1, g2, data, callback, counters );
+        }
+
+        // collide infinite ones with normal ones
+        CollideBounds( g1->aabb, g1, data, callback, counters );
+    }
+}
+
+bool dxSAPIncrementalSpace::SortedOverlap( const dReal* b0, const dReal* b1 ) const
+{
+    const uint32 i0 = sortedidx[0];
+    const uint32 i1 = sortedidx[1];
+    return b0[i0] <= b1[i0+1] && b1[i0] <= b0[i0+1] &&
+        b0[i1] <= b1[i1+1] && b1[i1] <= b0[i1+1];
+}
+
+// Reports the enabled sorted geoms whose AABBs overlap the given bounds.
+// The candidates are the minimums along the sorted axis where there are the
+// fewest of them from the lower bound less the largest extent to the upper
+// bound.
+void dxSAPIncrementalSpace::CollideBounds( const dReal* bounds, dxGeom* geom, void *data, dNearCallback *callback, dxSpaceCollideCounters& counters )
+{
+    const Endpoint* bestBegin = Endpoints[ 0 ].data();
+    const Endpoint* bestEnd = bestBegin + Endpoints[ 0 ].size();
+
+    for ( int axis = 0; axis < 2; ++axis ) {
+        const Endpoint* axisBegin = Endpoints[ axis ].data();
+        const Endpoint* axisEnd = axisBegin + Endpoints[ axis ].size();
+
+        dReal lo = bounds[ sortedidx[ axis ] ] - MaxExtent[ axis ];
+        dReal hi = bounds[ sortedidx[ axis ] + 1 ];
+        if ( lo != -dInfinity )
+            axisBegin = std::lower_bound( axisBegin, axisEnd, lo, EndpointValueLess );
+        if ( hi != dInfinity )
+            axisEnd = std::upper_bound( axisBegin, axisEnd, hi, ValueEndpointLess );
+
+        if ( axisEnd - axisBegin < bestEnd - bestBegin ) {
+            bestBegin = axisBegin;
+            bestEnd = axisEnd;
+        }
+    }
+
+    for ( const Endpoint* e = bestBegin; e < bestEnd; ++e ) {
+        if ( e->data & 1 )
+            continue;
+
+        const Proxy& proxy = Proxies[ e->data >> 1 ];
+        counters.aabb_tests++;
+        if ( BoundsOverlap( bounds, proxy.bounds ) && GEOM_ENABLED(proxy.geom) )
+            collideGeomsNoAABBs( proxy.geom, geom, data, callback, counters );
+    }
+}
+
+void dxSAPIncrementalSpace::collide2( void *data, dxGeom *geom, dNearCallback *callback )
+{
+    dAASSERT (geom && callback);
+
+    lock_count++;
+
+    cleanGeoms();
+    geom->recomputeAABB();
+
+    // infinite AABBs are all tested, the sorted ones are found by the query
+    dxSpaceCollideCounters counters;
+    int infSize = InfList.size();
+    for ( int i = 0; i < infSize; ++i ) {
+        dxGeom* g = Proxies[ InfList[ i ] ].geom;
+        if ( GEOM_ENABLED(g) )
+            collideAABBs( g, geom, data, callback, counters );
+    }
+
+    CollideBounds( geom->aabb, geom, data, callback, counters );
+
+    lock_count--;
 }
 
 
@@ -31,16 +31,23 @@ spaces
 #include <ode/common.h>
 #include <ode/collision_space.h>
 #include <ode/collision.h>
+#include <ode/odemath.h>
+#include <ode/threading_impl.h>
 #include "config.h"
 #include "matrix.h"
 #include "collision_kernel.h"
 #include "collision_space_internal.h"
 #include "util.h"
+#include "threading_base.h"
+#include "threadingutils.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable:4291)  // for VC++, no complaints about "no matching operator delete found"
 #endif
 
+#define dMIN(A,B)  ((A)>(B) ? (B) : (A))
+#define dMAX(A,B)  ((B)>(A) ? (B) : (A))
+
 //****************************************************************************
 // make the geom dirty by setting the GEOM_DIRTY and GEOM_BAD_AABB flags
 // and moving it to the front of the space's list. all the parents of a
@@ -214,14 +221,47 @@ void dxSpace::dirty (dxGeom *geom)
     geom->spaceAdd (&first);
 }
 
+
+int dxSpace::prepareCollideParallel()
+{
+    return 1;
+}
+
+
+void dxSpace::collideParallelItems (int begin, int end, void *data,
+                                    dNearCallback *callback)
+{
+    if (begin < end) {
+        collide (data,callback);
+    }
+}
+
+
+dReal dxSpace::raycast (const dReal *origin, const dReal *dir, dReal length,
+                        void *data, dxRaycastCallback *callback)
+{
+    dReal inv_dir[3], entry;
+    rayInverseDirection (dir,inv_dir);
+    for (dxGeom *g=first; g; g=g->next) {
+        if (GEOM_ENABLED(g) && segmentHitsAABB (origin,dir,inv_dir,length,g->aabb,&entry)) {
+            length = callback (data,g,length);
+        }
+    }
+    return length;
+}
+
 //****************************************************************************
 // simple space - reports all n^2 object intersections
 
 struct dxSimpleSpace : public dxSpace {
+    std::vector<dxGeom*> collide_geoms;	// enabled geoms, for the parallel pair search
+
     dxSimpleSpace (dSpaceID _space);
     void cleanGeoms();
     void collide (void *data, dNearCallback *callback);
     void collide2 (void *data, dxGeom *geom, dNearCallback *callback);
+    int prepareCollideParallel();
+    void collideParallelItems (int begin, int end, void *data, dNearCallback *callback);
 };
 
 
@@ -254,11 +294,12 @@ void dxSimpleSpace::collide (void *data, dNearCallback *callback)
     cleanGeoms();
 
     // intersect all bounding boxes
+    dxSpaceCollideCounters counters;
     for (dxGeom *g1=first; g1; g1=g1->next) {
         if (GEOM_ENABLED(g1)){
             for (dxGeom *g2=g1->next; g2; g2=g2->next) {
                 if (GEOM_ENABLED(g2)){
-                    collideAABBs (g1,g2,data,callback);
+                    collideAABBs (g1,g2,data,callback,counters);
                 }
             }
         }
@@ -268,6 +309,37 @@ void dxSimpleSpace::collide (void *data, dNearCallback *callback)
 }
 
 
+// work item i intersects the i-th enabled geom with all the enabled geoms
+// after it
+
+int dxSimpleSpace::prepareCollideParallel()
+{
+    cleanGeoms();
+
+    collide_geoms.clear();
+    for (dxGeom *g=first; g; g=g->next) {
+        if (GEOM_ENABLED(g)) collide_geoms.push_back (g);
+    }
+    return (int)collide_geoms.size();
+}
+
+
+void dxSimpleSpace::collideParallelItems (int begin, int end, void *data,
+                                          dNearCallback *callback)
+{
+    dxGeom *const *geoms = collide_geoms.empty() ? NULL : &collide_geoms[0];
+    const int n = (int)collide_geoms.size();
+
+    dxSpaceCollideCounters counters;
+    for (int i = begin; i < end; i++) {
+        dxGeom *g1 = geoms[i];
+        for (int j = i + 1; j < n; j++) {
+            collideAABBs (g1,geoms[j],data,callback,counters);
+        }
+    }
+}
+
+
 void dxSimpleSpace::collide2 (void *data, dxGeom *geom,
                               dNearCallback *callback)
 {
@@ -278,9 +350,10 @@ void dxSimpleSpace::collide2 (void *data, dxGeom *geom,
     geom->recomputeAABB();
 
     // intersect bounding boxes
+    dxSpaceCollideCounters counters;
     for (dxGeom *g=first; g; g=g->next) {
         if (GEOM_ENABLED(g)){
-            collideAABBs (g,geom,data,callback);
+            collideAABBs (g,geom,data,callback,counters);
         }
     }
 
@@ -304,12 +377,18 @@ static const long int prime[NUM_PRIMES] = {1L,2L,3L,7L,13L,31L,61L,127L,251L,509
 67108859L,134217689L,268435399L,536870909L,1073741789L};
 
 
-// an axis aligned bounding box in the hash table
+struct Node;
+
+// an axis aligned bounding box in the hash table. the boxes persist across the
+// collide() calls: a box is only placed into the cells again when its geom
+// has become dirty.
 struct dxAABB {
-    int level;		// the level this is stored in (cell size = 2^level)
+    int level;		// the level this is stored in (cell size = 2^level), above global_maxlevel for big boxes
     int dbounds[6];	// AABB bounds, discretized to cell size
     dxGeom *geom;		// corresponding geometry object (AABB stored here)
-    int index;		// index of this AABB, starting from 0
+    Node *nodes;		// the cells this AABB is stored in, 0 if none
+    dxAABB *big_next;	// next AABB in the big boxes list
+    dxAABB **big_tome;	// big boxes list backpointer, 0 if not in the list
 };
 
 
@@ -317,11 +396,72 @@ struct dxAABB {
 // at a particular level
 struct Node {
     Node *next;		// next node in hash table collision list, 0 if none
+    Node **tome;		// hash table collision list backpointer
+    Node *aabb_next;	// next node of the same AABB
+    int level;		// the level of the cell
     int x,y,z;		// cell position in space, discretized to cell size
     dxAABB *aabb;		// axis aligned bounding box that intersects this cell
 };
 
 
+// the hash space keeps the AABB of a geom in the extra list pointer of the geom
+#define GEOM_SET_HASH_AABB(g,a) { (g)->next_ex = (dxGeom*)(a); }
+#define GEOM_GET_HASH_AABB(g) ((dxAABB*)(g)->next_ex)
+
+
+// a pool of fixed size objects. the objects are allocated in blocks that are
+// only released when the pool is destroyed, the freed objects are reused.
+template<class T, size_t BlockSize>
+class dxHashSpacePool {
+public:
+    dxHashSpacePool(): blocks(0), free_list(0) {}
+    ~dxHashSpacePool()
+    {
+        while (blocks) {
+            Block *next = blocks->next;
+            dFree (blocks,sizeof(Block));
+            blocks = next;
+        }
+    }
+
+    T *allocate()
+    {
+        if (!free_list) {
+            Block *block = (Block *)dAlloc (sizeof(Block));
+            block->next = blocks;
+            blocks = block;
+            for (size_t i = 0; i != BlockSize; ++i) {
+                block->items[i].next_free = free_list;
+                free_list = &block->items[i];
+            }
+        }
+        Item *item = free_list;
+        free_list = item->next_free;
+        return &item->object;
+    }
+
+    void release (T *object)
+    {
+        Item *item = (Item *)object;
+        item->next_free = free_list;
+        free_list = item;
+    }
+
+private:
+    union Item {
+        T object;
+        Item *next_free;
+    };
+    struct Block {
+        Block *next;
+        Item items[BlockSize];
+    };
+
+    Block *blocks;
+    Item *free_list;
+};
+
+
 // return the `level' of an AABB. the AABB will be put into cells at this
 // level - the cell size will be 2^level. the level is chosen to be the
 // smallest value such that the AABB occupies no more than 8 cells, regardless
@@ -353,30 +493,63 @@ static int findLevel (dReal bounds[6])
 
 
 // find a virtual memory address for a cell at the given level and x,y,z
-// position.
-// @@@ currently this is not very sophisticated, e.g. the scaling
-// factors could be better designed to avoid collisions, and they should
-// probably depend on the hash table physical size.
+// position. the coordinates are scaled by large primes so that neighbouring
+// cells spread over the whole table.
 
 static unsigned long getVirtualAddress (int level, int x, int y, int z)
 {
-    return level*1000 + x*100 + y*10 + z;
+    return ((unsigned long)(unsigned)level * 1000003UL) ^ 
+        ((unsigned long)(unsigned)x * 73856093UL) ^ 
+        ((unsigned long)(unsigned)y * 19349663UL) ^ 
+        ((unsigned long)(unsigned)z * 83492791UL);
 }
 
 //****************************************************************************
 // hash space
+//
+// the AABBs and the hash table are kept across the collide() calls. only the
+// geoms that have become dirty are placed into the cells again, in cleanGeoms().
+// the table is rebuilt when the levels change or when the number of geoms
+// outgrows the table size.
 
 struct dxHashSpace : public dxSpace {
     int global_minlevel;	// smallest hash table level to put AABBs in
     int global_maxlevel;	// objects that need a level larger than this will be
     // put in a "big objects" list instead of a hash table
 
+    std::vector<Node*> table;	// hash table, the size is a prime
+    std::vector<int> level_counts; // number of AABBs at each level from global_minlevel to global_maxlevel
+    dxAABB *big_boxes;		// list of AABBs too big for hash table
+    int hashed_count;		// number of AABBs the table has been sized for
+    bool rebuild_required;	// all AABBs need to be placed again
+
+    dxHashSpacePool<dxAABB, 64> aabb_pool;
+    dxHashSpacePool<Node, 256> node_pool;
+
+    std::vector<dxGeom*> collide_geoms;	// enabled geoms, for the pair search
+    int collide_maxlevel;		// highest used level, for the pair search
+
     dxHashSpace (dSpaceID _space);
+    ~dxHashSpace();
     void setLevels (int minlevel, int maxlevel);
     void getLevels (int *minlevel, int *maxlevel);
+    void add (dxGeom *);
+    void remove (dxGeom *);
     void cleanGeoms();
     void collide (void *data, dNearCallback *callback);
     void collide2 (void *data, dxGeom *geom, dNearCallback *callback);
+    int prepareCollideParallel();
+    void collideParallelItems (int begin, int end, void *data, dNearCallback *callback);
+    dReal raycast (const dReal *origin, const dReal *dir, dReal length,
+        void *data, dxRaycastCallback *callback);
+
+private:
+    void resetTable();
+    void placeAABB (dxAABB *aabb);
+    void unplaceAABB (dxAABB *aabb);
+    int getMaxUsedLevel() const;
+    dReal raycastLevel (int level, const dReal *origin, const dReal *dir, const dReal *inv_dir,
+        dReal length, void *data, dxRaycastCallback *callback);
 };
 
 
@@ -385,14 +558,34 @@ dxHashSpace::dxHashSpace (dSpaceID _space) : dxSpace (_space)
     type = dHashSpaceClass;
     global_minlevel = -3;
     global_maxlevel = 10;
+    big_boxes = 0;
+    hashed_count = 0;
+    rebuild_required = true;
+    collide_maxlevel = global_minlevel;
+}
+
+
+dxHashSpace::~dxHashSpace()
+{
+    CHECK_NOT_LOCKED (this);
+    // the geoms are removed here, as dxSpace destructor can't call remove() of this class
+    if (cleanup) {
+        // note that destroying each geom will call remove()
+        for (; first; dGeomDestroy (first)) {}
+    }
+    else {
+        for (; first; remove (first)) {}
+    }
 }
 
 
 void dxHashSpace::setLevels (int minlevel, int maxlevel)
 {
     dAASSERT (minlevel <= maxlevel);
+    CHECK_NOT_LOCKED (this);
     global_minlevel = minlevel;
     global_maxlevel = maxlevel;
+    rebuild_required = true;
 }
 
 
@@ -403,211 +596,515 @@ void dxHashSpace::getLevels (int *minlevel, int *maxlevel)
 }
 
 
-void dxHashSpace::cleanGeoms()
+void dxHashSpace::add (dxGeom *geom)
 {
-    // compute the AABBs of all dirty geoms, and clear the dirty flags
-    lock_count++;
-    for (dxGeom *g=first; g && (g->gflags & GEOM_DIRTY); g=g->next) {
-        if (IS_SPACE(g)) {
-            ((dxSpace*)g)->cleanGeoms();
-        }
-        g->recomputeAABB();
-        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+    dAASSERT (geom);
+    dUASSERT (geom->next_ex == 0 && geom->tome_ex == 0, "geom is already in a space");
+
+    dxAABB *aabb = aabb_pool.allocate();
+    aabb->level = global_minlevel;
+    aabb->geom = geom;
+    aabb->nodes = 0;
+    aabb->big_next = 0;
+    aabb->big_tome = 0;
+    GEOM_SET_HASH_AABB (geom,aabb);
+
+    // the geom is dirty now, so it is placed into the cells by cleanGeoms()
+    dxSpace::add (geom);
+
+    if (count > 2 * hashed_count) {
+        rebuild_required = true;
     }
-    lock_count--;
 }
 
 
-void dxHashSpace::collide (void *data, dNearCallback *callback)
+void dxHashSpace::remove (dxGeom *geom)
 {
-    dAASSERT(this && callback);
-    dxGeom *geom;
-    int i,maxlevel;
-
-    // 0 or 1 geoms can't collide with anything
-    if (count < 2) return;
-
-    lock_count++;
-    cleanGeoms();
+    dAASSERT (geom);
+    dUASSERT (geom->parent_space == this,"object is not in this space");
 
-    // create a list of auxiliary information for all geom axis aligned bounding
-    // boxes. set the level for all AABBs. put AABBs larger than the space's
-    // global_maxlevel in the big_boxes list, check everything else against
-    // that list at the end. for AABBs that are not too big, record the maximum
-    // level that we need.
-
-    typedef std::vector<dxAABB> AABBlist;
-    AABBlist hash_boxes; // list of AABBs in hash table
-    AABBlist big_boxes; // list of AABBs too big for hash table
-    maxlevel = global_minlevel - 1;
-    for (geom = first; geom; geom=geom->next) {
-        if (!GEOM_ENABLED(geom)){
-            continue;
-        }
-        dxAABB aabb;
-        aabb.geom = geom;
-        // compute level, but prevent cells from getting too small
-        int level = findLevel (geom->aabb);
-        if (level < global_minlevel) level = global_minlevel;
-        if (level <= global_maxlevel) {
-            aabb.level = level;
-            if (level > maxlevel) maxlevel = level;
-            // cellsize = 2^level
-            dReal cellsize = (dReal) ldexp (1.0,level);
-            // discretize AABB position to cell size
-            for (i=0; i < 6; i++)
-                aabb.dbounds[i] = (int) floor (geom->aabb[i]/cellsize);
-            // set AABB index
-            aabb.index = hash_boxes.size();
-            // aabb goes in main list
-            hash_boxes.push_back(aabb);
-        }
-        else {
-            // aabb is too big, put it in the big_boxes list. we don't care about
-            // setting level, dbounds, index, or the maxlevel
-            big_boxes.push_back(aabb);
-        }
+    dxAABB *aabb = GEOM_GET_HASH_AABB (geom);
+    if (!rebuild_required) {
+        unplaceAABB (aabb);
     }
+    aabb_pool.release (aabb);
+    GEOM_SET_HASH_AABB (geom,0);
 
-    int n = hash_boxes.size(); // number of AABBs in main list
+    dxSpace::remove (geom);
+}
 
-    // for `n' objects, an n*n array of bits is used to record if those objects
-    // have been intersection-tested against each other yet. this array can
-    // grow large with high n, but oh well...
-    int tested_rowsize = (n+7) >> 3;	// number of bytes needed for n bits
-    std::vector<unsigned char> tested(n * tested_rowsize);
 
-    // create a hash table to store all AABBs. each AABB may take up to 8 cells.
-    // we use chaining to resolve collisions, but we use a relatively large table
-    // to reduce the chance of collisions.
+void dxHashSpace::resetTable()
+{
+    // release all the nodes
+    for (size_t i=0; i<table.size(); ++i) {
+        for (Node *node = table[i]; node; ) {
+            Node *next = node->next;
+            node_pool.release (node);
+            node = next;
+        }
+    }
 
     // compute hash table size sz to be a prime > 8*n
+    int i;
     for (i=0; i<NUM_PRIMES; i++) {
-        if (prime[i] >= (8*n)) break;
+        if (prime[i] >= (8*count)) break;
     }
     if (i >= NUM_PRIMES)
         i = NUM_PRIMES-1;	// probably pointless
-    int sz = prime[i];
+    table.assign (prime[i],(Node *)0);
+    hashed_count = count;
 
-    // allocate and initialize hash table node pointers
-    std::vector<Node*> table(sz);
+    level_counts.assign (global_maxlevel - global_minlevel + 1,0);
 
-    // add each AABB to the hash table (may need to add it to up to 8 cells)
-    for (AABBlist::iterator aabb=hash_boxes.begin(); aabb!=hash_boxes.end(); ++aabb) {
-        const int *dbounds = aabb->dbounds;
+    big_boxes = 0;
+    for (dxGeom *geom = first; geom; geom = geom->next) {
+        dxAABB *aabb = GEOM_GET_HASH_AABB (geom);
+        aabb->nodes = 0;
+        aabb->big_next = 0;
+        aabb->big_tome = 0;
+    }
+}
+
+
+// remove the AABB from the hash table cells or from the big boxes list
+
+void dxHashSpace::unplaceAABB (dxAABB *aabb)
+{
+    if (aabb->big_tome) {
+        *aabb->big_tome = aabb->big_next;
+        if (aabb->big_next) aabb->big_next->big_tome = aabb->big_tome;
+        aabb->big_next = 0;
+        aabb->big_tome = 0;
+    }
+    else if (aabb->nodes) {
+        for (Node *node = aabb->nodes; node; ) {
+            Node *aabb_next = node->aabb_next;
+            *node->tome = node->next;
+            if (node->next) node->next->tome = node->tome;
+            node_pool.release (node);
+            node = aabb_next;
+        }
+        aabb->nodes = 0;
+        level_counts[aabb->level - global_minlevel]--;
+    }
+}
+
+
+// put the AABB into the hash table cells it intersects (may need to add it to up to
+// 8 cells) or into the big boxes list. the cells are kept if they have not changed.
+
+void dxHashSpace::placeAABB (dxAABB *aabb)
+{
+    dxGeom *geom = aabb->geom;
+
+    // compute level, but prevent cells from getting too small
+    int level = findLevel (geom->aabb);
+    if (level < global_minlevel) level = global_minlevel;
+
+    if (level <= global_maxlevel) {
+        // cellsize = 2^level
+        dReal cellsize = (dReal) ldexp (1.0,level);
+        // discretize AABB position to cell size
+        int dbounds[6];
+        for (int i=0; i < 6; i++)
+            dbounds[i] = (int) floor (geom->aabb[i]/cellsize);
+
+        if (aabb->nodes && aabb->level == level && memcmp (aabb->dbounds,dbounds,sizeof(dbounds)) == 0) {
+            return;
+        }
+
+        unplaceAABB (aabb);
+        aabb->level = level;
+        memcpy (aabb->dbounds,dbounds,sizeof(dbounds));
+        level_counts[level - global_minlevel]++;
+
+        const int sz = (int)table.size();
         for (int xi = dbounds[0]; xi <= dbounds[1]; xi++) {
             for (int yi = dbounds[2]; yi <= dbounds[3]; yi++) {
                 for (int zi = dbounds[4]; zi <= dbounds[5]; zi++) {
                     // get the hash index
-                    unsigned long hi = getVirtualAddress (aabb->level,xi,yi,zi) % sz;
+                    unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
                     // add a new node to the hash table
-                    Node *node = new Node;
+                    Node *node = node_pool.allocate();
+                    node->level = level;
                     node->x = xi;
                     node->y = yi;
                     node->z = zi;
-                    node->aabb = &*aabb;
+                    node->aabb = aabb;
                     node->next = table[hi];
+                    node->tome = &table[hi];
+                    if (node->next) node->next->tome = &node->next;
                     table[hi] = node;
+                    node->aabb_next = aabb->nodes;
+                    aabb->nodes = node;
                 }
             }
         }
     }
+    else {
+        // aabb is too big, put it in the big_boxes list. we don't care about
+        // setting dbounds
+        if (aabb->big_tome) {
+            return;
+        }
+
+        unplaceAABB (aabb);
+        aabb->level = level;
+        aabb->big_next = big_boxes;
+        aabb->big_tome = &big_boxes;
+        if (big_boxes) big_boxes->big_tome = &aabb->big_next;
+        big_boxes = aabb;
+    }
+}
+
+
+int dxHashSpace::getMaxUsedLevel() const
+{
+    int maxlevel = global_maxlevel;
+    while (maxlevel >= global_minlevel && level_counts[maxlevel - global_minlevel] == 0) {
+        --maxlevel;
+    }
+    return maxlevel;
+}
+
+
+void dxHashSpace::cleanGeoms()
+{
+    // compute the AABBs of all dirty geoms, and clear the dirty flags.
+    // the dirty geoms are placed into the hash table cells again.
+    lock_count++;
+    for (dxGeom *g=first; g && (g->gflags & GEOM_DIRTY); g=g->next) {
+        if (IS_SPACE(g)) {
+            ((dxSpace*)g)->cleanGeoms();
+        }
+        g->recomputeAABB();
+        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+
+        if (!rebuild_required) {
+            placeAABB (GEOM_GET_HASH_AABB (g));
+        }
+    }
+
+    if (rebuild_required) {
+        resetTable();
+        for (dxGeom *g=first; g; g=g->next) {
+            placeAABB (GEOM_GET_HASH_AABB (g));
+        }
+        rebuild_required = false;
+    }
+    lock_count--;
+}
+
+
+void dxHashSpace::collide (void *data, dNearCallback *callback)
+{
+    dAASSERT(this && callback);
+
+    // 0 or 1 geoms can't collide with anything
+    if (count < 2) return;
+
+    lock_count++;
+    const int n = prepareCollideParallel();
+    collideParallelItems (0,n,data,callback);
+    lock_count--;
+}
+
+
+// work item i searches collisions for the i-th enabled geom. a geom in the
+// table is checked against the other AABBs in its cells and in all the
+// intersecting higher level cells, and then against every big box. a big
+// box is only checked against the big boxes after it in the list.
+
+int dxHashSpace::prepareCollideParallel()
+{
+    cleanGeoms();
+
+    collide_geoms.clear();
+    if (count < 2) return 0;
+
+    for (dxGeom *g=first; g; g=g->next) {
+        if (GEOM_ENABLED(g)) collide_geoms.push_back (g);
+    }
+    collide_maxlevel = getMaxUsedLevel();
+    return (int)collide_geoms.size();
+}
+
 
-    // now that all AABBs are loaded into the hash table, we do the actual
-    // collision detection. for all AABBs, check for other AABBs in the
-    // same cells for collisions, and then check for other AABBs in all
-    // intersecting higher level cells.
+void dxHashSpace::collideParallelItems (int begin, int end, void *data,
+                                        dNearCallback *callback)
+{
+    // a pair of AABBs is only reported in the first cell they share. AABBs of 
+    // the same level find each other, only the one at the lower address reports
+    // the pair.
+
+    const int maxlevel = collide_maxlevel;
+    const int sz = (int)table.size();
 
     int db[6];			// discrete bounds at current level
-    for (AABBlist::iterator aabb=hash_boxes.begin(); aabb!=hash_boxes.end(); ++aabb) {
+    dxSpaceCollideCounters counters;
+    for (int gi = begin; gi < end; gi++) {
+        dxGeom *geom = collide_geoms[gi];
+        dxAABB *aabb = GEOM_GET_HASH_AABB (geom);
+
+        if (aabb->level > global_maxlevel) {
+            // intersect the big boxes together
+            for (dxAABB *aabb2 = aabb->big_next; aabb2; aabb2 = aabb2->big_next) {
+                if (GEOM_ENABLED(aabb2->geom)) {
+                    collideAABBs (geom,aabb2->geom,data,callback,counters);
+                }
+            }
+            continue;
+        }
+
         // we are searching for collisions with aabb
-        for (i=0; i<6; i++) db[i] = aabb->dbounds[i];
+        for (int i=0; i<6; i++) db[i] = aabb->dbounds[i];
         for (int level = aabb->level; level <= maxlevel; level++) {
-            for (int xi = db[0]; xi <= db[1]; xi++) {
-                for (int yi = db[2]; yi <= db[3]; yi++) {
-                    for (int zi = db[4]; zi <= db[5]; zi++) {
-                        // get the hash index
-                        unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
-                        // search all nodes at this index
-                        for (Node* node = table[hi]; node; node=node->next) {
-                            // node points to an AABB that may intersect aabb
-                            if (node->aabb == &*aabb)
-                                continue;
-                            if (node->aabb->level == level &&
-                                node->x == xi && node->y == yi && node->z == zi) {
-                                    // see if aabb and node->aabb have already been tested
-                                    // against each other
-                                    unsigned char mask;
-                                    if (aabb->index <= node->aabb->index) {
-                                        i = (aabb->index * tested_rowsize)+(node->aabb->index >> 3);
-                                        mask = 1 << (node->aabb->index & 7);
-                                    }
-                                    else {
-                                        i = (node->aabb->index * tested_rowsize)+(aabb->index >> 3);
-                                        mask = 1 << (aabb->index & 7);
-                                    }
-                                    dIASSERT (i >= 0 && i < (tested_rowsize*n));
-                                    if ((tested[i] & mask)==0) {
-                                        collideAABBs (aabb->geom,node->aabb->geom,data,callback);
-                                    }
-                                    tested[i] |= mask;
+            if (level_counts[level - global_minlevel] != 0) {
+                for (int xi = db[0]; xi <= db[1]; xi++) {
+                    for (int yi = db[2]; yi <= db[3]; yi++) {
+                        for (int zi = db[4]; zi <= db[5]; zi++) {
+                            // get the hash index
+                            unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
+                            // search all nodes at this index
+                            for (Node* node = table[hi]; node; node=node->next) {
+                                // node points to an AABB that may intersect aabb
+                                if (node->level == level &&
+                                    node->x == xi && node->y == yi && node->z == zi) {
+                                        dxAABB *other = node->aabb;
+                                        if (level == aabb->level && (size_t)other <= (size_t)aabb)
+                                            continue;
+                                        // the first shared cell is the maximum of the lower bounds
+                                        if (xi != dMAX(db[0],other->dbounds[0]) ||
+                                            yi != dMAX(db[2],other->dbounds[2]) ||
+                                            zi != dMAX(db[4],other->dbounds[4]))
+                                            continue;
+                                        if (GEOM_ENABLED(other->geom)) {
+                                            collideAABBs (geom,other->geom,data,callback,counters);
+                                        }
+                                }
                             }
                         }
                     }
                 }
             }
             // get the discrete bounds for the next level up
-            for (i=0; i<6; i++)
+            for (int i=0; i<6; i++)
                 db[i] >>= 1;
         }
+
+        // every AABB in the normal list must now be intersected against every
+        // AABB in the big_boxes list. so let's hope there are not too many objects
+        // in the big_boxes list.
+        for (dxAABB *aabb2 = big_boxes; aabb2; aabb2 = aabb2->big_next) {
+            if (GEOM_ENABLED(aabb2->geom)) {
+                collideAABBs (geom,aabb2->geom,data,callback,counters);
+            }
+        }
     }
+}
+
+
+// the geom is looked up in the cells it intersects at every used level, and
+// then checked against the big boxes. a pair is only reported in the first
+// cell the AABBs share. when the geom would cover more cells than there are
+// geoms in the space (or is infinite), all the geoms are checked instead.
+
+void dxHashSpace::collide2 (void *data, dxGeom *geom,
+                            dNearCallback *callback)
+{
+    dAASSERT (geom && callback);
+
+    lock_count++;
+    cleanGeoms();
+    geom->recomputeAABB();
 
-    // every AABB in the normal list must now be intersected against every
-    // AABB in the big_boxes list. so let's hope there are not too many objects
-    // in the big_boxes list.
-    for (AABBlist::iterator aabb=hash_boxes.begin(); aabb!=hash_boxes.end(); ++aabb) {
-        for (AABBlist::iterator aabb2=big_boxes.begin(); aabb2!=big_boxes.end(); ++aabb2) {
-            collideAABBs (aabb->geom,aabb2->geom,data,callback);
+    dxSpaceCollideCounters counters;
+
+    const int maxlevel = getMaxUsedLevel();
+    bool use_cells = findLevel (geom->aabb) != MAXINT;
+    if (use_cells) {
+        double cells = 0;
+        for (int level = global_minlevel; level <= maxlevel; level++) {
+            if (level_counts[level - global_minlevel] != 0) {
+                double cellsize = ldexp (1.0,level);
+                double level_cells = 1;
+                for (int i=0; i<6; i+=2) {
+                    level_cells *= floor (geom->aabb[i+1]/cellsize) -
+                        floor (geom->aabb[i]/cellsize) + 1;
+                }
+                cells += level_cells;
+            }
         }
+        use_cells = cells <= count;
     }
 
-    // intersected all AABBs in the big_boxes list together
-    for (AABBlist::iterator aabb=big_boxes.begin(); aabb!=big_boxes.end(); ++aabb) {
-        for (AABBlist::iterator aabb2=big_boxes.begin(); aabb2!=big_boxes.end(); ++aabb2) {
-            collideAABBs (aabb->geom,aabb2->geom,data,callback);
+    if (!use_cells) {
+        // intersect bounding boxes
+        for (dxGeom *g=first; g; g=g->next) {
+            if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback,counters);
         }
+        lock_count--;
+        return;
     }
 
-    // deallocate table
-    for (size_t i=0; i<table.size(); ++i)
-        for (Node* node = table[i]; node;) {
-            Node* next = node->next;
-            delete node;
-            node = next;
+    const int sz = (int)table.size();
+    int db[6];			// discrete bounds of geom at current level
+    for (int level = global_minlevel; level <= maxlevel; level++) {
+        if (level_counts[level - global_minlevel] == 0) continue;
+
+        dReal cellsize = (dReal) ldexp (1.0,level);
+        for (int i=0; i < 6; i++)
+            db[i] = (int) floor (geom->aabb[i]/cellsize);
+
+        for (int xi = db[0]; xi <= db[1]; xi++) {
+            for (int yi = db[2]; yi <= db[3]; yi++) {
+                for (int zi = db[4]; zi <= db[5]; zi++) {
+                    unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
+                    for (Node* node = table[hi]; node; node=node->next) {
+                        if (node->level == level &&
+                            node->x == xi && node->y == yi && node->z == zi) {
+                                dxAABB *other = node->aabb;
+                                // the first shared cell is the maximum of the lower bounds
+                                if (xi != dMAX(db[0],other->dbounds[0]) ||
+                                    yi != dMAX(db[2],other->dbounds[2]) ||
+                                    zi != dMAX(db[4],other->dbounds[4]))
+                                    continue;
+                                if (GEOM_ENABLED(other->geom)) {
+                                    collideAABBs (other->geom,geom,data,callback,counters);
+                                }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (dxAABB *aabb2 = big_boxes; aabb2; aabb2 = aabb2->big_next) {
+        if (GEOM_ENABLED(aabb2->geom)) {
+            collideAABBs (aabb2->geom,geom,data,callback,counters);
         }
+    }
 
     lock_count--;
 }
 
+// the segment walks through the cells of every used level, and then is
+// tested against the big boxes. when the cells would outnumber the geoms
+// (or the segment is infinite), all the geoms are tested instead.
 
-void dxHashSpace::collide2 (void *data, dxGeom *geom,
-                            dNearCallback *callback)
+dReal dxHashSpace::raycast (const dReal *origin, const dReal *dir, dReal length,
+                            void *data, dxRaycastCallback *callback)
 {
-    dAASSERT (geom && callback);
+    const int maxlevel = getMaxUsedLevel();
+
+    // the number of cells the segment crosses at the used levels, and the
+    // highest cell coordinate it reaches
+    double cells = 0, reach = 0, min_cellsize = dInfinity;
+    for (int i=0; i<3; i++)
+        reach = dMAX(reach, fabs (origin[i]) + fabs (dir[i]) * length);
+    for (int level = global_minlevel; level <= maxlevel; level++) {
+        if (level_counts[level - global_minlevel] != 0) {
+            double cellsize = ldexp (1.0,level);
+            cells += (fabs (dir[0]) + fabs (dir[1]) + fabs (dir[2])) * length / cellsize + 1;
+            min_cellsize = dMIN(min_cellsize, cellsize);
+        }
+    }
+    if (!(cells <= count && reach / min_cellsize < MAXINT / 2)) {
+        return dxSpace::raycast (origin,dir,length,data,callback);
+    }
 
-    // this could take advantage of the hash structure to avoid
-    // O(n2) complexity, but it does not yet.
+    dReal inv_dir[3], entry;
+    rayInverseDirection (dir,inv_dir);
 
-    lock_count++;
-    cleanGeoms();
-    geom->recomputeAABB();
+    // the higher levels first, they hold the larger AABBs and have fewer cells
+    for (int level = maxlevel; level >= global_minlevel; level--) {
+        if (level_counts[level - global_minlevel] != 0) {
+            length = raycastLevel (level,origin,dir,inv_dir,length,data,callback);
+        }
+    }
 
-    // intersect bounding boxes
-    for (dxGeom *g=first; g; g=g->next) {
-        if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback);
+    for (dxAABB *aabb = big_boxes; aabb; aabb = aabb->big_next) {
+        dxGeom *g = aabb->geom;
+        if (GEOM_ENABLED(g) && segmentHitsAABB (origin,dir,inv_dir,length,g->aabb,&entry)) {
+            length = callback (data,g,length);
+        }
     }
 
-    lock_count--;
+    return length;
+}
+
+
+// walk the cells of one level along the segment, nearest first, and stop
+// at the first cell beyond the segment length. the cells an AABB covers form
+// a box and the walk moves monotonically along each axis, so it passes
+// through them in a row: an AABB is only reported in the cell where the walk
+// enters its box, i.e. when the previous cell lies outside of it.
+
+dReal dxHashSpace::raycastLevel (int level, const dReal *origin, const dReal *dir,
+                                 const dReal *inv_dir, dReal length,
+                                 void *data, dxRaycastCallback *callback)
+{
+    const dReal cellsize = (dReal) ldexp (1.0,level);
+    const int sz = (int)table.size();
+
+    int cell[3], step[3];
+    dReal tmax[3], tdelta[3];	// where the next cell boundary is crossed, and the distance between boundaries
+    for (int i=0; i<3; i++) {
+        cell[i] = (int) floor (origin[i]/cellsize);
+        if (dir[i] > 0) {
+            step[i] = 1;
+            tmax[i] = ((cell[i] + 1) * cellsize - origin[i]) * inv_dir[i];
+            tdelta[i] = cellsize * inv_dir[i];
+        }
+        else if (dir[i] < 0) {
+            step[i] = -1;
+            tmax[i] = (cell[i] * cellsize - origin[i]) * inv_dir[i];
+            tdelta[i] = -cellsize * inv_dir[i];
+        }
+        else {
+            step[i] = 0;
+            tmax[i] = dInfinity;
+            tdelta[i] = dInfinity;
+        }
+    }
+
+    int prev[3] = { 0, 0, 0 };	// the previous cell of the walk
+    bool has_prev = false;
+
+    dReal tenter = 0, entry;
+    while (tenter <= length) {
+        unsigned long hi = getVirtualAddress (level,cell[0],cell[1],cell[2]) % sz;
+        for (Node *node = table[hi]; node; node = node->next) {
+            if (node->level != level || node->x != cell[0] ||
+                node->y != cell[1] || node->z != cell[2])
+                continue;
+
+            const int *db = node->aabb->dbounds;
+            bool reported = has_prev &&
+                db[0] <= prev[0] && prev[0] <= db[1] &&
+                db[2] <= prev[1] && prev[1] <= db[3] &&
+                db[4] <= prev[2] && prev[2] <= db[5];
+
+            dxGeom *g = node->aabb->geom;
+            if (!reported && GEOM_ENABLED(g) &&
+                segmentHitsAABB (origin,dir,inv_dir,length,g->aabb,&entry)) {
+                    length = callback (data,g,length);
+            }
+        }
+
+        // step into the cell whose boundary is crossed first
+        int axis = 0;
+        if (tmax[1] < tmax[axis]) axis = 1;
+        if (tmax[2] < tmax[axis]) axis = 2;
+        tenter = tmax[axis];
+        prev[0] = cell[0]; prev[1] = cell[1]; prev[2] = cell[2];
+        has_prev = true;
+        cell[axis] += step[axis];
+        tmax[axis] += tdelta[axis];
+    }
+
+    return length;
 }
 
 //****************************************************************************
@@ -756,9 +1253,412 @@ void dSpaceCollide (dxSpace *space, void *data, dNearCallback *callback)
 {
     dAASSERT (space && callback);
     dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dxSpaceCollideTimer timer;
     space->collide (data,callback);
 }
 
+// pairs are stored up to the capacity of the array, but all of them are counted
+
+struct dxSpacePairCollector
+{
+    dxSpacePairCollector(dGeomPair *pairs, int capacity):
+        m_pairs(pairs), m_capacity(capacity), m_count(0)
+    {
+    }
+
+    static void AddPair_Callback(void *data, dxGeom *g1, dxGeom *g2);
+
+    dGeomPair   *m_pairs;
+    int         m_capacity;
+    int         m_count;
+};
+
+void dxSpacePairCollector::AddPair_Callback(void *data, dxGeom *g1, dxGeom *g2)
+{
+    dxSpacePairCollector *collector = (dxSpacePairCollector *)data;
+
+    if (collector->m_count < collector->m_capacity) {
+        dGeomPair &pair = collector->m_pairs[collector->m_count];
+        pair.o1 = g1;
+        pair.o2 = g2;
+    }
+    collector->m_count++;
+}
+
+
+int dSpaceCollectPairs (dxSpace *space, dGeomPair *pairs, int capacity)
+{
+    dAASSERT (space && (pairs || capacity == 0) && capacity >= 0);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+
+    dxSpaceCollideTimer timer;
+    dxSpacePairCollector collector(pairs, capacity);
+    space->collide (&collector,&dxSpacePairCollector::AddPair_Callback);
+    return collector.m_count;
+}
+
+//****************************************************************************
+// parallel space collision
+
+enum
+{
+    dxSPACE_COLLIDE_BLOCK_SIZE = 16,	// work items taken by a thread at a time
+    dxSPACE_COLLIDE_PAIR_BATCH_SIZE = 256,	// pairs delivered to a batch callback at a time
+    dxSPACE_RAYCAST_BLOCK_SIZE = 64,	// rays taken by a thread at a time
+};
+
+struct dxSpaceCollideThreading:
+    public dxThreadingBase
+{
+    dxSpaceCollideThreading(const dThreadingFunctionsInfo *functions, dThreadingImplementationID impl)
+    {
+        AssignThreadingImpl(functions, impl);
+    }
+};
+
+// pairs found by a thread are gathered here and handed to the batch callback
+// whenever the buffer fills up
+
+struct dxSpacePairBatch
+{
+    dxSpacePairBatch(void *data, dNearBatchCallback *callback):
+        m_data(data), m_callback(callback), m_count(0)
+    {
+    }
+
+    static void AddPair_Callback(void *data, dxGeom *g1, dxGeom *g2);
+    void Flush();
+
+    void                *m_data;
+    dNearBatchCallback  *m_callback;
+    int                 m_count;
+    dGeomPair           m_pairs[dxSPACE_COLLIDE_PAIR_BATCH_SIZE];
+};
+
+void dxSpacePairBatch::AddPair_Callback(void *data, dxGeom *g1, dxGeom *g2)
+{
+    dxSpacePairBatch *batch = (dxSpacePairBatch *)data;
+
+    dGeomPair &pair = batch->m_pairs[batch->m_count];
+    pair.o1 = g1;
+    pair.o2 = g2;
+
+    if (++batch->m_count == dxSPACE_COLLIDE_PAIR_BATCH_SIZE) {
+        batch->Flush();
+    }
+}
+
+void dxSpacePairBatch::Flush()
+{
+    if (m_count != 0) {
+        m_callback(m_data, m_pairs, m_count);
+        m_count = 0;
+    }
+}
+
+struct dxSpaceCollideCallContext
+{
+    dxSpaceCollideCallContext(dxSpace *space, int itemCount, 
+        void *const *threadData, dNearCallback *callback, dNearBatchCallback *batchCallback):
+        m_space(space), m_itemCount(itemCount), 
+        m_blockCount((unsigned int)(itemCount + (dxSPACE_COLLIDE_BLOCK_SIZE - 1)) / dxSPACE_COLLIDE_BLOCK_SIZE), 
+        m_blockIndex(0), m_threadData(threadData), m_callback(callback), m_batchCallback(batchCallback)
+    {
+    }
+
+    static int ThreadedCollideGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static int ThreadedCollide_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    void ThreadedCollide(unsigned threadIndex);
+    void CollideBlocks(void *data, dNearCallback *callback);
+
+    dxSpace                 *m_space;
+    int                     m_itemCount;
+    unsigned int            m_blockCount;
+    volatile unsigned int   m_blockIndex;
+    void *const             *m_threadData;
+    dNearCallback           *m_callback;
+    dNearBatchCallback      *m_batchCallback;
+};
+
+int dxSpaceCollideCallContext::ThreadedCollideGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxSpaceCollideCallContext::ThreadedCollide_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<dxSpaceCollideCallContext *>(callContext)->ThreadedCollide((unsigned)callInstanceIndex);
+    return true;
+}
+
+void dxSpaceCollideCallContext::ThreadedCollide(unsigned threadIndex)
+{
+    void *data = m_threadData != NULL ? m_threadData[threadIndex] : NULL;
+
+    if (m_batchCallback != NULL) {
+        dxSpacePairBatch batch(data, m_batchCallback);
+        CollideBlocks(&batch, &dxSpacePairBatch::AddPair_Callback);
+        batch.Flush();
+    }
+    else {
+        CollideBlocks(data, m_callback);
+    }
+}
+
+void dxSpaceCollideCallContext::CollideBlocks(void *data, dNearCallback *callback)
+{
+    const unsigned int blockCount = m_blockCount;
+
+    unsigned int blockIndex;
+    while ((blockIndex = ThrsafeIncrementIntUpToLimit(&m_blockIndex, blockCount)) != blockCount) {
+        const int blockBegin = (int)blockIndex * dxSPACE_COLLIDE_BLOCK_SIZE;
+        const int blockEnd = dMIN(blockBegin + (int)dxSPACE_COLLIDE_BLOCK_SIZE, m_itemCount);
+        m_space->collideParallelItems (blockBegin,blockEnd,data,callback);
+    }
+}
+
+static 
+void dxSpaceCollideThreaded (dxSpace *space, 
+                             const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+                             void *const *thread_data, unsigned thread_count, 
+                             dNearCallback *callback, dNearBatchCallback *batch_callback)
+{
+    space->lock_count++;
+
+    const int itemCount = space->prepareCollideParallel();
+    dxSpaceCollideCallContext callContext(space, itemCount, thread_data, callback, batch_callback);
+
+    unsigned collideThreadCount = dMIN(thread_count, callContext.m_blockCount);
+    bool collided = false;
+
+    if (impl != NULL && collideThreadCount > 1) {
+        dxSpaceCollideThreading threading(functions_info, impl);
+
+        if (threading.PreallocateResourcesForThreadedCalls(1 + collideThreadCount)) {
+            dCallWaitID pcwGroupCallWait = threading.AllocThreadedCallWait();
+
+            if (pcwGroupCallWait != NULL) {
+                dCallReleaseeID groupReleasee;
+                threading.PostThreadedCall(NULL, &groupReleasee, collideThreadCount, NULL, pcwGroupCallWait, 
+                    &dxSpaceCollideCallContext::ThreadedCollideGroup_Callback, (void *)&callContext, 0, "Space Collide Group");
+
+                threading.PostThreadedCallsGroup(NULL, collideThreadCount, groupReleasee, 
+                    &dxSpaceCollideCallContext::ThreadedCollide_Callback, (void *)&callContext, "Space Collide");
+
+                threading.WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "Space Collide Wait");
+                threading.FreeThreadedCallWait(pcwGroupCallWait);
+                collided = true;
+            }
+        }
+    }
+
+    if (!collided) {
+        callContext.ThreadedCollide(0);
+    }
+
+    space->lock_count--;
+}
+
+void dSpaceCollideParallel (dxSpace *space, 
+                            const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+                            void *const *thread_data, unsigned thread_count, 
+                            dNearCallback *callback)
+{
+    dAASSERT (space && callback && thread_count != 0);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dUASSERT (!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+    dxSpaceCollideTimer timer;
+    dxSpaceCollideThreaded (space,functions_info,impl,thread_data,thread_count,callback,NULL);
+}
+
+void dSpaceCollideParallelBatched (dxSpace *space, 
+                                   const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+                                   void *const *thread_data, unsigned thread_count, 
+                                   dNearBatchCallback *callback)
+{
+    dAASSERT (space && callback && thread_count != 0);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dUASSERT (!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+    dxSpaceCollideTimer timer;
+    dxSpaceCollideThreaded (space,functions_info,impl,thread_data,thread_count,NULL,callback);
+}
+
+
+//****************************************************************************
+// batched ray casts
+//
+// every threaded call casts blocks of rays with a ray geom of its own. the
+// geoms the space reports are collided with the ray, and each hit shortens
+// the ray for the rest of the search.
+
+struct dxSpaceRaycastState
+{
+    const dReal     *origin;
+    const dReal     *dir;
+    dxGeom          *ray;
+    dRaycastHit     *hit;
+};
+
+struct dxSpaceRaycastCallContext
+{
+    dxSpaceRaycastCallContext(dxSpace *space, const dReal *origins, const dReal *dirs, 
+        dReal maxLength, int rayCount, dRaycastHit *hits, dxGeom *const *rays):
+        m_space(space), m_origins(origins), m_dirs(dirs), m_maxLength(maxLength), m_rayCount(rayCount),
+        m_blockCount((unsigned int)(rayCount + (dxSPACE_RAYCAST_BLOCK_SIZE - 1)) / dxSPACE_RAYCAST_BLOCK_SIZE), 
+        m_blockIndex(0), m_hits(hits), m_rays(rays)
+    {
+    }
+
+    static int ThreadedRaycastGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static int ThreadedRaycast_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static dReal HitGeom_Callback(void *data, dxGeom *geom, dReal length);
+    void CastBlocks(unsigned threadIndex);
+    void CastRay(dxGeom *ray, int rayIndex);
+
+    dxSpace                 *m_space;
+    const dReal             *m_origins;
+    const dReal             *m_dirs;
+    dReal                   m_maxLength;
+    int                     m_rayCount;
+    unsigned int            m_blockCount;
+    volatile unsigned int   m_blockIndex;
+    dRaycastHit             *m_hits;
+    dxGeom *const           *m_rays;
+};
+
+int dxSpaceRaycastCallContext::ThreadedRaycastGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxSpaceRaycastCallContext::ThreadedRaycast_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<dxSpaceRaycastCallContext *>(callContext)->CastBlocks((unsigned)callInstanceIndex);
+    return true;
+}
+
+dReal dxSpaceRaycastCallContext::HitGeom_Callback(void *data, dxGeom *geom, dReal length)
+{
+    dxSpaceRaycastState *state = (dxSpaceRaycastState *)data;
+
+    if (IS_SPACE(geom)) {
+        return ((dxSpace *)geom)->raycast (state->origin,state->dir,length,data,&HitGeom_Callback);
+    }
+
+    dGeomRaySetLength (state->ray,length);
+    state->ray->recomputeAABB();
+
+    dContactGeom contact;
+    if (dCollide (state->ray,geom,1,&contact,sizeof(dContactGeom)) != 0 && contact.depth <= length) {
+        dRaycastHit *hit = state->hit;
+        for (int i = 0; i < 3; i++) {
+            hit->pos[i] = contact.pos[i];
+            hit->normal[i] = contact.normal[i];
+        }
+        hit->depth = contact.depth;
+        hit->geom = geom;
+        return contact.depth;
+    }
+    return length;
+}
+
+void dxSpaceRaycastCallContext::CastBlocks(unsigned threadIndex)
+{
+    dxGeom *ray = m_rays[threadIndex];
+    const unsigned int blockCount = m_blockCount;
+
+    unsigned int blockIndex;
+    while ((blockIndex = ThrsafeIncrementIntUpToLimit(&m_blockIndex, blockCount)) != blockCount) {
+        const int blockBegin = (int)blockIndex * dxSPACE_RAYCAST_BLOCK_SIZE;
+        const int blockEnd = dMIN(blockBegin + (int)dxSPACE_RAYCAST_BLOCK_SIZE, m_rayCount);
+        for (int i = blockBegin; i != blockEnd; i++) {
+            CastRay(ray, i);
+        }
+    }
+}
+
+void dxSpaceRaycastCallContext::CastRay(dxGeom *ray, int rayIndex)
+{
+    dRaycastHit *hit = m_hits + rayIndex;
+    hit->geom = 0;
+
+    const dReal *origin = m_origins + rayIndex * 3;
+    dVector3 dir;
+    dCopyVector3(dir, m_dirs + rayIndex * 3);
+    if (!dSafeNormalize3(dir)) {
+        return;
+    }
+
+    dGeomRaySet (ray,origin[0],origin[1],origin[2],dir[0],dir[1],dir[2]);
+
+    dxSpaceRaycastState state = { origin, dir, ray, hit };
+    m_space->raycast (origin,dir,m_maxLength,&state,&HitGeom_Callback);
+}
+
+int dSpaceRaycastBatch (dxSpace *space, const dReal *origins, const dReal *dirs,
+                        dReal max_length, int ray_count, dRaycastHit *hits, 
+                        const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, 
+                        unsigned thread_count)
+{
+    dAASSERT (space && (ray_count == 0 || (origins && dirs && hits)) && thread_count != 0);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dUASSERT (!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+    dUASSERT (max_length >= 0,"the length must not be negative");
+
+    space->lock_count++;
+    space->cleanGeoms();
+
+    std::vector<dxGeom*> rays (thread_count);
+    for (unsigned i = 0; i != thread_count; i++) {
+        rays[i] = dCreateRay (0,max_length);
+        dGeomRaySetClosestHit (rays[i],1);
+    }
+
+    dxSpaceRaycastCallContext callContext(space, origins, dirs, max_length, ray_count, hits, &rays[0]);
+
+    unsigned castThreadCount = dMIN(thread_count, callContext.m_blockCount);
+    bool cast = false;
+
+    if (impl != NULL && castThreadCount > 1) {
+        dxSpaceCollideThreading threading(functions_info, impl);
+
+        if (threading.PreallocateResourcesForThreadedCalls(1 + castThreadCount)) {
+            dCallWaitID pcwGroupCallWait = threading.AllocThreadedCallWait();
+
+            if (pcwGroupCallWait != NULL) {
+                dCallReleaseeID groupReleasee;
+                threading.PostThreadedCall(NULL, &groupReleasee, castThreadCount, NULL, pcwGroupCallWait, 
+                    &dxSpaceRaycastCallContext::ThreadedRaycastGroup_Callback, (void *)&callContext, 0, "Space Raycast Group");
+
+                threading.PostThreadedCallsGroup(NULL, castThreadCount, groupReleasee, 
+                    &dxSpaceRaycastCallContext::ThreadedRaycast_Callback, (void *)&callContext, "Space Raycast");
+
+                threading.WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "Space Raycast Wait");
+                threading.FreeThreadedCallWait(pcwGroupCallWait);
+                cast = true;
+            }
+        }
+    }
+
+    if (!cast) {
+        callContext.CastBlocks(0);
+    }
+
+    for (unsigned i = 0; i != thread_count; i++) {
+        dGeomDestroy (rays[i]);
+    }
+
+    space->lock_count--;
+
+    int hitCount = 0;
+    for (int i = 0; i != ray_count; i++) {
+        if (hits[i].geom != 0) hitCount++;
+    }
+    return hitCount;
+}
+
 
 struct DataCallback {
     void *data;
@@ -776,6 +1676,7 @@ void dSpaceCollide2 (dxGeom *g1, dxGeom *g2, void *data,
                      dNearCallback *callback)
 {
     dAASSERT (g1 && g2 && callback);
+    dxSpaceCollideTimer timer;
     dxSpace *s1,*s2;
 
     // see if either geom is a space
@@ -834,7 +1735,8 @@ void dSpaceCollide2 (dxGeom *g1, dxGeom *g2, void *data,
             // make sure they have valid AABBs
             g1->recomputeAABB();
             g2->recomputeAABB();
-            collideAABBs(g1,g2, data, callback);
+            dxSpaceCollideCounters counters;
+            collideAABBs(g1,g2, data, callback, counters);
         }
     }
 }
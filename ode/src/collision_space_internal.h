@@ -29,6 +29,8 @@ stuff common to all spaces
 #ifndef _ODE_COLLISION_SPACE_INTERNAL_H_
 #define _ODE_COLLISION_SPACE_INTERNAL_H_
 
+#include <ode/timer.h>
+
 #define ALLOCA(x) dALLOCA16(x)
 
 #define CHECK_NOT_LOCKED(space) \
@@ -36,6 +38,36 @@ stuff common to all spaces
     "invalid operation for locked space");
 
 
+void dxAddSpaceCollideStatistics (duint64 aabbTests, duint64 nearCallbacks);
+bool dxGetCollisionStatisticsEnabled ();
+
+// times a call of one of the dSpaceCollide*() functions, callbacks included,
+// if the statistics are enabled.
+struct dxSpaceCollideTimer
+{
+    dxSpaceCollideTimer();
+    ~dxSpaceCollideTimer();
+
+    dStopwatch m_stopwatch;
+    bool m_enabled;
+};
+
+// counts the pairs a space pass tests and passes on to the callback. the
+// counts are added to the collision statistics when the pass is finished,
+// if the statistics are enabled.
+struct dxSpaceCollideCounters
+{
+    duint64 aabb_tests;
+    duint64 near_callbacks;
+
+    dxSpaceCollideCounters(): aabb_tests(0), near_callbacks(0) {}
+    ~dxSpaceCollideCounters()
+    {
+        if (aabb_tests != 0) dxAddSpaceCollideStatistics (aabb_tests, near_callbacks);
+    }
+};
+
+
 // collide two geoms together. for the hash table space, this is
 // called if the two AABBs inhabit the same hash table cells.
 // this only calls the callback function if the AABBs actually
@@ -46,8 +78,11 @@ stuff common to all spaces
 // and that both geoms are enabled.
 
 static inline void collideAABBs (dxGeom *g1, dxGeom *g2,
-                                 void *data, dNearCallback *callback)
+                                 void *data, dNearCallback *callback,
+                                 dxSpaceCollideCounters &counters)
 {
+    counters.aabb_tests++;
+
     dIASSERT((g1->gflags & GEOM_AABB_BAD)==0);
     dIASSERT((g2->gflags & GEOM_AABB_BAD)==0);
 
@@ -78,7 +113,47 @@ static inline void collideAABBs (dxGeom *g1, dxGeom *g2,
     if (g2->AABBTest (g1,bounds1) == 0) return;
 
     // the objects might actually intersect - call the space callback function
+    counters.near_callbacks++;
     callback (data,g1,g2);
 }
 
+
+// compute the reciprocals of a ray direction for segmentHitsAABB(). they are
+// left at zero along the axes the direction is parallel to.
+
+static inline void rayInverseDirection (const dReal *dir, dReal *inv_dir)
+{
+    for (int axis = 0; axis < 3; axis++)
+        inv_dir[axis] = dir[axis] != 0 ? REAL(1.0) / dir[axis] : 0;
+}
+
+
+// tell if the segment origin + t * dir, t in [0,length], hits the AABB. if
+// so, the distance t at which it enters the AABB is stored in *entry.
+
+static inline bool segmentHitsAABB (const dReal *origin, const dReal *dir,
+                                    const dReal *inv_dir, dReal length,
+                                    const dReal *bounds, dReal *entry)
+{
+    dReal tmin = 0, tmax = length;
+    for (int axis = 0; axis < 3; axis++) {
+        const dReal lo = bounds[axis*2], hi = bounds[axis*2+1];
+        if (dir[axis] == 0) {
+            if (origin[axis] < lo || origin[axis] > hi)
+                return false;
+        }
+        else {
+            dReal t1 = (lo - origin[axis]) * inv_dir[axis];
+            dReal t2 = (hi - origin[axis]) * inv_dir[axis];
+            if (t1 > t2) { dReal t = t1; t1 = t2; t2 = t; }
+            if (t1 > tmin) tmin = t1;
+            if (t2 < tmax) tmax = t2;
+            if (tmin > tmax)
+                return false;
+        }
+    }
+    *entry = tmin;
+    return true;
+}
+
 #endif
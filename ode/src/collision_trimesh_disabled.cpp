@@ -103,6 +103,7 @@ void dGeomTriMeshDataBuildSimple1(dTriMeshDataID g,
     const int* Normals) { }
 
 void dGeomTriMeshDataPreprocess(dTriMeshDataID g) { }
+void dGeomTriMeshDataSetBuildThreading(dTriMeshDataID g, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, unsigned thread_count) { }
 
 void dGeomTriMeshDataGetBuffer(dTriMeshDataID g, unsigned char** buf, int* bufLen) { *buf = NULL; *bufLen=0; }
 void dGeomTriMeshDataSetBuffer(dTriMeshDataID g, unsigned char* buf) {}
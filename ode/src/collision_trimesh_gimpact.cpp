@@ -140,6 +140,12 @@ void dGeomTriMeshDataPreprocess(dTriMeshDataID g)
     g->Preprocess();
 }
 
+void dGeomTriMeshDataSetBuildThreading(dTriMeshDataID g, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, unsigned thread_count)
+{
+    dUASSERT(g, "argument not trimesh data");
+    // GIMPACT builds its own structures, serially
+}
+
 void dGeomTriMeshDataGetBuffer(dTriMeshDataID g, unsigned char** buf, int* bufLen)
 {
     dUASSERT(g, "argument not trimesh data");
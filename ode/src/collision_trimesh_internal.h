@@ -234,6 +234,11 @@ struct dxTriMeshData  : public dBase
         const void* Normals, 
         bool Single);
 
+    /* threads used to build the tree, see dGeomTriMeshDataSetBuildThreading() */
+    const dThreadingFunctionsInfo *BuildThreadingFunctions;
+    dThreadingImplementationID BuildThreading;
+    unsigned BuildThreadCount;
+
     /* aabb in model space */
     dVector3 AABBCenter;
     dVector3 AABBExtents;
@@ -24,11 +24,14 @@
 
 #include <ode/collision.h>
 #include <ode/rotation.h>
+#include <ode/threading_impl.h>
 #include "config.h"
 #include "matrix.h"
 #include "odemath.h"
 #include "collision_util.h"
 #include "collision_trimesh_internal.h"
+#include "threading_base.h"
+#include "threadingutils.h"
 
 #if dTRIMESH_ENABLED
 #if dTRIMESH_OPCODE
@@ -68,8 +71,108 @@ void TrimeshCollidersCache::InitOPCODECaches()
 
 
 
+// Runs the parallel parts of the tree build on a threading implementation.
+// Each posted call takes tasks until none are left.
+
+struct dxTriMeshBuildThreading:
+    public dxThreadingBase
+{
+    dxTriMeshBuildThreading(const dThreadingFunctionsInfo *functions, dThreadingImplementationID impl)
+    {
+        AssignThreadingImpl(functions, impl);
+    }
+};
+
+class dxTriMeshBuildScheduler:
+    public AABBTreeBuildScheduler
+{
+public:
+    dxTriMeshBuildScheduler(const dThreadingFunctionsInfo *functions, dThreadingImplementationID impl, unsigned threadCount):
+        m_functions(functions), m_impl(impl), m_threadCount(threadCount)
+    {
+    }
+
+    virtual void Run(BuildTask task, void* context, udword nb_tasks);
+    virtual udword GetNbThreads() const { return m_threadCount; }
+
+private:
+    struct CallContext
+    {
+        BuildTask               m_task;
+        void                    *m_context;
+        unsigned int            m_taskCount;
+        volatile unsigned int   m_taskIndex;
+
+        void RunTasks();
+    };
+
+    static int ThreadedRunGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static int ThreadedRun_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+
+    const dThreadingFunctionsInfo *m_functions;
+    dThreadingImplementationID  m_impl;
+    unsigned                    m_threadCount;
+};
+
+void dxTriMeshBuildScheduler::CallContext::RunTasks()
+{
+    const unsigned int taskCount = m_taskCount;
+
+    unsigned int taskIndex;
+    while ((taskIndex = ThrsafeIncrementIntUpToLimit(&m_taskIndex, taskCount)) != taskCount) {
+        m_task(m_context, taskIndex);
+    }
+}
+
+int dxTriMeshBuildScheduler::ThreadedRunGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxTriMeshBuildScheduler::ThreadedRun_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<CallContext *>(callContext)->RunTasks();
+    return true;
+}
+
+void dxTriMeshBuildScheduler::Run(BuildTask task, void* context, udword nb_tasks)
+{
+    CallContext callContext;
+    callContext.m_task = task;
+    callContext.m_context = context;
+    callContext.m_taskCount = nb_tasks;
+    callContext.m_taskIndex = 0;
+
+    unsigned runThreadCount = m_threadCount < (unsigned)nb_tasks ? m_threadCount : (unsigned)nb_tasks;
+
+    if (m_impl != NULL && runThreadCount > 1) {
+        dxTriMeshBuildThreading threading(m_functions, m_impl);
+
+        if (threading.PreallocateResourcesForThreadedCalls(1 + runThreadCount)) {
+            dCallWaitID pcwGroupCallWait = threading.AllocThreadedCallWait();
+
+            if (pcwGroupCallWait != NULL) {
+                dCallReleaseeID groupReleasee;
+                threading.PostThreadedCall(NULL, &groupReleasee, runThreadCount, NULL, pcwGroupCallWait, 
+                    &ThreadedRunGroup_Callback, (void *)&callContext, 0, "TriMesh Build Group");
+
+                threading.PostThreadedCallsGroup(NULL, runThreadCount, groupReleasee, 
+                    &ThreadedRun_Callback, (void *)&callContext, "TriMesh Build");
+
+                threading.WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "TriMesh Build Wait");
+                threading.FreeThreadedCallWait(pcwGroupCallWait);
+            }
+        }
+    }
+
+    // Whatever the threads have not taken (or all of it, without threads) is run here
+    callContext.RunTasks();
+}
+
+
 // Trimesh data
-dxTriMeshData::dxTriMeshData() : UseFlags( NULL )
+dxTriMeshData::dxTriMeshData() : BuildThreadingFunctions( NULL ), BuildThreading( NULL ), BuildThreadCount( 1 ), UseFlags( NULL )
 {
 #if !dTRIMESH_ENABLED
     dUASSERT(false, "dTRIMESH_ENABLED is not defined. Trimesh geoms will not work");
@@ -104,11 +207,16 @@ dxTriMeshData::Build(const void* Vertices, int VertexStide, int VertexCount,
     //Settings.mRules = SPLIT_BEST_AXIS;
 
     // best compromise?
-    Settings.mRules = SPLIT_BEST_AXIS | SPLIT_SPLATTER_POINTS | SPLIT_GEOM_CENTER;
+    //Settings.mRules = SPLIT_BEST_AXIS | SPLIT_SPLATTER_POINTS | SPLIT_GEOM_CENTER;
+
+    // binned SAH for the complete tree, the other rules are only used by incomplete trees
+    Settings.mRules = SPLIT_SAH | SPLIT_BEST_AXIS | SPLIT_SPLATTER_POINTS | SPLIT_GEOM_CENTER;
 
+    dxTriMeshBuildScheduler Scheduler(BuildThreadingFunctions, BuildThreading, BuildThreadCount);
 
     OPCODECREATE TreeBuilder;
     TreeBuilder.mIMesh = &Mesh;
+    TreeBuilder.mScheduler = BuildThreading != NULL && BuildThreadCount > 1 ? &Scheduler : NULL;
 
     TreeBuilder.mSettings = Settings;
     TreeBuilder.mNoLeaf = true;
@@ -515,6 +623,16 @@ void dGeomTriMeshDataPreprocess(dTriMeshDataID g)
     g->Preprocess();
 }
 
+void dGeomTriMeshDataSetBuildThreading(dTriMeshDataID g, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID impl, unsigned thread_count)
+{
+    dUASSERT(g, "argument not trimesh data");
+    dAASSERT(thread_count != 0);
+    dUASSERT(!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+    g->BuildThreadingFunctions = functions_info;
+    g->BuildThreading = impl;
+    g->BuildThreadCount = thread_count;
+}
+
 void dGeomTriMeshDataGetBuffer(dTriMeshDataID g, unsigned char** buf, int* bufLen)
 {
     dUASSERT(g, "argument not trimesh data");
@@ -0,0 +1,174 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+#include <ode/common.h>
+#include <ode/odemath.h>
+#include "config.h"
+#include "contact_cache.h"
+#include "collision_kernel.h"
+#include "threadingutils.h"
+
+
+// minimal cosine of the angle between the old and the new contact normal
+// for the cached impulse to be reused
+#define dCONTACT_CACHE_MIN_NORMAL_COS REAL(0.9)
+
+// maximal number of entries; the cache starts over when it is full, which
+// bounds it when contacts are destroyed without any step invalidating it
+#define dCONTACT_CACHE_MAX_ENTRIES 65536
+
+
+// serial numbers of the geoms with cached contacts
+static volatile atomicord32 s_geomSerial = 0;
+
+
+void dxContactCache::clear()
+{
+    m_entries.setSize(0);
+    m_stale = false;
+    m_bucketsValid = false;
+}
+
+void dxContactCache::storeContact(const dContactGeom &geom, const dReal *lambda)
+{
+    if (m_stale || m_entries.size() >= dCONTACT_CACHE_MAX_ENTRIES) {
+        clear();
+    }
+
+    dxContactCacheEntry entry;
+    entry.g1 = geom.g1;
+    entry.g2 = geom.g2;
+    entry.serial1 = getGeomSerial(geom.g1);
+    entry.serial2 = getGeomSerial(geom.g2);
+    entry.side1 = geom.side1;
+    entry.side2 = geom.side2;
+    dCopyVector3(entry.pos, geom.pos);
+    dCopyVector3(entry.normal, geom.normal);
+    for (unsigned int i = 0; i != 6; i++) entry.lambda[i] = lambda[i];
+    entry.next = -1;
+
+    m_entries.push(entry);
+    m_bucketsValid = false;
+}
+
+bool dxContactCache::lookupContact(const dContactGeom &geom, dReal max_distance, dReal *out_lambda)
+{
+    // contacts are destroyed, then created again with lookups: the next
+    // contacts stored replace the entries even if no step was taken
+    m_stale = true;
+
+    if (m_entries.size() == 0) {
+        return false;
+    }
+
+    if (!m_bucketsValid) {
+        rebuildBuckets();
+    }
+
+    const dxContactCacheEntry *best = NULL;
+    dReal best_distance2 = max_distance * max_distance;
+
+    // A geom gets a serial when its first contact is cached. One without a
+    // serial, e.g. a new geom at the address of a destroyed one, has none.
+    const unsigned serial1 = geom.g1 != NULL ? geom.g1->contact_cache_serial : 0;
+    const unsigned serial2 = geom.g2 != NULL ? geom.g2->contact_cache_serial : 0;
+
+    const unsigned bucket = hashGeomPair(geom.g1, geom.g2) & (unsigned)(m_buckets.size() - 1);
+    for (int i = m_buckets[bucket]; i != -1; i = m_entries[i].next) {
+        const dxContactCacheEntry &entry = m_entries[i];
+        if (entry.g1 != geom.g1 || entry.g2 != geom.g2 
+            || entry.serial1 != serial1 || entry.serial2 != serial2
+            || entry.side1 != geom.side1 || entry.side2 != geom.side2) {
+            continue;
+        }
+
+        if (dCalcVectorDot3(entry.normal, geom.normal) < dCONTACT_CACHE_MIN_NORMAL_COS) {
+            continue;
+        }
+
+        dVector3 delta;
+        dSubtractVectors3(delta, entry.pos, geom.pos);
+        dReal distance2 = dCalcVectorLengthSquare3(delta);
+        if (distance2 <= best_distance2) {
+            best_distance2 = distance2;
+            best = &entry;
+        }
+    }
+
+    if (best != NULL) {
+        for (unsigned int i = 0; i != 6; i++) out_lambda[i] = best->lambda[i];
+    }
+
+    return best != NULL;
+}
+
+void dxContactCache::rebuildBuckets()
+{
+    const int entry_count = m_entries.size();
+
+    int bucket_count = 16;
+    while (bucket_count < entry_count) bucket_count <<= 1;
+
+    m_buckets.setSize(bucket_count);
+    for (int b = 0; b != bucket_count; b++) m_buckets[b] = -1;
+
+    // Entries are inserted in reverse so that the chains keep the store order
+    for (int i = entry_count; i != 0; ) {
+        --i;
+        dxContactCacheEntry &entry = m_entries[i];
+        const unsigned bucket = hashGeomPair(entry.g1, entry.g2) & (unsigned)(bucket_count - 1);
+        entry.next = m_buckets[bucket];
+        m_buckets[bucket] = i;
+    }
+
+    m_bucketsValid = true;
+}
+
+/*static */
+unsigned dxContactCache::getGeomSerial(dGeomID g)
+{
+    if (g == NULL) {
+        return 0;
+    }
+
+    unsigned serial = g->contact_cache_serial;
+    if (serial == 0) {
+        // zero is skipped when the counter wraps around
+        do {
+            serial = (unsigned)ThrsafeExchangeAdd(&s_geomSerial, 1) + 1;
+        } while (serial == 0);
+        // the geom may be shared by the caches of several worlds
+        if (!ThrsafeCompareExchange((volatile atomicord32 *)&g->contact_cache_serial, 0, serial)) {
+            serial = g->contact_cache_serial;
+        }
+    }
+    return serial;
+}
+
+/*static */
+unsigned dxContactCache::hashGeomPair(dGeomID g1, dGeomID g2)
+{
+    // Geoms are heap allocated, so the low bits of the addresses carry no information
+    size_t h1 = (size_t)g1 >> 4, h2 = (size_t)g2 >> 4;
+    return (unsigned)(h1 * 73856093u) ^ (unsigned)(h2 * 19349663u);
+}
+
@@ -0,0 +1,86 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+ * Contact impulse cache for warm starting of the QuickStep solver.
+ * Contact joints are normally recreated every step, so the constraint forces
+ * they were solved with are collected as the joints are destroyed and are
+ * matched to the new contacts by geom pair, features and position.
+ */
+
+
+#ifndef _ODE_CONTACT_CACHE_H_
+#define _ODE_CONTACT_CACHE_H_
+
+
+#include <ode/common.h>
+#include <ode/memory.h>
+#include <ode/contact.h>
+#include "array.h"
+
+
+struct dxContactCacheEntry
+{
+    dGeomID g1, g2;
+    unsigned serial1, serial2;  // contact_cache_serial of g1 and g2
+    int side1, side2;
+    dVector3 pos;
+    dVector3 normal;
+    dReal lambda[6];
+    int next;                   // next entry in the same hash bucket or -1
+};
+
+
+class dxContactCache
+{
+public:
+    dxContactCache(): m_stale(false), m_bucketsValid(false) {}
+
+    void *operator new (size_t size) { return dAlloc (size); }
+    void operator delete (void *ptr, size_t size) { dFree (ptr,size); }
+
+    // Called at the start of a step: the entries remain available for lookups
+    // until the first contact of the step is stored. Lookups invalidate the
+    // cache too, as the contacts destroyed after them are newer.
+    void invalidate() { m_stale = true; }
+    void clear();
+
+    void storeContact(const dContactGeom &geom, const dReal *lambda);
+    bool lookupContact(const dContactGeom &geom, dReal max_distance, dReal *out_lambda);
+
+    int getEntryCount() const { return m_entries.size(); }
+
+private:
+    void rebuildBuckets();
+
+    static unsigned hashGeomPair(dGeomID g1, dGeomID g2);
+    static unsigned getGeomSerial(dGeomID g);
+
+private:
+    dArray<dxContactCacheEntry> m_entries;
+    dArray<int> m_buckets;
+    bool m_stale;
+    bool m_bucketsValid;
+};
+
+
+#endif // #ifndef _ODE_CONTACT_CACHE_H_
@@ -38,6 +38,7 @@
 #include "collision_std.h"
 #include "collision_util.h"
 #include "heightfield.h"
+#include "threadingutils.h"
 
 
 
@@ -121,9 +122,16 @@ dxHeightfieldData::dxHeightfieldData():
     m_pHeightData( NULL ),
     m_pUserData( NULL ),
 
-    m_pGetHeightCallback( NULL )
+    m_pGetHeightCallback( NULL ),
+
+    m_pTileCache( NULL ),
+    m_pTileBounds( NULL ),
+
+    m_pPyramid( NULL ),
+    m_nPyramidLevels( 0 ),
+    m_nPyramidBlockCells( HEIGHTFIELDPYRAMIDBLOCKCELLS )
 {
-    memset( m_contacts, 0, sizeof( m_contacts ) );
+    memset( m_aPyramidLevelStart, 0, sizeof( m_aPyramidLevelStart ) );
 }
 
 // build Heightfield data
@@ -137,6 +145,9 @@ void dxHeightfieldData::SetData( int nWidthSamples, int nDepthSamples,
     dIASSERT( nWidthSamples > 0 );
     dIASSERT( nDepthSamples > 0 );
 
+    // tiles of a previous tiled build
+    FreeTiles();
+
     // x,z bounds
     m_fWidth = fWidth;
     m_fDepth = fDepth;
@@ -247,6 +258,19 @@ void dxHeightfieldData::ComputeHeightBounds()
 
         break;
 
+        // tiled
+    case 5:
+        m_fMinHeight = dInfinity;
+        m_fMaxHeight = -dInfinity;
+
+        for (i=0; i<m_pTileCache->m_nTilesX*m_pTileCache->m_nTilesZ; i++)
+        {
+            if (m_pTileBounds[i*2] < m_fMinHeight)	m_fMinHeight = m_pTileBounds[i*2];
+            if (m_pTileBounds[i*2+1] > m_fMaxHeight)	m_fMaxHeight = m_pTileBounds[i*2+1];
+        }
+
+        break;
+
     }
 
     // scale and offset
@@ -257,6 +281,211 @@ void dxHeightfieldData::ComputeHeightBounds()
 
     // add thickness
     m_fMinHeight -= m_fThickness;
+
+    BuildHeightPyramid();
+}
+
+
+// builds min/max height pyramid of the sample data
+void dxHeightfieldData::BuildHeightPyramid()
+{
+    FreeHeightPyramid();
+
+    // Level 0 is filled from the samples, or from the tile bounds of tiled
+    // data. Every next level merges 2x2 blocks of the previous one until
+    // a single block covers the whole heightfield.
+    m_nPyramidBlockCells = m_pTileCache != NULL ? m_pTileCache->m_nTileSamples : HEIGHTFIELDPYRAMIDBLOCKCELLS;
+
+    size_t total = 0;
+    int levels = 0;
+    for (int blockCells = m_nPyramidBlockCells; ; blockCells *= 2)
+    {
+        const int nbX = ( m_nWidthSamples + blockCells - 1 ) / blockCells;
+        const int nbZ = ( m_nDepthSamples + blockCells - 1 ) / blockCells;
+        dIASSERT( levels < HEIGHTFIELDPYRAMIDMAXLEVELS );
+        m_aPyramidLevelStart[levels++] = total;
+        total += (size_t)nbX * nbZ * 2;
+        if ( nbX == 1 && nbZ == 1 )
+            break;
+    }
+
+    m_pPyramid = new dReal[ total ];
+
+    int nbX = ( m_nWidthSamples + m_nPyramidBlockCells - 1 ) / m_nPyramidBlockCells;
+    int nbZ = ( m_nDepthSamples + m_nPyramidBlockCells - 1 ) / m_nPyramidBlockCells;
+    if ( m_pTileCache != NULL )
+    {
+        dIASSERT( nbX == m_pTileCache->m_nTilesX && nbZ == m_pTileCache->m_nTilesZ );
+
+        dReal *level = m_pPyramid;
+        for (int i = 0; i < nbX * nbZ * 2; i += 2)
+        {
+            const dReal h0 = ( m_pTileBounds[i] * m_fScale ) + m_fOffset;
+            const dReal h1 = ( m_pTileBounds[i + 1] * m_fScale ) + m_fOffset;
+            level[i] = dMIN( h0, h1 );
+            level[i + 1] = dMAX( h0, h1 );
+        }
+    }
+    else
+    {
+        dReal *level = m_pPyramid;
+        for (int i = 0; i < nbX * nbZ * 2; i += 2)
+        {
+            level[i] = dInfinity;
+            level[i + 1] = -dInfinity;
+        }
+
+        for (int z = 0; z < m_nDepthSamples; z++)
+        {
+            dReal *row = level + ( z / m_nPyramidBlockCells ) * nbX * 2;
+            for (int x = 0; x < m_nWidthSamples; x++)
+            {
+                const dReal h = GetHeight( x, z );
+                dReal *block = row + ( x / m_nPyramidBlockCells ) * 2;
+                if (h < block[0])	block[0] = h;
+                if (h > block[1])	block[1] = h;
+            }
+        }
+    }
+
+    for (int l = 1; l < levels; l++)
+    {
+        const dReal *src = m_pPyramid + m_aPyramidLevelStart[l - 1];
+        dReal *dst = m_pPyramid + m_aPyramidLevelStart[l];
+        const int srcX = nbX, srcZ = nbZ;
+        nbX = ( srcX + 1 ) / 2;
+        nbZ = ( srcZ + 1 ) / 2;
+
+        for (int bz = 0; bz < nbZ; bz++)
+        {
+            for (int bx = 0; bx < nbX; bx++)
+            {
+                dReal minH = dInfinity, maxH = -dInfinity;
+                for (int sz = bz * 2; sz < dMIN( bz * 2 + 2, srcZ ); sz++)
+                {
+                    for (int sx = bx * 2; sx < dMIN( bx * 2 + 2, srcX ); sx++)
+                    {
+                        const dReal *block = src + ( sz * srcX + sx ) * 2;
+                        minH = dMIN( minH, block[0] );
+                        maxH = dMAX( maxH, block[1] );
+                    }
+                }
+                dst[( bz * nbX + bx ) * 2] = minH;
+                dst[( bz * nbX + bx ) * 2 + 1] = maxH;
+            }
+        }
+    }
+
+    m_nPyramidLevels = levels;
+}
+
+
+void dxHeightfieldData::FreeHeightPyramid()
+{
+    delete [] m_pPyramid;
+    m_pPyramid = NULL;
+    m_nPyramidLevels = 0;
+}
+
+
+void dxHeightfieldData::FreeTiles()
+{
+    delete m_pTileCache;
+    m_pTileCache = NULL;
+    delete [] m_pTileBounds;
+    m_pTileBounds = NULL;
+}
+
+
+// bounds of the samples in the given ranges (inclusive, inside the sample data)
+void dxHeightfieldData::GetBlockRangeHeightBounds( int minX, int maxX, int minZ, int maxZ,
+                                                   dReal &minHeight, dReal &maxHeight ) const
+{
+    dIASSERT( minX >= 0 && maxX < m_nWidthSamples && minX <= maxX );
+    dIASSERT( minZ >= 0 && maxZ < m_nDepthSamples && minZ <= maxZ );
+
+    // Use the finest level at which the ranges span a few blocks at most
+    int level = 0, blockCells = m_nPyramidBlockCells;
+    for (; level < m_nPyramidLevels - 1; level++, blockCells *= 2)
+    {
+        if ( maxX / blockCells - minX / blockCells < 4 && maxZ / blockCells - minZ / blockCells < 4 )
+            break;
+    }
+
+    const int nbX = ( m_nWidthSamples + blockCells - 1 ) / blockCells;
+    const dReal *blocks = m_pPyramid + m_aPyramidLevelStart[level];
+    for (int bz = minZ / blockCells; bz <= maxZ / blockCells; bz++)
+    {
+        const dReal *row = blocks + bz * nbX * 2;
+        for (int bx = minX / blockCells; bx <= maxX / blockCells; bx++)
+        {
+            minHeight = dMIN( minHeight, row[bx * 2] );
+            maxHeight = dMAX( maxHeight, row[bx * 2 + 1] );
+        }
+    }
+}
+
+
+// splits a range of wrapped sample indices into at most two ranges within the period
+static int SplitWrappedRange( int minIndex, int maxIndex, int period, int ranges[4] )
+{
+    if ( maxIndex - minIndex + 1 >= period )
+    {
+        ranges[0] = 0;	ranges[1] = period - 1;
+        return 1;
+    }
+
+    int first = minIndex % period;
+    if ( first < 0 ) first += period;
+    const int last = first + ( maxIndex - minIndex );
+    if ( last < period )
+    {
+        ranges[0] = first;	ranges[1] = last;
+        return 1;
+    }
+
+    ranges[0] = first;	ranges[1] = period - 1;
+    ranges[2] = 0;		ranges[3] = last - period;
+    return 2;
+}
+
+
+// bounds of the samples a collision zone may read, false if unknown
+bool dxHeightfieldData::GetZoneHeightBounds( int minX, int maxX, int minZ, int maxZ,
+                                             dReal &minHeight, dReal &maxHeight ) const
+{
+    if ( m_nPyramidLevels == 0 )
+        return false;
+
+    // Split the sample ranges into intervals within the data the same way
+    // GetHeight() maps coordinates
+    int rangesX[4], rangesZ[4];
+    int numRangesX = 1, numRangesZ = 1;
+    if ( m_bWrapMode == 0 )
+    {
+        rangesX[0] = dMAX( minX, 0 );	rangesX[1] = dMIN( maxX, m_nWidthSamples - 1 );
+        rangesZ[0] = dMAX( minZ, 0 );	rangesZ[1] = dMIN( maxZ, m_nDepthSamples - 1 );
+        if ( rangesX[0] > rangesX[1] || rangesZ[0] > rangesZ[1] )
+            return false;
+    }
+    else
+    {
+        const int periodX = m_nWidthSamples - 1, periodZ = m_nDepthSamples - 1;
+        numRangesX = SplitWrappedRange( minX, maxX, periodX, rangesX );
+        numRangesZ = SplitWrappedRange( minZ, maxZ, periodZ, rangesZ );
+    }
+
+    minHeight = dInfinity;
+    maxHeight = -dInfinity;
+    for (int i = 0; i < numRangesX; i++)
+    {
+        for (int j = 0; j < numRangesZ; j++)
+        {
+            GetBlockRangeHeightBounds( rangesX[i * 2], rangesX[i * 2 + 1],
+                rangesZ[j * 2], rangesZ[j * 2 + 1], minHeight, maxHeight );
+        }
+    }
+    return true;
 }
 
 
@@ -378,6 +607,11 @@ dReal dxHeightfieldData::GetHeight( int x, int z )
         data_double = (double*)m_pHeightData;
         h = (dReal)( data_double[x+(z * m_nWidthSamples)] );
         break;
+
+        // tiled
+    case 5:
+        h = m_pTileCache->GetSample( x, z );
+        break;
     }
 
     return (h * m_fScale) + m_fOffset;
@@ -428,6 +662,9 @@ dxHeightfieldData::~dxHeightfieldData()
     float *data_float;
     double *data_double;
 
+    FreeHeightPyramid();
+    FreeTiles();
+
     if ( m_bCopyHeightData )
     {
         switch ( m_nGetHeightMode )
@@ -471,6 +708,138 @@ dxHeightfieldData::~dxHeightfieldData()
 }
 
 
+//////// dxHeightfieldTileCache ////////////////////////////////////////////////////////
+
+
+dxHeightfieldTileCache::dxHeightfieldTileCache( void *pUserData, dHeightfieldGetTile *pCallback,
+                                               int nTileSamples, int nTilesX, int nTilesZ, int nMaxResidentTiles ):
+    m_pUserData( pUserData ),
+    m_pGetTileCallback( pCallback ),
+    m_nTileSamples( nTileSamples ),
+    m_nTilesX( nTilesX ),
+    m_nTilesZ( nTilesZ ),
+    m_nMaxResidentTiles( nMaxResidentTiles ),
+    m_nResidentTiles( 0 ),
+    m_nLoadCounter( 0 )
+{
+    m_pTileSlots = new atomicord32[ nTilesX * nTilesZ ];
+    for (int i = 0; i < nTilesX * nTilesZ; i++)
+        m_pTileSlots[i] = TILE_NOT_LOADED;
+
+    m_pSlots = new Slot[ nMaxResidentTiles ];
+    for (int i = 0; i < nMaxResidentTiles; i++)
+    {
+        m_pSlots[i].tile = SLOT_EMPTY;
+        m_pSlots[i].state = 0;
+        m_pSlots[i].heights = NULL;
+        m_pSlots[i].buffer = NULL;
+        m_pSlots[i].lastUse = 0;
+    }
+}
+
+dxHeightfieldTileCache::~dxHeightfieldTileCache()
+{
+    for (int i = 0; i < m_nMaxResidentTiles; i++)
+        delete [] m_pSlots[i].buffer;
+    delete [] m_pSlots;
+    delete [] m_pTileSlots;
+}
+
+dReal dxHeightfieldTileCache::GetSample( int x, int z )
+{
+    const int tileX = x / m_nTileSamples, tileZ = z / m_nTileSamples;
+    dIASSERT( tileX < m_nTilesX && tileZ < m_nTilesZ );
+    const unsigned tile = tileZ * m_nTilesX + tileX;
+
+    Slot &s = m_pSlots[PinTile( tile )];
+    const dReal h = s.heights[( z - tileZ * m_nTileSamples ) * m_nTileSamples + ( x - tileX * m_nTileSamples )];
+
+    // Only write the line when the clock moved, reads of a hot tile stay shared
+    const atomicord32 clock = m_nLoadCounter;
+    if ( s.lastUse != clock )
+        s.lastUse = clock;
+
+    ThrsafeExchangeAdd( &s.state, (atomicord32)-1 );
+    return h;
+}
+
+// returns the slot of the tile with a pin added, loads the tile when nobody else does
+unsigned dxHeightfieldTileCache::PinTile( unsigned tile )
+{
+    for (;;)
+    {
+        const unsigned slot = (unsigned)m_pTileSlots[tile];
+        if ( slot < TILE_LOADING )
+        {
+            Slot &s = m_pSlots[slot];
+            // The slot may have been refilled with another tile since the lookup
+            if ( ( ThrsafeExchangeAdd( &s.state, 1 ) & SLOT_CLAIMED ) == 0 && (unsigned)s.tile == tile )
+                return slot;
+            ThrsafeExchangeAdd( &s.state, (atomicord32)-1 );
+        }
+        else if ( slot == TILE_NOT_LOADED
+            && ThrsafeCompareExchange( &m_pTileSlots[tile], TILE_NOT_LOADED, TILE_LOADING ) )
+        {
+            return LoadTile( tile );
+        }
+        // otherwise another thread is loading the tile
+    }
+}
+
+// brings a tile into a free or the least recently used unpinned slot, called
+// by the thread that marked the tile as loading. Returns the slot pinned.
+unsigned dxHeightfieldTileCache::LoadTile( unsigned tile )
+{
+    unsigned slot;
+    for (;;)
+    {
+        int best = -1;
+        for (int i = 0; i < m_nMaxResidentTiles; i++)
+        {
+            const Slot &s = m_pSlots[i];
+            if ( s.state != 0 )
+                continue;
+            if ( (unsigned)s.tile == SLOT_EMPTY )
+            {
+                best = i;
+                break;
+            }
+            // counter differences handle the wrap around
+            if ( best < 0 || (int)( s.lastUse - m_pSlots[best].lastUse ) < 0 )
+                best = i;
+        }
+
+        // Every slot is read or refilled, they are all released shortly
+        if ( best >= 0 && ThrsafeCompareExchange( &m_pSlots[best].state, 0, SLOT_CLAIMED ) )
+        {
+            slot = best;
+            break;
+        }
+    }
+
+    Slot &s = m_pSlots[slot];
+    if ( (unsigned)s.tile != SLOT_EMPTY )
+    {
+        ThrsafeExchange( &m_pTileSlots[s.tile], TILE_NOT_LOADED );
+    }
+    else
+    {
+        s.buffer = new dReal[ (size_t)m_nTileSamples * m_nTileSamples ];
+        ThrsafeExchangeAdd( &m_nResidentTiles, 1 );
+    }
+    s.tile = tile;
+    s.lastUse = ThrsafeExchangeAdd( &m_nLoadCounter, 1 ) + 1;
+
+    // No lock is held here, the claim only keeps other threads off this slot
+    s.heights = (*m_pGetTileCallback)( m_pUserData, tile % m_nTilesX, tile / m_nTilesX, s.buffer );
+    dIASSERT( s.heights != NULL );
+
+    ThrsafeExchange( &s.state, 1 );
+    ThrsafeExchange( &m_pTileSlots[tile], slot );
+    return slot;
+}
+
+
 //////// dxHeightfield /////////////////////////////////////////////////////////////////
 
 
@@ -479,15 +848,7 @@ dxHeightfield::dxHeightfield( dSpaceID space,
                              dHeightfieldDataID data,
                              int bPlaceable )			:
     dxGeom( space, bPlaceable ),
-    tempPlaneBuffer(0),
-    tempPlaneInstances(0),
-    tempPlaneBufferSize(0),
-    tempTriangleBuffer(0),
-    tempTriangleBufferSize(0),
-    tempHeightBuffer(0),
-    tempHeightInstances(0),
-    tempHeightBufferSizeX(0),
-    tempHeightBufferSizeZ(0)
+    m_pCachedScratch(NULL)
 {
     type = dHeightfieldClass;
     this->m_p_data = data;
@@ -625,25 +986,64 @@ void dxHeightfield::computeAABB()
 
 // dxHeightfield destructor
 dxHeightfield::~dxHeightfield()
+{
+    delete m_pCachedScratch;
+}
+
+// takes the cached scratch buffers or creates new ones if another collision owns them
+dxHeightfieldScratch *dxHeightfield::acquireScratch()
+{
+    dxHeightfieldScratch *scratch = (dxHeightfieldScratch *)ThrsafeExchangePointer((volatile atomicptr *)&m_pCachedScratch, (atomicptr)NULL);
+    return scratch != NULL ? scratch : new dxHeightfieldScratch();
+}
+
+// returns scratch buffers to the cache or deletes them if the cache is already filled
+void dxHeightfield::releaseScratch(dxHeightfieldScratch *scratch)
+{
+    if (!ThrsafeCompareExchangePointer((volatile atomicptr *)&m_pCachedScratch, (atomicptr)NULL, (atomicptr)scratch))
+    {
+        delete scratch;
+    }
+}
+
+
+//////// dxHeightfieldScratch //////////////////////////////////////////////////////////
+
+
+dxHeightfieldScratch::dxHeightfieldScratch():
+    tempPlaneBuffer(0),
+    tempPlaneInstances(0),
+    tempPlaneBufferSize(0),
+    tempTriangleBuffer(0),
+    tempTriangleBufferSize(0),
+    tempHeightBuffer(0),
+    tempHeightInstances(0),
+    tempHeightBufferSizeX(0),
+    tempHeightBufferSizeZ(0)
+{
+    memset( m_contacts, 0, sizeof( m_contacts ) );
+}
+
+dxHeightfieldScratch::~dxHeightfieldScratch()
 {
     resetTriangleBuffer();
     resetPlaneBuffer();
     resetHeightBuffer();
 }
 
-void dxHeightfield::allocateTriangleBuffer(size_t numTri)
+void dxHeightfieldScratch::allocateTriangleBuffer(size_t numTri)
 {
     size_t alignedNumTri = AlignBufferSize(numTri, TEMP_TRIANGLE_BUFFER_ELEMENT_COUNT_ALIGNMENT);
     tempTriangleBufferSize = alignedNumTri;
     tempTriangleBuffer = new HeightFieldTriangle[alignedNumTri];
 }
 
-void dxHeightfield::resetTriangleBuffer()
+void dxHeightfieldScratch::resetTriangleBuffer()
 {
     delete[] tempTriangleBuffer;
 }
 
-void dxHeightfield::allocatePlaneBuffer(size_t numTri)
+void dxHeightfieldScratch::allocatePlaneBuffer(size_t numTri)
 {
     size_t alignedNumTri = AlignBufferSize(numTri, TEMP_PLANE_BUFFER_ELEMENT_COUNT_ALIGNMENT);
     tempPlaneBufferSize = alignedNumTri;
@@ -658,13 +1058,13 @@ void dxHeightfield::allocatePlaneBuffer(size_t numTri)
     }
 }
 
-void dxHeightfield::resetPlaneBuffer()
+void dxHeightfieldScratch::resetPlaneBuffer()
 {
     delete[] tempPlaneInstances;
     delete[] tempPlaneBuffer;
 }
 
-void dxHeightfield::allocateHeightBuffer(size_t numX, size_t numZ)
+void dxHeightfieldScratch::allocateHeightBuffer(size_t numX, size_t numZ)
 {
     size_t alignedNumX = AlignBufferSize(numX, TEMP_HEIGHT_BUFFER_ELEMENT_COUNT_ALIGNMENT_X);
     size_t alignedNumZ = AlignBufferSize(numZ, TEMP_HEIGHT_BUFFER_ELEMENT_COUNT_ALIGNMENT_Z);
@@ -682,7 +1082,7 @@ void dxHeightfield::allocateHeightBuffer(size_t numX, size_t numZ)
     }
 }
 
-void dxHeightfield::resetHeightBuffer()
+void dxHeightfieldScratch::resetHeightBuffer()
 {
     delete[] tempHeightInstances;
     delete[] tempHeightBuffer;
@@ -717,6 +1117,9 @@ void dGeomHeightfieldDataBuildCallback( dHeightfieldDataID d,
     // default bounds
     d->m_fMinHeight = -dInfinity;
     d->m_fMaxHeight = dInfinity;
+
+    // heights are unknown until queried
+    d->FreeHeightPyramid();
 }
 
 
@@ -865,11 +1268,54 @@ void dGeomHeightfieldDataBuildDouble( dHeightfieldDataID d,
 
 
 
+void dGeomHeightfieldDataBuildTiled( dHeightfieldDataID d,
+                                    void* pUserData, dHeightfieldGetTile* pCallback,
+                                    const dReal* pTileBounds, int tileSamples, int maxResidentTiles,
+                                    dReal width, dReal depth, int widthSamples, int depthSamples,
+                                    dReal scale, dReal offset, dReal thickness, int bWrap )
+{
+    dUASSERT( d, "argument not Heightfield data" );
+    dAASSERT( pCallback );
+    dAASSERT( pTileBounds );
+    dUASSERT( tileSamples >= 1, "tiles need at least one sample" );
+    dUASSERT( maxResidentTiles >= 1, "at least one tile must stay in memory" );
+    dUASSERT( widthSamples >= 2 && depthSamples >= 2, "heightfield needs at least one cell" );
+
+    // set info
+    d->SetData( widthSamples, depthSamples, width, depth, scale, offset, thickness, bWrap );
+    d->m_nGetHeightMode = 5;
+    d->m_bCopyHeightData = 0;
+    d->m_pHeightData = NULL;
+
+    const int tilesX = ( widthSamples + tileSamples - 1 ) / tileSamples;
+    const int tilesZ = ( depthSamples + tileSamples - 1 ) / tileSamples;
+    d->m_pTileCache = new dxHeightfieldTileCache( pUserData, pCallback,
+        tileSamples, tilesX, tilesZ, maxResidentTiles );
+
+    d->m_pTileBounds = new dReal[ tilesX * tilesZ * 2 ];
+    memcpy( d->m_pTileBounds, pTileBounds, sizeof( dReal ) * tilesX * tilesZ * 2 );
+
+    // Find height bounds
+    d->ComputeHeightBounds();
+}
+
+
+int dGeomHeightfieldDataGetResidentTileCount( dHeightfieldDataID d )
+{
+    dUASSERT( d, "argument not Heightfield data" );
+    return d->m_pTileCache != NULL ? (int)d->m_pTileCache->m_nResidentTiles : 0;
+}
+
+
 void dGeomHeightfieldDataSetBounds( dHeightfieldDataID d, dReal minHeight, dReal maxHeight )
 {
     dUASSERT(d, "Argument not Heightfield data");
     d->m_fMinHeight = ( minHeight * d->m_fScale ) + d->m_fOffset - d->m_fThickness;
     d->m_fMaxHeight = ( maxHeight * d->m_fScale ) + d->m_fOffset;
+
+    // Explicit bounds are set for data that changes after the build,
+    // block bounds computed from the samples are no longer reliable
+    d->FreeHeightPyramid();
 }
 
 
@@ -930,7 +1376,7 @@ static inline bool DescendingPlaneSort(const HeightFieldPlane * const A, const H
     return ((A->maxAAAB - B->maxAAAB) > dEpsilon);
 }
 
-void dxHeightfield::sortPlanes(const size_t numPlanes)
+void dxHeightfieldScratch::sortPlanes(const size_t numPlanes)
 {
     bool has_swapped = true;
     do
@@ -972,8 +1418,55 @@ static inline dReal DistancePointToLine(const dVector3 &_point,
 
 
 
+void dxHeightfieldFrame::ToWorldPoint(dVector3 res, const dVector3 a) const
+{
+    dVector3 local;
+    local[0] = a[0] - offsetX;
+    local[1] = a[1];
+    local[2] = a[2] - offsetZ;
+    if (R)
+    {
+        dMultiply0_331(res, R, local);
+        dAddVectors3(res, res, pos);
+    }
+    else
+        dCopyVector3(res, local);
+}
+
+void dxHeightfieldFrame::ToWorldVector(dVector3 res, const dVector3 a) const
+{
+    if (R)
+        dMultiply0_331(res, R, a);
+    else
+        dCopyVector3(res, a);
+}
+
+void dxHeightfieldFrame::ToWorldPlane(dVector4 res, const dVector4 a) const
+{
+    ToWorldVector(res, a);
+    res[3] = a[3] - a[0] * offsetX - a[2] * offsetZ;
+    if (R)
+        res[3] += dCalcVectorDot3(res, pos);
+}
+
+void dxHeightfieldFrame::ToLocalPoint(dVector3 res, const dVector3 a) const
+{
+    if (R)
+    {
+        dVector3 rel;
+        dSubtractVectors3(rel, a, pos);
+        dMultiply1_331(res, R, rel);
+    }
+    else
+        dCopyVector3(res, a);
+    res[0] += offsetX;
+    res[2] += offsetZ;
+}
+
+
 int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, const int minZ, const int maxZ, 
-                                           dxGeom* o2, const int numMaxContactsPossible,
+                                           dxGeom* o2, const dReal *o2aabb, const dxHeightfieldFrame &frame,
+                                           dxHeightfieldScratch *scratch, const int numMaxContactsPossible,
                                            int flags, dContactGeom* contact, 
                                            int skip )
 {
@@ -983,8 +1476,8 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
     // while filling a heightmap partial temporary buffer
     const unsigned int numX = (maxX - minX) + 1;
     const unsigned int numZ = (maxZ - minZ) + 1;
-    const dReal minO2Height = o2->aabb[2];
-    const dReal maxO2Height = o2->aabb[3];
+    const dReal minO2Height = o2aabb[2];
+    const dReal maxO2Height = o2aabb[3];
     unsigned int x_local, z_local;
     dReal maxY = - dInfinity;
     dReal minY = dInfinity;
@@ -992,10 +1485,18 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
     const dReal cfSampleWidth = m_p_data->m_fSampleWidth;
     const dReal cfSampleDepth = m_p_data->m_fSampleDepth;
     {
-        if (tempHeightBufferSizeX < numX || tempHeightBufferSizeZ < numZ)
+        // reject zones the geom is above of without reading the samples
+        dReal zoneMinY, zoneMaxY;
+        if (m_p_data->GetZoneHeightBounds(minX, maxX, minZ, maxZ, zoneMinY, zoneMaxY)
+            && minO2Height - zoneMaxY > -dEpsilon)
+        {
+            return 0;
+        }
+
+        if (scratch->tempHeightBufferSizeX < numX || scratch->tempHeightBufferSizeZ < numZ)
         {
-            resetHeightBuffer();
-            allocateHeightBuffer(numX, numZ);
+            scratch->resetHeightBuffer();
+            scratch->allocateHeightBuffer(numX, numZ);
         }
 
         dReal Xpos, Ypos;
@@ -1005,7 +1506,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
             Xpos = x * cfSampleWidth; // Always calculate pos via multiplication to avoid computational error accumulation during multiple additions
 
             const dReal c_Xpos = Xpos;
-            HeightFieldVertex *HeightFieldRow = tempHeightBuffer[x_local];
+            HeightFieldVertex *HeightFieldRow = scratch->tempHeightBuffer[x_local];
             for ( z = minZ, z_local = 0; z_local < numZ; z++, z_local++)
             {
                 Ypos = z * cfSampleDepth; // Always calculate pos via multiplication to avoid computational error accumulation during multiple additions
@@ -1031,13 +1532,13 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
             // totally under heightfield
             pContact = CONTACT(contact, 0);
 
-            pContact->pos[0] = o2->final_posr->pos[0];
-            pContact->pos[1] = minY;
-            pContact->pos[2] = o2->final_posr->pos[2];
+            dVector3 localPos;
+            frame.ToLocalPoint(localPos, o2->final_posr->pos);
+            localPos[1] = minY;
+            frame.ToWorldPoint(pContact->pos, localPos);
 
-            pContact->normal[0] = 0;
-            pContact->normal[1] = - 1;
-            pContact->normal[2] = 0;
+            const dVector3 down = { 0, -1, 0 };
+            frame.ToWorldVector(pContact->normal, down);
 
             pContact->depth =  minY - maxO2Height;
 
@@ -1128,6 +1629,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
         triplane[1] = 1;
         triplane[2] = 0;
         triplane[3] =  minY;
+        frame.ToWorldPlane(triplane, triplane);
         dGeomPlaneSetNoNormalize (sliding_plane, triplane);
         // find collision and compute contact points
         const int numTerrainContacts = geomNPlaneCollider (o2, sliding_plane, flags, contact, skip);
@@ -1218,13 +1720,13 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
     */
 
     int numTerrainContacts = 0;
-    dContactGeom *PlaneContact = m_p_data->m_contacts;
+    dContactGeom *PlaneContact = scratch->m_contacts;
 
     const unsigned int numTriMax = (maxX - minX) * (maxZ - minZ) * 2;
-    if (tempTriangleBufferSize < numTriMax)
+    if (scratch->tempTriangleBufferSize < numTriMax)
     {
-        resetTriangleBuffer();
-        allocateTriangleBuffer(numTriMax);
+        scratch->resetTriangleBuffer();
+        scratch->allocateTriangleBuffer(numTriMax);
     }
 
     // Sorting triangle/plane  resulting from heightfield zone
@@ -1248,12 +1750,12 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
     // no FurtherPasses are needed in ray class
     if (o2->type != dRayClass  && needFurtherPasses == false)
     {
-        const dReal xratio = (o2->aabb[1] - o2->aabb[0]) * m_p_data->m_fInvSampleWidth;
+        const dReal xratio = (o2aabb[1] - o2aabb[0]) * m_p_data->m_fInvSampleWidth;
         if (xratio > REAL(1.5))
             needFurtherPasses = true;
         else
         {
-            const dReal zratio = (o2->aabb[5] - o2->aabb[4]) * m_p_data->m_fInvSampleDepth;
+            const dReal zratio = (o2aabb[5] - o2aabb[4]) * m_p_data->m_fInvSampleDepth;
             if (zratio > REAL(1.5))
                 needFurtherPasses = true;
         }
@@ -1285,8 +1787,8 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
     for ( x_local = 0; x_local < maxX_local; x_local++)
     {
-        HeightFieldVertex *HeightFieldRow      = tempHeightBuffer[x_local];
-        HeightFieldVertex *HeightFieldNextRow  = tempHeightBuffer[x_local + 1];
+        HeightFieldVertex *HeightFieldRow      = scratch->tempHeightBuffer[x_local];
+        HeightFieldVertex *HeightFieldNextRow  = scratch->tempHeightBuffer[x_local + 1];
 
         // First A
         C = &HeightFieldRow    [0];
@@ -1318,7 +1820,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
             if (isACollide || isBCollide || isCCollide)
             {
-                HeightFieldTriangle * const CurrTriUp = &tempTriangleBuffer[numTri++];
+                HeightFieldTriangle * const CurrTriUp = &scratch->tempTriangleBuffer[numTri++];
 
                 CurrTriUp->state = false;
 
@@ -1334,7 +1836,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
             if (isBCollide || isCCollide || isDCollide)
             {
-                HeightFieldTriangle * const CurrTriDown = &tempTriangleBuffer[numTri++];
+                HeightFieldTriangle * const CurrTriDown = &scratch->tempTriangleBuffer[numTri++];
 
                 CurrTriDown->state = false;
                 // changing point order here implies to change it in isOnHeightField
@@ -1380,7 +1882,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
         //compute all triangles normals.
         for (unsigned int k = 0; k < numTri; k++)
         {
-            HeightFieldTriangle * const itTriangle = &tempTriangleBuffer[k];
+            HeightFieldTriangle * const itTriangle = &scratch->tempTriangleBuffer[k];
 
             // define 2 edges and a point that will define collision plane
             dVector3Subtract(itTriangle->vertices[2]->vertex, itTriangle->vertices[0]->vertex, Edge1);
@@ -1408,21 +1910,21 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
         }
 
         // group by Triangles by Planes sharing shame plane definition
-        if (tempPlaneBufferSize  < numTri)
+        if (scratch->tempPlaneBufferSize  < numTri)
         {
-            resetPlaneBuffer();
-            allocatePlaneBuffer(numTri);
+            scratch->resetPlaneBuffer();
+            scratch->allocatePlaneBuffer(numTri);
         }
 
         unsigned int numPlanes = 0;
         for (unsigned int k = 0; k < numTri; k++)
         {
-            HeightFieldTriangle * const tri_base = &tempTriangleBuffer[k];
+            HeightFieldTriangle * const tri_base = &scratch->tempTriangleBuffer[k];
 
             if (tri_base->state == true)
                 continue;// already tested or added to plane list.
 
-            HeightFieldPlane * const currPlane = tempPlaneBuffer[numPlanes];
+            HeightFieldPlane * const currPlane = scratch->tempPlaneBuffer[numPlanes];
             currPlane->resetTriangleListSize(numTri - k);
             currPlane->addTriangle(tri_base);
             // saves normal for collision check (planes, triangles, vertices and edges.)
@@ -1438,7 +1940,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
             for (unsigned int m = k + 1; m < numTri; m++)
             {
 
-                HeightFieldTriangle * const tri_test = &tempTriangleBuffer[m];
+                HeightFieldTriangle * const tri_test = &scratch->tempTriangleBuffer[m];
                 if (tri_test->state == true)
                     continue;// already tested or added to plane list.
 
@@ -1464,7 +1966,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
         // sort planes
         if (isContactNumPointsLimited)
-            sortPlanes(numPlanes);
+            scratch->sortPlanes(numPlanes);
 
 #if !defined(NO_CONTACT_CULLING_BY_ISONHEIGHTFIELD2)
         /*
@@ -1487,10 +1989,12 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
         for (unsigned int k = 0; k < numPlanes; k++)
         {
-            HeightFieldPlane * const itPlane = tempPlaneBuffer[k];
+            HeightFieldPlane * const itPlane = scratch->tempPlaneBuffer[k];
 
             //set Geom
-            dGeomPlaneSetNoNormalize (sliding_plane,  itPlane->planeDef);
+            dVector4 worldPlane;
+            frame.ToWorldPlane(worldPlane, itPlane->planeDef);
+            dGeomPlaneSetNoNormalize (sliding_plane,  worldPlane);
             //dGeomPlaneSetParams (sliding_plane, triangle_Plane[0], triangle_Plane[1], triangle_Plane[2], triangle_Plane[3]);
             // find collision and compute contact points
             bool didCollide = false;
@@ -1501,15 +2005,17 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                 dContactGeom *planeCurrContact = PlaneContact + i;
                 // Check if contact point found in plane is inside Triangle.
                 const dVector3 &pCPos = planeCurrContact->pos;
+                dVector3 localPos;
+                frame.ToLocalPoint(localPos, pCPos);
                 for (size_t b = 0; planeTriListSize > b; b++)
                 {  
                     if (m_p_data->IsOnHeightfield2 (itPlane->trianglelist[b]->vertices[0], 
-                        pCPos, 
+                        localPos, 
                         itPlane->trianglelist[b]->isUp))
                     {
                         pContact = CONTACT(contact, numTerrainContacts*skip);
                         dVector3Copy(pCPos, pContact->pos);
-                        dOPESIGN(pContact->normal, =, -, itPlane->planeDef);
+                        dOPESIGN(pContact->normal, =, -, worldPlane);
                         pContact->depth = planeCurrContact->depth;
                         pContact->side1 = planeCurrContact->side1;
                         pContact->side2 = planeCurrContact->side2;
@@ -1569,7 +2075,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
         //
         for (unsigned int k = 0; k < numTri; k++)
         {
-            const HeightFieldTriangle * const itTriangle = &tempTriangleBuffer[k];
+            const HeightFieldTriangle * const itTriangle = &scratch->tempTriangleBuffer[k];
             if (itTriangle->state == true)
                 continue;// plane triangle did already collide.
 
@@ -1580,7 +2086,9 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                     continue;// vertice did already collide.
 
                 vertexCollided = false;
-                const dVector3 &triVertex = vertex->vertex;
+                dVector3 triVertex, triNormal;
+                frame.ToWorldPoint(triVertex, vertex->vertex);
+                frame.ToWorldVector(triNormal, itTriangle->planeDef);
                 if ( geomNDepthGetter )
                 {
                     depth = geomNDepthGetter( o2,
@@ -1593,11 +2101,11 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                     // We don't have a GetDepth function, so do a ray cast instead.
                     // NOTE: This isn't ideal, and a GetDepth function should be
                     // written for all geom classes.
-                    tempRay.length = (minO2Height - triVertex[1]) * REAL(1000.0);
+                    tempRay.length = (minO2Height - vertex->vertex[1]) * REAL(1000.0);
 
                     //dGeomRaySet( &tempRay, pContact->pos[0], pContact->pos[1], pContact->pos[2],
                     //    - itTriangle->Normal[0], - itTriangle->Normal[1], - itTriangle->Normal[2] );
-                    dGeomRaySetNoNormalize(tempRay, triVertex, itTriangle->planeDef);
+                    dGeomRaySetNoNormalize(tempRay, triVertex, triNormal);
 
                     if ( geomRayNCollider( &tempRay, o2, rayTestFlags, PlaneContact, sizeof( dContactGeom ) ) )
                     {
@@ -1611,7 +2119,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                     //create contact using vertices
                     dVector3Copy (triVertex, pContact->pos);
                     //create contact using Plane Normal
-                    dOPESIGN(pContact->normal, =, -, itTriangle->planeDef);
+                    dOPESIGN(pContact->normal, =, -, triNormal);
 
                     pContact->depth = depth;
                     pContact->side1 = -1;
@@ -1640,7 +2148,7 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
 
         for (unsigned int k = 0; k < numTri; k++)
         {
-            const HeightFieldTriangle * const itTriangle = &tempTriangleBuffer[k];
+            const HeightFieldTriangle * const itTriangle = &scratch->tempTriangleBuffer[k];
 
             if (itTriangle->state == true)
                 continue;// plane did already collide.
@@ -1656,9 +2164,12 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                 if (vertex0->state == true && vertex1->state == true)
                     continue;// plane did already collide.
 
-                dVector3Subtract(vertex1->vertex, vertex0->vertex, Edge);
+                dVector3 edgeStart, edgeEnd;
+                frame.ToWorldPoint(edgeStart, vertex0->vertex);
+                frame.ToWorldPoint(edgeEnd, vertex1->vertex);
+                dVector3Subtract(edgeEnd, edgeStart, Edge);
                 edgeRay.length = dVector3Length (Edge);
-                dGeomRaySetNoNormalize(edgeRay, vertex1->vertex, Edge);
+                dGeomRaySetNoNormalize(edgeRay, edgeEnd, Edge);
                 int prevTerrainContacts = numTerrainContacts;
                 pContact = CONTACT(contact, prevTerrainContacts*skip);
                 const int numCollision = geomRayNCollider(&edgeRay,o2,triTestFlags,pContact,skip);
@@ -1668,14 +2179,16 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
                 {
                     numTerrainContacts += numCollision;
 
+                    dVector3 triNormal;
+                    frame.ToWorldVector(triNormal, itTriangle->planeDef);
                     do
                     {
                         pContact = CONTACT(contact, prevTerrainContacts*skip);
 
                         //create contact using Plane Normal
-                        dOPESIGN(pContact->normal, =, -, itTriangle->planeDef);
+                        dOPESIGN(pContact->normal, =, -, triNormal);
 
-                        pContact->depth = DistancePointToLine(pContact->pos, vertex1->vertex, Edge, edgeRay.length);
+                        pContact->depth = DistancePointToLine(pContact->pos, edgeEnd, Edge, edgeRay.length);
                     }
                     while (++prevTerrainContacts != numTerrainContacts);
 
@@ -1697,6 +2210,95 @@ int dxHeightfield::dCollideHeightfieldZone( const int minX, const int maxX, cons
     return numTerrainContacts;
 }
 
+// AABB of o2 in heightfield space. Primitives get the box their own
+// computeAABB() would produce in that space; for other classes the box
+// enclosing the world AABB is used if the heightfield is rotated.
+static void ComputeHeightfieldSpaceAABB( dxGeom *o2, const dxHeightfieldFrame &frame, dReal aabb[6] )
+{
+    int i;
+
+    o2->recomputeAABB();
+
+    if ( frame.R == NULL )
+    {
+        memcpy( aabb, o2->aabb, sizeof( dReal ) * 6 );
+        aabb[0] += frame.offsetX;	aabb[1] += frame.offsetX;
+        aabb[4] += frame.offsetZ;	aabb[5] += frame.offsetZ;
+        return;
+    }
+
+    dVector3 center, range;
+    dMatrix3 R;
+    dMultiply1_333( R, frame.R, o2->final_posr->R );
+    frame.ToLocalPoint( center, o2->final_posr->pos );
+
+    switch ( o2->type )
+    {
+    case dSphereClass:
+        {
+            const dReal radius = ((dxSphere *)o2)->radius;
+            range[0] = range[1] = range[2] = radius;
+        }
+        break;
+
+    case dBoxClass:
+        {
+            const dReal *side = ((dxBox *)o2)->side;
+            for ( i = 0; i < 3; i++ )
+            {
+                range[i] = REAL(0.5) * ( dFabs( R[i * 4] * side[0] ) +
+                    dFabs( R[i * 4 + 1] * side[1] ) + dFabs( R[i * 4 + 2] * side[2] ) );
+            }
+        }
+        break;
+
+    case dCapsuleClass:
+        {
+            const dxCapsule *capsule = (dxCapsule *)o2;
+            for ( i = 0; i < 3; i++ )
+                range[i] = dFabs( R[i * 4 + 2] * capsule->lz ) * REAL(0.5) + capsule->radius;
+        }
+        break;
+
+    case dCylinderClass:
+        {
+            const dxCylinder *cylinder = (dxCylinder *)o2;
+            for ( i = 0; i < 3; i++ )
+            {
+                const dReal oneMinusSquare = REAL(1.0) - R[i * 4 + 2] * R[i * 4 + 2];
+                range[i] = dFabs( R[i * 4 + 2] * cylinder->lz * REAL(0.5) )
+                    + cylinder->radius * dSqrt( dMAX( REAL(0.0), oneMinusSquare ) );
+            }
+        }
+        break;
+
+    default:
+        {
+            dVector3 worldCenter, worldRange;
+            for ( i = 0; i < 3; i++ )
+            {
+                worldCenter[i] = ( o2->aabb[i * 2] + o2->aabb[i * 2 + 1] ) * REAL(0.5);
+                worldRange[i] = ( o2->aabb[i * 2 + 1] - o2->aabb[i * 2] ) * REAL(0.5);
+            }
+            frame.ToLocalPoint( center, worldCenter );
+
+            for ( i = 0; i < 3; i++ )
+            {
+                range[i] = dFabs( frame.R[i] ) * worldRange[0]
+                    + dFabs( frame.R[4 + i] ) * worldRange[1]
+                    + dFabs( frame.R[8 + i] ) * worldRange[2];
+            }
+        }
+        break;
+    }
+
+    for ( i = 0; i < 3; i++ )
+    {
+        aabb[i * 2] = center[i] - range[i];
+        aabb[i * 2 + 1] = center[i] + range[i];
+    }
+}
+
 int dCollideHeightfield( dxGeom *o1, dxGeom *o2, int flags, dContactGeom* contact, int skip )
 {
     dIASSERT( skip >= (int)sizeof(dContactGeom) );
@@ -1712,58 +2314,37 @@ int dCollideHeightfield( dxGeom *o1, dxGeom *o2, int flags, dContactGeom* contac
 
     dxHeightfield *terrain = (dxHeightfield*) o1;
 
-    dVector3 posbak;
-    dMatrix3 Rbak;
-    dReal aabbbak[6];
-    int gflagsbak;
-    dVector3 pos0,pos1;
-    dMatrix3 R1;
-
     int numTerrainContacts = 0;
     int numTerrainOrigContacts = 0;
 
-    //@@ Should find a way to set reComputeAABB to false in default case
-    // aka DHEIGHTFIELD_CORNER_ORIGIN not defined and terrain not PLACEABLE
-    // so that we can free some memory and speed up things a bit
-    // while saving some precision loss 
-#ifndef DHEIGHTFIELD_CORNER_ORIGIN
-    const bool reComputeAABB = true;
-#else
-    const bool reComputeAABB = ( terrain->gflags & GEOM_PLACEABLE ) ? true : false;
-#endif //DHEIGHTFIELD_CORNER_ORIGIN
-
     //
-    // Transform O2 into Heightfield Space
+    // Heightfield space <-> world space mapping
     //
-    if (reComputeAABB)
+    // O2 is left untouched so that several heightfields may collide with it
+    // at once; heightfield planes and points are moved to world space instead.
+    //
+    dxHeightfieldFrame frame;
+    if ( terrain->gflags & GEOM_PLACEABLE )
     {
-        // Backup original o2 position, rotation and AABB.
-        dVector3Copy( o2->final_posr->pos, posbak );
-        dMatrix3Copy( o2->final_posr->R, Rbak );
-        memcpy( aabbbak, o2->aabb, sizeof( dReal ) * 6 );
-        gflagsbak = o2->gflags;
+        frame.R = terrain->final_posr->R;
+        frame.pos = terrain->final_posr->pos;
     }
-
-    if ( terrain->gflags & GEOM_PLACEABLE )
+    else
     {
-        // Transform o2 into heightfield space.
-        dSubtractVectors3( pos0, o2->final_posr->pos, terrain->final_posr->pos );
-        dMultiply1_331( pos1, terrain->final_posr->R, pos0 );
-        dMultiply1_333( R1, terrain->final_posr->R, o2->final_posr->R );
-
-        // Update o2 with transformed position and rotation.
-        dVector3Copy( pos1, o2->final_posr->pos );
-        dMatrix3Copy( R1, o2->final_posr->R );
+        frame.R = NULL;
+        frame.pos = NULL;
     }
-
 #ifndef DHEIGHTFIELD_CORNER_ORIGIN
-    o2->final_posr->pos[ 0 ] += terrain->m_p_data->m_fHalfWidth;
-    o2->final_posr->pos[ 2 ] += terrain->m_p_data->m_fHalfDepth;
+    frame.offsetX = terrain->m_p_data->m_fHalfWidth;
+    frame.offsetZ = terrain->m_p_data->m_fHalfDepth;
+#else
+    frame.offsetX = 0;
+    frame.offsetZ = 0;
 #endif // DHEIGHTFIELD_CORNER_ORIGIN
 
-    // Rebuild AABB for O2
-    if (reComputeAABB)
-        o2->computeAABB();
+    // aabb[6] is (minx, maxx, miny, maxy, minz, maxz)
+    dReal o2aabb[6];
+    ComputeHeightfieldSpaceAABB( o2, frame, o2aabb );
 
     //
     // Collide
@@ -1771,27 +2352,26 @@ int dCollideHeightfield( dxGeom *o1, dxGeom *o2, int flags, dContactGeom* contac
 
     //check if inside boundaries
     // using O2 aabb
-    //  aabb[6] is (minx, maxx, miny, maxy, minz, maxz) 
     const bool wrapped = terrain->m_p_data->m_bWrapMode != 0;
 
     if ( !wrapped )
     {
-        if (    o2->aabb[0] > terrain->m_p_data->m_fWidth //MinX
-            ||  o2->aabb[4] > terrain->m_p_data->m_fDepth)//MinZ
-            goto dCollideHeightfieldExit;
+        if (    o2aabb[0] > terrain->m_p_data->m_fWidth //MinX
+            ||  o2aabb[4] > terrain->m_p_data->m_fDepth)//MinZ
+            return 0;
 
-        if (    o2->aabb[1] < 0 //MaxX
-            ||  o2->aabb[5] < 0)//MaxZ
-            goto dCollideHeightfieldExit;
+        if (    o2aabb[1] < 0 //MaxX
+            ||  o2aabb[5] < 0)//MaxZ
+            return 0;
     }
 
     { // To narrow scope of following variables
         const dReal fInvSampleWidth = terrain->m_p_data->m_fInvSampleWidth;
-        int nMinX = (int)dFloor(dNextAfter(o2->aabb[0] * fInvSampleWidth, -dInfinity));
-        int nMaxX = (int)dCeil(dNextAfter(o2->aabb[1] * fInvSampleWidth, dInfinity));
+        int nMinX = (int)dFloor(dNextAfter(o2aabb[0] * fInvSampleWidth, -dInfinity));
+        int nMaxX = (int)dCeil(dNextAfter(o2aabb[1] * fInvSampleWidth, dInfinity));
         const dReal fInvSampleDepth = terrain->m_p_data->m_fInvSampleDepth;
-        int nMinZ = (int)dFloor(dNextAfter(o2->aabb[4] * fInvSampleDepth, -dInfinity));
-        int nMaxZ = (int)dCeil(dNextAfter(o2->aabb[5] * fInvSampleDepth, dInfinity));
+        int nMinZ = (int)dFloor(dNextAfter(o2aabb[4] * fInvSampleDepth, -dInfinity));
+        int nMaxZ = (int)dCeil(dNextAfter(o2aabb[5] * fInvSampleDepth, dInfinity));
 
         if ( !wrapped )
         {
@@ -1803,11 +2383,16 @@ int dCollideHeightfield( dxGeom *o1, dxGeom *o2, int flags, dContactGeom* contac
             dIASSERT ((nMinX < nMaxX) && (nMinZ < nMaxZ));
         }
 
+        dxHeightfieldScratch *scratch = terrain->acquireScratch();
+
         numTerrainOrigContacts = numTerrainContacts;
         numTerrainContacts += terrain->dCollideHeightfieldZone(
-            nMinX,nMaxX,nMinZ,nMaxZ,o2,numMaxTerrainContacts - numTerrainContacts,
+            nMinX,nMaxX,nMinZ,nMaxZ,o2,o2aabb,frame,scratch,
+            numMaxTerrainContacts - numTerrainContacts,
             flags,CONTACT(contact,numTerrainContacts*skip),skip	);
         dIASSERT( numTerrainContacts <= numMaxTerrainContacts );
+
+        terrain->releaseScratch(scratch);
     }
 
     dContactGeom *pContact;
@@ -1820,57 +2405,6 @@ int dCollideHeightfield( dxGeom *o1, dxGeom *o2, int flags, dContactGeom* contac
         // pContact->side2 = -1;
     }
 
-
-    //------------------------------------------------------------------------------
-
-dCollideHeightfieldExit:
-
-    if (reComputeAABB)
-    {
-        // Restore o2 position, rotation and AABB
-        dVector3Copy( posbak, o2->final_posr->pos );
-        dMatrix3Copy( Rbak, o2->final_posr->R );
-        memcpy( o2->aabb, aabbbak, sizeof(dReal)*6 );
-        o2->gflags = gflagsbak;
-
-        //
-        // Transform Contacts to World Space
-        //
-        if ( terrain->gflags & GEOM_PLACEABLE )
-        {
-            for ( i = 0; i < numTerrainContacts; ++i )
-            {
-                pContact = CONTACT(contact,i*skip);
-                dCopyVector3( pos0, pContact->pos );
-
-#ifndef DHEIGHTFIELD_CORNER_ORIGIN
-                pos0[ 0 ] -= terrain->m_p_data->m_fHalfWidth;
-                pos0[ 2 ] -= terrain->m_p_data->m_fHalfDepth;
-#endif // !DHEIGHTFIELD_CORNER_ORIGIN
-
-                dMultiply0_331( pContact->pos, terrain->final_posr->R, pos0 );
-
-                dAddVectors3( pContact->pos, pContact->pos, terrain->final_posr->pos );
-                dCopyVector3( pos0, pContact->normal );
-
-                dMultiply0_331( pContact->normal, terrain->final_posr->R, pos0 );
-            }
-        }
-#ifndef DHEIGHTFIELD_CORNER_ORIGIN
-        else
-        {
-            for ( i = 0; i < numTerrainContacts; ++i )
-            {
-                pContact = CONTACT(contact,i*skip);
-                pContact->pos[ 0 ] -= terrain->m_p_data->m_fHalfWidth;
-                pContact->pos[ 2 ] -= terrain->m_p_data->m_fHalfDepth;
-            }
-        }
-#endif // !DHEIGHTFIELD_CORNER_ORIGIN
-    }
     // Return contact count.
     return numTerrainContacts;
 }
-
-
-
@@ -31,15 +31,72 @@
 
 #include <ode/common.h>
 #include "collision_kernel.h"
+#include "odeou.h"
 
 
 #define HEIGHTFIELDMAXCONTACTPERCELL 10
 
+// Cells per side of a block in the finest level of the height pyramid
+#define HEIGHTFIELDPYRAMIDBLOCKCELLS 8
+#define HEIGHTFIELDPYRAMIDMAXLEVELS 32
+
 
 class HeightFieldVertex;
 class HeightFieldEdge;
 class HeightFieldTriangle;
 
+//
+// dxHeightfieldTileCache
+//
+// Tiles of tiled heightfield data held in memory. A tile is loaded with the
+// user callback on the first read of one of its samples, the least recently
+// read tile nobody reads at the moment is dropped when all the slots are used.
+// Reads take no lock, they pin the slot of the tile while reading a sample.
+// A thread loading a tile claims a slot no one has pinned and runs the
+// callback holding only that claim. Other threads only wait for it when they
+// need the same tile.
+//
+struct dxHeightfieldTileCache
+{
+    dxHeightfieldTileCache( void *pUserData, dHeightfieldGetTile *pCallback,
+        int nTileSamples, int nTilesX, int nTilesZ, int nMaxResidentTiles );
+    ~dxHeightfieldTileCache();
+
+    dReal GetSample( int x, int z );      // Raw height of a sample inside the data
+
+    enum
+    {
+        TILE_NOT_LOADED = 0xFFFFFFFF,   // m_pTileSlots value of a tile not in memory
+        TILE_LOADING = 0xFFFFFFFE,      // m_pTileSlots value of a tile being loaded
+        SLOT_EMPTY = 0xFFFFFFFF,        // Slot::tile value of a slot that never held a tile
+        SLOT_CLAIMED = 0x80000000       // Slot::state bit set while a thread refills the slot
+    };
+
+    struct Slot
+    {
+        volatile atomicord32 tile;      // Tile index, or SLOT_EMPTY
+        volatile atomicord32 state;     // Count of pinning readers, plus SLOT_CLAIMED
+        const dReal *heights;           // Tile samples returned by the callback
+        dReal *buffer;                  // Storage passed to the callback
+        volatile atomicord32 lastUse;   // Load counter value at the last read
+    };
+
+    void* m_pUserData;                  // Callback user data
+    dHeightfieldGetTile* m_pGetTileCallback;
+    int m_nTileSamples;                 // Samples per tile side
+    int m_nTilesX;                      // Tile count on X axis
+    int m_nTilesZ;                      // Tile count on Z axis
+    int m_nMaxResidentTiles;            // Slot count
+    volatile atomicord32 m_nResidentTiles; // Slots in use
+    volatile atomicord32* m_pTileSlots; // Slot of each tile, TILE_NOT_LOADED or TILE_LOADING
+    Slot* m_pSlots;
+    volatile atomicord32 m_nLoadCounter; // Tiles loaded so far, serves as the clock of the LRU
+
+private:
+    unsigned PinTile( unsigned tile );
+    unsigned LoadTile( unsigned tile );
+};
+
 //
 // dxHeightfieldData
 //
@@ -68,15 +125,25 @@ struct dxHeightfieldData
     int	m_nDepthSamples;       // Vertex count on Z axis edge (number of samples)
     int m_bCopyHeightData;     // Do we own the sample data?
     int	m_bWrapMode;           // Heightfield wrapping mode (0=finite, 1=infinite)
-    int m_nGetHeightMode;      // GetHeight mode ( 0=callback, 1=byte, 2=short, 3=float )
+    int m_nGetHeightMode;      // GetHeight mode ( 0=callback, 1=byte, 2=short, 3=float, 4=double, 5=tiled )
 
     const void* m_pHeightData; // Sample data array
     void* m_pUserData;         // Callback user data
 
-    dContactGeom            m_contacts[HEIGHTFIELDMAXCONTACTPERCELL];
-
     dHeightfieldGetHeight* m_pGetHeightCallback;		// Callback pointer.
 
+    dxHeightfieldTileCache* m_pTileCache;	// Loaded tiles of tiled data
+    dReal* m_pTileBounds;      // Raw min and max height of each tile of tiled data
+
+    // Min/max sample heights of square blocks of cells. The blocks of a level
+    // are twice as large as those of the previous one, the last level has
+    // a single block. Not available for callback data. Tiled data uses its
+    // tiles as the finest blocks.
+    dReal* m_pPyramid;         // Min and max height of each block, by level, row-major with X varying fastest
+    int m_nPyramidLevels;      // Number of levels (0=no pyramid)
+    int m_nPyramidBlockCells;  // Samples per block side in the finest level
+    size_t m_aPyramidLevelStart[HEIGHTFIELDPYRAMIDMAXLEVELS];
+
     dxHeightfieldData();
     ~dxHeightfieldData();
 
@@ -87,6 +154,15 @@ struct dxHeightfieldData
 
     void ComputeHeightBounds();
 
+    void FreeTiles();
+
+    void BuildHeightPyramid();
+    void FreeHeightPyramid();
+    bool GetZoneHeightBounds( int minX, int maxX, int minZ, int maxZ,
+        dReal &minHeight, dReal &maxHeight ) const;
+    void GetBlockRangeHeightBounds( int minX, int maxX, int minZ, int maxZ,
+        dReal &minHeight, dReal &maxHeight ) const;
+
     bool IsOnHeightfield2  ( const HeightFieldVertex * const CellCorner, 
         const dReal * const pos,  const bool isABC) const;
 
@@ -190,22 +266,16 @@ public:
 };
 
 //
-// dxHeightfield
+// dxHeightfieldScratch
 //
-// Heightfield geom structure
+// Temporary buffers of the collider. A heightfield geom keeps one instance
+// for reuse; collisions running concurrently with the same geom allocate
+// their own.
 //
-struct dxHeightfield : public dxGeom
+struct dxHeightfieldScratch
 {
-    dxHeightfieldData* m_p_data;
-
-    dxHeightfield( dSpaceID space, dHeightfieldDataID data, int bPlaceable );
-    ~dxHeightfield();
-
-    void computeAABB();
-
-    int dCollideHeightfieldZone( const int minX, const int maxX, const int minZ, const int maxZ,  
-        dxGeom *o2, const int numMaxContacts,
-        int flags, dContactGeom *contact, int skip );
+    dxHeightfieldScratch();
+    ~dxHeightfieldScratch();
 
     enum
     {
@@ -238,6 +308,52 @@ struct dxHeightfield : public dxGeom
     size_t              tempHeightBufferSizeX;
     size_t              tempHeightBufferSizeZ;
 
+    dContactGeom        m_contacts[HEIGHTFIELDMAXCONTACTPERCELL];
+};
+
+//
+// dxHeightfieldFrame
+//
+// Mapping between the heightfield sample space (origin at the corner of
+// the heightfield, Y up) and the world space. The other geom is kept in world
+// space and the planes and points of the heightfield are moved there instead.
+//
+struct dxHeightfieldFrame
+{
+    const dReal *R;            // Heightfield rotation or NULL if it is not placeable
+    const dReal *pos;          // Heightfield position or NULL if it is not placeable
+    dReal offsetX;             // Sample space position of the heightfield origin
+    dReal offsetZ;
+
+    void ToWorldPoint(dVector3 res, const dVector3 a) const;
+    void ToWorldVector(dVector3 res, const dVector3 a) const;
+    void ToWorldPlane(dVector4 res, const dVector4 a) const;
+    void ToLocalPoint(dVector3 res, const dVector3 a) const;
+};
+
+//
+// dxHeightfield
+//
+// Heightfield geom structure
+//
+struct dxHeightfield : public dxGeom
+{
+    dxHeightfieldData* m_p_data;
+
+    dxHeightfield( dSpaceID space, dHeightfieldDataID data, int bPlaceable );
+    ~dxHeightfield();
+
+    void computeAABB();
+
+    int dCollideHeightfieldZone( const int minX, const int maxX, const int minZ, const int maxZ,  
+        dxGeom *o2, const dReal *o2aabb, const dxHeightfieldFrame &frame,
+        dxHeightfieldScratch *scratch, const int numMaxContacts,
+        int flags, dContactGeom *contact, int skip );
+
+    dxHeightfieldScratch *acquireScratch();
+    void releaseScratch(dxHeightfieldScratch *scratch);
+
+    dxHeightfieldScratch *m_pCachedScratch; // Scratch instance available for reuse (accessed atomically)
 };
 
 
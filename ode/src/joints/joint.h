@@ -175,6 +175,23 @@ struct dxJointGroup : public dBase
         return j;
     }
 
+    // allocate a run of up to max_count joints in one go. their number is
+    // stored in out_count, and they follow each other at out_stride bytes.
+    template<class T>
+    void *allocArray(dWorldID w, size_t max_count, size_t *out_count, size_t *out_stride)
+    {
+        size_t count, stride;
+        char *block = (char *)m_stack.allocArray(sizeof(T), max_count, &count, &stride);
+        for (size_t i = 0; i != count; ++i) {
+            T *j = new(block + i * stride) T(w);
+            j->flags |= dJOINT_INGROUP;
+        }
+        m_num += count;
+        *out_count = count;
+        *out_stride = stride;
+        return block;
+    }
+
     size_t getJointCount() const { return m_num; }
     size_t exportJoints(dxJoint **jlist);
 
@@ -188,6 +205,20 @@ private:
     dObStack m_stack; // a stack of (possibly differently sized) dxJoint objects.
 };
 
+// contacts staged by a thread, to be created as joints later on by
+// dJointGroupAddContactsBatch()
+struct dxContactBuffer : public dBase
+{
+    struct Entry
+    {
+        dContact contact;
+        dxBody *body1;
+        dxBody *body2;
+    };
+
+    dArray<Entry> m_entries;
+};
+
 // common limit and motor information for a single joint axis of movement
 struct dxJointLimitMotor
 {
@@ -0,0 +1,855 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+THE ALGORITHM
+-------------
+
+the rows are split into the unbounded set U and the bounded set B. with
+
+    A = [ Auu Aub ]
+        [ Abu Abb ]
+
+the unbounded rows give Auu*xu = bu - Aub*xb, so xb solves the LCP
+
+    (Abb - Abu*inv(Auu)*Aub) * xb = bb - Abu*inv(Auu)*bu + wb
+
+with the same bounds and findex values. Auu = Ju*invM*Ju' + diag(Adcfm) is
+factored as L*D*L', L being block lower triangular with a block per joint.
+
+a column of the reduced matrix for the bounded row `k' is found without
+forming Abu or Abb. with w = invM*Jk' (which is a row of JinvM):
+
+    z   = inv(Auu) * Ju*w
+    y   = w - invM*Ju'*z
+    col = Jb*y (+ Adcfm on the diagonal)
+
+this costs one sparse solve per bounded row. likewise the reduced right hand
+side is bb + Jb*y0 with y0 = -invM*Ju'*inv(Auu)*bu and the unbounded part of
+the solution is inv(Auu)*(bu - Ju*invM*Jb'*xb).
+
+the factorization itself is left-looking: every column is gathered from the
+blocks of A that couple the joint with the joints sharing its bodies and
+updated by the earlier columns that have a block in its row. these columns
+are chained in lists by the next row they have to update, so no search is
+needed.
+
+*/
+
+#include <ode/common.h>
+#include "config.h"
+#include "matrix.h"
+#include "odemath.h"
+#include "lcp.h"
+#include "lcp_sparse.h"
+#include "util.h"
+
+#include <algorithm>
+
+
+//***************************************************************************
+// the elimination ordering. the unbounded rows of a joint make a node. the
+// joints sharing a body form a clique, and so does the set of nodes left
+// after a node is eliminated, so the cliques of the two bodies of
+// an eliminated node are merged into one ("element"). the nodes of an element
+// are kept in a list; a node is in the lists of its two bodies' elements,
+// so the lists are concatenated on merging and the stale entries are dropped
+// when the list is walked.
+
+struct dxSparseElimination
+{
+    const int       *jb;
+    const int       *nodejoint;     // joint of node
+    unsigned int    nn;             // number of nodes
+    unsigned int    nb;
+
+    int             *elemparent;    // union-find of bodies into elements
+    int             *elemhead;
+    int             *elemtail;
+    unsigned int    *elemsize;
+    int             *entrynode;
+    int             *entrynext;
+    unsigned int    *degree;        // approximate degree of node
+    unsigned int    *marker;
+    int             *rank;          // position of node in the elimination order, -1 if not eliminated
+
+    int FindElement(int b)
+    {
+        while (elemparent[b] != b) {
+            elemparent[b] = elemparent[elemparent[b]];
+            b = elemparent[b];
+        }
+        return b;
+    }
+
+    void GetNodeElements(int node, int &e1, int &e2)
+    {
+        const int *nodejb = jb + 2 * nodejoint[node];
+        e1 = nodejb[0] != -1 ? FindElement(nodejb[0]) : -1;
+        e2 = nodejb[1] != -1 ? FindElement(nodejb[1]) : -1;
+        if (e1 == -1) { e1 = e2; e2 = -1; }
+        if (e2 == e1) e2 = -1;
+    }
+
+    unsigned int ComputeDegree(int node)
+    {
+        int e1, e2;
+        GetNodeElements(node, e1, e2);
+        // the node itself is in both of the elements
+        return e1 == -1 ? 0 : e2 == -1 ? elemsize[e1] - 1 : elemsize[e1] + elemsize[e2] - 2;
+    }
+
+    void Initialize(const unsigned int *bodystart, const int *bodynodes);
+    unsigned int EliminateNode(int node, unsigned int t, int *colnodes, bool updatedegrees);
+    int PickMinimalDegreeNode() const;
+};
+
+void dxSparseElimination::Initialize(const unsigned int *bodystart, const int *bodynodes)
+{
+    for (unsigned int b = 0; b != nb; ++b) {
+        const unsigned int start = bodystart[b], end = bodystart[b + 1];
+        elemparent[b] = (int)b;
+        elemhead[b] = start != end ? (int)start : -1;
+        elemtail[b] = start != end ? (int)end - 1 : -1;
+        elemsize[b] = end - start;
+        for (unsigned int e = start; e != end; ++e) {
+            entrynode[e] = bodynodes[e];
+            entrynext[e] = e + 1 != end ? (int)e + 1 : -1;
+        }
+    }
+
+    for (unsigned int i = 0; i != nn; ++i) {
+        rank[i] = -1;
+        marker[i] = 0;
+        degree[i] = ComputeDegree((int)i);
+    }
+}
+
+// Eliminates `node' as `t'-th and returns the number of nodes it is coupled with
+// at that point. The nodes are stored into `colnodes' if it is not NULL.
+unsigned int dxSparseElimination::EliminateNode(int node, unsigned int t, int *colnodes, bool updatedegrees)
+{
+    rank[node] = (int)t;
+
+    int e, e2;
+    GetNodeElements(node, e, e2);
+    if (e == -1) {
+        return 0;
+    }
+
+    if (e2 != -1) {
+        elemparent[e2] = e;
+        if (elemhead[e2] != -1) {
+            if (elemhead[e] != -1) entrynext[elemtail[e]] = elemhead[e2];
+            else elemhead[e] = elemhead[e2];
+            elemtail[e] = elemtail[e2];
+        }
+    }
+
+    const unsigned int stamp = t + 1;
+    unsigned int count = 0;
+    int prev = -1;
+    for (int x = elemhead[e]; x != -1; ) {
+        const int next = entrynext[x];
+        const int i = entrynode[x];
+        if (rank[i] != -1 || marker[i] == stamp) {
+            if (prev != -1) entrynext[prev] = next;
+            else elemhead[e] = next;
+            if (x == elemtail[e]) elemtail[e] = prev;
+        }
+        else {
+            marker[i] = stamp;
+            if (colnodes != NULL) colnodes[count] = i;
+            ++count;
+            prev = x;
+        }
+        x = next;
+    }
+    elemsize[e] = count;
+
+    if (updatedegrees) {
+        for (int x = elemhead[e]; x != -1; x = entrynext[x]) {
+            degree[entrynode[x]] = ComputeDegree(entrynode[x]);
+        }
+    }
+
+    return count;
+}
+
+int dxSparseElimination::PickMinimalDegreeNode() const
+{
+    int best = -1;
+    unsigned int bestdegree = 0;
+    for (unsigned int i = 0; i != nn; ++i) {
+        if (rank[i] == -1 && (best == -1 || degree[i] < bestdegree)) {
+            best = (int)i;
+            bestdegree = degree[i];
+        }
+    }
+    return best;
+}
+
+
+//***************************************************************************
+// the factorization of Auu. nodes are numbered in the elimination order.
+// the values of column `j' start at valstart[j] with the bs(j) x bs(j)
+// diagonal block holding the unit lower triangle, followed by the blocks
+// of the rows colnodes[colstart[j]..colstart[j+1]), each bs(i) x bs(j).
+// all the blocks are row major.
+
+struct dxSparseFactor
+{
+    unsigned int        nn;
+    const unsigned int  *xoff;      // nn + 1, offsets of the rows of nodes
+    const unsigned int  *colstart;  // nn + 1
+    const int           *colnodes;
+    const size_t        *valstart;  // nn
+    dReal               *values;
+    dReal               *d;         // the diagonal of D
+
+    void Solve(dReal *x) const;
+};
+
+void dxSparseFactor::Solve(dReal *x) const
+{
+    // forward substitution with L
+    for (unsigned int j = 0; j != nn; ++j) {
+        const unsigned int bsj = xoff[j + 1] - xoff[j];
+        dReal *xj = x + xoff[j];
+        const dReal *Ljj = values + valstart[j];
+        for (unsigned int c = 1; c < bsj; ++c) {
+            dReal sum = xj[c];
+            for (unsigned int t = 0; t != c; ++t) sum -= Ljj[c*bsj + t] * xj[t];
+            xj[c] = sum;
+        }
+        const dReal *Lij = Ljj + bsj*bsj;
+        for (unsigned int e = colstart[j]; e != colstart[j + 1]; ++e) {
+            const int i = colnodes[e];
+            const unsigned int bsi = xoff[i + 1] - xoff[i];
+            dReal *xi = x + xoff[i];
+            for (unsigned int a = 0; a != bsi; Lij += bsj, ++a) {
+                dReal sum = 0;
+                for (unsigned int c = 0; c != bsj; ++c) sum += Lij[c] * xj[c];
+                xi[a] -= sum;
+            }
+        }
+    }
+
+    const unsigned int nu = xoff[nn];
+    for (unsigned int r = 0; r != nu; ++r) {
+        x[r] /= d[r];
+    }
+
+    // backward substitution with L'
+    for (unsigned int j = nn; j != 0; ) {
+        --j;
+        const unsigned int bsj = xoff[j + 1] - xoff[j];
+        dReal *xj = x + xoff[j];
+        const dReal *Ljj = values + valstart[j];
+        const dReal *Lij = Ljj + bsj*bsj;
+        for (unsigned int e = colstart[j]; e != colstart[j + 1]; ++e) {
+            const int i = colnodes[e];
+            const unsigned int bsi = xoff[i + 1] - xoff[i];
+            const dReal *xi = x + xoff[i];
+            for (unsigned int a = 0; a != bsi; Lij += bsj, ++a) {
+                for (unsigned int c = 0; c != bsj; ++c) xj[c] -= Lij[c] * xi[a];
+            }
+        }
+        for (unsigned int c = bsj - 1; c != 0; ) {
+            --c;
+            dReal sum = xj[c];
+            for (unsigned int t = c + 1; t != bsj; ++t) sum -= Ljj[t*bsj + c] * xj[t];
+            xj[c] = sum;
+        }
+    }
+}
+
+
+//***************************************************************************
+// helpers for the 8 element per body vectors (3 linear, pad, 3 angular, pad)
+
+static inline dReal Dot8 (const dReal *a, const dReal *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[4]*b[4] + a[5]*b[5] + a[6]*b[6];
+}
+
+static inline void AddScaled8 (dReal *a, const dReal *b, dReal s)
+{
+    a[0] += b[0]*s; a[1] += b[1]*s; a[2] += b[2]*s;
+    a[4] += b[4]*s; a[5] += b[5]*s; a[6] += b[6]*s;
+}
+
+// y = -invM*u for all bodies
+static void MultiplyNegInvM (dReal *y, const dReal *u, const dxSparseLCPSystem *system)
+{
+    const unsigned int nb = system->nb;
+    const dReal *invI = system->invI;
+    const dReal *invMass = system->invMass;
+    for (unsigned int b = 0; b != nb; y += 8, u += 8, invI += 12, ++b) {
+        const dReal invm = invMass[b];
+        y[0] = -u[0]*invm; y[1] = -u[1]*invm; y[2] = -u[2]*invm; y[3] = 0;
+        dMultiply0_331 (y + 4, invI, u + 4);
+        y[4] = -y[4]; y[5] = -y[5]; y[6] = -y[6]; y[7] = 0;
+    }
+}
+
+
+//***************************************************************************
+
+struct dxSparseLCPWork
+{
+    const dxSparseLCPSystem *system;
+    unsigned int        nu;
+    unsigned int        nbounded;
+    const int           *urow;      // nu, the rows of the unbounded variables
+    const int           *brow;      // nbounded, the rows of the bounded variables
+    const int           *nodejoint; // joint of a node in the elimination order
+    const unsigned int  *bodystart; // nb + 1
+    const int           *bodynodes; // nodes attached to bodies
+    dxSparseFactor      factor;
+
+    // Row `r' of joint `ji' for side `s' of J or JinvM
+    const dReal *GetJointRow(const dReal *JJ, unsigned int ji, int r, unsigned int s) const
+    {
+        const unsigned int ofs = system->mindex[ji];
+        const unsigned int infom = system->mindex[ji + 1] - ofs;
+        return JJ + 2*8*(size_t)ofs + 8*(size_t)(s*infom + ((unsigned int)r - ofs));
+    }
+
+    unsigned int GetBodySide(unsigned int ji, int b) const { return system->jb[2*ji] == b ? 0 : 1; }
+
+    void FactorUnbounded(int *listhead, int *listnext, unsigned int *rowptr, size_t *rowoff, size_t *pos);
+    void MultiplyJuBy8(dReal *xu, int b, const dReal *w8) const;
+    void AccumulateJuTransposed(dReal *u, const dReal *xu) const;
+};
+
+// xu[k] += Ju(k) * w8 for the unbounded rows of the nodes attached to body `b'
+void dxSparseLCPWork::MultiplyJuBy8(dReal *xu, int b, const dReal *w8) const
+{
+    const dReal *J = system->J;
+    const unsigned int *xoff = factor.xoff;
+    for (unsigned int e = bodystart[b]; e != bodystart[b + 1]; ++e) {
+        const int i = bodynodes[e];
+        const unsigned int ji = (unsigned int)nodejoint[i];
+        const unsigned int s = GetBodySide(ji, b);
+        for (unsigned int k = xoff[i]; k != xoff[i + 1]; ++k) {
+            xu[k] += Dot8(GetJointRow(J, ji, urow[k], s), w8);
+        }
+    }
+}
+
+// u = Ju' * xu, with u being 8 elements per body
+void dxSparseLCPWork::AccumulateJuTransposed(dReal *u, const dReal *xu) const
+{
+    const dxSparseLCPSystem *sys = system;
+    dSetZero(u, 8*(size_t)sys->nb);
+
+    const unsigned int *xoff = factor.xoff;
+    const unsigned int nn = factor.nn;
+    for (unsigned int i = 0; i != nn; ++i) {
+        const unsigned int ji = (unsigned int)nodejoint[i];
+        const int *nodejb = sys->jb + 2*ji;
+        for (unsigned int s = 0; s != 2; ++s) {
+            if (nodejb[s] != -1) {
+                dReal *ub = u + 8*(size_t)nodejb[s];
+                for (unsigned int k = xoff[i]; k != xoff[i + 1]; ++k) {
+                    AddScaled8(ub, GetJointRow(sys->J, ji, urow[k], s), xu[k]);
+                }
+            }
+        }
+    }
+}
+
+void dxSparseLCPWork::FactorUnbounded(int *listhead, int *listnext, unsigned int *rowptr, size_t *rowoff, size_t *pos)
+{
+    const dxSparseLCPSystem *sys = system;
+    const unsigned int nn = factor.nn;
+    const unsigned int *xoff = factor.xoff;
+    const unsigned int *colstart = factor.colstart;
+    const int *colnodes = factor.colnodes;
+    dReal *d = factor.d;
+
+    for (unsigned int j = 0; j != nn; ++j) {
+        listhead[j] = -1;
+    }
+
+    for (unsigned int j = 0; j != nn; ++j) {
+        const unsigned int bsj = xoff[j + 1] - xoff[j];
+        dReal *colvalues = factor.values + factor.valstart[j];
+
+        // locate the blocks of the column
+        size_t colsize = (size_t)bsj*bsj;
+        pos[j] = 0;
+        for (unsigned int e = colstart[j]; e != colstart[j + 1]; ++e) {
+            const int i = colnodes[e];
+            pos[i] = colsize;
+            colsize += (size_t)(xoff[i + 1] - xoff[i]) * bsj;
+        }
+        dSetZero(colvalues, colsize);
+
+        // gather A: the nodes sharing a body with j that come later are all in the column
+        const unsigned int jj = (unsigned int)nodejoint[j];
+        for (unsigned int sj = 0; sj != 2; ++sj) {
+            const int b = sys->jb[2*jj + sj];
+            if (b == -1) continue;
+
+            for (unsigned int e = bodystart[b]; e != bodystart[b + 1]; ++e) {
+                const int i = bodynodes[e];
+                if ((unsigned int)i < j) continue;
+
+                const unsigned int ji = (unsigned int)nodejoint[i];
+                const unsigned int si = GetBodySide(ji, b);
+                dReal *block = colvalues + pos[i];
+                for (unsigned int a = xoff[i]; a != xoff[i + 1]; ++a) {
+                    const dReal *Jrow = GetJointRow(sys->J, ji, urow[a], si);
+                    for (unsigned int c = xoff[j]; c != xoff[j + 1]; ++block, ++c) {
+                        *block += Dot8(Jrow, GetJointRow(sys->JinvM, jj, urow[c], sj));
+                    }
+                }
+            }
+        }
+        for (unsigned int c = 0; c != bsj; ++c) {
+            colvalues[c*bsj + c] += sys->Adcfm[urow[xoff[j] + c]];
+        }
+
+        // subtract L(i,k)*D(k)*L(j,k)' of the columns k having a block in row j
+        for (int k = listhead[j]; k != -1; ) {
+            const int nextk = listnext[k];
+            const unsigned int bsk = xoff[k + 1] - xoff[k];
+            const dReal *dk = d + xoff[k];
+            const dReal *kvalues = factor.values + factor.valstart[k];
+
+            dReal T[6*6]; // L(j,k)*D(k)
+            const dReal *Ljk = kvalues + rowoff[k];
+            for (unsigned int t = 0; t != bsj*bsk; ++t) T[t] = Ljk[t] * dk[t % bsk];
+
+            const unsigned int kend = colstart[k + 1];
+            const dReal *Lik = Ljk;
+            for (unsigned int e = rowptr[k]; e != kend; ++e) {
+                const int i = colnodes[e];
+                const unsigned int bsi = xoff[i + 1] - xoff[i];
+                dReal *block = colvalues + pos[i];
+                for (unsigned int a = 0; a != bsi; Lik += bsk, ++a) {
+                    for (unsigned int c = 0; c != bsj; ++block, ++c) {
+                        const dReal *Tc = T + c*bsk;
+                        dReal sum = 0;
+                        for (unsigned int t = 0; t != bsk; ++t) sum += Lik[t] * Tc[t];
+                        *block -= sum;
+                    }
+                }
+            }
+
+            // move on to the next row of column k
+            rowoff[k] += (size_t)bsj*bsk;
+            rowptr[k] += 1;
+            if (rowptr[k] != kend) {
+                const int nexti = colnodes[rowptr[k]];
+                listnext[k] = listhead[nexti];
+                listhead[nexti] = k;
+            }
+            k = nextk;
+        }
+
+        // factor the diagonal block
+        dReal *Ljj = colvalues;
+        dReal *dj = d + xoff[j];
+        for (unsigned int c = 0; c != bsj; ++c) {
+            dReal dc = Ljj[c*bsj + c];
+            for (unsigned int t = 0; t != c; ++t) dc -= Ljj[c*bsj + t] * Ljj[c*bsj + t] * dj[t];
+            dj[c] = dc;
+            const dReal dcrecip = dRecip(dc);
+            for (unsigned int r = c + 1; r != bsj; ++r) {
+                dReal sum = Ljj[r*bsj + c];
+                for (unsigned int t = 0; t != c; ++t) sum -= Ljj[r*bsj + t] * Ljj[c*bsj + t] * dj[t];
+                Ljj[r*bsj + c] = sum * dcrecip;
+            }
+        }
+
+        // L(i,j) = W(i) * inv(L(j,j)') * inv(D(j))
+        dReal *Lij = colvalues + (size_t)bsj*bsj;
+        dReal *const colend = colvalues + colsize;
+        for (; Lij != colend; Lij += bsj) {
+            for (unsigned int c = 1; c < bsj; ++c) {
+                dReal sum = Lij[c];
+                for (unsigned int t = 0; t != c; ++t) sum -= Ljj[c*bsj + t] * Lij[t];
+                Lij[c] = sum;
+            }
+            for (unsigned int c = 0; c != bsj; ++c) Lij[c] /= dj[c];
+        }
+
+        if (colstart[j] != colstart[j + 1]) {
+            rowptr[j] = colstart[j];
+            rowoff[j] = (size_t)bsj*bsj;
+            const int firsti = colnodes[colstart[j]];
+            listnext[j] = listhead[firsti];
+            listhead[firsti] = (int)j;
+        }
+    }
+}
+
+
+
+//***************************************************************************
+
+bool dSolveLCPSparse (dxWorldProcessMemArena *memarena, size_t memlimit,
+                      const dxSparseLCPSystem *system, dReal *x, const dReal *b,
+                      const dReal *lo, const dReal *hi, const int *findex)
+{
+    const unsigned int m = system->m, nj = system->nj, nb = system->nb;
+    const unsigned int *mindex = system->mindex;
+    const int *jb = system->jb;
+    const dReal *J = system->J, *JinvM = system->JinvM;
+    dAASSERT (m > 0 && x && b && lo && hi && findex);
+
+    // everything up to the patterns of the columns has the size known in advance
+    size_t memreq = dEFFICIENT_SIZE(sizeof(int) * m) // for rowidx
+        + 2 * dEFFICIENT_SIZE(sizeof(int) * nj) // for nodejoint, order
+        + dEFFICIENT_SIZE(sizeof(unsigned int) * (nb + 1)) // for bodystart
+        + dEFFICIENT_SIZE(sizeof(int) * 2 * (size_t)nj) // for bodynodes
+        + 3 * dEFFICIENT_SIZE(sizeof(int) * nb) + dEFFICIENT_SIZE(sizeof(unsigned int) * nb) // for elements
+        + 2 * dEFFICIENT_SIZE(sizeof(int) * 2 * (size_t)nj) // for element entries
+        + 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * nj) + dEFFICIENT_SIZE(sizeof(int) * nj) // for degree, marker, rank
+        + 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * (nj + 1)) // for colstart, xoff
+        + dEFFICIENT_SIZE(sizeof(size_t) * nj); // for valstart
+    if (memreq > memlimit) {
+        return false;
+    }
+
+    // sort the rows out: unbounded ones are marked with 0, bounded ones with -1
+    int *rowidx = memarena->AllocateArray<int>(m);
+    for (unsigned int r = 0; r != m; ++r) {
+        rowidx[r] = (lo[r] == -dInfinity && hi[r] == dInfinity && findex[r] < 0) ? 0 : -1;
+    }
+    for (unsigned int r = 0; r != m; ++r) {
+        if (findex[r] >= 0) rowidx[findex[r]] = -1;
+    }
+
+    int *nodejoint = memarena->AllocateArray<int>(nj);
+    unsigned int nn = 0, nu = 0;
+    for (unsigned int ji = 0; ji != nj; ++ji) {
+        unsigned int jointnu = 0;
+        for (unsigned int r = mindex[ji]; r != mindex[ji + 1]; ++r) {
+            jointnu += rowidx[r] == 0;
+        }
+        if (jointnu != 0) {
+            nodejoint[nn++] = (int)ji;
+            nu += jointnu;
+        }
+    }
+    const unsigned int nbounded = m - nu;
+
+    // the nodes attached to bodies
+    unsigned int *bodystart = memarena->AllocateArray<unsigned int>(nb + 1);
+    int *bodynodes = memarena->AllocateArray<int>(2 * (size_t)nj);
+    {
+        dSetZero(bodystart, nb + 1);
+        for (unsigned int i = 0; i != nn; ++i) {
+            const int *nodejb = jb + 2 * nodejoint[i];
+            if (nodejb[0] != -1) bodystart[nodejb[0] + 1] += 1;
+            if (nodejb[1] != -1) bodystart[nodejb[1] + 1] += 1;
+        }
+        for (unsigned int bi = 0; bi != nb; ++bi) {
+            bodystart[bi + 1] += bodystart[bi];
+        }
+        for (unsigned int i = 0; i != nn; ++i) {
+            const int *nodejb = jb + 2 * nodejoint[i];
+            if (nodejb[0] != -1) bodynodes[bodystart[nodejb[0]]++] = (int)i;
+            if (nodejb[1] != -1) bodynodes[bodystart[nodejb[1]]++] = (int)i;
+        }
+        for (unsigned int bi = nb; bi != 0; --bi) {
+            bodystart[bi] = bodystart[bi - 1];
+        }
+        bodystart[0] = 0;
+    }
+
+    // choose the elimination order and count the blocks of the columns
+    dxSparseElimination elimination;
+    elimination.jb = jb;
+    elimination.nodejoint = nodejoint;
+    elimination.nn = nn;
+    elimination.nb = nb;
+    elimination.elemparent = memarena->AllocateArray<int>(nb);
+    elimination.elemhead = memarena->AllocateArray<int>(nb);
+    elimination.elemtail = memarena->AllocateArray<int>(nb);
+    elimination.elemsize = memarena->AllocateArray<unsigned int>(nb);
+    elimination.entrynode = memarena->AllocateArray<int>(2 * (size_t)nj);
+    elimination.entrynext = memarena->AllocateArray<int>(2 * (size_t)nj);
+    elimination.degree = memarena->AllocateArray<unsigned int>(nj);
+    elimination.marker = memarena->AllocateArray<unsigned int>(nj);
+    elimination.rank = memarena->AllocateArray<int>(nj);
+
+    int *order = memarena->AllocateArray<int>(nj);
+    unsigned int *colstart = memarena->AllocateArray<unsigned int>(nj + 1);
+    unsigned int *xoff = memarena->AllocateArray<unsigned int>(nj + 1);
+    size_t *valstart = memarena->AllocateArray<size_t>(nj);
+
+    {
+        elimination.Initialize(bodystart, bodynodes);
+
+        unsigned int colsum = 0;
+        for (unsigned int t = 0; t != nn; ++t) {
+            const int node = elimination.PickMinimalDegreeNode();
+            order[t] = node;
+            colstart[t] = colsum;
+            colsum += elimination.EliminateNode(node, t, NULL, true);
+        }
+        colstart[nn] = colsum;
+    }
+
+    memreq += dEFFICIENT_SIZE(sizeof(int) * colstart[nn]); // for colnodes
+    if (memreq > memlimit) {
+        return false;
+    }
+
+    // collect the blocks of the columns by repeating the elimination in the same order
+    int *colnodes = memarena->AllocateArray<int>(colstart[nn]);
+    {
+        elimination.Initialize(bodystart, bodynodes);
+
+        for (unsigned int t = 0; t != nn; ++t) {
+            elimination.EliminateNode(order[t], t, colnodes + colstart[t], false);
+        }
+
+        const int *rank = elimination.rank;
+        for (unsigned int e = 0; e != colstart[nn]; ++e) {
+            colnodes[e] = rank[colnodes[e]];
+        }
+        for (unsigned int t = 0; t != nn; ++t) {
+            std::sort(colnodes + colstart[t], colnodes + colstart[t + 1]);
+        }
+        for (unsigned int e = 0; e != bodystart[nb]; ++e) {
+            bodynodes[e] = rank[bodynodes[e]];
+        }
+    }
+
+    // renumber the nodes and the unbounded rows in the elimination order.
+    // the unbounded rows get positive indices and the bounded ones negative
+    int *urow = NULL, *brow = NULL;
+    size_t valsize = 0;
+    {
+        unsigned int xcurr = 0;
+        for (unsigned int t = 0; t != nn; ++t) {
+            const int ji = nodejoint[order[t]];
+            order[t] = ji; // the original numbering is not needed any more
+            xoff[t] = xcurr;
+            for (unsigned int r = mindex[ji]; r != mindex[ji + 1]; ++r) {
+                if (rowidx[r] == 0) rowidx[r] = (int)(xcurr++) + 1;
+            }
+        }
+        xoff[nn] = xcurr;
+        dIASSERT(xcurr == nu);
+
+        for (unsigned int t = 0; t != nn; ++t) {
+            const size_t bst = xoff[t + 1] - xoff[t];
+            size_t rows = bst;
+            for (unsigned int e = colstart[t]; e != colstart[t + 1]; ++e) {
+                const int i = colnodes[e];
+                rows += xoff[i + 1] - xoff[i];
+            }
+            valstart[t] = valsize;
+            valsize += rows * bst;
+        }
+    }
+    const int *rankjoint = order;
+
+    const unsigned int bskip = dPAD(nbounded);
+    memreq += dEFFICIENT_SIZE(sizeof(dReal) * valsize) // for values
+        + dEFFICIENT_SIZE(sizeof(dReal) * nu) // for d
+        + 2 * dEFFICIENT_SIZE(sizeof(int) * nn) // for listhead, listnext
+        + dEFFICIENT_SIZE(sizeof(unsigned int) * nn) // for rowptr
+        + 2 * dEFFICIENT_SIZE(sizeof(size_t) * nn) // for rowoff, pos
+        + dEFFICIENT_SIZE(sizeof(int) * nu) // for urow
+        + dEFFICIENT_SIZE(sizeof(int) * nbounded) // for brow
+        + dEFFICIENT_SIZE(sizeof(dReal) * nu) // for xu
+        + 2 * dEFFICIENT_SIZE(sizeof(dReal) * 8 * (size_t)nb); // for u, y
+    if (nbounded != 0) {
+        memreq += dEFFICIENT_SIZE(sizeof(dReal) * nbounded * (size_t)bskip) // for S
+            + 4 * dEFFICIENT_SIZE(sizeof(dReal) * nbounded) // for bb, lob, hib, xb
+            + dEFFICIENT_SIZE(sizeof(int) * nbounded) // for findexb
+            + dEstimateSolveLCPMemoryReq(nbounded, false);
+    }
+    if (memreq > memlimit) {
+        return false;
+    }
+
+    dxSparseLCPWork work;
+    work.system = system;
+    work.nu = nu;
+    work.nbounded = nbounded;
+    work.nodejoint = rankjoint;
+    work.bodystart = bodystart;
+    work.bodynodes = bodynodes;
+    work.factor.nn = nn;
+    work.factor.xoff = xoff;
+    work.factor.colstart = colstart;
+    work.factor.colnodes = colnodes;
+    work.factor.valstart = valstart;
+    work.factor.values = memarena->AllocateArray<dReal>(valsize);
+    work.factor.d = memarena->AllocateArray<dReal>(nu);
+
+    int *listhead = memarena->AllocateArray<int>(nn);
+    int *listnext = memarena->AllocateArray<int>(nn);
+    unsigned int *rowptr = memarena->AllocateArray<unsigned int>(nn);
+    size_t *rowoff = memarena->AllocateArray<size_t>(nn);
+    size_t *pos = memarena->AllocateArray<size_t>(nn);
+
+    urow = memarena->AllocateArray<int>(nu);
+    brow = memarena->AllocateArray<int>(nbounded);
+    {
+        unsigned int bcurr = 0;
+        for (unsigned int r = 0; r != m; ++r) {
+            const int idx = rowidx[r];
+            if (idx > 0) {
+                urow[idx - 1] = (int)r;
+            }
+            else {
+                rowidx[r] = -(int)(bcurr + 1);
+                brow[bcurr++] = (int)r;
+            }
+        }
+        dIASSERT(bcurr == nbounded);
+    }
+    work.urow = urow;
+    work.brow = brow;
+
+    work.FactorUnbounded(listhead, listnext, rowptr, rowoff, pos);
+
+    dReal *xu = memarena->AllocateArray<dReal>(nu);
+    dReal *u = memarena->AllocateArray<dReal>(8 * (size_t)nb);
+    dReal *y = memarena->AllocateArray<dReal>(8 * (size_t)nb);
+
+    // xu = inv(Auu)*bu, the solution if there are no bounded rows
+    for (unsigned int k = 0; k != nu; ++k) {
+        xu[k] = b[urow[k]];
+    }
+    work.factor.Solve(xu);
+
+    if (nbounded != 0) {
+        dReal *S = memarena->AllocateArray<dReal>(nbounded * (size_t)bskip);
+        dReal *bb = memarena->AllocateArray<dReal>(nbounded);
+        dReal *lob = memarena->AllocateArray<dReal>(nbounded);
+        dReal *hib = memarena->AllocateArray<dReal>(nbounded);
+        dReal *xb = memarena->AllocateArray<dReal>(nbounded);
+        int *findexb = memarena->AllocateArray<int>(nbounded);
+
+        // the reduced right hand side is bb + Jb*y0 with y0 = -invM*Ju'*xu
+        work.AccumulateJuTransposed(u, xu);
+        MultiplyNegInvM(y, u, system);
+
+        unsigned int jcurr = 0;
+        for (unsigned int kb = 0; kb != nbounded; ++kb) {
+            const int r = brow[kb];
+            while (mindex[jcurr + 1] <= (unsigned int)r) ++jcurr;
+            dReal sum = b[r];
+            for (unsigned int s = 0; s != 2; ++s) {
+                const int bi = jb[2*jcurr + s];
+                if (bi != -1) sum += Dot8(work.GetJointRow(J, jcurr, r, s), y + 8*(size_t)bi);
+            }
+            bb[kb] = sum;
+            lob[kb] = lo[r];
+            hib[kb] = hi[r];
+            findexb[kb] = findex[r] >= 0 ? -rowidx[findex[r]] - 1 : -1;
+        }
+
+        jcurr = 0;
+        for (unsigned int kb = 0; kb != nbounded; ++kb) {
+            const int r = brow[kb];
+            while (mindex[jcurr + 1] <= (unsigned int)r) ++jcurr;
+            const int *rowjb = jb + 2*jcurr;
+
+            // z = inv(Auu) * Ju * invM * Jk'
+            bool coupled = false;
+            dSetZero(xu, nu);
+            for (unsigned int s = 0; s != 2; ++s) {
+                const int bi = rowjb[s];
+                if (bi != -1 && bodystart[bi] != bodystart[bi + 1]) {
+                    work.MultiplyJuBy8(xu, bi, work.GetJointRow(JinvM, jcurr, r, s));
+                    coupled = true;
+                }
+            }
+
+            // y = invM*Jk' - invM*Ju'*z
+            if (coupled) {
+                work.factor.Solve(xu);
+                work.AccumulateJuTransposed(u, xu);
+                MultiplyNegInvM(y, u, system);
+            }
+            else {
+                dSetZero(y, 8*(size_t)nb);
+            }
+            for (unsigned int s = 0; s != 2; ++s) {
+                const int bi = rowjb[s];
+                if (bi != -1) AddScaled8(y + 8*(size_t)bi, work.GetJointRow(JinvM, jcurr, r, s), REAL(1.0));
+            }
+
+            // the column of the reduced matrix is Jb*y
+            unsigned int jother = 0;
+            for (unsigned int ib = 0; ib != nbounded; ++ib) {
+                const int ri = brow[ib];
+                while (mindex[jother + 1] <= (unsigned int)ri) ++jother;
+                const int *otherjb = jb + 2*jother;
+                dReal sum = 0;
+                for (unsigned int s = 0; s != 2; ++s) {
+                    const int bi = otherjb[s];
+                    if (bi != -1) sum += Dot8(work.GetJointRow(J, jother, ri, s), y + 8*(size_t)bi);
+                }
+                S[ib*(size_t)bskip + kb] = sum;
+            }
+            S[kb*(size_t)bskip + kb] += system->Adcfm[r];
+        }
+
+        dSolveLCP (memarena, nbounded, S, xb, bb, NULL, 0, lob, hib, findexb);
+
+        // xu = inv(Auu) * (bu - Ju*invM*Jb'*xb)
+        dSetZero(u, 8*(size_t)nb);
+        jcurr = 0;
+        for (unsigned int kb = 0; kb != nbounded; ++kb) {
+            const int r = brow[kb];
+            while (mindex[jcurr + 1] <= (unsigned int)r) ++jcurr;
+            for (unsigned int s = 0; s != 2; ++s) {
+                const int bi = jb[2*jcurr + s];
+                if (bi != -1) AddScaled8(u + 8*(size_t)bi, work.GetJointRow(JinvM, jcurr, r, s), xb[kb]);
+            }
+            x[r] = xb[kb];
+        }
+
+        for (unsigned int t = 0; t != nn; ++t) {
+            const unsigned int ji = (unsigned int)rankjoint[t];
+            for (unsigned int k = xoff[t]; k != xoff[t + 1]; ++k) {
+                dReal sum = b[urow[k]];
+                for (unsigned int s = 0; s != 2; ++s) {
+                    const int bi = jb[2*ji + s];
+                    if (bi != -1) sum -= Dot8(work.GetJointRow(J, ji, urow[k], s), u + 8*(size_t)bi);
+                }
+                xu[k] = sum;
+            }
+        }
+        work.factor.Solve(xu);
+    }
+
+    for (unsigned int k = 0; k != nu; ++k) {
+        x[urow[k]] = xu[k];
+    }
+
+    return true;
+}
@@ -0,0 +1,73 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+solve the LCP problem of dSolveLCP for A = J*invM*J' + diag(Adcfm) without
+forming A, using the block structure of the constraint graph.
+
+the rows that are unbounded (lo = -inf, hi = inf, no findex and not used as
+a findex of another row) are eliminated with a block-sparse LDL' factorization
+of their part of A. the blocks are the rows of a joint and two joints are
+coupled if they share a body, so the elimination order is chosen with a
+minimum degree heuristic on the joint graph: the joints of a body form a clique
+and eliminating a joint merges the cliques of its two bodies. for tree-like
+articulations this produces no fill-in at all.
+
+the remaining (bounded) rows make a dense LCP with the Schur complement
+of the unbounded rows, which is solved with dSolveLCP. the unbounded rows
+are then found by back substitution, so the result is the same as that of
+dSolveLCP on the full matrix.
+
+J and JinvM are in the two-block per joint format of step.cpp: the rows of
+joint `i' start at 2*8*mindex[i], the rows for the first body come first,
+followed by the rows for the second body.
+
+*/
+
+
+#ifndef _ODE_LCP_SPARSE_H_
+#define _ODE_LCP_SPARSE_H_
+
+class dxWorldProcessMemArena;
+
+struct dxSparseLCPSystem
+{
+    unsigned int        nb;         // number of bodies
+    unsigned int        nj;         // number of joints
+    unsigned int        m;          // number of constraint rows
+    const unsigned int  *mindex;    // row offsets of joints, nj + 1 entries
+    const int           *jb;        // body indices of joints, 2 per joint, -1 for none
+    const dReal         *J;         // jacobian, 2*8*m
+    const dReal         *JinvM;     // J*invM, 2*8*m
+    const dReal         *invI;      // world inverse inertia tensors, 12 per body
+    const dReal         *invMass;   // inverse masses, 1 per body
+    const dReal         *Adcfm;     // the diagonal added to J*invM*J', m
+};
+
+// Returns false without touching `x' if the solution would need more
+// than `memlimit' bytes of the arena. The arena state is not restored.
+bool dSolveLCPSparse (dxWorldProcessMemArena *memarena, size_t memlimit,
+                      const dxSparseLCPSystem *system, dReal *x, const dReal *b,
+                      const dReal *lo, const dReal *hi, const int *findex);
+
+#endif
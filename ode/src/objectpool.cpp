@@ -0,0 +1,195 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+
+#include <ode/common.h>
+#include <ode/error.h>
+#include <ode/memory.h>
+#include "config.h"
+#include "objectpool.h"
+#include "util.h"
+
+//****************************************************************************
+// macros and constants
+
+#define SLAB_HEADER_SIZE dEFFICIENT_SIZE(sizeof(Slab))
+
+//****************************************************************************
+// dxObjectPool
+
+dxObjectPool::dxObjectPool():
+    m_first_slab(NULL), m_free_list(NULL),
+    m_object_size(0), m_slab_objects(dOBJECTPOOL_FIRST_SLAB_OBJECTS),
+    m_live_count(0)
+{
+}
+
+
+dxObjectPool::~dxObjectPool()
+{
+    // objects still alive at this point are leaked by the user, their
+    // slabs are left alone so the objects remain usable
+    purge();
+}
+
+
+void dxObjectPool::initialize (size_t object_size)
+{
+    dIASSERT (m_first_slab == NULL);
+
+    size_t size = object_size > sizeof (FreeObject) ? object_size : sizeof (FreeObject);
+    m_object_size = dEFFICIENT_SIZE (size);
+    m_slab_objects = dOBJECTPOOL_FIRST_SLAB_OBJECTS;
+}
+
+
+void dxObjectPool::allocSlab()
+{
+    dIASSERT (m_object_size != 0);
+
+    size_t slab_objects = m_slab_objects;
+    size_t slab_size = SLAB_HEADER_SIZE + slab_objects * m_object_size;
+    Slab *slab = (Slab *) dAlloc (slab_size);
+    slab->m_next = m_first_slab;
+    slab->m_size = slab_size;
+    m_first_slab = slab;
+
+    // thread the new objects onto the free list in address order
+    char *first = ((char *) slab) + SLAB_HEADER_SIZE;
+    for (size_t i = slab_objects; i != 0; ) {
+        --i;
+        FreeObject *obj = (FreeObject *) (first + i * m_object_size);
+        obj->m_next = m_free_list;
+        m_free_list = obj;
+    }
+
+    // grow the slabs geometrically up to dOBJECTPOOL_SLAB_SIZE
+    size_t max_objects = (dOBJECTPOOL_SLAB_SIZE - SLAB_HEADER_SIZE) / m_object_size;
+    if (slab_objects * 2 <= max_objects) {
+        m_slab_objects = slab_objects * 2;
+    } else if (max_objects > slab_objects) {
+        m_slab_objects = max_objects;
+    }
+}
+
+
+void *dxObjectPool::alloc()
+{
+    if (m_free_list == NULL) {
+        allocSlab();
+    }
+
+    FreeObject *obj = m_free_list;
+    m_free_list = obj->m_next;
+    m_live_count++;
+    return obj;
+}
+
+
+void dxObjectPool::free (void *ptr)
+{
+    dIASSERT (ptr != NULL && m_live_count != 0);
+
+    FreeObject *obj = (FreeObject *) ptr;
+    obj->m_next = m_free_list;
+    m_free_list = obj;
+    m_live_count--;
+}
+
+
+bool dxObjectPool::purge()
+{
+    if (m_live_count == 0) {
+        Slab *slab = m_first_slab, *next_slab;
+        while (slab) {
+            next_slab = slab->m_next;
+            dFree (slab, slab->m_size);
+            slab = next_slab;
+        }
+        m_first_slab = NULL;
+        m_free_list = NULL;
+        m_slab_objects = dOBJECTPOOL_FIRST_SLAB_OBJECTS;
+    }
+    return m_first_slab == NULL;
+}
+
+//****************************************************************************
+// dxSizeClassPool
+
+dxSizeClassPool::dxSizeClassPool()
+{
+    for (unsigned i = 0; i != dSIZECLASSPOOL_CLASS_COUNT; ++i) {
+        m_pools[i].initialize ((i + 1) * dSIZECLASSPOOL_GRANULARITY);
+    }
+}
+
+
+/*static */
+int dxSizeClassPool::getSizeClass (size_t size)
+{
+    size_t size_class = (size + (dSIZECLASSPOOL_GRANULARITY - 1)) / dSIZECLASSPOOL_GRANULARITY;
+    if (size_class == 0 || size_class > dSIZECLASSPOOL_CLASS_COUNT) {
+        return -1;
+    }
+    return (int)size_class - 1;
+}
+
+
+void *dxSizeClassPool::alloc (size_t size)
+{
+    int size_class = getSizeClass (size);
+    if (size_class < 0) {
+        return dAlloc (size);
+    }
+    return m_pools[size_class].alloc();
+}
+
+
+void dxSizeClassPool::free (void *ptr, size_t size)
+{
+    int size_class = getSizeClass (size);
+    if (size_class < 0) {
+        dFree (ptr, size);
+    } else {
+        m_pools[size_class].free (ptr);
+    }
+}
+
+
+bool dxSizeClassPool::purge()
+{
+    bool result = true;
+    for (unsigned i = 0; i != dSIZECLASSPOOL_CLASS_COUNT; ++i) {
+        if (!m_pools[i].purge()) result = false;
+    }
+    return result;
+}
+
+
+size_t dxSizeClassPool::getLiveCount() const
+{
+    size_t result = 0;
+    for (unsigned i = 0; i != dSIZECLASSPOOL_CLASS_COUNT; ++i) {
+        result += m_pools[i].getLiveCount();
+    }
+    return result;
+}
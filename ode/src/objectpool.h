@@ -0,0 +1,108 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef _ODE_OBJECTPOOL_H_
+#define _ODE_OBJECTPOOL_H_
+
+#include <ode/common.h>
+
+// the largest slab a pool allocates, smaller pools start with fewer objects
+#define dOBJECTPOOL_SLAB_SIZE 16384
+// number of objects in the first slab of a pool
+#define dOBJECTPOOL_FIRST_SLAB_OBJECTS 8
+
+// size class granularity and count of dxSizeClassPool. larger requests
+// are passed to the global allocator.
+#define dSIZECLASSPOOL_GRANULARITY 16
+#define dSIZECLASSPOOL_CLASS_COUNT 64
+
+
+// a pool of fixed size objects. memory is taken from the global allocator
+// in slabs holding several objects, so objects of one pool stay close
+// together and alloc() and free() are O(1). slabs are kept until the pool
+// is purged or destroyed. the pool is not thread safe.
+
+class dxObjectPool {
+public:
+    dxObjectPool();
+    ~dxObjectPool();
+
+    void initialize (size_t object_size);
+    // set the object size. must be called before the first alloc().
+
+    void *alloc();
+    // return storage for one object, allocating a new slab if necessary.
+
+    void free (void *ptr);
+    // return an object's storage to the pool.
+
+    bool purge();
+    // release all slabs if there are no live objects. return true if the
+    // pool holds no memory afterwards.
+
+    size_t getLiveCount() const { return m_live_count; }
+    size_t getObjectSize() const { return m_object_size; }
+
+private:
+    struct Slab {
+        Slab *m_next;       // next slab in linked list
+        size_t m_size;      // total size of the slab in bytes, counting this header
+    };
+    struct FreeObject {
+        FreeObject *m_next;
+    };
+
+private:
+    void allocSlab();
+
+private:
+    Slab *m_first_slab;         // head of the slab linked list
+    FreeObject *m_free_list;    // head of the free object list
+    size_t m_object_size;       // object size rounded up to EFFICIENT_ALIGNMENT
+    size_t m_slab_objects;      // number of objects in the next slab
+    size_t m_live_count;        // number of objects currently allocated
+};
+
+
+// a set of object pools for objects of differing sizes, like the joint or
+// geom classes. the size must be passed to free() again.
+
+class dxSizeClassPool {
+public:
+    dxSizeClassPool();
+
+    void *alloc (size_t size);
+    void free (void *ptr, size_t size);
+    bool purge();
+
+    static int getSizeClass (size_t size);
+    // return the index of the pool serving the size, -1 for the sizes
+    // passed to the global allocator.
+
+    size_t getLiveCount() const;
+
+private:
+    dxObjectPool m_pools[dSIZECLASSPOOL_CLASS_COUNT];
+};
+
+
+#endif
@@ -31,6 +31,7 @@
 #include "objects.h"
 #include "util.h"
 #include "threading_impl.h"
+#include "contact_cache.h"
 
 
 #define dWORLD_DEFAULT_GLOBAL_ERP REAL(0.2)
@@ -72,13 +73,18 @@ dxDampingParameters::dxDampingParameters(void *):
 
 dxQuickStepParameters::dxQuickStepParameters(void *):
     num_iterations(20),
-    w(REAL(1.3))
+    w(REAL(1.3)),
+    parallel_sor(0),
+    warm_starting(0),
+    warm_starting_factor(REAL(0.9)),
+    tolerance(REAL(0.0))
 {
 }
 
 dxContactParameters::dxContactParameters(void *):
     max_vel(dInfinity),
-    min_depth(REAL(0.0))
+    min_depth(REAL(0.0)),
+    warm_starting_distance(REAL(0.01))
 {
 }
 
@@ -94,8 +100,12 @@ dxWorld::dxWorld():
     adis(NULL),
     body_flags(0),
     islands_max_threads(dWORLDSTEP_THREADCOUNT_UNLIMITED),
+    island_links_valid(0),
+    island_step(0),
     wmem(NULL),
+    contact_cache(NULL),
     qs(NULL),
+    step_stats_enabled(0),
     contactp(NULL),
     dampingp(NULL),
     max_angular_speed(dInfinity)
@@ -103,6 +113,10 @@ dxWorld::dxWorld():
     dxThreadingBase::SetThreadingDefaultImplProvider(this);
 
     dSetZero (gravity, 4);
+    memset (&step_stats, 0, sizeof (step_stats));
+    memset ((void *)step_stats_shards, 0, sizeof (step_stats_shards));
+
+    body_pool.initialize (sizeof (dxBody));
 }
 
 dxWorld::~dxWorld()
@@ -112,6 +126,10 @@ dxWorld::~dxWorld()
         wmem->CleanupWorldReferences(this);
         wmem->Release();
     }
+
+    delete contact_cache;
+
+    dIASSERT (body_pool.getLiveCount() == 0 && joint_pool.getLiveCount() == 0);
 }
 
 bool dxWorld::InitializeDefaultThreading()
@@ -31,11 +31,13 @@
 #include <ode/mass.h>
 #include "error.h"
 #include "array.h"
+#include "objectpool.h"
 #include "threading_base.h"
 
 
 class dxStepWorkingMemory;
 class dxWorldProcessContext;
+class dxContactCache;
 
 // some body flags
 
@@ -106,6 +108,10 @@ struct dxDampingParameters {
 struct dxQuickStepParameters {
     int num_iterations;		// number of SOR iterations to perform
     dReal w;			// the SOR over-relaxation parameter
+    int parallel_sor;		// solve independent row batches of an island in multiple threads
+    int warm_starting;		// start the SOR iterations from the forces of the previous step
+    dReal warm_starting_factor;	// scale of the previous forces of the joints other than contacts
+    dReal tolerance;		// stop the SOR iterations once forces change by less than this
 
     dxQuickStepParameters() {}
     explicit dxQuickStepParameters(void *);
@@ -116,11 +122,41 @@ struct dxQuickStepParameters {
 struct dxContactParameters {
     dReal max_vel;		// maximum correcting velocity
     dReal min_depth;		// thickness of 'surface layer'
+    dReal warm_starting_distance;	// maximum contact displacement for the cached force to be reused
 
     dxContactParameters() {}
     explicit dxContactParameters(void *);
 };
 
+// stages of world stepping timed by the step statistics
+enum dxStepStage {
+    dxSTEP_STAGE0_BODIES,
+    dxSTEP_STAGE0_JOINTS,
+    dxSTEP_STAGE1,
+    dxSTEP_STAGE2A,
+    dxSTEP_STAGE2B,
+    dxSTEP_STAGE2C,
+    dxSTEP_STAGE3,
+    dxSTEP_LCP,
+    dxSTEP_INTEGRATION,
+
+    dxSTEP__MAX,
+    dxSTEP__NONE = dxSTEP__MAX
+};
+
+// the step statistics the stepping threads add to, kept in shards with
+// their own cache lines as the collision statistics are. A step folds the
+// shards into step_stats when it ends. Times are kept in nanoseconds.
+#define dSTEP_STATISTICS_SHARDS 8
+
+struct dxStepStatisticsShard {
+    volatile size_t stage_time[dxSTEP__MAX];
+    volatile size_t rows;
+    volatile size_t max_island_rows;
+    char pad[64];
+};
+
+
 // position vector and rotation matrix for geometry objects that are not
 // connected to bodies.
 struct dxPosR {
@@ -130,6 +166,9 @@ struct dxPosR {
 
 struct dxBody : public dObject {
     dxJointNode *firstjoint;	// list of attached joints
+    dxBody *island_parent;	// union-find link to a body of the same island
+    dxBody *island_step_parent;	// link of a set root to a set joined by group joints in island_step
+    unsigned island_step;		// world step the island_step_parent link is valid for
     unsigned flags;			// some dxBodyFlagXXX flags
     dGeomID geom;			// first collision geom associated with body
     dMass mass;			// mass parameters about POR
@@ -168,12 +207,21 @@ struct dxWorld : public dBase, public dxThreadingBase, private dxIThreadingDefau
     dxAutoDisable adis;		// auto-disable parameters
     int body_flags;               // flags for new bodies
     unsigned islands_max_threads; // maximum threads to allocate for island processing
+    int island_links_valid;       // body island_parent links match the current joint connectivity
+    unsigned island_step;         // counts the steps for the body island_step_parent links
     dxStepWorkingMemory *wmem; // Working memory object for dWorldStep/dWorldQuickStep
+    dxContactCache *contact_cache; // Contact forces of the previous step for warm starting
 
     dxQuickStepParameters qs;
+    dArray<dQuickStepIslandStatistics> qs_stats; // QuickStep statistics of the islands of the last step
+    int step_stats_enabled;       // collect step_stats while stepping
+    dWorldStepStatistics step_stats; // statistics of the last step
+    dxStepStatisticsShard step_stats_shards[dSTEP_STATISTICS_SHARDS]; // step_stats being collected
     dxContactParameters contactp;
     dxDampingParameters dampingp; // damping parameters
     dReal max_angular_speed;      // limit the angular velocity to this magnitude
+    dxObjectPool body_pool;       // storage of the bodies
+    dxSizeClassPool joint_pool;   // storage of the joints that are not in a group
 
 
     dxWorld();
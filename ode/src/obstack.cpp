@@ -105,6 +105,25 @@ void *dObStack::alloc (size_t num_bytes)
 }
 
 
+void *dObStack::allocArray (size_t num_bytes, size_t max_count, size_t *out_count, size_t *out_stride)
+{
+    dIASSERT (max_count != 0);
+
+    // the first block may need a new arena, the others fill this one
+    void *first = alloc (num_bytes);
+    size_t count = 1;
+    while (count != max_count && m_last->m_used + num_bytes <= dOBSTACK_ARENA_SIZE) {
+        m_last->m_used += num_bytes;
+        ROUND_UP_OFFSET_TO_EFFICIENT_SIZE (m_last,m_last->m_used);
+        count++;
+    }
+
+    *out_count = count;
+    *out_stride = dEFFICIENT_SIZE(num_bytes);
+    return first;
+}
+
+
 void dObStack::freeAll()
 {
     Arena *current = m_first;
@@ -37,6 +37,14 @@ struct dObStack : public dBase {
     // allocate a block in the last arena, allocating a new arena if necessary.
     // it is a runtime error if num_bytes is larger than the arena size.
 
+    void *allocArray (size_t num_bytes, size_t max_count, size_t *out_count, size_t *out_stride);
+    // allocate a run of up to 'max_count' blocks of 'num_bytes' each in the
+    // last arena, allocating a new arena if necessary, and return the address
+    // of the first one. the number of blocks is stored in 'out_count', it is
+    // less than 'max_count' when the arena is full. the blocks follow each
+    // other at 'out_stride' bytes, just as 'out_count' calls to alloc() would
+    // lay them out, so next() enumerates them one by one.
+
     void freeAll();
     // free all blocks in all arenas. this does not deallocate the arenas
     // themselves, so future alloc()s will reuse them.
@@ -39,6 +39,7 @@
 #include "quickstep.h"
 #include "util.h"
 #include "odetls.h"
+#include "contact_cache.h"
 
 // misc defines
 #define ALLOCA dALLOCA16
@@ -74,6 +75,8 @@ static inline void removeObjectFromList (dObject *obj)
 
 static void removeJointReferencesFromAttachedBodies (dxJoint *j)
 {
+    dxIslandLinksRemoveJoint (j);
+
     for (int i=0; i<2; i++) {
         dxBody *body = j->node[i].body;
         if (body) {
@@ -238,8 +241,11 @@ dxWorld* dBodyGetWorld (dxBody * b)
 dxBody *dBodyCreate (dxWorld *w)
 {
     dAASSERT (w);
-    dxBody *b = new dxBody(w);
+    dxBody *b = new (w->body_pool.alloc()) dxBody(w);
     b->firstjoint = 0;
+    b->island_parent = b;
+    b->island_step_parent = b;
+    b->island_step = 0;
     b->flags = 0;
     b->geom = 0;
     b->average_lvel_buffer = 0;
@@ -324,7 +330,9 @@ void dBodyDestroy (dxBody *b)
         b->average_avel_buffer = 0;
     }
 
-    delete b;
+    dxWorld *w = b->world;
+    b->~dxBody();
+    w->body_pool.free (b);
 }
 
 
@@ -1156,7 +1164,7 @@ dxJoint* createJoint(dWorldID w, dJointGroupID group)
     if (group) {
         j = group->alloc<T>(w);
     } else {
-        j = new T(w);
+        j = new (w->joint_pool.alloc(sizeof(T))) T(w);
     }
     return j;
 }
@@ -1190,6 +1198,11 @@ dxJoint * dJointCreateContact (dWorldID w, dJointGroupID group,
     dxJointContact *j = (dxJointContact *)
         createJoint<dxJointContact> (w,group);
     j->contact = *c;
+    if (w->contact_cache != NULL) {
+        // seed the constraint forces with those of the matching contact
+        // of the previous step, if there is one
+        w->contact_cache->lookupContact (c->geom, w->contactp.warm_starting_distance, j->lambda);
+    }
     return j;
 }
 
@@ -1278,15 +1291,25 @@ dxJoint * dJointCreateTransmission (dWorldID w, dJointGroupID group)
 
 static void FinalizeAndDestroyJointInstance(dxJoint *j, bool delete_it)
 {
+    dxWorld *w = j->world;
     // if any group joints have their world pointer set to 0, their world was
     // previously destroyed. no special handling is required for these joints.
     if (j->world != NULL) {
+        dxContactCache *contact_cache = j->world->contact_cache;
+        if (contact_cache != NULL && j->type() == dJointTypeContact) {
+            // keep the forces of the contact for the next step
+            contact_cache->storeContact (((dxJointContact *)j)->contact.geom, j->lambda);
+        }
         removeJointReferencesFromAttachedBodies (j);
         removeObjectFromList (j);
         j->world->nj--;
     }
-    if (delete_it) { 
-        delete j;
+    if (delete_it) {
+        // joints outside of groups are destroyed before their world
+        dIASSERT (w != NULL);
+        size_t sz = j->size();
+        j->~dxJoint();
+        w->joint_pool.free (j, sz);
     } else {
         j->~dxJoint();
     }
@@ -1360,6 +1383,94 @@ void dJointGroupEmpty (dJointGroupID group)
 }
 
 
+dContactBufferID dContactBufferCreate()
+{
+    return new dxContactBuffer();
+}
+
+
+void dContactBufferDestroy (dContactBufferID buffer)
+{
+    dAASSERT (buffer);
+    delete buffer;
+}
+
+
+void dContactBufferAdd (dContactBufferID buffer, const dContact *c, dBodyID b1, dBodyID b2)
+{
+    dAASSERT (buffer && c);
+    dxContactBuffer::Entry entry;
+    entry.contact = *c;
+    entry.body1 = b1;
+    entry.body2 = b2;
+    buffer->m_entries.push (entry);
+}
+
+
+int dContactBufferGetCount (dContactBufferID buffer)
+{
+    dAASSERT (buffer);
+    return buffer->m_entries.size();
+}
+
+
+void dContactBufferEmpty (dContactBufferID buffer)
+{
+    dAASSERT (buffer);
+    buffer->m_entries.setSize (0);
+}
+
+
+// the joints of all the buffers are placed one after another on the group
+// stack in a single pass
+
+int dJointGroupAddContactsBatch (dWorldID w, dJointGroupID group,
+                                 dContactBufferID const *buffers, int buffer_count)
+{
+    dAASSERT (w && group && (buffers || buffer_count == 0));
+
+    dxContactCache *cache = w->contact_cache;
+    const dReal warm_starting_distance = w->contactp.warm_starting_distance;
+
+    size_t total = 0;
+    for (int b = 0; b < buffer_count; b++) {
+        dAASSERT (buffers[b]);
+        total += buffers[b]->m_entries.size();
+    }
+
+    // the joints are allocated in runs as long as the group arenas allow,
+    // and filled in as the entries are walked
+    char *run = NULL;
+    size_t run_left = 0, stride = 0, left = total;
+
+    for (int b = 0; b < buffer_count; b++) {
+        dxContactBuffer *buffer = buffers[b];
+
+        const int count = buffer->m_entries.size();
+        const dxContactBuffer::Entry *entries = buffer->m_entries.data();
+        for (int i = 0; i < count; i++) {
+            if (run_left == 0) {
+                run = (char *)group->allocArray<dxJointContact>(w, left, &run_left, &stride);
+            }
+            dxJointContact *j = (dxJointContact *)run;
+            run += stride;
+            run_left--;
+            left--;
+
+            const dxContactBuffer::Entry &entry = entries[i];
+            j->contact = entry.contact;
+            if (cache != NULL) {
+                cache->lookupContact (entry.contact.geom, warm_starting_distance, j->lambda);
+            }
+            dJointAttach (j, entry.body1, entry.body2);
+        }
+
+        buffer->m_entries.setSize (0);
+    }
+    return (int)total;
+}
+
+
 int dJointGetNumBodies(dxJoint *joint)
 {
     // check arguments
@@ -1425,17 +1536,26 @@ void dJointAttach (dxJoint *joint, dxBody *body1, dxBody *body2)
     // Only need to calculate relative value if a body exist
     if (body1 || body2)
         joint->setRelativeValues();
+
+    dxIslandLinksAddJoint (joint);
 }
 
 void dJointEnable (dxJoint *joint)
 {
     dAASSERT (joint);
     joint->flags &= ~dJOINT_DISABLED;
+    // group joints of a destroyed world have no world to update
+    if (joint->world != NULL) {
+        dxIslandLinksAddJoint (joint);
+    }
 }
 
 void dJointDisable (dxJoint *joint)
 {
     dAASSERT (joint);
+    if (joint->world != NULL) {
+        dxIslandLinksRemoveJoint (joint);
+    }
     joint->flags |= dJOINT_DISABLED;
 }
 
@@ -1603,7 +1723,7 @@ void dWorldDestroy (dxWorld *w)
             // TODO: shouldn't we call dJointDestroy()?
             size_t sz = j->size();
             j->~dxJoint();
-            dFree (j,sz);
+            w->joint_pool.free (j,sz);
         }
         j = nextj;
     }
@@ -1800,6 +1920,29 @@ void dWorldSetStepThreadingImplementation(dWorldID w,
 }
 
 
+// the step statistics are cleared at the beginning of every step and
+// filled while stepping, if enabled
+
+static void BeginStepStatistics (dxWorld *w, dStopwatch *stepStopwatch)
+{
+    memset (&w->step_stats, 0, sizeof (w->step_stats));
+
+    if (w->step_stats_enabled) {
+        memset ((void *)w->step_stats_shards, 0, sizeof (w->step_stats_shards));
+        dStopwatchReset (stepStopwatch);
+        dStopwatchStart (stepStopwatch);
+    }
+}
+
+static void EndStepStatistics (dxWorld *w, dStopwatch *stepStopwatch)
+{
+    if (w->step_stats_enabled) {
+        dStopwatchStop (stepStopwatch);
+        w->step_stats.step_time = dStopwatchTime (stepStopwatch);
+        dxFoldStepStatistics (w);
+    }
+}
+
 int dWorldStep (dWorldID w, dReal stepsize)
 {
     dUASSERT (w,"bad world argument");
@@ -1807,6 +1950,15 @@ int dWorldStep (dWorldID w, dReal stepsize)
 
     bool result = false;
 
+    dStopwatch stepStopwatch;
+    BeginStepStatistics (w, &stepStopwatch);
+
+    if (w->contact_cache != NULL) {
+        // this step does not warm start, but the contacts destroyed after it
+        // still replace the cached ones
+        w->contact_cache->invalidate();
+    }
+
     dxWorldProcessIslandsInfo islandsinfo;
     if (dxReallocateWorldProcessContext (w, islandsinfo, stepsize, &dxEstimateStepMemoryRequirements))
     {
@@ -1816,6 +1968,8 @@ int dWorldStep (dWorldID w, dReal stepsize)
         }
     }
 
+    EndStepStatistics (w, &stepStopwatch);
+
     return result;
 }
 
@@ -1826,15 +1980,29 @@ int dWorldQuickStep (dWorldID w, dReal stepsize)
 
     bool result = false;
 
+    dStopwatch stepStopwatch;
+    BeginStepStatistics (w, &stepStopwatch);
+
+    if (w->contact_cache != NULL) {
+        // the contacts of this step have been created already; the contacts
+        // destroyed after it are going to replace the cached ones
+        w->contact_cache->invalidate();
+    }
+
     dxWorldProcessIslandsInfo islandsinfo;
     if (dxReallocateWorldProcessContext (w, islandsinfo, stepsize, &dxEstimateQuickStepMemoryRequirements))
     {
+        // each island stores its solver statistics at its index
+        w->qs_stats.setSize ((int)islandsinfo.GetIslandsCount());
+
         if (dxProcessIslands (w, islandsinfo, stepsize, &dxQuickStepIsland, &dxEstimateQuickStepMaxCallCount))
         {
             result = true;
         }
     }
 
+    EndStepStatistics (w, &stepStopwatch);
+
     return result;
 }
 
@@ -2051,6 +2219,112 @@ dReal dWorldGetQuickStepW (dWorldID w)
 }
 
 
+void dWorldSetQuickStepParallelSOR (dWorldID w, int enabled)
+{
+    dAASSERT(w);
+    w->qs.parallel_sor = enabled != 0;
+}
+
+
+int dWorldGetQuickStepParallelSOR (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.parallel_sor;
+}
+
+
+int dWorldSetQuickStepWarmStarting (dWorldID w, int enabled)
+{
+    dAASSERT(w);
+
+    if (enabled) {
+        if (w->contact_cache == NULL) {
+            w->contact_cache = new dxContactCache();
+        }
+    }
+    else {
+        delete w->contact_cache;
+        w->contact_cache = NULL;
+    }
+
+    w->qs.warm_starting = enabled != 0;
+    return 1;
+}
+
+
+int dWorldGetQuickStepWarmStarting (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.warm_starting;
+}
+
+
+void dWorldSetQuickStepWarmStartingFactor (dWorldID w, dReal factor)
+{
+    dAASSERT(w);
+    dUASSERT (factor >= 0, "factor must be non-negative");
+    w->qs.warm_starting_factor = factor;
+}
+
+
+dReal dWorldGetQuickStepWarmStartingFactor (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.warm_starting_factor;
+}
+
+
+void dWorldSetQuickStepTolerance (dWorldID w, dReal tolerance)
+{
+    dAASSERT(w);
+    dUASSERT (tolerance >= 0, "tolerance must be non-negative");
+    w->qs.tolerance = tolerance;
+}
+
+
+dReal dWorldGetQuickStepTolerance (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.tolerance;
+}
+
+
+unsigned int dWorldGetQuickStepIslandCount (dWorldID w)
+{
+    dAASSERT(w);
+    return (unsigned int)w->qs_stats.size();
+}
+
+
+void dWorldGetQuickStepIslandStatistics (dWorldID w, unsigned int island, dQuickStepIslandStatistics *stats)
+{
+    dAASSERT(w && stats);
+    dUASSERT (island < (unsigned int)w->qs_stats.size(), "island index out of range");
+    *stats = w->qs_stats[island];
+}
+
+
+void dWorldSetStepStatisticsEnabled (dWorldID w, int enabled)
+{
+    dAASSERT(w);
+    w->step_stats_enabled = (enabled != 0);
+}
+
+
+int dWorldGetStepStatisticsEnabled (dWorldID w)
+{
+    dAASSERT(w);
+    return w->step_stats_enabled;
+}
+
+
+void dWorldGetStepStatistics (dWorldID w, dWorldStepStatistics *stats)
+{
+    dAASSERT(w && stats);
+    *stats = w->step_stats;
+}
+
+
 void dWorldSetContactMaxCorrectingVel (dWorldID w, dReal vel)
 {
     dAASSERT(w);
@@ -2078,6 +2352,21 @@ dReal dWorldGetContactSurfaceLayer (dWorldID w)
     return w->contactp.min_depth;
 }
 
+
+void dWorldSetContactWarmStartingDistance (dWorldID w, dReal distance)
+{
+    dAASSERT(w);
+    dUASSERT (distance >= 0, "distance must be non-negative");
+    w->contactp.warm_starting_distance = distance;
+}
+
+
+dReal dWorldGetContactWarmStartingDistance (dWorldID w)
+{
+    dAASSERT(w);
+    return w->contactp.warm_starting_distance;
+}
+
 //****************************************************************************
 // testing
 
@@ -33,6 +33,7 @@
 #include "lcp.h"
 #include "util.h"
 #include "threadingutils.h"
+#include "quickstep_kernels.h"
 
 #include <new>
 
@@ -45,11 +46,12 @@
 // configuration
 
 // for the SOR and CG methods:
-// uncomment the following line to use warm starting. this definitely
-// help for motor-driven joints. unfortunately it appears to hurt
-// with high-friction contacts using the SOR method. use with care
-
-//#define WARM_STARTING 1
+// warm starting is enabled at run time with dWorldSetQuickStepWarmStarting().
+// this definitely helps for motor-driven joints and, as long as contact
+// forces are matched to the new contacts via the world contact cache, for
+// stacks and resting contacts as well. the forces of the other joints are
+// scaled with dWorldSetQuickStepWarmStartingFactor(), which prevents jerkiness
+// in motor-driven joints; the cached contact forces are taken as they are.
 
 
 // for the SOR method:
@@ -121,6 +123,17 @@ struct dJointWithInfo1
     dxJoint::Info1 info;
 };
 
+// copy of the island body state used by the stepper passes. it is gathered
+// from the bodies in stage 0, so that the passes up to the integration
+// stream over contiguous arrays rather than visiting every dxBody.
+// velocities are stored 6 per body like the other per body arrays.
+struct dxQuickStepperBodyState
+{
+    dReal                           *m_invI;        // inverse inertia tensors in the global frame, 3x4 per body
+    dReal                           *m_invMass;
+    dReal                           *m_vel;         // linear and angular velocity
+};
+
 struct dxQuickStepperStage0Outputs
 {
     unsigned int                    nj;
@@ -130,37 +143,33 @@ struct dxQuickStepperStage0Outputs
 
 struct dxQuickStepperStage1CallContext
 {
-    void Initialize(const dxStepperProcessingCallContext *stepperCallContext, void *stageMemArenaState, dReal *invI, dJointWithInfo1 *jointinfos)
+    void Initialize(const dxStepperProcessingCallContext *stepperCallContext, void *stageMemArenaState, dxQuickStepperBodyState *bodyState, dJointWithInfo1 *jointinfos)
     {
         m_stepperCallContext = stepperCallContext;
         m_stageMemArenaState = stageMemArenaState; 
-        m_invI = invI;
+        m_bodyState = bodyState;
         m_jointinfos = jointinfos;
     }
 
     const dxStepperProcessingCallContext *m_stepperCallContext;
     void                            *m_stageMemArenaState;
-    dReal                           *m_invI;
+    dxQuickStepperBodyState         *m_bodyState;
     dJointWithInfo1                 *m_jointinfos;
     dxQuickStepperStage0Outputs     m_stage0Outputs;
 };
 
 struct dxQuickStepperStage0BodiesCallContext
 {
-    void Initialize(const dxStepperProcessingCallContext *stepperCallContext, dReal *invI)
+    void Initialize(const dxStepperProcessingCallContext *stepperCallContext, dxQuickStepperBodyState *bodyState)
     {
         m_stepperCallContext = stepperCallContext;
-        m_invI = invI;
-        m_tagsTaken = 0;
-        m_gravityTaken = 0;
-        m_inertiaBodyIndex = 0;
+        m_bodyState = bodyState;
+        m_bodyIndex = 0;
     }
 
     const dxStepperProcessingCallContext *m_stepperCallContext;
-    dReal                           *m_invI;
-    atomicord32                     m_tagsTaken;
-    atomicord32                     m_gravityTaken;
-    unsigned int                    volatile m_inertiaBodyIndex;
+    dxQuickStepperBodyState         *m_bodyState;
+    unsigned int                    volatile m_bodyIndex;
 };
 
 struct dxQuickStepperStage0JointsCallContext
@@ -188,11 +197,11 @@ static void dxQuickStepIsland_Stage1(dxQuickStepperStage1CallContext *callContex
 
 struct dxQuickStepperLocalContext
 {
-    void Initialize(dReal *invI, dJointWithInfo1 *jointinfos, unsigned int nj, 
+    void Initialize(const dxQuickStepperBodyState *bodyState, dJointWithInfo1 *jointinfos, unsigned int nj, 
         unsigned int m, unsigned int mfb, const unsigned int *mindex, int *findex, 
         dReal *J, dReal *cfm, dReal *lo, dReal *hi, int *jb, dReal *rhs, dReal *Jcopy)
     {
-        m_invI = invI;
+        m_bodyState = bodyState;
         m_jointinfos = jointinfos;
         m_nj = nj;
         m_m = m;
@@ -208,7 +217,7 @@ struct dxQuickStepperLocalContext
         m_Jcopy = Jcopy;
     }
 
-    dReal                           *m_invI;
+    const dxQuickStepperBodyState   *m_bodyState;
     dJointWithInfo1                 *m_jointinfos;
     unsigned int                    m_nj;
     unsigned int                    m_m;
@@ -239,6 +248,76 @@ struct dxQuickStepperStage3CallContext
     void                            *m_stage1MemArenaState;
 };
 
+struct dxQuickStepperStage4CallContext
+{
+    void Initialize(const dxStepperProcessingCallContext *callContext, const dxQuickStepperLocalContext *localContext, 
+        dReal *lambda, dReal *cforce)
+    {
+        m_stepperCallContext = callContext;
+        m_localContext = localContext;
+        m_lambda = lambda;
+        m_cforce = cforce;
+        m_lcpMemArenaState = NULL;
+    }
+
+    const dxStepperProcessingCallContext *m_stepperCallContext;
+    const dxQuickStepperLocalContext   *m_localContext;
+    dReal                           *m_lambda;
+    dReal                           *m_cforce;
+    void                            *m_lcpMemArenaState;
+};
+
+struct dxSORRowLayout;
+
+struct dxQuickStepperLCPCallContext
+{
+    void Initialize(const dxStepperProcessingCallContext *callContext, const dxQuickStepperLocalContext *localContext, 
+        const dxSORRowLayout *layout, dReal *lambda, dReal *fc, 
+        const unsigned int *batchStart, const unsigned int *batchGroups, unsigned int batchCount, 
+        dReal *blockResiduals, unsigned int num_iterations, dReal tolerance)
+    {
+        m_stepperCallContext = callContext;
+        m_localContext = localContext;
+        m_layout = layout;
+        m_lambda = lambda;
+        m_fc = fc;
+        m_batchStart = batchStart;
+        m_batchGroups = batchGroups;
+        m_batchCount = batchCount;
+        m_blockResiduals = blockResiduals;
+        m_num_iterations = num_iterations;
+        m_tolerance = tolerance;
+        m_stage4Releasee = NULL;
+        m_iteration = 0;
+        m_batch = 0;
+        m_activeBatch = 0;
+        m_blockCount = 0;
+        m_blockIndex = 0;
+        m_residual = 0;
+        m_lastResidual = 0;
+    }
+
+    const dxStepperProcessingCallContext *m_stepperCallContext;
+    const dxQuickStepperLocalContext   *m_localContext;
+    const dxSORRowLayout            *m_layout;
+    dReal                           *m_lambda;          // receives the solution in the original row order
+    dReal                           *m_fc;
+    const unsigned int              *m_batchStart;      // batch row positions in the layout
+    const unsigned int              *m_batchGroups;     // first layout group of each batch
+    unsigned int                    m_batchCount;
+    dReal                           *m_blockResiduals;  // largest lambda change of each block of the active batch
+    unsigned int                    m_num_iterations;
+    dReal                           m_tolerance;
+    dCallReleaseeID                 m_stage4Releasee;
+    unsigned int                    m_iteration;
+    unsigned int                    m_batch;
+    unsigned int                    m_activeBatch;
+    unsigned int                    m_blockCount;
+    volatile unsigned int           m_blockIndex;
+    dReal                           m_residual;         // largest lambda change of the current iteration
+    dReal                           m_lastResidual;     // largest lambda change of the last complete iteration
+};
+
 struct dxQuickStepperStage2CallContext
 {
     void Initialize(const dxStepperProcessingCallContext *callContext, const dxQuickStepperLocalContext *localContext, 
@@ -268,41 +347,55 @@ static int dxQuickStepIsland_Stage2b_Callback(void *callContext, dcallindex_t ca
 static int dxQuickStepIsland_Stage2bSync_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
 static int dxQuickStepIsland_Stage2c_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
 static int dxQuickStepIsland_Stage3_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+static int dxQuickStepIsland_Stage4LCP_Sync_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+static int dxQuickStepIsland_Stage4LCP_Batch_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+static int dxQuickStepIsland_Stage4_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
 
 static void dxQuickStepIsland_Stage2a(dxQuickStepperStage2CallContext *callContext);
 static void dxQuickStepIsland_Stage2b(dxQuickStepperStage2CallContext *callContext);
 static void dxQuickStepIsland_Stage2c(dxQuickStepperStage2CallContext *callContext);
 static void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *callContext);
+static void dxQuickStepIsland_Stage4LCP_Batch(dxQuickStepperLCPCallContext *callContext);
+static void dxQuickStepIsland_Stage4(dxQuickStepperStage4CallContext *callContext);
+static void dxQuickStepIsland_StoreStatistics(const dxStepperProcessingCallContext *callContext, unsigned int m, unsigned int iterations, dReal residual);
 
 
 //***************************************************************************
 // various common computations involving the matrix J
 
+// compute a row of iMJ = inv(M)*J'. only the first half is computed
+// for a row of one body.
+
+static inline void compute_invM_JT_row (const dReal *J_ptr, dReal *iMJ_ptr, int b1, int b2,
+                                        const dReal *invMass, const dReal *invI)
+{
+    dReal k1 = invMass[b1];
+    for (unsigned int j=0; j<3; j++) iMJ_ptr[j] = k1*J_ptr[j];
+    const dReal *invIrow1 = invI + 12*(size_t)(unsigned)b1;
+    dxQuickStepMultiply0_331 (iMJ_ptr + 3, invIrow1, J_ptr + 3);
+    if (b2 != -1) {
+        dReal k2 = invMass[b2];
+        for (unsigned int j=0; j<3; j++) iMJ_ptr[j+6] = k2*J_ptr[j+6];
+        const dReal *invIrow2 = invI + 12*(size_t)(unsigned)b2;
+        dxQuickStepMultiply0_331 (iMJ_ptr + 9, invIrow2, J_ptr + 9);
+    }
+}
+
+#ifdef USE_CG_LCP
+
 // compute iMJ = inv(M)*J'
 
 static void compute_invM_JT (unsigned int m, const dReal *J, dReal *iMJ, int *jb,
-                             dxBody * const *body, const dReal *invI)
+                             const dReal *invMass, const dReal *invI)
 {
     dReal *iMJ_ptr = iMJ;
     const dReal *J_ptr = J;
     for (unsigned int i=0; i<m; J_ptr += 12, iMJ_ptr += 12, i++) {
-        int b1 = jb[(size_t)i*2];
-        int b2 = jb[(size_t)i*2+1];
-        dReal k1 = body[b1]->invMass;
-        for (unsigned int j=0; j<3; j++) iMJ_ptr[j] = k1*J_ptr[j];
-        const dReal *invIrow1 = invI + 12*(size_t)(unsigned)b1;
-        dMultiply0_331 (iMJ_ptr + 3, invIrow1, J_ptr + 3);
-        if (b2 != -1) {
-            dReal k2 = body[b2]->invMass;
-            for (unsigned int j=0; j<3; j++) iMJ_ptr[j+6] = k2*J_ptr[j+6];
-            const dReal *invIrow2 = invI + 12*(size_t)(unsigned)b2;
-            dMultiply0_331 (iMJ_ptr + 9, invIrow2, J_ptr + 9);
-        }
+        compute_invM_JT_row (J_ptr, iMJ_ptr, jb[(size_t)i*2], jb[(size_t)i*2+1], invMass, invI);
     }
 }
 
 // compute out = inv(M)*J'*in.
-#ifdef WARM_STARTING
 static void multiply_invM_JT (unsigned int m, unsigned int nb, dReal *iMJ, int *jb,
                               const dReal *in, dReal *out)
 {
@@ -313,15 +406,16 @@ static void multiply_invM_JT (unsigned int m, unsigned int nb, dReal *iMJ, int *
         int b2 = jb[(size_t)i*2+1];
         const dReal in_i = in[i];
         dReal *out_ptr = out + (size_t)(unsigned)b1*6;
-        for (unsigned int j=0; j<6; j++) out_ptr[j] += iMJ_ptr[j] * in_i;
+        dxQuickStepAxpy6 (out_ptr, iMJ_ptr, in_i);
         iMJ_ptr += 6;
         if (b2 != -1) {
             out_ptr = out + (size_t)(unsigned)b2*6;
-            for (unsigned int j=0; j<6; j++) out_ptr[j] += iMJ_ptr[j] * in_i;
+            dxQuickStepAxpy6 (out_ptr, iMJ_ptr, in_i);
         }
         iMJ_ptr += 6;
     }
 }
+
 #endif
 
 // compute out = J*in.
@@ -333,12 +427,11 @@ static void multiplyAdd_J (volatile unsigned *mi_storage,
         int b1 = jb[(size_t)mi*2];
         int b2 = jb[(size_t)mi*2+1];
         const dReal *J_ptr = J + (size_t)mi * 12;
-        dReal sum = REAL(0.0);
         const dReal *in_ptr = in + (size_t)(unsigned)b1*6;
-        for (unsigned int j = 0; j < 6; ++j) sum += J_ptr[j] * in_ptr[j];
+        dReal sum = dxQuickStepDot6 (J_ptr, in_ptr);
         if (b2 != -1) {
             in_ptr = in + (size_t)(unsigned)b2*6;
-            for (unsigned int j=0; j<6; j++) sum += J_ptr[6 + j] * in_ptr[j];
+            sum += dxQuickStepDot6 (J_ptr + 6, in_ptr);
         }
         out[mi] += sum;
     }
@@ -352,13 +445,12 @@ static void _multiply_J (unsigned int m, const dReal* J, int *jb,
     for (unsigned int i=0; i<m; i++) {
         int b1 = jb[(size_t)i*2];
         int b2 = jb[(size_t)i*2+1];
-        dReal sum = 0;
         const dReal* in_ptr = in + (size_t)(unsigned)b1*6;
-        for (unsigned int j=0; j<6; j++) sum += J_ptr[j] * in_ptr[j];
+        dReal sum = dxQuickStepDot6 (J_ptr, in_ptr);
         J_ptr += 6;
         if (b2 != -1) {
             in_ptr = in + (size_t)(unsigned)b2*6;
-            for (unsigned int j=0; j<6; j++) sum += J_ptr[j] * in_ptr[j];
+            sum += dxQuickStepDot6 (J_ptr, in_ptr);
         }
         J_ptr += 6;
         out[i] = sum;
@@ -368,7 +460,7 @@ static void _multiply_J (unsigned int m, const dReal* J, int *jb,
 
 // compute out = (J*inv(M)*J' + cfm)*in.
 // use z as an nb*6 temporary.
-#ifdef WARM_STARTING
+#ifdef USE_CG_LCP
 static void multiply_J_invM_JT (unsigned int m, unsigned int nb, dReal *J, dReal *iMJ, int *jb,
                                 const dReal *cfm, dReal *z, dReal *in, dReal *out)
 {
@@ -404,7 +496,7 @@ static inline void add (unsigned int n, dReal *x, const dReal *y, const dReal *z
 }
 
 static void CG_LCP (dxWorldProcessMemArena *memarena,
-                    unsigned int m, unsigned int nb, dReal *J, int *jb, dxBody * const *body,
+                    unsigned int m, unsigned int nb, dReal *J, int *jb, const dReal *invMass,
                     const dReal *invI, dReal *lambda, dReal *fc, dReal *b,
                     dReal *lo, dReal *hi, const dReal *cfm, int *findex,
                     dxQuickStepParameters *qs)
@@ -413,7 +505,7 @@ static void CG_LCP (dxWorldProcessMemArena *memarena,
 
     // precompute iMJ = inv(M)*J'
     dReal *iMJ = memarena->AllocateArray<dReal> ((size_t)m*12);
-    compute_invM_JT (m,J,iMJ,jb,body,invI);
+    compute_invM_JT (m,J,iMJ,jb,invMass,invI);
 
     dReal last_rho = 0;
     dReal *r = memarena->AllocateArray<dReal>(m);
@@ -436,14 +528,15 @@ static void CG_LCP (dxWorldProcessMemArena *memarena,
         Ad[i] = REAL(1.0) / (sum + cfm[i]);
     }
 
-#ifdef WARM_STARTING
-    // compute residual r = b - A*lambda
-    multiply_J_invM_JT (m,nb,J,iMJ,jb,cfm,fc,lambda,r);
-    for (unsigned int k=0; k<m; k++) r[k] = b[k] - r[k];
-#else
-    dSetZero (lambda,m);
-    memcpy (r,b,(size_t)m*sizeof(dReal));		// residual r = b - A*lambda
-#endif
+    if (qs->warm_starting) {
+        // compute residual r = b - A*lambda
+        multiply_J_invM_JT (m,nb,J,iMJ,jb,cfm,fc,lambda,r);
+        for (unsigned int k=0; k<m; k++) r[k] = b[k] - r[k];
+    }
+    else {
+        dSetZero (lambda,m);
+        memcpy (r,b,(size_t)m*sizeof(dReal));		// residual r = b - A*lambda
+    }
 
     for (unsigned int iteration=0; iteration < num_iterations; iteration++) {
         for (unsigned int i=0; i<m; i++) z[i] = r[i]*Ad[i];	// z = inv(M)*r
@@ -493,7 +586,8 @@ static void CG_LCP (dxWorldProcessMemArena *memarena,
 // nb is the number of bodies in the body array.
 // J is an m*12 matrix of constraint rows
 // jb is an array of first and second body numbers for each constraint row
-// invI is the global frame inverse inertia for each body (stacked 3x3 matrices)
+// invMass is the inverse mass and invI the global frame inverse inertia
+// for each body (stacked 3x3 matrices)
 //
 // this returns lambda and fc (the constraint force).
 // note: fc is returned as inv(M)*J'*lambda, the constraint force is actually J'*lambda
@@ -524,72 +618,481 @@ static int compare_index_error (const void *a, const void *b)
 
 #endif
 
-static void SOR_LCP (dxWorldProcessMemArena *memarena,
-                     const unsigned int m, const unsigned int nb, dReal *J, int *jb, dxBody * const *body,
-                     const dReal *invI, dReal *lambda, dReal *fc, dReal *b,
-                     const dReal *lo, const dReal *hi, const dReal *cfm, const int *findex,
-                     const dxQuickStepParameters *qs)
+// initialize lambda and fc for the SOR iterations. with warm starting
+// lambda has been loaded from the joints, and the layout adds its share of
+// fc=(inv(M)*J')*lambda as it computes iMJ (see SOR_LCP_LayoutRows). fc is
+// then maintained incrementally as lambda changes.
+
+static void SOR_LCP_Prepare (const unsigned int m, const unsigned int nb, dReal *lambda, dReal *fc,
+                             const dxQuickStepParameters *qs)
 {
-#ifdef WARM_STARTING
-    {
-        // for warm starting, this seems to be necessary to prevent
-        // jerkiness in motor-driven joints. i have no idea why this works.
-        for (unsigned int i=0; i<m; i++) lambda[i] *= 0.9;
+    if (qs->warm_starting == 0) {
+        dSetZero (lambda,m);
     }
-#else
-    dSetZero (lambda,m);
-#endif
+    dSetZero (fc,(size_t)nb*6);
+}
 
-    // precompute iMJ = inv(M)*J'
-    dReal *iMJ = memarena->AllocateArray<dReal>((size_t)m*12);
-    compute_invM_JT (m,J,iMJ,jb,body,invI);
+//***************************************************************************
+// SOR-LCP row layout
+//
+// the rows are copied into separate contiguous arrays for J, iMJ, b, Ad, 
+// lo, hi, lambda etc. in the order in which they are solved, so that the
+// iterations walk all of them linearly. the order is given as a sequence
+// of segments (the head and the tail of the serial solver's order or the
+// batches of the parallel one). within a segment the rows are grouped by
+// kind and each group is solved by a loop specialized for that kind, 
+// without tests for the second body and for the friction dependency.
+// the rows of one body (i.e. attached to the world) only keep the first
+// halves of their J and iMJ rows.
+// iMJ and the scaled J only exist in the layout, where they are computed
+// once. when the serial solver reorders the rows, the laid out rows are
+// moved to their new positions (see SOR_LCP_ReorderRows). a row keeps its
+// segment and its kind, so it moves within its group.
+// the normal rows kinds go before the friction ones, so that a friction row
+// still follows its normal row if both are in the same segment.
+
+enum
+{
+    dxSOR_ROW_TWO_BODIES = 0x01,
+    dxSOR_ROW_FRICTION = 0x02,
 
-    // compute fc=(inv(M)*J')*lambda. we will incrementally maintain fc
-    // as we change lambda.
-#ifdef WARM_STARTING
-    multiply_invM_JT (m,nb,iMJ,jb,lambda,fc);
-#else
-    dSetZero (fc,(size_t)nb*6);
-#endif
+    dxSOR_ROW_KIND__MAX = 0x04
+};
 
-    dReal *Ad = memarena->AllocateArray<dReal>(m);
+static inline unsigned int SOR_LCP_RowKind (const int *jb, const int *findex, unsigned int i)
+{
+    return (jb[(size_t)i*2+1] != -1 ? dxSOR_ROW_TWO_BODIES : 0) | (findex[i] != -1 ? dxSOR_ROW_FRICTION : 0);
+}
 
-    {
-        const dReal sor_w = qs->w;		// SOR over-relaxation parameter
-        // precompute 1 / diagonals of A
-        const dReal *iMJ_ptr = iMJ;
-        const dReal *J_ptr = J;
-        for (unsigned int i=0; i<m; J_ptr += 12, iMJ_ptr += 12, i++) {
-            dReal sum = 0;
-            for (unsigned int j=0; j<6; j++) sum += iMJ_ptr[j] * J_ptr[j];
-            if (jb[(size_t)i*2+1] != -1) {
-                for (unsigned int k=6; k<12; k++) sum += iMJ_ptr[k] * J_ptr[k];
+struct dxSORRowGroup
+{
+    unsigned int m_begin;       // position of the first row of the group
+    unsigned int m_end;
+    unsigned int m_kind;
+    size_t m_jOffset;           // offset of the first row of the group in J and iMJ
+};
+
+struct dxSORRowLayout
+{
+    dReal *m_J;                 // 6 or 12 per row, depending on the row kind
+    dReal *m_iMJ;               // same as J
+    dReal *m_b;
+    dReal *m_Ad;
+    dReal *m_lo;
+    dReal *m_hi;
+    dReal *m_lambda;
+    int *m_findex;              // position of the normal row for friction rows
+    unsigned int *m_bodies;     // two body numbers per row, the second is not used for one body rows
+    unsigned int *m_rowIndex;   // the original row number of each position
+    unsigned int *m_rowPosition; // the position of each original row
+    dxSORRowGroup *m_groups;
+    unsigned int m_groupCount;
+};
+
+static void SOR_LCP_AllocateRowLayout (dxWorldProcessMemArena *memarena, unsigned int m, unsigned int maxGroupCount, 
+                                       dxSORRowLayout *layout)
+{
+    layout->m_J = memarena->AllocateArray<dReal>((size_t)m*12);
+    layout->m_iMJ = memarena->AllocateArray<dReal>((size_t)m*12);
+    layout->m_b = memarena->AllocateArray<dReal>(m);
+    layout->m_Ad = memarena->AllocateArray<dReal>(m);
+    layout->m_lo = memarena->AllocateArray<dReal>(m);
+    layout->m_hi = memarena->AllocateArray<dReal>(m);
+    layout->m_lambda = memarena->AllocateArray<dReal>(m);
+    layout->m_findex = memarena->AllocateArray<int>(m);
+    layout->m_bodies = memarena->AllocateArray<unsigned int>((size_t)m*2);
+    layout->m_rowIndex = memarena->AllocateArray<unsigned int>(m);
+    layout->m_rowPosition = memarena->AllocateArray<unsigned int>(m);
+    layout->m_groups = memarena->AllocateArray<dxSORRowGroup>(maxGroupCount);
+    layout->m_groupCount = 0;
+}
+
+static size_t EstimateSOR_LCPRowLayoutMemoryRequirements(unsigned int m, unsigned int maxGroupCount)
+{
+    size_t res = 2 * dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for J, iMJ
+    res += 5 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for b, Ad, lo, hi, lambda
+    res += dEFFICIENT_SIZE(sizeof(int) * (size_t)m); // for findex
+    res += dEFFICIENT_SIZE(sizeof(unsigned int) * 2 * (size_t)m); // for bodies
+    res += 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)m); // for rowIndex, rowPosition
+    res += dEFFICIENT_SIZE(sizeof(dxSORRowGroup) * (size_t)maxGroupCount); // for groups
+    return res;
+}
+
+// translate the friction dependencies to the positions of the rows
+
+static void SOR_LCP_TranslateFindex (dxSORRowLayout *layout, unsigned int m, const int *findex)
+{
+    const unsigned int *rowIndex = layout->m_rowIndex;
+    const unsigned int *rowPosition = layout->m_rowPosition;
+    for (unsigned int pos = 0; pos != m; ++pos) {
+        int findex_i = findex[rowIndex[pos]];
+        layout->m_findex[pos] = findex_i != -1 ? (int)rowPosition[findex_i] : -1;
+    }
+}
+
+// copy the rows into the layout in the order given by rows[], computing
+// iMJ and the diagonal of A on the way. Ad (the SOR over-relaxation
+// parameter over the diagonal) scales J and b in the layout, which moves
+// the multiplication out of the iterations, and is scaled by cfm itself.
+// if fc is not NULL, inv(M)*J'*lambda of the rows is added to it.
+// segmentStart has segmentCount + 1 elements. segmentGroups receives the index of 
+// the first group of each segment (segmentCount + 1 elements as well).
+// the layout must have room for at least segmentCount * dxSOR_ROW_KIND__MAX groups.
+
+static void SOR_LCP_LayoutRows (dxSORRowLayout *layout, 
+                                const unsigned int *rows, const unsigned int *segmentStart, unsigned int segmentCount, 
+                                unsigned int *segmentGroups,
+                                const dReal *J, const int *jb, const dReal *invMass, const dReal *invI,
+                                const dReal *b, const dReal *cfm, const dReal sor_w,
+                                const dReal *lo, const dReal *hi, const int *findex, const dReal *lambda, dReal *fc)
+{
+    dxSORRowGroup *groups = layout->m_groups;
+    unsigned int groupCount = 0;
+    unsigned int position = 0;
+    size_t jOffset = 0;
+
+    for (unsigned int segment = 0; segment != segmentCount; ++segment) {
+        segmentGroups[segment] = groupCount;
+
+        const unsigned int *const segmentRowsBegin = rows + segmentStart[segment];
+        const unsigned int *const segmentRowsEnd = rows + segmentStart[segment + 1];
+
+        for (unsigned int kind = 0; kind != dxSOR_ROW_KIND__MAX; ++kind) {
+            const size_t jCount = (kind & dxSOR_ROW_TWO_BODIES) != 0 ? 12 : 6;
+            const unsigned int groupBegin = position;
+            const size_t groupJOffset = jOffset;
+
+            for (const unsigned int *rowsCurr = segmentRowsBegin; rowsCurr != segmentRowsEnd; ++rowsCurr) {
+                const unsigned int i = *rowsCurr;
+                if (SOR_LCP_RowKind(jb, findex, i) != kind) {
+                    continue;
+                }
+
+                const dReal *J_ptr = J + (size_t)i*12;
+                const int b1 = jb[(size_t)i*2];
+                const int b2 = jb[(size_t)i*2+1];
+                dReal *iMJ_ptr = layout->m_iMJ + jOffset;
+                compute_invM_JT_row (J_ptr, iMJ_ptr, b1, b2, invMass, invI);
+
+                dReal sum = dxQuickStepDot6 (iMJ_ptr, J_ptr);
+                if (b2 != -1) {
+                    sum += dxQuickStepDot6 (iMJ_ptr + 6, J_ptr + 6);
+                }
+                const dReal Ad_i = sor_w / (sum + cfm[i]);
+
+                dReal *layoutJ_ptr = layout->m_J + jOffset;
+                for (size_t j = 0; j != jCount; ++j) {
+                    layoutJ_ptr[j] = J_ptr[j] * Ad_i;
+                }
+
+                if (fc != NULL) {
+                    dxQuickStepAxpy6 (fc + (size_t)(unsigned)b1*6, iMJ_ptr, lambda[i]);
+                    if (b2 != -1) {
+                        dxQuickStepAxpy6 (fc + (size_t)(unsigned)b2*6, iMJ_ptr + 6, lambda[i]);
+                    }
+                }
+                jOffset += jCount;
+
+                layout->m_b[position] = b[i] * Ad_i;
+                layout->m_Ad[position] = Ad_i * cfm[i];
+                layout->m_lo[position] = lo[i];
+                layout->m_hi[position] = hi[i];
+                layout->m_lambda[position] = lambda[i];
+                layout->m_bodies[(size_t)position*2] = (unsigned int)jb[(size_t)i*2];
+                layout->m_bodies[(size_t)position*2+1] = (unsigned int)jb[(size_t)i*2+1];
+                layout->m_rowIndex[position] = i;
+                layout->m_rowPosition[i] = position;
+                ++position;
+            }
+
+            if (position != groupBegin) {
+                dxSORRowGroup &group = groups[groupCount++];
+                group.m_begin = groupBegin;
+                group.m_end = position;
+                group.m_kind = kind;
+                group.m_jOffset = groupJOffset;
             }
-            Ad[i] = sor_w / (sum + cfm[i]);
         }
     }
 
-    {
-        // NOTE: This may seem unnecessary but it's indeed an optimization 
-        // to move multiplication by Ad[i] and cfm[i] out of iteration loop.
-
-        // scale J and b by Ad
-        dReal *J_ptr = J;
-        for (unsigned int i=0; i<m; J_ptr += 12, i++) {
-            dReal Ad_i = Ad[i];
-            for (unsigned int j=0; j<12; j++) {
-                J_ptr[j] *= Ad_i;
+    segmentGroups[segmentCount] = groupCount;
+    layout->m_groupCount = groupCount;
+
+    SOR_LCP_TranslateFindex (layout,position,findex);
+}
+
+// the values of a laid out row, as saved while the rows are moved
+
+struct dxSORRowValues
+{
+    dReal J[12];
+    dReal iMJ[12];
+    dReal b, Ad, lo, hi, lambda;
+    unsigned int bodies[2];
+};
+
+static inline void SOR_LCP_SaveRow (const dxSORRowLayout *layout, const dxSORRowGroup &group, size_t jCount, 
+                                    unsigned int position, dxSORRowValues *row)
+{
+    const size_t jOffset = group.m_jOffset + (size_t)(position - group.m_begin) * jCount;
+    memcpy (row->J, layout->m_J + jOffset, jCount * sizeof(dReal));
+    memcpy (row->iMJ, layout->m_iMJ + jOffset, jCount * sizeof(dReal));
+    row->b = layout->m_b[position];
+    row->Ad = layout->m_Ad[position];
+    row->lo = layout->m_lo[position];
+    row->hi = layout->m_hi[position];
+    row->lambda = layout->m_lambda[position];
+    row->bodies[0] = layout->m_bodies[(size_t)position*2];
+    row->bodies[1] = layout->m_bodies[(size_t)position*2+1];
+}
+
+static inline void SOR_LCP_RestoreRow (dxSORRowLayout *layout, const dxSORRowGroup &group, size_t jCount, 
+                                       unsigned int position, const dxSORRowValues *row)
+{
+    const size_t jOffset = group.m_jOffset + (size_t)(position - group.m_begin) * jCount;
+    memcpy (layout->m_J + jOffset, row->J, jCount * sizeof(dReal));
+    memcpy (layout->m_iMJ + jOffset, row->iMJ, jCount * sizeof(dReal));
+    layout->m_b[position] = row->b;
+    layout->m_Ad[position] = row->Ad;
+    layout->m_lo[position] = row->lo;
+    layout->m_hi[position] = row->hi;
+    layout->m_lambda[position] = row->lambda;
+    layout->m_bodies[(size_t)position*2] = row->bodies[0];
+    layout->m_bodies[(size_t)position*2+1] = row->bodies[1];
+}
+
+static inline void SOR_LCP_MoveRow (dxSORRowLayout *layout, const dxSORRowGroup &group, size_t jCount, 
+                                    unsigned int to, unsigned int from)
+{
+    const size_t toJOffset = group.m_jOffset + (size_t)(to - group.m_begin) * jCount;
+    const size_t fromJOffset = group.m_jOffset + (size_t)(from - group.m_begin) * jCount;
+    memcpy (layout->m_J + toJOffset, layout->m_J + fromJOffset, jCount * sizeof(dReal));
+    memcpy (layout->m_iMJ + toJOffset, layout->m_iMJ + fromJOffset, jCount * sizeof(dReal));
+    layout->m_b[to] = layout->m_b[from];
+    layout->m_Ad[to] = layout->m_Ad[from];
+    layout->m_lo[to] = layout->m_lo[from];
+    layout->m_hi[to] = layout->m_hi[from];
+    layout->m_lambda[to] = layout->m_lambda[from];
+    layout->m_bodies[(size_t)to*2] = layout->m_bodies[(size_t)from*2];
+    layout->m_bodies[(size_t)to*2+1] = layout->m_bodies[(size_t)from*2+1];
+}
+
+// move the rows laid out by SOR_LCP_LayoutRows to the positions that the
+// order given by rows[] gives them, without computing them again. the rows
+// must be in the segments they were laid out in, so each row stays in its
+// group; segmentGroups is the one SOR_LCP_LayoutRows filled. the
+// permutation is applied in place one cycle at a time.
+
+static void SOR_LCP_ReorderRows (dxSORRowLayout *layout, 
+                                 const unsigned int *rows, const unsigned int *segmentStart, unsigned int segmentCount, 
+                                 const unsigned int *segmentGroups, const int *jb, const int *findex)
+{
+    unsigned int *rowIndex = layout->m_rowIndex;
+    unsigned int *rowPosition = layout->m_rowPosition;
+    const dxSORRowGroup *groups = layout->m_groups;
+
+    for (unsigned int segment = 0; segment != segmentCount; ++segment) {
+        const unsigned int *const segmentRowsBegin = rows + segmentStart[segment];
+        const unsigned int *const segmentRowsEnd = rows + segmentStart[segment + 1];
+
+        for (unsigned int g = segmentGroups[segment]; g != segmentGroups[segment + 1]; ++g) {
+            const dxSORRowGroup &group = groups[g];
+            const size_t jCount = (group.m_kind & dxSOR_ROW_TWO_BODIES) != 0 ? 12 : 6;
+
+            // the rows of the group in their new order. rowPosition still
+            // has the old positions until a row is moved
+            unsigned int position = group.m_begin;
+            for (const unsigned int *rowsCurr = segmentRowsBegin; rowsCurr != segmentRowsEnd; ++rowsCurr) {
+                const unsigned int i = *rowsCurr;
+                if (SOR_LCP_RowKind(jb, findex, i) == group.m_kind) {
+                    dIASSERT(position < group.m_end);
+                    rowIndex[position++] = i;
+                }
+            }
+            dIASSERT(position == group.m_end);
+
+            for (unsigned int start = group.m_begin; start != group.m_end; ++start) {
+                if (rowPosition[rowIndex[start]] == start) {
+                    continue;
+                }
+
+                dxSORRowValues saved;
+                SOR_LCP_SaveRow (layout,group,jCount,start,&saved);
+                for (unsigned int to = start; ; ) {
+                    const unsigned int i = rowIndex[to];
+                    const unsigned int from = rowPosition[i];
+                    dIASSERT(from >= group.m_begin && from < group.m_end);
+                    rowPosition[i] = to;
+                    if (from == start) {
+                        SOR_LCP_RestoreRow (layout,group,jCount,to,&saved);
+                        break;
+                    }
+                    SOR_LCP_MoveRow (layout,group,jCount,to,from);
+                    to = from;
+                }
             }
-            b[i] *= Ad_i;
-            // scale Ad by CFM. N.B. this should be done last since it is used above
-            Ad[i] = Ad_i * cfm[i];
         }
     }
 
+    SOR_LCP_TranslateFindex (layout,segmentStart[segmentCount],findex);
+}
+
+// copy the lambda values of the layout back into the original row order
+
+static void SOR_LCP_StoreRowLambdas (const dxSORRowLayout *layout, unsigned int m, dReal *lambda)
+{
+    const dReal *layoutLambda = layout->m_lambda;
+    const unsigned int *rowIndex = layout->m_rowIndex;
+    for (unsigned int pos = 0; pos != m; ++pos) {
+        lambda[rowIndex[pos]] = layoutLambda[pos];
+    }
+}
+
+// solve the rows [begin, end) of a group of the given kind, updating lambda and fc.
+// J and b are expected to be scaled by SOR_LCP_Prepare.
+// returns the largest absolute change of lambda.
+
+template<unsigned int kind>
+static dReal SOR_LCP_SolveGroupRows (const dxSORRowLayout *layout, const dxSORRowGroup &group, 
+                                     unsigned int begin, unsigned int end, dReal *fc)
+{
+    const bool twoBodies = (kind & dxSOR_ROW_TWO_BODIES) != 0;
+    const bool friction = (kind & dxSOR_ROW_FRICTION) != 0;
+    const size_t jCount = twoBodies ? 12 : 6;
+
+    const size_t jOffset = group.m_jOffset + (size_t)(begin - group.m_begin) * jCount;
+    const dReal *J_ptr = layout->m_J + jOffset;
+    const dReal *iMJ_ptr = layout->m_iMJ + jOffset;
+    const unsigned int *bodies_ptr = layout->m_bodies + (size_t)begin*2;
+    const dReal *b = layout->m_b;
+    const dReal *Ad = layout->m_Ad;
+    const dReal *lo = layout->m_lo;
+    const dReal *hi = layout->m_hi;
+    const int *findex = layout->m_findex;
+    dReal *lambda = layout->m_lambda;
+
+    dReal residual = 0;
+
+    for (unsigned int i = begin; i != end; J_ptr += jCount, iMJ_ptr += jCount, bodies_ptr += 2, ++i) {
+        dReal *fc_ptr1 = fc + 6*(size_t)bodies_ptr[0];
+        dReal *fc_ptr2 = twoBodies ? fc + 6*(size_t)bodies_ptr[1] : NULL;
+
+        dReal old_lambda = lambda[i];
+
+        dReal delta = b[i] - old_lambda*Ad[i];
+        delta -= dxQuickStepDot6 (fc_ptr1, J_ptr);
+        if (twoBodies) {
+            delta -= dxQuickStepDot6 (fc_ptr2, J_ptr + 6);
+        }
+
+        // set the limits for this constraint. 
+        // this is the place where the QuickStep method differs from the
+        // direct LCP solving method, since that method only performs this
+        // limit adjustment once per time step, whereas this method performs
+        // once per iteration per constraint row.
+        // the constraints are ordered so that all lambda[] values needed have
+        // already been computed.
+        dReal hi_act, lo_act;
+        if (friction) {
+            hi_act = dFabs (hi[i] * lambda[findex[i]]);
+            lo_act = -hi_act;
+        } else {
+            hi_act = hi[i];
+            lo_act = lo[i];
+        }
+
+        // compute lambda and clamp it to [lo,hi].
+        dReal new_lambda = old_lambda + delta;
+        if (new_lambda < lo_act) {
+            delta = lo_act-old_lambda;
+            lambda[i] = lo_act;
+        }
+        else if (new_lambda > hi_act) {
+            delta = hi_act-old_lambda;
+            lambda[i] = hi_act;
+        }
+        else {
+            lambda[i] = new_lambda;
+        }
+
+        // update fc.
+        dxQuickStepAxpy6 (fc_ptr1, iMJ_ptr, delta);
+        if (twoBodies) {
+            dxQuickStepAxpy6 (fc_ptr2, iMJ_ptr + 6, delta);
+        }
+
+        dReal abs_delta = dFabs (delta);
+        if (abs_delta > residual) residual = abs_delta;
+    }
+
+    return residual;
+}
+
+// solve the rows at positions [begin, end) which must lie within groups [groupBegin, groupEnd).
+// returns the largest absolute change of lambda.
+
+static dReal SOR_LCP_SolveRows (const dxSORRowLayout *layout, unsigned int groupBegin, unsigned int groupEnd,
+                                unsigned int begin, unsigned int end, dReal *fc)
+{
+    dReal residual = 0;
+
+    for (unsigned int g = groupBegin; g != groupEnd; ++g) {
+        const dxSORRowGroup &group = layout->m_groups[g];
+        const unsigned int rangeBegin = dMAX(begin, group.m_begin);
+        const unsigned int rangeEnd = dMIN(end, group.m_end);
+        if (rangeBegin >= rangeEnd) {
+            continue;
+        }
+
+        dReal groupResidual;
+        switch (group.m_kind) {
+            case 0: 
+                groupResidual = SOR_LCP_SolveGroupRows<0>(layout, group, rangeBegin, rangeEnd, fc); 
+                break;
+            case dxSOR_ROW_TWO_BODIES: 
+                groupResidual = SOR_LCP_SolveGroupRows<dxSOR_ROW_TWO_BODIES>(layout, group, rangeBegin, rangeEnd, fc); 
+                break;
+            case dxSOR_ROW_FRICTION: 
+                groupResidual = SOR_LCP_SolveGroupRows<dxSOR_ROW_FRICTION>(layout, group, rangeBegin, rangeEnd, fc); 
+                break;
+            default: 
+                dIASSERT(group.m_kind == (dxSOR_ROW_TWO_BODIES | dxSOR_ROW_FRICTION));
+                groupResidual = SOR_LCP_SolveGroupRows<dxSOR_ROW_TWO_BODIES | dxSOR_ROW_FRICTION>(layout, group, rangeBegin, rangeEnd, fc); 
+                break;
+        }
+
+        if (groupResidual > residual) residual = groupResidual;
+    }
+
+    return residual;
+}
+
+enum
+{
+    dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT = 2,   // the rows with findex == -1 and the rest
+    dxQUICKSTEP_SOR_SERIAL_MAX_GROUPS = dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT * dxSOR_ROW_KIND__MAX
+};
+
+// returns the number of iterations performed. the iterations stop early
+// if no lambda changes by more than qs->tolerance during an iteration.
+// the largest lambda change of the last iteration is stored in out_residual.
+
+static unsigned int SOR_LCP (dxWorldProcessMemArena *memarena,
+                             const unsigned int m, const unsigned int nb, dReal *J, int *jb, const dReal *invMass,
+                             const dReal *invI, dReal *lambda, dReal *fc, dReal *b,
+                             const dReal *lo, const dReal *hi, const dReal *cfm, const int *findex,
+                             const dxQuickStepParameters *qs, dReal *out_residual)
+{
+    SOR_LCP_Prepare (m,nb,lambda,fc,qs);
+
+    dxSORRowLayout layout;
+    SOR_LCP_AllocateRowLayout (memarena,m,dxQUICKSTEP_SOR_SERIAL_MAX_GROUPS,&layout);
 
     // order to solve constraint rows in
     IndexError *order = memarena->AllocateArray<IndexError>(m);
+    unsigned int *rows = memarena->AllocateArray<unsigned int>(m);
     unsigned int head_size;
+    unsigned int segmentGroups[dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT + 1];
 
 #ifndef REORDER_CONSTRAINTS
     {
@@ -618,9 +1121,26 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
 #endif
 
     const unsigned int num_iterations = qs->num_iterations;
-    for (unsigned int iteration=0; iteration < num_iterations; iteration++) {
-
+    const dReal tolerance = qs->tolerance;
+    dReal residual = 0;
+    unsigned int iteration = 0;
+    // the first pass lays the rows out even if there are no iterations, as
+    // fc and the returned lambda come from the layout
+    while (iteration < num_iterations || iteration == 0) {
+
+#if defined(REORDER_CONSTRAINTS)
+        const bool relayout = true;
+#elif defined(RANDOMLY_REORDER_CONSTRAINTS)
+        const bool relayout = (iteration & 7) == 0;
+#else
+        const bool relayout = iteration == 0;
+#endif
 #ifdef REORDER_CONSTRAINTS
+        if (iteration != 0) {
+            // the errors are measured in the original row order
+            SOR_LCP_StoreRowLambdas (&layout,m,lambda);
+        }
+
         // constraints with findex == -1 always come first.
         if (iteration < 2) {
             // for the first two iterations, solve the constraints in
@@ -638,6 +1158,7 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
         else {
             // sort the constraints so that the ones converging slowest
             // get solved last. use the absolute (not relative) error.
+            head_size = 0;
             for (unsigned int i=0; i<m; i++) {
                 dReal v1 = dFabs (lambda[i]);
                 dReal v2 = dFabs (last_lambda[i]);
@@ -680,106 +1201,148 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
         }
 #endif
 
-        for (unsigned int i=0; i<m; i++) {
-            // @@@ potential optimization: we could pre-sort J and iMJ, thereby
-            //     linearizing access to those arrays. hmmm, this does not seem
-            //     like a win, but we should think carefully about our memory
-            //     access pattern.
+        if (relayout) {
+            // lay the rows out in the new order, or move the laid out rows
+            // to it. the head and the tail keep their rows
+            for (unsigned int i=0; i<m; i++) {
+                rows[i] = order[i].index;
+            }
+            const unsigned int segmentStart[dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT + 1] = { 0, head_size, m };
+            if (iteration == 0) {
+                SOR_LCP_LayoutRows (&layout,rows,segmentStart,dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT,segmentGroups,
+                    J,jb,invMass,invI,b,cfm,qs->w,lo,hi,findex,lambda,qs->warm_starting ? fc : NULL);
+            }
+            else {
+                SOR_LCP_ReorderRows (&layout,rows,segmentStart,dxQUICKSTEP_SOR_SERIAL_SEGMENT_COUNT,segmentGroups,jb,findex);
+            }
+        }
 
-            unsigned int index = order[i].index;
+        if (num_iterations == 0) {
+            break;
+        }
 
-            dReal *fc_ptr1;
-            dReal *fc_ptr2;
-            dReal delta;
+        residual = SOR_LCP_SolveRows (&layout,0,layout.m_groupCount,0,m,fc);
 
-            {
-                int b1 = jb[(size_t)index*2];
-                int b2 = jb[(size_t)index*2+1];
-                fc_ptr1 = fc + 6*(size_t)(unsigned)b1;
-                fc_ptr2 = (b2 != -1) ? fc + 6*(size_t)(unsigned)b2 : NULL;
-            }
+        iteration++;
 
-            dReal old_lambda = lambda[index];
+        if (residual < tolerance) {
+            break;
+        }
+    }
 
-            {
-                delta = b[index] - old_lambda*Ad[index];
-
-                const dReal *J_ptr = J + (size_t)index*12;
-                // @@@ potential optimization: SIMD-ize this and the b2 >= 0 case
-                delta -=fc_ptr1[0] * J_ptr[0] + fc_ptr1[1] * J_ptr[1] +
-                    fc_ptr1[2] * J_ptr[2] + fc_ptr1[3] * J_ptr[3] +
-                    fc_ptr1[4] * J_ptr[4] + fc_ptr1[5] * J_ptr[5];
-                // @@@ potential optimization: handle 1-body constraints in a separate
-                //     loop to avoid the cost of test & jump?
-                if (fc_ptr2) {
-                    delta -=fc_ptr2[0] * J_ptr[6] + fc_ptr2[1] * J_ptr[7] +
-                        fc_ptr2[2] * J_ptr[8] + fc_ptr2[3] * J_ptr[9] +
-                        fc_ptr2[4] * J_ptr[10] + fc_ptr2[5] * J_ptr[11];
-                }
-            }
+    SOR_LCP_StoreRowLambdas (&layout,m,lambda);
 
-            {
-                dReal hi_act, lo_act;
-
-                // set the limits for this constraint. 
-                // this is the place where the QuickStep method differs from the
-                // direct LCP solving method, since that method only performs this
-                // limit adjustment once per time step, whereas this method performs
-                // once per iteration per constraint row.
-                // the constraints are ordered so that all lambda[] values needed have
-                // already been computed.
-                if (findex[index] != -1) {
-                    hi_act = dFabs (hi[index] * lambda[findex[index]]);
-                    lo_act = -hi_act;
-                } else {
-                    hi_act = hi[index];
-                    lo_act = lo[index];
-                }
+    *out_residual = residual;
+    return iteration;
+}
 
-                // compute lambda and clamp it to [lo,hi].
-                // @@@ potential optimization: does SSE have clamping instructions
-                //     to save test+jump penalties here?
-                dReal new_lambda = old_lambda + delta;
-                if (new_lambda < lo_act) {
-                    delta = lo_act-old_lambda;
-                    lambda[index] = lo_act;
-                }
-                else if (new_lambda > hi_act) {
-                    delta = hi_act-old_lambda;
-                    lambda[index] = hi_act;
+//***************************************************************************
+// parallel SOR-LCP method
+//
+// the rows are partitioned into batches so that no two rows of a batch 
+// share a body (a greedy coloring of the row/body graph). rows of a batch
+// can then be solved concurrently since each of them reads and writes
+// only fc entries of its own bodies. the batches are processed in sequence.
+// a friction row always gets a later batch than its normal row so that
+// the lambda[findex] value it reads is the current one and is not written
+// concurrently.
+// rows that do not fit into dxQUICKSTEP_SOR_MAX_BATCHES batches go into 
+// an extra batch that is solved serially at the end of each iteration.
+
+enum
+{
+    dxQUICKSTEP_SOR_MAX_BATCHES = 32,       // must not exceed bit count of unsigned
+    dxQUICKSTEP_SOR_SERIAL_BATCH = dxQUICKSTEP_SOR_MAX_BATCHES,
+    dxQUICKSTEP_SOR_BATCH_COUNT = dxQUICKSTEP_SOR_MAX_BATCHES + 1,
+
+    dxQUICKSTEP_SOR_BLOCK_SIZE = 32,        // rows picked by a thread at a time
+    dxQUICKSTEP_SOR_PARALLEL_MIN_ROWS = 4 * dxQUICKSTEP_SOR_BLOCK_SIZE // smaller islands are solved serially
+};
+
+static inline unsigned int SOR_LCP_MaxBlockCount (unsigned int m)
+{
+    return (m + (dxQUICKSTEP_SOR_BLOCK_SIZE - 1)) / dxQUICKSTEP_SOR_BLOCK_SIZE;
+}
+
+// returns index of the last batch that contains rows plus one.
+// batchStart must have room for dxQUICKSTEP_SOR_BATCH_COUNT + 1 elements.
+
+static unsigned int SOR_LCP_BuildBatches (dxWorldProcessMemArena *memarena,
+                                          const unsigned int m, const unsigned int nb, const int *jb, const int *findex,
+                                          unsigned int *batchRows, unsigned int *batchStart)
+{
+    unsigned int batchCount = 0;
+
+    BEGIN_STATE_SAVE(memarena, batchstate) {
+        unsigned int *bodyBatchMasks = memarena->AllocateArray<unsigned int>(nb);
+        memset(bodyBatchMasks, 0, (size_t)nb * sizeof(unsigned int));
+        unsigned char *rowBatches = memarena->AllocateArray<unsigned char>(m);
+
+        memset(batchStart, 0, (dxQUICKSTEP_SOR_BATCH_COUNT + 1) * sizeof(unsigned int));
+
+        // normal rows (findex == -1) are colored first so that their friction
+        // rows could be placed after them
+        for (unsigned int pass = 0; pass != 2; ++pass) {
+            for (unsigned int i = 0; i != m; ++i) {
+                int findex_i = findex[i];
+                if ((findex_i == -1) != (pass == 0)) {
+                    continue;
                 }
-                else {
-                    lambda[index] = new_lambda;
+
+                int b1 = jb[(size_t)i*2];
+                int b2 = jb[(size_t)i*2+1];
+                unsigned int usedMask = bodyBatchMasks[b1] | (b2 != -1 ? bodyBatchMasks[b2] : 0);
+
+                unsigned int minBatch = findex_i != -1 ? (unsigned int)rowBatches[findex_i] + 1 : 0;
+                if (minBatch != 0) {
+                    usedMask |= minBatch < dxQUICKSTEP_SOR_MAX_BATCHES ? (1U << minBatch) - 1 : ~0U;
                 }
-            }
 
-            //@@@ a trick that may or may not help
-            //dReal ramp = (1-((dReal)(iteration+1)/(dReal)num_iterations));
-            //delta *= ramp;
+                unsigned int batch = 0;
+                for (; batch != dxQUICKSTEP_SOR_MAX_BATCHES && (usedMask & (1U << batch)) != 0; ++batch) {}
 
-            {
-                const dReal *iMJ_ptr = iMJ + (size_t)index*12;
-                // update fc.
-                // @@@ potential optimization: SIMD for this and the b2 >= 0 case
-                fc_ptr1[0] += delta * iMJ_ptr[0];
-                fc_ptr1[1] += delta * iMJ_ptr[1];
-                fc_ptr1[2] += delta * iMJ_ptr[2];
-                fc_ptr1[3] += delta * iMJ_ptr[3];
-                fc_ptr1[4] += delta * iMJ_ptr[4];
-                fc_ptr1[5] += delta * iMJ_ptr[5];
-                // @@@ potential optimization: handle 1-body constraints in a separate
-                //     loop to avoid the cost of test & jump?
-                if (fc_ptr2) {
-                    fc_ptr2[0] += delta * iMJ_ptr[6];
-                    fc_ptr2[1] += delta * iMJ_ptr[7];
-                    fc_ptr2[2] += delta * iMJ_ptr[8];
-                    fc_ptr2[3] += delta * iMJ_ptr[9];
-                    fc_ptr2[4] += delta * iMJ_ptr[10];
-                    fc_ptr2[5] += delta * iMJ_ptr[11];
+                if (batch != dxQUICKSTEP_SOR_MAX_BATCHES) {
+                    bodyBatchMasks[b1] |= 1U << batch;
+                    if (b2 != -1) {
+                        bodyBatchMasks[b2] |= 1U << batch;
+                    }
                 }
+
+                rowBatches[i] = (unsigned char)batch;
+                batchStart[batch + 1] += 1;
+            }
+        }
+
+        // convert counts into batch start offsets and distribute the rows
+        for (unsigned int batch = 0; batch != dxQUICKSTEP_SOR_BATCH_COUNT; ++batch) {
+            if (batchStart[batch + 1] != 0) {
+                batchCount = batch + 1;
             }
+            batchStart[batch + 1] += batchStart[batch];
         }
+
+        unsigned int *batchCurrent = memarena->AllocateArray<unsigned int>(dxQUICKSTEP_SOR_BATCH_COUNT);
+        memcpy(batchCurrent, batchStart, dxQUICKSTEP_SOR_BATCH_COUNT * sizeof(unsigned int));
+
+        for (unsigned int i = 0; i != m; ++i) {
+            batchRows[batchCurrent[rowBatches[i]]++] = i;
+        }
+    } END_STATE_SAVE(memarena, batchstate);
+
+    return batchCount;
+}
+
+static size_t EstimateSOR_LCPBatchesMemoryRequirements(unsigned int m, unsigned int nb)
+{
+    size_t res = dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)m); // for batchRows
+    res += dEFFICIENT_SIZE(sizeof(unsigned int) * (dxQUICKSTEP_SOR_BATCH_COUNT + 1)); // for batchStart
+    {
+        size_t sub1_res1 = dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)nb); // for bodyBatchMasks
+        sub1_res1 += dEFFICIENT_SIZE(sizeof(unsigned char) * (size_t)m); // for rowBatches
+        sub1_res1 += dEFFICIENT_SIZE(sizeof(unsigned int) * dxQUICKSTEP_SOR_BATCH_COUNT); // for batchCurrent
+        res += sub1_res1;
     }
+    return res;
 }
 
 /*extern */
@@ -792,7 +1355,10 @@ void dxQuickStepIsland(const dxStepperProcessingCallContext *callContext)
     unsigned int nb = callContext->m_islandBodiesCount;
     unsigned int _nj = callContext->m_islandJointsCount;
 
-    dReal *invI = memarena->AllocateArray<dReal>(3 * 4 * (size_t)nb);
+    dxQuickStepperBodyState *bodyState = (dxQuickStepperBodyState *)memarena->AllocateBlock(sizeof(dxQuickStepperBodyState));
+    bodyState->m_invI = memarena->AllocateArray<dReal>(3 * 4 * (size_t)nb);
+    bodyState->m_invMass = memarena->AllocateArray<dReal>(nb);
+    bodyState->m_vel = memarena->AllocateArray<dReal>(6 * (size_t)nb);
     dJointWithInfo1 *const jointinfos = memarena->AllocateArray<dJointWithInfo1>(_nj);
 
     const unsigned allowedThreads = callContext->m_stepperAllowedThreads;
@@ -801,10 +1367,10 @@ void dxQuickStepIsland(const dxStepperProcessingCallContext *callContext)
     void *stagesMemArenaState = memarena->SaveState();
 
     dxQuickStepperStage1CallContext *stage1CallContext = (dxQuickStepperStage1CallContext *)memarena->AllocateBlock(sizeof(dxQuickStepperStage1CallContext));
-    stage1CallContext->Initialize(callContext, stagesMemArenaState, invI, jointinfos);
+    stage1CallContext->Initialize(callContext, stagesMemArenaState, bodyState, jointinfos);
 
     dxQuickStepperStage0BodiesCallContext *stage0BodiesCallContext = (dxQuickStepperStage0BodiesCallContext *)memarena->AllocateBlock(sizeof(dxQuickStepperStage0BodiesCallContext));
-    stage0BodiesCallContext->Initialize(callContext, invI);
+    stage0BodiesCallContext->Initialize(callContext, bodyState);
 
     dxQuickStepperStage0JointsCallContext *stage0JointsCallContext = (dxQuickStepperStage0JointsCallContext *)memarena->AllocateBlock(sizeof(dxQuickStepperStage0JointsCallContext));
     stage0JointsCallContext->Initialize(callContext, jointinfos, &stage1CallContext->m_stage0Outputs);
@@ -844,61 +1410,39 @@ void dxQuickStepIsland_Stage0_Bodies(dxQuickStepperStage0BodiesCallContext *call
 {
     dxBody * const *body = callContext->m_stepperCallContext->m_islandBodiesStart;
     unsigned int nb = callContext->m_stepperCallContext->m_islandBodiesCount;
-
-    if (ThrsafeExchange(&callContext->m_tagsTaken, 1) == 0)
-    {
-        // number all bodies in the body list - set their tag values
-        for (unsigned int i=0; i<nb; i++) body[i]->tag = i;
-    }
-
-    if (ThrsafeExchange(&callContext->m_gravityTaken, 1) == 0)
+    dxWorld *world = callContext->m_stepperCallContext->m_world;
+    dxQuickStepperBodyState *bodyState = callContext->m_bodyState;
+    dxStepStageTimer stageTimer(world, dxSTEP_STAGE0_BODIES);
+
+    // number all bodies in the body list, add the gravity force to them, 
+    // compute the inertia tensor and its inverse in the global frame, and
+    // compute the rotational force and add it to the torque accumulator.
+    // the body state used by the following stages is gathered at the same
+    // time, so every body is visited only once here. invI is a vertical
+    // stack of 3x4 matrices, one per body.
     {
-        dxWorld *world = callContext->m_stepperCallContext->m_world;
-
-        // add the gravity force to all bodies
-        // since gravity does normally have only one component it's more efficient
-        // to run three loops for each individual component
-        dxBody *const *const bodyend = body + nb;
-        dReal gravity_x = world->gravity[0];
-        if (gravity_x) {
-            for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
-                dxBody *b = *bodycurr;
-                if ((b->flags & dxBodyNoGravity) == 0) {
-                    b->facc[0] += b->mass.mass * gravity_x;
-                }
-            }
-        }
-        dReal gravity_y = world->gravity[1];
-        if (gravity_y) {
-            for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
-                dxBody *b = *bodycurr;
-                if ((b->flags & dxBodyNoGravity) == 0) {
-                    b->facc[1] += b->mass.mass * gravity_y;
-                }
-            }
-        }
-        dReal gravity_z = world->gravity[2];
-        if (gravity_z) {
-            for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
-                dxBody *b = *bodycurr;
-                if ((b->flags & dxBodyNoGravity) == 0) {
-                    b->facc[2] += b->mass.mass * gravity_z;
-                }
+        const dReal gravity_x = world->gravity[0], gravity_y = world->gravity[1], gravity_z = world->gravity[2];
+        unsigned int i;
+
+        while ((i = ThrsafeIncrementIntUpToLimit(&callContext->m_bodyIndex, nb)) != nb) {
+            dxBody *b = body[i];
+            b->tag = i;
+
+            if ((b->flags & dxBodyNoGravity) == 0) {
+                // gravity does normally have only one component
+                if (gravity_x) b->facc[0] += b->mass.mass * gravity_x;
+                if (gravity_y) b->facc[1] += b->mass.mass * gravity_y;
+                if (gravity_z) b->facc[2] += b->mass.mass * gravity_z;
             }
-        }
-    }
 
-    // for all bodies, compute the inertia tensor and its inverse in the global
-    // frame, and compute the rotational force and add it to the torque
-    // accumulator. I and invI are a vertical stack of 3x4 matrices, one per body.
-    {
-        dReal *invIrow = callContext->m_invI;
-        unsigned int bodyIndex = ThrsafeIncrementIntUpToLimit(&callContext->m_inertiaBodyIndex, nb);
+            bodyState->m_invMass[i] = b->invMass;
+            dReal *velcurr = bodyState->m_vel + (size_t)i * 6;
+            dCopyVector3 (velcurr, b->lvel);
+            dCopyVector3 (velcurr + 3, b->avel);
 
-        for (unsigned int i = 0; i != nb; invIrow += 12, ++i) {
-            if (i == bodyIndex) {
+            {
                 dMatrix3 tmp;
-                dxBody *b = body[i];
+                dReal *invIrow = bodyState->m_invI + (size_t)i * 12;
 
                 // compute inverse inertia tensor in global frame
                 dMultiply2_333 (tmp,b->invI,b->posr.R);
@@ -972,8 +1516,6 @@ void dxQuickStepIsland_Stage0_Bodies(dxQuickStepperStage0BodiesCallContext *call
                     }
 #endif
                 }
-
-                bodyIndex = ThrsafeIncrementIntUpToLimit(&callContext->m_inertiaBodyIndex, nb);
             }
         }
     }
@@ -992,6 +1534,7 @@ void dxQuickStepIsland_Stage0_Joints(dxQuickStepperStage0JointsCallContext *call
 {
     dxJoint * const *_joint = callContext->m_stepperCallContext->m_islandJointsStart;
     unsigned int _nj = callContext->m_stepperCallContext->m_islandJointsCount;
+    dxStepStageTimer stageTimer(callContext->m_stepperCallContext->m_world, dxSTEP_STAGE0_JOINTS);
 
     // get joint information (m = total constraint dimension, nub = number of unbounded variables).
     // joints with m=0 are inactive and are removed from the joints array
@@ -1033,7 +1576,7 @@ static
 void dxQuickStepIsland_Stage1(dxQuickStepperStage1CallContext *stage1CallContext)
 {
     const dxStepperProcessingCallContext *callContext = stage1CallContext->m_stepperCallContext;
-    dReal *invI = stage1CallContext->m_invI;
+    dxQuickStepperBodyState *bodyState = stage1CallContext->m_bodyState;
     dJointWithInfo1 *jointinfos = stage1CallContext->m_jointinfos;
     unsigned int nj = stage1CallContext->m_stage0Outputs.nj;
     unsigned int m = stage1CallContext->m_stage0Outputs.m;
@@ -1044,6 +1587,8 @@ void dxQuickStepIsland_Stage1(dxQuickStepperStage1CallContext *stage1CallContext
     stage1CallContext = NULL; // WARNING! _stage1CallContext is not valid after this point!
     dIVERIFY(stage1CallContext == NULL); // To suppress unused variable assignment warnings
 
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE1);
+
     {
         unsigned int _nj = callContext->m_islandJointsCount;
         memarena->ShrinkArray<dJointWithInfo1>(jointinfos, _nj, nj);
@@ -1089,12 +1634,15 @@ void dxQuickStepIsland_Stage1(dxQuickStepperStage1CallContext *stage1CallContext
     }
 
     dxQuickStepperLocalContext *localContext = (dxQuickStepperLocalContext *)memarena->AllocateBlock(sizeof(dxQuickStepperLocalContext));
-    localContext->Initialize(invI, jointinfos, nj, m, mfb, mindex, findex, J, cfm, lo, hi, jb, rhs, Jcopy);
+    localContext->Initialize(bodyState, jointinfos, nj, m, mfb, mindex, findex, J, cfm, lo, hi, jb, rhs, Jcopy);
 
     void *stage1MemarenaState = memarena->SaveState();
     dxQuickStepperStage3CallContext *stage3CallContext = (dxQuickStepperStage3CallContext*)memarena->AllocateBlock(sizeof(dxQuickStepperStage3CallContext));
     stage3CallContext->Initialize(callContext, localContext, stage1MemarenaState);
 
+    // the following stages may be called from here and time themselves
+    stageTimer.Switch(dxSTEP__NONE);
+
     if (m > 0) {
         // create a constraint equation right hand side vector `rhs', a constraint
         // force mixing vector `cfm', and LCP low and high bound vectors, and an
@@ -1155,6 +1703,8 @@ void dxQuickStepIsland_Stage2a(dxQuickStepperStage2CallContext *stage2CallContex
     const unsigned int *mindex = localContext->m_mindex;
 
     dxWorld *world = callContext->m_world;
+    dxStepStageTimer stageTimer(world, dxSTEP_STAGE2A);
+
     const dReal stepsizeRecip = dRecip(callContext->m_stepSize);
     {
         int *findex = localContext->m_findex;
@@ -1284,6 +1834,7 @@ void dxQuickStepIsland_Stage2b(dxQuickStepperStage2CallContext *stage2CallContex
 {
     const dxStepperProcessingCallContext *callContext = stage2CallContext->m_stepperCallContext;
     const dxQuickStepperLocalContext *localContext = stage2CallContext->m_localContext;
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE2B);
 
     const dReal stepsizeRecip = dRecip(callContext->m_stepSize);
     {
@@ -1295,7 +1846,9 @@ void dxQuickStepIsland_Stage2b(dxQuickStepperStage2CallContext *stage2CallContex
         // Warning!!!
         dxBody * const *const body = callContext->m_islandBodiesStart;
         const unsigned int nb = callContext->m_islandBodiesCount;
-        const dReal *invI = localContext->m_invI;
+        const dReal *invI = localContext->m_bodyState->m_invI;
+        const dReal *invMass = localContext->m_bodyState->m_invMass;
+        const dReal *vel = localContext->m_bodyState->m_vel;
         dReal *rhs_tmp = stage2CallContext->m_rhs_tmp;
 
         // compute the right hand side `rhs'
@@ -1306,11 +1859,12 @@ void dxQuickStepIsland_Stage2b(dxQuickStepperStage2CallContext *stage2CallContex
         while ((bi = ThrsafeIncrementIntUpToLimit(&stage2CallContext->m_bi, nb)) != nb) {
             dReal *tmp1curr = rhs_tmp + (size_t)bi * 6;
             const dReal *invIrow = invI + (size_t)bi * (6 * 2);
+            const dReal *velcurr = vel + (size_t)bi * 6;
             dxBody *b = body[bi];
-            dReal body_invMass = b->invMass;
-            for (unsigned int j=0; j<3; ++j) tmp1curr[j] = -(b->facc[j] * body_invMass + b->lvel[j] * stepsizeRecip);
+            dReal body_invMass = invMass[bi];
+            for (unsigned int j=0; j<3; ++j) tmp1curr[j] = -(b->facc[j] * body_invMass + velcurr[j] * stepsizeRecip);
             dMultiply0_331 (tmp1curr + 3, invIrow, b->tacc);
-            for (unsigned int k=0; k<3; ++k) tmp1curr[3+k] = -(b->avel[k] * stepsizeRecip) - tmp1curr[3+k];
+            for (unsigned int k=0; k<3; ++k) tmp1curr[3+k] = -(velcurr[3+k] * stepsizeRecip) - tmp1curr[3+k];
         }
     }
 }
@@ -1343,6 +1897,7 @@ void dxQuickStepIsland_Stage2c(dxQuickStepperStage2CallContext *stage2CallContex
 {
     const dxStepperProcessingCallContext *callContext = stage2CallContext->m_stepperCallContext;
     const dxQuickStepperLocalContext *localContext = stage2CallContext->m_localContext;
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE2C);
 
     const dReal stepsizeRecip = dRecip(callContext->m_stepSize);
     {
@@ -1382,12 +1937,9 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
     stage3CallContext = NULL; // WARNING! stage3CallContext is not valid after this point!
     dIVERIFY(stage3CallContext == NULL); // To suppress unused variable assignment warnings
 
-    dReal *invI = localContext->m_invI;
-    dJointWithInfo1 *jointinfos = localContext->m_jointinfos;
-    unsigned int nj = localContext->m_nj;
+    const dReal *invI = localContext->m_bodyState->m_invI;
+    const dReal *invMass = localContext->m_bodyState->m_invMass;
     unsigned int m = localContext->m_m;
-    unsigned int mfb = localContext->m_mfb;
-    const unsigned int *mindex = localContext->m_mindex;
     const int *findex = localContext->m_findex;
     dReal *J = localContext->m_J;
     dReal *cfm = localContext->m_cfm;
@@ -1395,43 +1947,269 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
     dReal *hi = localContext->m_hi;
     int *jb = localContext->m_jb;
     dReal *rhs = localContext->m_rhs;
-    dReal *Jcopy = localContext->m_Jcopy;
 
     dxWorld *world = callContext->m_world;
-    dxBody * const *body = callContext->m_islandBodiesStart;
     unsigned int nb = callContext->m_islandBodiesCount;
 
-    if (m > 0) {
-        // load lambda from the value saved on the previous iteration
-        dReal *lambda = memarena->AllocateArray<dReal>(m);
+    dxStepStageTimer stageTimer(world, dxSTEP_STAGE3);
 
-#ifdef WARM_STARTING
-        {
+    dReal *lambda = NULL, *cforce = NULL;
+
+    if (m > 0) {
+        lambda = memarena->AllocateArray<dReal>(m);
+
+        if (world->qs.warm_starting) {
+            // load lambda from the value saved on the previous iteration.
+            // the contact joints have theirs from the contact cache and take
+            // it as it is, the others are damped with the warm starting factor
+            const dReal factor = world->qs.warm_starting_factor;
+            dJointWithInfo1 *jointinfos = localContext->m_jointinfos;
+            unsigned int nj = localContext->m_nj;
             dReal *lambdscurr = lambda;
             const dJointWithInfo1 *jicurr = jointinfos;
             const dJointWithInfo1 *const jiend = jicurr + nj;
             for (; jicurr != jiend; jicurr++) {
                 unsigned int infom = jicurr->info.m;
-                memcpy (lambdscurr, jicurr->joint->lambda, infom * sizeof(dReal));
+                const dReal *jointlambda = jicurr->joint->lambda;
+                if (jicurr->joint->type() == dJointTypeContact) {
+                    memcpy (lambdscurr, jointlambda, infom * sizeof(dReal));
+                }
+                else {
+                    for (unsigned int i = 0; i != infom; i++) lambdscurr[i] = jointlambda[i] * factor;
+                }
                 lambdscurr += infom;
             }
         }
-#endif
 
-        dReal *cforce = memarena->AllocateArray<dReal>((size_t)nb*6);
+        cforce = memarena->AllocateArray<dReal>((size_t)nb*6);
+    }
 
-        BEGIN_STATE_SAVE(memarena, lcpstate) {
-            IFTIMING (dTimerNow ("solving LCP problem"));
-            // solve the LCP problem and get lambda and invM*constraint_force
-            SOR_LCP (memarena,m,nb,J,jb,body,invI,lambda,cforce,rhs,lo,hi,cfm,findex,&world->qs);
+    dxQuickStepperStage4CallContext *stage4CallContext = (dxQuickStepperStage4CallContext *)memarena->AllocateBlock(sizeof(dxQuickStepperStage4CallContext));
+    stage4CallContext->Initialize(callContext, localContext, lambda, cforce);
 
-        } END_STATE_SAVE(memarena, lcpstate);
+    if (m > 0) {
+        void *lcpstate = memarena->SaveState();
+        stage4CallContext->m_lcpMemArenaState = lcpstate;
 
-#ifdef WARM_STARTING
-        {
-            // save lambda for the next iteration
-            //@@@ note that this doesn't work for contact joints yet, as they are
-            // recreated every iteration
+        const unsigned allowedThreads = callContext->m_stepperAllowedThreads;
+        dIASSERT(allowedThreads != 0);
+
+        IFTIMING (dTimerNow ("solving LCP problem"));
+        stageTimer.Switch(dxSTEP_LCP);
+
+        if (world->qs.parallel_sor && allowedThreads != 1 && m >= dxQUICKSTEP_SOR_PARALLEL_MIN_ROWS) {
+            // solve the LCP problem by batches of independent rows in multiple threads.
+            // the rest of the stage is going to be executed after the batches are processed.
+            SOR_LCP_Prepare (m,nb,lambda,cforce,&world->qs);
+
+            dxSORRowLayout *layout = (dxSORRowLayout *)memarena->AllocateBlock(sizeof(dxSORRowLayout));
+            SOR_LCP_AllocateRowLayout (memarena,m,dxQUICKSTEP_SOR_BATCH_COUNT * dxSOR_ROW_KIND__MAX,layout);
+
+            unsigned int *batchStart = memarena->AllocateArray<unsigned int>(dxQUICKSTEP_SOR_BATCH_COUNT + 1);
+            unsigned int *batchGroups = memarena->AllocateArray<unsigned int>(dxQUICKSTEP_SOR_BATCH_COUNT + 1);
+            unsigned int batchCount;
+
+            BEGIN_STATE_SAVE(memarena, batchesstate) {
+                unsigned int *batchRows = memarena->AllocateArray<unsigned int>(m);
+                batchCount = SOR_LCP_BuildBatches (memarena,m,nb,jb,findex,batchRows,batchStart);
+                // the batch rows keep their positions in the layout, only the order within each batch changes
+                SOR_LCP_LayoutRows (layout,batchRows,batchStart,batchCount,batchGroups,J,jb,invMass,invI,rhs,cfm,world->qs.w,
+                    lo,hi,findex,lambda,world->qs.warm_starting ? cforce : NULL);
+            } END_STATE_SAVE(memarena, batchesstate);
+
+            dReal *blockResiduals = memarena->AllocateArray<dReal>(SOR_LCP_MaxBlockCount(m));
+
+            dxQuickStepperLCPCallContext *lcpCallContext = (dxQuickStepperLCPCallContext *)memarena->AllocateBlock(sizeof(dxQuickStepperLCPCallContext));
+            lcpCallContext->Initialize(callContext, localContext, layout, lambda, cforce, batchStart, batchGroups, batchCount, 
+                blockResiduals, world->qs.num_iterations, world->qs.tolerance);
+
+            dCallReleaseeID stage4CallReleasee;
+            world->PostThreadedCallForUnawareReleasee(NULL, &stage4CallReleasee, 1, callContext->m_finalReleasee, 
+                NULL, &dxQuickStepIsland_Stage4_Callback, stage4CallContext, 0, "QuickStepIsland Stage4");
+
+            lcpCallContext->m_stage4Releasee = stage4CallReleasee;
+
+            world->PostThreadedCall(NULL, NULL, 0, stage4CallReleasee, 
+                NULL, &dxQuickStepIsland_Stage4LCP_Sync_Callback, lcpCallContext, 0, "QuickStepIsland Stage4LCP Sync");
+            return;
+        }
+
+        // solve the LCP problem and get lambda and invM*constraint_force
+        dReal residual;
+        unsigned int iterations = SOR_LCP (memarena,m,nb,J,jb,invMass,invI,lambda,cforce,rhs,lo,hi,cfm,findex,&world->qs,&residual);
+        dxQuickStepIsland_StoreStatistics(callContext, m, iterations, residual);
+    }
+    else {
+        dxQuickStepIsland_StoreStatistics(callContext, 0, 0, REAL(0.0));
+    }
+
+    stageTimer.Switch(dxSTEP__NONE);
+    dxQuickStepIsland_Stage4(stage4CallContext);
+}
+
+static 
+int dxQuickStepIsland_Stage4LCP_Sync_Callback(void *_lcpCallContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    dxQuickStepperLCPCallContext *lcpCallContext = (dxQuickStepperLCPCallContext *)_lcpCallContext;
+    const dxStepperProcessingCallContext *callContext = lcpCallContext->m_stepperCallContext;
+    const dxQuickStepperLocalContext *localContext = lcpCallContext->m_localContext;
+
+    const unsigned int *batchStart = lcpCallContext->m_batchStart;
+    const unsigned int batchCount = lcpCallContext->m_batchCount;
+    const unsigned int num_iterations = lcpCallContext->m_num_iterations;
+
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_LCP);
+
+    if (lcpCallContext->m_blockCount != 0) {
+        // collect the lambda changes of the batch just solved by the threads
+        const dReal *blockResiduals = lcpCallContext->m_blockResiduals;
+        dReal residual = lcpCallContext->m_residual;
+        for (unsigned int block = 0; block != lcpCallContext->m_blockCount; ++block) {
+            if (blockResiduals[block] > residual) residual = blockResiduals[block];
+        }
+        lcpCallContext->m_residual = residual;
+        lcpCallContext->m_blockCount = 0;
+    }
+
+    // process the batches in sequence, solving the small ones right here and 
+    // posting the large ones to the threads. the call is re-posted after 
+    // each threaded batch to continue with the next one.
+    while (lcpCallContext->m_iteration != num_iterations) {
+        for (; lcpCallContext->m_batch != batchCount; ++lcpCallContext->m_batch) {
+            const unsigned int batch = lcpCallContext->m_batch;
+            const unsigned int batchSize = batchStart[batch + 1] - batchStart[batch];
+
+            if (batch != dxQUICKSTEP_SOR_SERIAL_BATCH && batchSize > dxQUICKSTEP_SOR_BLOCK_SIZE) {
+                const unsigned int blockCount = (batchSize + (dxQUICKSTEP_SOR_BLOCK_SIZE - 1)) / dxQUICKSTEP_SOR_BLOCK_SIZE;
+                const unsigned allowedThreads = callContext->m_stepperAllowedThreads;
+                const unsigned batchThreads = dMIN(allowedThreads, blockCount);
+
+                lcpCallContext->m_activeBatch = batch;
+                lcpCallContext->m_blockCount = blockCount;
+                lcpCallContext->m_blockIndex = 0;
+                ++lcpCallContext->m_batch;
+
+                dxWorld *world = callContext->m_world;
+
+                dCallReleaseeID nextSyncReleasee;
+                world->PostThreadedCallForUnawareReleasee(NULL, &nextSyncReleasee, batchThreads, lcpCallContext->m_stage4Releasee, 
+                    NULL, &dxQuickStepIsland_Stage4LCP_Sync_Callback, lcpCallContext, 0, "QuickStepIsland Stage4LCP Sync");
+
+                world->PostThreadedCallsGroup(NULL, batchThreads, nextSyncReleasee, &dxQuickStepIsland_Stage4LCP_Batch_Callback, lcpCallContext, "QuickStepIsland Stage4LCP Batch");
+                return 1;
+            }
+
+            const unsigned int *batchGroups = lcpCallContext->m_batchGroups;
+            dReal batchResidual = SOR_LCP_SolveRows (lcpCallContext->m_layout, batchGroups[batch], batchGroups[batch + 1], 
+                batchStart[batch], batchStart[batch + 1], lcpCallContext->m_fc);
+            if (batchResidual > lcpCallContext->m_residual) lcpCallContext->m_residual = batchResidual;
+        }
+
+        lcpCallContext->m_batch = 0;
+        ++lcpCallContext->m_iteration;
+
+        lcpCallContext->m_lastResidual = lcpCallContext->m_residual;
+        lcpCallContext->m_residual = 0;
+
+        if (lcpCallContext->m_lastResidual < lcpCallContext->m_tolerance) {
+            break;
+        }
+    }
+
+    SOR_LCP_StoreRowLambdas (lcpCallContext->m_layout, localContext->m_m, lcpCallContext->m_lambda);
+    dxQuickStepIsland_StoreStatistics(callContext, localContext->m_m, lcpCallContext->m_iteration, lcpCallContext->m_lastResidual);
+
+    return 1;
+}
+
+static 
+int dxQuickStepIsland_Stage4LCP_Batch_Callback(void *_lcpCallContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    dxQuickStepperLCPCallContext *lcpCallContext = (dxQuickStepperLCPCallContext *)_lcpCallContext;
+    dxQuickStepIsland_Stage4LCP_Batch(lcpCallContext);
+    return 1;
+}
+
+static 
+void dxQuickStepIsland_Stage4LCP_Batch(dxQuickStepperLCPCallContext *lcpCallContext)
+{
+    const dxSORRowLayout *layout = lcpCallContext->m_layout;
+    dReal *fc = lcpCallContext->m_fc;
+
+    const unsigned int batch = lcpCallContext->m_activeBatch;
+    const unsigned int batchBegin = lcpCallContext->m_batchStart[batch];
+    const unsigned int batchEnd = lcpCallContext->m_batchStart[batch + 1];
+    const unsigned int groupBegin = lcpCallContext->m_batchGroups[batch];
+    const unsigned int groupEnd = lcpCallContext->m_batchGroups[batch + 1];
+    const unsigned int blockCount = lcpCallContext->m_blockCount;
+
+    dxStepStageTimer stageTimer(lcpCallContext->m_stepperCallContext->m_world, dxSTEP_LCP);
+
+    // rows of a batch do not share bodies and can be solved in any order
+    unsigned int blockIndex;
+    while ((blockIndex = ThrsafeIncrementIntUpToLimit(&lcpCallContext->m_blockIndex, blockCount)) != blockCount) {
+        const unsigned int blockBegin = batchBegin + blockIndex * dxQUICKSTEP_SOR_BLOCK_SIZE;
+        const unsigned int blockEnd = dMIN(blockBegin + dxQUICKSTEP_SOR_BLOCK_SIZE, batchEnd);
+
+        lcpCallContext->m_blockResiduals[blockIndex] = SOR_LCP_SolveRows (layout, groupBegin, groupEnd, blockBegin, blockEnd, fc);
+    }
+}
+
+static 
+void dxQuickStepIsland_StoreStatistics(const dxStepperProcessingCallContext *callContext, unsigned int m, unsigned int iterations, dReal residual)
+{
+    // every island has its own slot, so no synchronization is needed
+    dQuickStepIslandStatistics &stats = callContext->m_world->qs_stats[(int)callContext->m_islandOrdinal];
+    stats.bodies = callContext->m_islandBodiesCount;
+    stats.rows = m;
+    stats.iterations = iterations;
+    stats.residual = residual;
+
+    dxAddStepStatisticsRows(callContext->m_world, m);
+}
+
+static 
+int dxQuickStepIsland_Stage4_Callback(void *_stage4CallContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    dxQuickStepperStage4CallContext *stage4CallContext = (dxQuickStepperStage4CallContext *)_stage4CallContext;
+    dxQuickStepIsland_Stage4(stage4CallContext);
+    return 1;
+}
+
+static 
+void dxQuickStepIsland_Stage4(dxQuickStepperStage4CallContext *stage4CallContext)
+{
+    const dxStepperProcessingCallContext *callContext = stage4CallContext->m_stepperCallContext;
+    const dxQuickStepperLocalContext *localContext = stage4CallContext->m_localContext;
+
+    dReal *lambda = stage4CallContext->m_lambda;
+    dReal *cforce = stage4CallContext->m_cforce;
+
+    // the constraint forces and the velocity update count as stage 3
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE3);
+
+    dxWorldProcessMemArena *memarena = callContext->m_stepperArena;
+    if (stage4CallContext->m_lcpMemArenaState != NULL) {
+        memarena->RestoreState(stage4CallContext->m_lcpMemArenaState);
+    }
+
+    const dReal *invI = localContext->m_bodyState->m_invI;
+    const dReal *invMass = localContext->m_bodyState->m_invMass;
+    dReal *vel = localContext->m_bodyState->m_vel;
+    dJointWithInfo1 *jointinfos = localContext->m_jointinfos;
+    unsigned int nj = localContext->m_nj;
+    unsigned int m = localContext->m_m;
+    unsigned int mfb = localContext->m_mfb;
+    dReal *Jcopy = localContext->m_Jcopy;
+
+    dxBody * const *body = callContext->m_islandBodiesStart;
+    unsigned int nb = callContext->m_islandBodiesCount;
+
+    if (m > 0) {
+        if (callContext->m_world->qs.warm_starting) {
+            // save lambda for the next iteration. contact joints are usually
+            // recreated every iteration, so their lambda is passed on through
+            // the world contact cache when the joints are destroyed
             const dReal *lambdacurr = lambda;
             const dJointWithInfo1 *jicurr = jointinfos;
             const dJointWithInfo1 *const jiend = jicurr + nj;
@@ -1441,7 +2219,6 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
                 lambdacurr += infom;
             }
         }
-#endif
 
         // note that the SOR method overwrites rhs and J at this point, so
         // they should not be used again.
@@ -1449,14 +2226,10 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
         {
             dReal stepsize = callContext->m_stepSize;
             // add stepsize * cforce to the body velocity
+            dReal *const velend = vel + (size_t)nb * 6;
             const dReal *cforcecurr = cforce;
-            dxBody *const *const bodyend = body + nb;
-            for (dxBody *const *bodycurr = body; bodycurr != bodyend; cforcecurr+=6, bodycurr++) {
-                dxBody *b = *bodycurr;
-                for (unsigned int j=0; j<3; j++) {
-                    b->lvel[j] += stepsize * cforcecurr[j];
-                    b->avel[j] += stepsize * cforcecurr[3+j];
-                }
+            for (dReal *velcurr = vel; velcurr != velend; cforcecurr++, velcurr++) {
+                *velcurr += stepsize * *cforcecurr;
             }
         }
 
@@ -1502,38 +2275,13 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
         }
     }
 
-    {
-        IFTIMING (dTimerNow ("compute velocity update"));
-        dReal stepsize = callContext->m_stepSize;
-        // compute the velocity update:
-        // add stepsize * invM * fe to the body velocity
-        const dReal *invIrow = invI;
-        dxBody *const *const bodyend = body + nb;
-        for (dxBody *const *bodycurr = body; bodycurr != bodyend; invIrow += 12, bodycurr++) {
-            dxBody *b = *bodycurr;
-            dReal body_invMass_mul_stepsize = stepsize * b->invMass;
-            for (unsigned int j=0; j<3; j++) {
-                b->lvel[j] += body_invMass_mul_stepsize * b->facc[j];
-                b->tacc[j] *= stepsize;
-            }
-            dMultiplyAdd0_331 (b->avel, invIrow, b->tacc);
-        }
-    }
-
 #ifdef CHECK_VELOCITY_OBEYS_CONSTRAINT
     if (m > 0) {
+        const dReal *J = localContext->m_J;
+        const int *jb = localContext->m_jb;
         BEGIN_STATE_SAVE(memarena, velstate) {
-            dReal *vel = memarena->AllocateArray<dReal>((size_t)nb*6);
-
-            // check that the updated velocity obeys the constraint (this check needs unmodified J)
-            dReal *velcurr = vel;
-            dxBody *bodycurr = body, *const bodyend = body + nb;
-            for (; bodycurr != bodyend; velcurr += 6, bodycurr++) {
-                for (unsigned int j=0; j<3; j++) {
-                    velcurr[j] = bodycurr->lvel[j];
-                    velcurr[3+j] = bodycurr->avel[j];
-                }
-            }
+            // check that the velocity updated with the constraint forces obeys
+            // the constraint (this check needs unmodified J)
             dReal *tmp = memarena->AllocateArray<dReal>(m);
             _multiply_J (m,J,jb,vel,tmp);
             dReal error = 0;
@@ -1545,26 +2293,31 @@ void dxQuickStepIsland_Stage3(dxQuickStepperStage3CallContext *stage3CallContext
 #endif
 
     {
+        IFTIMING (dTimerNow ("compute velocity update"));
         dReal stepsize = callContext->m_stepSize;
-        // update the position and orientation from the new linear/angular velocity
-        // (over the given timestep)
-        IFTIMING (dTimerNow ("update position"));
+        // compute the velocity update by adding stepsize * invM * fe to the
+        // body velocity, write it back to the bodies and zero the force
+        // accumulators.
+        const dReal *invIrow = invI;
+        const dReal *velcurr = vel;
+        const dReal *invMasscurr = invMass;
         dxBody *const *const bodyend = body + nb;
-        for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
+        for (dxBody *const *bodycurr = body; bodycurr != bodyend; invIrow += 12, velcurr += 6, invMasscurr++, bodycurr++) {
             dxBody *b = *bodycurr;
-            dxStepBody (b,stepsize);
-        }
-    }
+            dReal body_invMass_mul_stepsize = stepsize * *invMasscurr;
+            for (unsigned int j=0; j<3; j++) {
+                b->lvel[j] = velcurr[j] + body_invMass_mul_stepsize * b->facc[j];
+                b->avel[j] = velcurr[3+j];
+                b->tacc[j] *= stepsize;
+            }
+            dMultiplyAdd0_331 (b->avel, invIrow, b->tacc);
 
-    {
-        IFTIMING (dTimerNow ("tidy up"));
-        // zero all force accumulators
-        dxBody *const *const bodyend = body + nb;
-        for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
-            dxBody *b = *bodycurr;
             dSetZero (b->facc,3);
             dSetZero (b->tacc,3);
         }
+
+        // the positions and orientations are updated from the new velocities
+        // by dxProcessIslands() for the bodies of all the islands together
     }
 
     IFTIMING (dTimerEnd());
@@ -1580,14 +2333,25 @@ static size_t EstimateGR_LCPMemoryRequirements(unsigned int m)
 }
 #endif
 
-static size_t EstimateSOR_LCPMemoryRequirements(unsigned int m)
+static size_t EstimateSOR_LCPMemoryRequirements(unsigned int m, unsigned int nb)
 {
-    size_t res = dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for iMJ
-    res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for Ad
-    res += dEFFICIENT_SIZE(sizeof(IndexError) * (size_t)m); // for order
+    size_t res = 0; // Ad and iMJ are only in the layout
+    {
+        size_t sub1_res1 = EstimateSOR_LCPRowLayoutMemoryRequirements(m, dxQUICKSTEP_SOR_SERIAL_MAX_GROUPS); // for layout
+        sub1_res1 += dEFFICIENT_SIZE(sizeof(IndexError) * (size_t)m); // for order
+        sub1_res1 += dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)m); // for rows
 #ifdef REORDER_CONSTRAINTS
-    res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for last_lambda
+        sub1_res1 += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for last_lambda
 #endif
+        size_t sub1_res2 = dEFFICIENT_SIZE(sizeof(dxSORRowLayout)); // for layout
+        sub1_res2 += EstimateSOR_LCPRowLayoutMemoryRequirements(m, dxQUICKSTEP_SOR_BATCH_COUNT * dxSOR_ROW_KIND__MAX); // for layout arrays
+        sub1_res2 += dEFFICIENT_SIZE(sizeof(unsigned int) * (dxQUICKSTEP_SOR_BATCH_COUNT + 1)); // for batchGroups
+        sub1_res2 += EstimateSOR_LCPBatchesMemoryRequirements(m, nb); // for parallel SOR batches
+        sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * SOR_LCP_MaxBlockCount(m)); // for blockResiduals
+        sub1_res2 += dEFFICIENT_SIZE(sizeof(dxQuickStepperLCPCallContext)); // for dxQuickStepperLCPCallContext
+
+        res += dMAX(sub1_res1, sub1_res2);
+    }
     return res;
 }
 
@@ -1619,7 +2383,10 @@ size_t dxEstimateQuickStepMemoryRequirements (
 
     size_t res = 0;
 
+    res += dEFFICIENT_SIZE(sizeof(dxQuickStepperBodyState)); // for dxQuickStepperBodyState
     res += dEFFICIENT_SIZE(sizeof(dReal) * 3 * 4 * nb); // for invI
+    res += dEFFICIENT_SIZE(sizeof(dReal) * nb); // for invMass
+    res += dEFFICIENT_SIZE(sizeof(dReal) * 6 * nb); // for vel
 
     {
         size_t sub1_res1 = dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * _nj); // for initial jointinfos
@@ -1640,14 +2407,14 @@ size_t dxEstimateQuickStepMemoryRequirements (
 
                 size_t sub2_res2 = dEFFICIENT_SIZE(sizeof(dReal) * m); // for lambda
                 sub2_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 6 * nb); // for cforce
+                sub2_res2 += dEFFICIENT_SIZE(sizeof(dxQuickStepperStage4CallContext)); // for dxQuickStepperStage4CallContext
                 {
-                    size_t sub3_res1 = EstimateSOR_LCPMemoryRequirements(m); // for SOR_LCP
+                    size_t sub3_res1 = EstimateSOR_LCPMemoryRequirements(m, nb); // for SOR_LCP
 
                     size_t sub3_res2 = 0;
 #ifdef CHECK_VELOCITY_OBEYS_CONSTRAINT
                     {
-                        size_t sub4_res1 = dEFFICIENT_SIZE(sizeof(dReal) * 6 * nb); // for vel
-                        sub4_res1 += dEFFICIENT_SIZE(sizeof(dReal) * m); // for tmp
+                        size_t sub4_res1 = dEFFICIENT_SIZE(sizeof(dReal) * m); // for tmp
 
                         size_t sub4_res2 = 0;
 
@@ -1661,7 +2428,8 @@ size_t dxEstimateQuickStepMemoryRequirements (
             }
         }
         else {
-            sub1_res2 += dEFFICIENT_SIZE(sizeof(dxQuickStepperStage3CallContext)); // for dxQuickStepperStage3CallContext
+            sub1_res2 += dMAX(dEFFICIENT_SIZE(sizeof(dxQuickStepperStage3CallContext)), // for dxQuickStepperStage3CallContext
+                dEFFICIENT_SIZE(sizeof(dxQuickStepperStage4CallContext))); // for dxQuickStepperStage4CallContext
         }
 
         size_t sub1_res12_max = dMAX(sub1_res1, sub1_res2);
@@ -1679,8 +2447,10 @@ unsigned dxEstimateQuickStepMaxCallCount(
     unsigned activeThreadCount, unsigned allowedThreadCount)
 {
     unsigned result = 1 // dxQuickStepIsland itself
-        + (2 * allowedThreadCount + 2) // (dxQuickStepIsland_Stage2a + dxQuickStepIsland_Stage2b) * allowedThreadCount + 2 * dxStepIsland_Stage2?_Sync
-        + 1; // dxStepIsland_Stage3
+        + dMAX(2 * allowedThreadCount + 2, // (dxQuickStepIsland_Stage2a + dxQuickStepIsland_Stage2b) * allowedThreadCount + 2 * dxStepIsland_Stage2?_Sync
+            allowedThreadCount + 2) // dxQuickStepIsland_Stage4LCP_Batch * allowedThreadCount + 2 * dxQuickStepIsland_Stage4LCP_Sync
+        + 1 // dxStepIsland_Stage3
+        + 1; // dxStepIsland_Stage4
     return result;
 }
 
@@ -0,0 +1,187 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+ * Six element row kernels of the QuickStep solver.
+ *
+ * A constraint row of J (and of inv(M)*J') consists of two 6 element halves,
+ * one per body, which are multiplied with (or accumulated into) the 6 element
+ * force/velocity vectors of the bodies. The kernels are implemented with SSE2
+ * when the compiler targets it, for both single and double precision. 
+ * Defining dQUICKSTEP_NO_SIMD forces the scalar versions.
+ *
+ * The dot product sums the products in a fixed order, pairing even and odd 
+ * elements, which the SIMD versions follow exactly so that both produce 
+ * bitwise identical results. The same holds for the 3x3 matrix by vector
+ * multiplication which matches dMultiply0_331().
+ */
+
+#ifndef _ODE_QUICKSTEP_KERNELS_H_
+#define _ODE_QUICKSTEP_KERNELS_H_
+
+
+#include <ode/common.h>
+#include <ode/odemath.h>
+
+
+#if !defined(dQUICKSTEP_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define dxQUICKSTEP_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+// returns a[0..5] . b[0..5], summed as ((p0 + p2) + p4) + ((p1 + p3) + p5)
+static inline dReal dxQuickStepDot6_Scalar (const dReal *a, const dReal *b)
+{
+    dReal even = a[0] * b[0];
+    dReal odd = a[1] * b[1];
+    even += a[2] * b[2];
+    odd += a[3] * b[3];
+    even += a[4] * b[4];
+    odd += a[5] * b[5];
+    return even + odd;
+}
+
+// y[0..5] += alpha * x[0..5]
+static inline void dxQuickStepAxpy6_Scalar (dReal *y, const dReal *x, dReal alpha)
+{
+    y[0] += alpha * x[0];
+    y[1] += alpha * x[1];
+    y[2] += alpha * x[2];
+    y[3] += alpha * x[3];
+    y[4] += alpha * x[4];
+    y[5] += alpha * x[5];
+}
+
+
+// res[0..2] = a * b[0..2], a being a 3x4 matrix with the 4th column unused
+static inline void dxQuickStepMultiply0_331_Scalar (dReal *res, const dReal *a, const dReal *b)
+{
+    dMultiply0_331 (res, a, b);
+}
+
+
+#ifdef dxQUICKSTEP_SIMD_SSE2
+
+#if defined(dSINGLE)
+
+static inline dReal dxQuickStepDot6_SSE2 (const dReal *a, const dReal *b)
+{
+    __m128 p0123 = _mm_mul_ps (_mm_loadu_ps (a), _mm_loadu_ps (b));
+    __m128 p45 = _mm_mul_ps (_mm_loadl_pi (_mm_setzero_ps (), (const __m64 *)(a + 4)), 
+        _mm_loadl_pi (_mm_setzero_ps (), (const __m64 *)(b + 4)));
+    __m128 sum = _mm_add_ps (p0123, _mm_movehl_ps (p0123, p0123)); // p0 + p2, p1 + p3
+    sum = _mm_add_ps (sum, p45);
+    sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32 (sum);
+}
+
+static inline void dxQuickStepAxpy6_SSE2 (dReal *y, const dReal *x, dReal alpha)
+{
+    __m128 a = _mm_set1_ps (alpha);
+    _mm_storeu_ps (y, _mm_add_ps (_mm_loadu_ps (y), _mm_mul_ps (a, _mm_loadu_ps (x))));
+    __m128 y45 = _mm_loadl_pi (_mm_setzero_ps (), (const __m64 *)(y + 4));
+    __m128 x45 = _mm_loadl_pi (_mm_setzero_ps (), (const __m64 *)(x + 4));
+    _mm_storel_pi ((__m64 *)(y + 4), _mm_add_ps (y45, _mm_mul_ps (a, x45)));
+}
+
+static inline void dxQuickStepMultiply0_331_SSE2 (dReal *res, const dReal *a, const dReal *b)
+{
+    // the rows are transposed into columns, so that each lane gets the row 
+    // sum in the same order as in dMultiply0_331()
+    __m128 c0 = _mm_loadu_ps (a), c1 = _mm_loadu_ps (a + 4), c2 = _mm_loadu_ps (a + 8), c3 = _mm_setzero_ps ();
+    _MM_TRANSPOSE4_PS (c0, c1, c2, c3);
+    __m128 sum = _mm_mul_ps (c0, _mm_set1_ps (b[0]));
+    sum = _mm_add_ps (sum, _mm_mul_ps (c1, _mm_set1_ps (b[1])));
+    sum = _mm_add_ps (sum, _mm_mul_ps (c2, _mm_set1_ps (b[2])));
+    _mm_storel_pi ((__m64 *)res, sum);
+    _mm_store_ss (res + 2, _mm_movehl_ps (sum, sum));
+}
+
+#elif defined(dDOUBLE)
+
+static inline dReal dxQuickStepDot6_SSE2 (const dReal *a, const dReal *b)
+{
+    __m128d sum = _mm_mul_pd (_mm_loadu_pd (a), _mm_loadu_pd (b));
+    sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadu_pd (a + 2), _mm_loadu_pd (b + 2)));
+    sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadu_pd (a + 4), _mm_loadu_pd (b + 4)));
+    sum = _mm_add_sd (sum, _mm_unpackhi_pd (sum, sum));
+    return _mm_cvtsd_f64 (sum);
+}
+
+static inline void dxQuickStepAxpy6_SSE2 (dReal *y, const dReal *x, dReal alpha)
+{
+    __m128d a = _mm_set1_pd (alpha);
+    _mm_storeu_pd (y, _mm_add_pd (_mm_loadu_pd (y), _mm_mul_pd (a, _mm_loadu_pd (x))));
+    _mm_storeu_pd (y + 2, _mm_add_pd (_mm_loadu_pd (y + 2), _mm_mul_pd (a, _mm_loadu_pd (x + 2))));
+    _mm_storeu_pd (y + 4, _mm_add_pd (_mm_loadu_pd (y + 4), _mm_mul_pd (a, _mm_loadu_pd (x + 4))));
+}
+
+static inline void dxQuickStepMultiply0_331_SSE2 (dReal *res, const dReal *a, const dReal *b)
+{
+    // the first two rows are processed in the lanes of column vectors,
+    // each lane getting the row sum in the same order as in dMultiply0_331()
+    __m128d r0 = _mm_loadu_pd (a), r1 = _mm_loadu_pd (a + 4);
+    __m128d sum = _mm_mul_pd (_mm_unpacklo_pd (r0, r1), _mm_set1_pd (b[0]));
+    sum = _mm_add_pd (sum, _mm_mul_pd (_mm_unpackhi_pd (r0, r1), _mm_set1_pd (b[1])));
+    sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadh_pd (_mm_load_sd (a + 2), a + 6), _mm_set1_pd (b[2])));
+    const dReal res_2 = dCalcVectorDot3 (a + 8, b);
+    _mm_storeu_pd (res, sum);
+    res[2] = res_2;
+}
+
+#else
+#error dSINGLE or dDOUBLE must be defined
+#endif
+
+#endif // #ifdef dxQUICKSTEP_SIMD_SSE2
+
+
+static inline dReal dxQuickStepDot6 (const dReal *a, const dReal *b)
+{
+#ifdef dxQUICKSTEP_SIMD_SSE2
+    return dxQuickStepDot6_SSE2 (a, b);
+#else
+    return dxQuickStepDot6_Scalar (a, b);
+#endif
+}
+
+static inline void dxQuickStepAxpy6 (dReal *y, const dReal *x, dReal alpha)
+{
+#ifdef dxQUICKSTEP_SIMD_SSE2
+    dxQuickStepAxpy6_SSE2 (y, x, alpha);
+#else
+    dxQuickStepAxpy6_Scalar (y, x, alpha);
+#endif
+}
+
+static inline void dxQuickStepMultiply0_331 (dReal *res, const dReal *a, const dReal *b)
+{
+#ifdef dxQUICKSTEP_SIMD_SSE2
+    dxQuickStepMultiply0_331_SSE2 (res, a, b);
+#else
+    dxQuickStepMultiply0_331_Scalar (res, a, b);
+#endif
+}
+
+
+#endif // #ifndef _ODE_QUICKSTEP_KERNELS_H_
@@ -30,6 +30,7 @@
 #include "objects.h"
 #include "joints/joint.h"
 #include "lcp.h"
+#include "lcp_sparse.h"
 #include "util.h"
 #include "threadingutils.h"
 
@@ -51,6 +52,10 @@
 #define IFTIMING(x) ((void)0)
 #endif
 
+// Islands having at least this many constraint rows, mostly unbounded ones,
+// are solved with dSolveLCPSparse() without forming A.
+#define dxSTEP_SPARSE_MIN_ROWS 48
+
 
 struct dJointWithInfo1
 {
@@ -121,7 +126,7 @@ struct dxStepperLocalContext
 {
     void Initialize(dReal *invI, dJointWithInfo1 *jointinfos, unsigned int nj, 
         unsigned int m, unsigned int nub, const unsigned int *mindex, int *findex, 
-        dReal *lo, dReal *hi, dReal *J, dReal *A, dReal *rhs)
+        dReal *lo, dReal *hi, dReal *J, dReal *A, dReal *rhs, dReal *JinvM, dReal *Adcfm)
     {
         m_invI = invI;
         m_jointinfos = jointinfos;
@@ -135,6 +140,8 @@ struct dxStepperLocalContext
         m_J = J;
         m_A = A;
         m_rhs = rhs;
+        m_JinvM = JinvM;
+        m_Adcfm = Adcfm;
     }
 
     dReal                           *m_invI;
@@ -149,6 +156,8 @@ struct dxStepperLocalContext
     dReal                           *m_J;
     dReal                           *m_A;
     dReal                           *m_rhs;
+    dReal                           *m_JinvM;   // for the sparse solver only (when m_A is NULL)
+    dReal                           *m_Adcfm;   // for the sparse solver only (when m_A is NULL)
 };
 
 struct dxStepperStage3CallContext
@@ -169,12 +178,13 @@ struct dxStepperStage3CallContext
 struct dxStepperStage2CallContext
 {
     void Initialize(const dxStepperProcessingCallContext *callContext, const dxStepperLocalContext *localContext, 
-        dReal *JinvM, dReal *rhs_tmp_or_cfm)
+        dReal *JinvM, dReal *cfm, dReal *rhs_tmp)
     {
         m_stepperCallContext = callContext;
         m_localContext = localContext;
         m_JinvM = JinvM;
-        m_rhs_tmp_or_cfm = rhs_tmp_or_cfm;
+        m_cfm = cfm;
+        m_rhs_tmp = rhs_tmp;
         m_ji_J = 0;
         m_ji_Ainit = 0;
         m_ji_JinvM = 0;
@@ -186,7 +196,8 @@ struct dxStepperStage2CallContext
     const dxStepperProcessingCallContext *m_stepperCallContext;
     const dxStepperLocalContext     *m_localContext;
     dReal                           *m_JinvM;
-    dReal                           *m_rhs_tmp_or_cfm;
+    dReal                           *m_cfm;
+    dReal                           *m_rhs_tmp;     // may be the same memory as m_cfm
     volatile unsigned               m_ji_J;
     volatile unsigned               m_ji_Ainit;
     volatile unsigned               m_ji_JinvM;
@@ -342,6 +353,80 @@ static void Multiply1_8q1 (dReal *A, const dReal *B, const dReal *C, unsigned in
 
 //****************************************************************************
 
+// set the rows of A of a joint to zero except for the diagonal elements
+// which are set to cfm*cfm_scale
+static void InitializeJointRowsOfA (dReal *A, unsigned int mskip, unsigned int ofsi, unsigned int infom, 
+    const dReal *cfm_block, dReal cfm_scale)
+{
+    dReal *Arow = A + (size_t)mskip*ofsi;
+    dSetZero(Arow, (size_t)mskip*infom);
+    dReal *Adiag = Arow + ofsi;
+    for (unsigned int i = 0; i != infom; Adiag += mskip, ++i) {
+        Adiag[i] = cfm_block[i] * cfm_scale;
+    }
+}
+
+// add JinvM * J' to the blocks of A in the rows of joint `ji' that lie on
+// or below the diagonal. A's rows and columns are grouped by joint,
+// i.e. in the same way as the rows of J. block (i,j) of A is only nonzero
+// if joints i and j have at least one body in common. 
+static void AddJointBlocksToA (dReal *A, unsigned int mskip, unsigned int ji, const dJointWithInfo1 *jointinfos, 
+    const unsigned int *mindex, const dReal *J, const dReal *JinvM)
+{
+    const unsigned ofsi = mindex[ji];
+    const unsigned int infom = mindex[ji + 1] - ofsi;
+
+    dReal *Arow = A + (size_t)mskip*ofsi;
+    const dReal *JinvMrow = JinvM + 2*8*(size_t)ofsi;
+    dxJoint *joint = jointinfos[ji].joint;
+
+    dxBody *jb0 = joint->node[0].body;
+    if (true || jb0 != NULL) { // -- always true
+        // compute diagonal block of A
+        MultiplyAdd2_p8r (Arow + ofsi, JinvMrow, 
+            J + 2*8*(size_t)ofsi, infom, infom, mskip);
+
+        for (dxJointNode *n0=(ji != 0 ? jb0->firstjoint : NULL); n0; n0=n0->next) {
+            // if joint was tagged as -1 then it is an inactive (m=0 or disabled)
+            // joint that should not be considered
+            int j0 = n0->joint->tag;
+            if (j0 != -1 && (unsigned)j0 < ji) {
+                const unsigned int jiother_ofsi = mindex[j0];
+                const unsigned int jiother_infom = mindex[j0 + 1] - jiother_ofsi;
+                const dJointWithInfo1 *jiother = jointinfos + j0;
+                unsigned int ofsother = (jiother->joint->node[1].body == jb0) ? 8*jiother_infom : 0;
+                // set block of A
+                MultiplyAdd2_p8r (Arow + jiother_ofsi, JinvMrow, 
+                    J + 2*8*(size_t)jiother_ofsi + ofsother, infom, jiother_infom, mskip);
+            }
+        }
+    }
+
+    dxBody *jb1 = joint->node[1].body;
+    dIASSERT(jb1 != jb0);
+    if (jb1 != NULL) {
+        // compute diagonal block of A
+        MultiplyAdd2_p8r (Arow + ofsi, JinvMrow + 8*infom, 
+            J + 2*8*(size_t)ofsi + 8*infom, infom, infom, mskip);
+
+        for (dxJointNode *n1=(ji != 0 ? jb1->firstjoint : NULL); n1; n1=n1->next) {
+            // if joint was tagged as -1 then it is an inactive (m=0 or disabled)
+            // joint that should not be considered
+            int j1 = n1->joint->tag;
+            if (j1 != -1 && (unsigned)j1 < ji) {
+                const unsigned int jiother_ofsi = mindex[j1];
+                const unsigned int jiother_infom = mindex[j1 + 1] - jiother_ofsi;
+                const dJointWithInfo1 *jiother = jointinfos + j1;
+                unsigned int ofsother = (jiother->joint->node[1].body == jb1) ? 8*jiother_infom : 0;
+                // set block of A
+                MultiplyAdd2_p8r (Arow + jiother_ofsi, JinvMrow + 8*infom, 
+                    J + 2*8*(size_t)jiother_ofsi + ofsother, infom, jiother_infom, mskip);
+            }
+        }
+    }
+}
+
+
 /*extern */
 void dxStepIsland(const dxStepperProcessingCallContext *callContext)
 {
@@ -407,6 +492,7 @@ void dxStepIsland_Stage0_Bodies(dxStepperStage0BodiesCallContext *callContext)
 {
     dxBody * const *body = callContext->m_stepperCallContext->m_islandBodiesStart;
     unsigned int nb = callContext->m_stepperCallContext->m_islandBodiesCount;
+    dxStepStageTimer stageTimer(callContext->m_stepperCallContext->m_world, dxSTEP_STAGE0_BODIES);
 
     if (ThrsafeExchange(&callContext->m_tagsTaken, 1) == 0)
     {
@@ -556,6 +642,7 @@ void dxStepIsland_Stage0_Joints(dxStepperStage0JointsCallContext *callContext)
     dxJoint * const *_joint = callContext->m_stepperCallContext->m_islandJointsStart;
     dJointWithInfo1 *jointinfos = callContext->m_jointinfos;
     unsigned int _nj = callContext->m_stepperCallContext->m_islandJointsCount;
+    dxStepStageTimer stageTimer(callContext->m_stepperCallContext->m_world, dxSTEP_STAGE0_JOINTS);
 
     // get m = total constraint dimension, nub = number of unbounded variables.
     // create constraint offset array and number-of-rows array for all joints.
@@ -726,6 +813,9 @@ void dxStepIsland_Stage1(dxStepperStage1CallContext *stage1CallContext)
     unsigned int m = stage1CallContext->m_stage0Outputs.m;
     unsigned int nub = stage1CallContext->m_stage0Outputs.nub;
 
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE1);
+    dxAddStepStatisticsRows(callContext->m_world, m);
+
     dxWorldProcessMemArena *memarena = callContext->m_stepperArena;
     {
         memarena->RestoreState(stage1CallContext->m_stageMemArenaState);
@@ -744,10 +834,13 @@ void dxStepIsland_Stage1(dxStepperStage1CallContext *stage1CallContext)
 
     unsigned int *mindex = NULL;
     dReal *lo = NULL, *hi = NULL, *J = NULL, *A = NULL, *rhs = NULL;
+    dReal *sparseJinvM = NULL, *sparseAdcfm = NULL;
     int *findex = NULL;
 
     // if there are constraints, compute cforce
     if (m > 0) {
+        unsigned int infonub = 0;
+
         mindex = memarena->AllocateArray<unsigned int>((size_t)(nj + 1));
         {
             unsigned int *mcurr = mindex;
@@ -757,8 +850,8 @@ void dxStepIsland_Stage1(dxStepperStage1CallContext *stage1CallContext)
 
             const dJointWithInfo1 *const jiend = jointinfos + nj;
             for (const dJointWithInfo1 *jicurr = jointinfos; jicurr != jiend; ++jicurr) {
-                dxJoint *joint = jicurr->joint;
                 moffs += jicurr->info.m;
+                infonub += jicurr->info.nub;
                 mcurr[0] = moffs;
                 mcurr += 1;
             }
@@ -768,29 +861,48 @@ void dxStepIsland_Stage1(dxStepperStage1CallContext *stage1CallContext)
         lo = memarena->AllocateArray<dReal>(m);
         hi = memarena->AllocateArray<dReal>(m);
         J = memarena->AllocateArray<dReal>(2 * 8 * (size_t)m);
-        A = memarena->AllocateArray<dReal>(m * (size_t)dPAD(m));
         rhs = memarena->AllocateArray<dReal>(m);
+
+        // the sparse solver needs JinvM and cfm in Stage3 instead of A
+        if (m >= dxSTEP_SPARSE_MIN_ROWS && 2 * infonub >= m) {
+            sparseJinvM = memarena->AllocateArray<dReal>(2 * 8 * (size_t)m);
+            sparseAdcfm = memarena->AllocateArray<dReal>(m);
+        }
+        else {
+            A = memarena->AllocateArray<dReal>(m * (size_t)dPAD(m));
+        }
     }
 
     dxStepperLocalContext *localContext = (dxStepperLocalContext *)memarena->AllocateBlock(sizeof(dxStepperLocalContext));
-    localContext->Initialize(invI, jointinfos, nj, m, nub, mindex, findex, lo, hi, J, A, rhs);
+    localContext->Initialize(invI, jointinfos, nj, m, nub, mindex, findex, lo, hi, J, A, rhs, sparseJinvM, sparseAdcfm);
 
     void *stage1MemarenaState = memarena->SaveState();
     dxStepperStage3CallContext *stage3CallContext = (dxStepperStage3CallContext*)memarena->AllocateBlock(sizeof(dxStepperStage3CallContext));
     stage3CallContext->Initialize(callContext, localContext, stage1MemarenaState);
 
+    // the following stages may be called from here and time themselves
+    stageTimer.Switch(dxSTEP__NONE);
+
     if (m > 0) {
         // create a constraint equation right hand side vector `c', a constraint
         // force mixing vector `cfm', and LCP low and high bound vectors, and an
         // 'findex' vector.
-        dReal *JinvM = memarena->AllocateArray<dReal>(2 * 8 * (size_t)m);
         const unsigned int nb = callContext->m_islandBodiesCount;
         size_t cfm_elem = (size_t)m, rhs_tmp_elem = (size_t)nb*8;
-        dReal *cfm = memarena->AllocateArray<dReal>(dMAX(cfm_elem, rhs_tmp_elem));
-        // dReal *rhs_tmp = cfm; // Reuse the same memory since rhs calculations start after cfm is not needed anymore
+        dReal *JinvM, *cfm, *rhs_tmp;
+        if (A != NULL) {
+            JinvM = memarena->AllocateArray<dReal>(2 * 8 * (size_t)m);
+            cfm = memarena->AllocateArray<dReal>(dMAX(cfm_elem, rhs_tmp_elem));
+            rhs_tmp = cfm; // Reuse the same memory since rhs calculations start after cfm is not needed anymore
+        }
+        else {
+            JinvM = sparseJinvM;
+            cfm = sparseAdcfm;
+            rhs_tmp = memarena->AllocateArray<dReal>(rhs_tmp_elem);
+        }
 
         dxStepperStage2CallContext *stage2CallContext = (dxStepperStage2CallContext *)memarena->AllocateBlock(sizeof(dxStepperStage2CallContext));
-        stage2CallContext->Initialize(callContext, localContext, JinvM, cfm);
+        stage2CallContext->Initialize(callContext, localContext, JinvM, cfm, rhs_tmp);
 
         const unsigned allowedThreads = callContext->m_stepperAllowedThreads;
         dIASSERT(allowedThreads != 0);
@@ -844,11 +956,12 @@ void dxStepIsland_Stage2a(dxStepperStage2CallContext *stage2CallContext)
 
     const dReal stepsizeRecip = dRecip(callContext->m_stepSize);
     dxWorld *world = callContext->m_world;
+    dxStepStageTimer stageTimer(world, dxSTEP_STAGE2A);
 
     {
         int *findex = localContext->m_findex;
         dReal *J = localContext->m_J;
-        dReal *cfm = stage2CallContext->m_rhs_tmp_or_cfm;
+        dReal *cfm = stage2CallContext->m_cfm;
         dReal *lo = localContext->m_lo;
         dReal *hi = localContext->m_hi;
         dReal *rhs = localContext->m_rhs;
@@ -950,6 +1063,7 @@ void dxStepIsland_Stage2b(dxStepperStage2CallContext *stage2CallContext)
     dJointWithInfo1 *jointinfos = localContext->m_jointinfos;
     unsigned int nj = localContext->m_nj;
     const unsigned int *mindex = localContext->m_mindex;
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE2B);
 
     {
         // Warning!!!
@@ -960,7 +1074,7 @@ void dxStepIsland_Stage2b(dxStepperStage2CallContext *stage2CallContext)
         const dReal stepsizeRecip = dRecip(callContext->m_stepSize);
 
         dReal *A = localContext->m_A;
-        const dReal *cfm = stage2CallContext->m_rhs_tmp_or_cfm;
+        dReal *cfm = stage2CallContext->m_cfm;
         const unsigned m = localContext->m_m;
 
         const unsigned int mskip = dPAD(m);
@@ -970,12 +1084,15 @@ void dxStepIsland_Stage2b(dxStepperStage2CallContext *stage2CallContext)
             const unsigned ofsi = mindex[ji];
             const unsigned int infom = mindex[ji + 1] - ofsi;
 
-            dReal *Arow = A + (size_t)mskip*ofsi;
-            dSetZero(Arow, (size_t)mskip*infom);
-            dReal *Adiag = Arow + ofsi;
-            const dReal *cfm_block = cfm + ofsi;
-            for (unsigned int i = 0; i != infom; Adiag += mskip, ++i) {
-                Adiag[i] = cfm_block[i] * stepsizeRecip;
+            if (A != NULL) {
+                InitializeJointRowsOfA(A, mskip, ofsi, infom, cfm + ofsi, stepsizeRecip);
+            }
+            else {
+                // there is no A for the sparse solver, so keep its diagonal in cfm
+                dReal *cfm_block = cfm + ofsi;
+                for (unsigned int i = 0; i != infom; ++i) {
+                    cfm_block[i] *= stepsizeRecip;
+                }
             }
         }
     }
@@ -1043,7 +1160,7 @@ void dxStepIsland_Stage2b(dxStepperStage2CallContext *stage2CallContext)
         dxBody * const *const body = callContext->m_islandBodiesStart;
         const unsigned int nb = callContext->m_islandBodiesCount;
         const dReal *invI = localContext->m_invI;
-        dReal *rhs_tmp = stage2CallContext->m_rhs_tmp_or_cfm;
+        dReal *rhs_tmp = stage2CallContext->m_rhs_tmp;
 
         // compute the right hand side `rhs'
         IFTIMING(dTimerNow ("compute rhs_tmp"));
@@ -1094,6 +1211,7 @@ void dxStepIsland_Stage2c(dxStepperStage2CallContext *stage2CallContext)
     dJointWithInfo1 *jointinfos = localContext->m_jointinfos;
     unsigned int nj = localContext->m_nj;
     const unsigned int *mindex = localContext->m_mindex;
+    dxStepStageTimer stageTimer(callContext->m_world, dxSTEP_STAGE2C);
 
     {
         // Warning!!!
@@ -1106,63 +1224,13 @@ void dxStepIsland_Stage2c(dxStepperStage2CallContext *stage2CallContext)
         const dReal *J = localContext->m_J;
         const unsigned m = localContext->m_m;
 
-        // now compute A = JinvM * J'. A's rows and columns are grouped by joint,
-        // i.e. in the same way as the rows of J. block (i,j) of A is only nonzero
-        // if joints i and j have at least one body in common. 
+        // now compute A = JinvM * J' (it is not formed for the sparse solver).
         const unsigned int mskip = dPAD(m);
 
-        unsigned ji;
-        while ((ji = ThrsafeIncrementIntUpToLimit(&stage2CallContext->m_ji_Aaddjb, nj)) != nj) {
-            const unsigned ofsi = mindex[ji];
-            const unsigned int infom = mindex[ji + 1] - ofsi;
-
-            dReal *Arow = A + (size_t)mskip*ofsi;
-            const dReal *JinvMrow = JinvM + 2*8*(size_t)ofsi;
-            dxJoint *joint = jointinfos[ji].joint;
-
-            dxBody *jb0 = joint->node[0].body;
-            if (true || jb0 != NULL) { // -- always true
-                // compute diagonal block of A
-                MultiplyAdd2_p8r (Arow + ofsi, JinvMrow, 
-                    J + 2*8*(size_t)ofsi, infom, infom, mskip);
-
-                for (dxJointNode *n0=(ji != 0 ? jb0->firstjoint : NULL); n0; n0=n0->next) {
-                    // if joint was tagged as -1 then it is an inactive (m=0 or disabled)
-                    // joint that should not be considered
-                    int j0 = n0->joint->tag;
-                    if (j0 != -1 && (unsigned)j0 < ji) {
-                        const unsigned int jiother_ofsi = mindex[j0];
-                        const unsigned int jiother_infom = mindex[j0 + 1] - jiother_ofsi;
-                        const dJointWithInfo1 *jiother = jointinfos + j0;
-                        unsigned int ofsother = (jiother->joint->node[1].body == jb0) ? 8*jiother_infom : 0;
-                        // set block of A
-                        MultiplyAdd2_p8r (Arow + jiother_ofsi, JinvMrow, 
-                            J + 2*8*(size_t)jiother_ofsi + ofsother, infom, jiother_infom, mskip);
-                    }
-                }
-            }
-
-            dxBody *jb1 = joint->node[1].body;
-            dIASSERT(jb1 != jb0);
-            if (jb1 != NULL) {
-                // compute diagonal block of A
-                MultiplyAdd2_p8r (Arow + ofsi, JinvMrow + 8*infom, 
-                    J + 2*8*(size_t)ofsi + 8*infom, infom, infom, mskip);
-
-                for (dxJointNode *n1=(ji != 0 ? jb1->firstjoint : NULL); n1; n1=n1->next) {
-                    // if joint was tagged as -1 then it is an inactive (m=0 or disabled)
-                    // joint that should not be considered
-                    int j1 = n1->joint->tag;
-                    if (j1 != -1 && (unsigned)j1 < ji) {
-                        const unsigned int jiother_ofsi = mindex[j1];
-                        const unsigned int jiother_infom = mindex[j1 + 1] - jiother_ofsi;
-                        const dJointWithInfo1 *jiother = jointinfos + j1;
-                        unsigned int ofsother = (jiother->joint->node[1].body == jb1) ? 8*jiother_infom : 0;
-                        // set block of A
-                        MultiplyAdd2_p8r (Arow + jiother_ofsi, JinvMrow + 8*infom, 
-                            J + 2*8*(size_t)jiother_ofsi + ofsother, infom, jiother_infom, mskip);
-                    }
-                }
+        if (A != NULL) {
+            unsigned ji;
+            while ((ji = ThrsafeIncrementIntUpToLimit(&stage2CallContext->m_ji_Aaddjb, nj)) != nj) {
+                AddJointBlocksToA(A, mskip, ji, jointinfos, mindex, J, JinvM);
             }
         }
     }
@@ -1174,7 +1242,7 @@ void dxStepIsland_Stage2c(dxStepperStage2CallContext *stage2CallContext)
         // proper synchronization and avoid accessing numbers being modified.
         // Warning!!!
         const dReal *J = localContext->m_J;
-        const dReal *rhs_tmp = stage2CallContext->m_rhs_tmp_or_cfm;
+        const dReal *rhs_tmp = stage2CallContext->m_rhs_tmp;
         dReal *rhs = localContext->m_rhs;
 
         // compute the right hand side `rhs'
@@ -1241,21 +1309,83 @@ void dxStepIsland_Stage3(dxStepperStage3CallContext *stage3CallContext)
     dxBody * const *body = callContext->m_islandBodiesStart;
     unsigned int nb = callContext->m_islandBodiesCount;
 
+    dxStepStageTimer stageTimer(world, dxSTEP_LCP);
+
     dReal *lambda = NULL;
 
     if (m > 0) {
         lambda = memarena->AllocateArray<dReal>(m);
 
         BEGIN_STATE_SAVE(memarena, lcpstate) {
-            IFTIMING(dTimerNow ("solving LCP problem"));
+            bool solved = false;
+
+            if (A == NULL) {
+                IFTIMING(dTimerNow ("solving sparse LCP problem"));
+
+                // the sparse solver may use as much memory as A and dSolveLCP()
+                // would need as that is what has been reserved for the step
+                const size_t denseMemReq = dEFFICIENT_SIZE(sizeof(dReal) * m * (size_t)dPAD(m)) + dEstimateSolveLCPMemoryReq(m, false);
+                const size_t systemMemReq = dEFFICIENT_SIZE(sizeof(int) * 2 * (size_t)nj) + dEFFICIENT_SIZE(sizeof(dReal) * nb);
+
+                BEGIN_STATE_SAVE(memarena, sparsestate) {
+                    int *jb = memarena->AllocateArray<int>(2 * (size_t)nj);
+                    for (unsigned int ji = 0; ji != nj; ++ji) {
+                        dxJoint *joint = jointinfos[ji].joint;
+                        jb[2*ji] = joint->node[0].body->tag;
+                        jb[2*ji + 1] = joint->node[1].body != NULL ? joint->node[1].body->tag : -1;
+                    }
+
+                    dReal *invMass = memarena->AllocateArray<dReal>(nb);
+                    for (unsigned int bi = 0; bi != nb; ++bi) {
+                        invMass[bi] = body[bi]->invMass;
+                    }
+
+                    dxSparseLCPSystem system;
+                    system.nb = nb;
+                    system.nj = nj;
+                    system.m = m;
+                    system.mindex = mindex;
+                    system.jb = jb;
+                    system.J = J;
+                    system.JinvM = localContext->m_JinvM;
+                    system.invI = invI;
+                    system.invMass = invMass;
+                    system.Adcfm = localContext->m_Adcfm;
+
+                    dIASSERT(systemMemReq <= denseMemReq);
+                    solved = dSolveLCPSparse (memarena, denseMemReq - systemMemReq, &system, lambda, rhs, lo, hi, findex);
+
+                } END_STATE_SAVE(memarena, sparsestate);
+
+                if (!solved) {
+                    // there was not enough memory for the fill-in, so form A after all
+                    const unsigned int mskip = dPAD(m);
+                    A = memarena->AllocateArray<dReal>(m * (size_t)mskip);
+
+                    const dReal *Adcfm = localContext->m_Adcfm;
+                    for (unsigned int ji = 0; ji != nj; ++ji) {
+                        const unsigned ofsi = mindex[ji];
+                        InitializeJointRowsOfA(A, mskip, ofsi, mindex[ji + 1] - ofsi, Adcfm + ofsi, REAL(1.0));
+                    }
+                    for (unsigned int ji = 0; ji != nj; ++ji) {
+                        AddJointBlocksToA(A, mskip, ji, jointinfos, mindex, J, localContext->m_JinvM);
+                    }
+                }
+            }
 
-            // solve the LCP problem and get lambda.
-            // this will destroy A but that's OK
-            dSolveLCP (memarena, m, A, lambda, rhs, NULL, nub, lo, hi, findex);
+            if (!solved) {
+                IFTIMING(dTimerNow ("solving LCP problem"));
+
+                // solve the LCP problem and get lambda.
+                // this will destroy A but that's OK
+                dSolveLCP (memarena, m, A, lambda, rhs, NULL, nub, lo, hi, findex);
+            }
 
         } END_STATE_SAVE(memarena, lcpstate);
     }
 
+    stageTimer.Switch(dxSTEP_STAGE3);
+
     // this will be set to the force due to the constraints
     dReal *cforce = memarena->AllocateArray<dReal>((size_t)nb * 8);
     dSetZero (cforce,(size_t)nb*8);
@@ -1348,19 +1478,8 @@ void dxStepIsland_Stage3(dxStepperStage3CallContext *stage3CallContext)
         }
     }
 
-    {
-        // update the position and orientation from the new linear/angular velocity
-        // (over the given timestep)
-        IFTIMING(dTimerNow ("update position"));
-
-        const dReal stepsize = callContext->m_stepSize;
-
-        dxBody *const *const bodyend = body + nb;
-        for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
-            dxBody *b = *bodycurr;
-            dxStepBody (b, stepsize);
-        }
-    }
+    // the positions and orientations are updated from the new velocities
+    // by dxProcessIslands() for the bodies of all the islands together
 
     {
         IFTIMING(dTimerNow ("tidy up"));
@@ -1424,6 +1543,10 @@ size_t dxEstimateStepMemoryRequirements (dxBody * const *body, unsigned int nb,
             sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 2 * 8 * m); // for J
             unsigned int mskip = dPAD(m);
             sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * mskip * m); // for A
+            if (m >= dxSTEP_SPARSE_MIN_ROWS) {
+                // for JinvM and cfm kept till Stage3 for the sparse solver
+                sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 2 * 8 * m) + dEFFICIENT_SIZE(sizeof(dReal) * m);
+            }
             sub1_res2 += 3 * dEFFICIENT_SIZE(sizeof(dReal) * m); // for lo, hi, rhs
             sub1_res2 += dEFFICIENT_SIZE(sizeof(int) * m); // for findex
             {
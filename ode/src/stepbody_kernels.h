@@ -0,0 +1,229 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+ * Lane kernels of the batched body integrator.
+ *
+ * dxStepBodies() gathers the bodies that do not use finite rotations into
+ * blocks of dxSTEPBODY_LANES bodies, with every state component stored in
+ * its own array, and integrates a block at a time: the position update, the
+ * infinitesimal quaternion update, the quaternion normalization and the
+ * rebuild of the rotation matrix. The kernels are implemented with SSE2
+ * when the compiler targets it, for both single and double precision.
+ * Defining dSTEPBODY_NO_SIMD forces the scalar versions.
+ *
+ * Every lane performs the operations of dDQfromW(), dNormalize4() and
+ * dRfromQ() in the same order, so that the results are bitwise identical
+ * to integrating the bodies one by one.
+ */
+
+#ifndef _ODE_STEPBODY_KERNELS_H_
+#define _ODE_STEPBODY_KERNELS_H_
+
+
+#include <ode/common.h>
+#include <ode/odemath.h>
+#include <ode/rotation.h>
+
+
+#if !defined(dSTEPBODY_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define dxSTEPBODY_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+#define dxSTEPBODY_LANES 4
+
+// the state of dxSTEPBODY_LANES bodies, one array element per body.
+// R receives the first three columns of the rotation matrix rows.
+struct dxStepBodyLanes
+{
+    dReal pos[3][dxSTEPBODY_LANES];
+    dReal lvel[3][dxSTEPBODY_LANES];
+    dReal avel[3][dxSTEPBODY_LANES];
+    dReal q[4][dxSTEPBODY_LANES];
+    dReal R[9][dxSTEPBODY_LANES];
+};
+
+
+static inline void dxStepBodyLanes_Scalar (dxStepBodyLanes *lanes, dReal h)
+{
+    for (unsigned int l = 0; l != dxSTEPBODY_LANES; ++l) {
+        for (unsigned int j = 0; j != 3; ++j) lanes->pos[j][l] += h * lanes->lvel[j][l];
+
+        dVector3 w;
+        dQuaternion q;
+        for (unsigned int j = 0; j != 3; ++j) w[j] = lanes->avel[j][l];
+        for (unsigned int j = 0; j != 4; ++j) q[j] = lanes->q[j][l];
+
+        dReal dq[4];
+        dDQfromW (dq, w, q);
+        for (unsigned int j = 0; j != 4; ++j) q[j] += h * dq[j];
+        dNormalize4 (q);
+
+        dMatrix3 R;
+        dRfromQ (R, q);
+        for (unsigned int j = 0; j != 4; ++j) lanes->q[j][l] = q[j];
+        for (unsigned int i = 0; i != 3; ++i) {
+            for (unsigned int j = 0; j != 3; ++j) lanes->R[i * 3 + j][l] = R[i * 4 + j];
+        }
+    }
+}
+
+
+#ifdef dxSTEPBODY_SIMD_SSE2
+
+#if defined(dSINGLE)
+
+typedef __m128 dxStepBodyVec;
+#define dxSTEPBODY_VEC_SIZE 4
+#define dxStepBodyLoad(p) _mm_loadu_ps (p)
+#define dxStepBodyStore(p, a) _mm_storeu_ps ((p), (a))
+#define dxStepBodySet1(x) _mm_set1_ps (x)
+#define dxStepBodyAdd(a, b) _mm_add_ps ((a), (b))
+#define dxStepBodySub(a, b) _mm_sub_ps ((a), (b))
+#define dxStepBodyMul(a, b) _mm_mul_ps ((a), (b))
+#define dxStepBodyDiv(a, b) _mm_div_ps ((a), (b))
+#define dxStepBodySqrt(a) _mm_sqrt_ps (a)
+#define dxStepBodyXor(a, b) _mm_xor_ps ((a), (b))
+#define dxStepBodyAnd(a, b) _mm_and_ps ((a), (b))
+#define dxStepBodyAndNot(a, b) _mm_andnot_ps ((a), (b))
+#define dxStepBodyOr(a, b) _mm_or_ps ((a), (b))
+#define dxStepBodyCmpGt(a, b) _mm_cmpgt_ps ((a), (b))
+
+#elif defined(dDOUBLE)
+
+typedef __m128d dxStepBodyVec;
+#define dxSTEPBODY_VEC_SIZE 2
+#define dxStepBodyLoad(p) _mm_loadu_pd (p)
+#define dxStepBodyStore(p, a) _mm_storeu_pd ((p), (a))
+#define dxStepBodySet1(x) _mm_set1_pd (x)
+#define dxStepBodyAdd(a, b) _mm_add_pd ((a), (b))
+#define dxStepBodySub(a, b) _mm_sub_pd ((a), (b))
+#define dxStepBodyMul(a, b) _mm_mul_pd ((a), (b))
+#define dxStepBodyDiv(a, b) _mm_div_pd ((a), (b))
+#define dxStepBodySqrt(a) _mm_sqrt_pd (a)
+#define dxStepBodyXor(a, b) _mm_xor_pd ((a), (b))
+#define dxStepBodyAnd(a, b) _mm_and_pd ((a), (b))
+#define dxStepBodyAndNot(a, b) _mm_andnot_pd ((a), (b))
+#define dxStepBodyOr(a, b) _mm_or_pd ((a), (b))
+#define dxStepBodyCmpGt(a, b) _mm_cmpgt_pd ((a), (b))
+
+#else
+#error dSINGLE or dDOUBLE must be defined
+#endif
+
+static inline void dxStepBodyLanes_SSE2 (dxStepBodyLanes *lanes, dReal h)
+{
+    const dxStepBodyVec vh = dxStepBodySet1 (h);
+    const dxStepBodyVec half = dxStepBodySet1 (REAL(0.5));
+    const dxStepBodyVec one = dxStepBodySet1 (REAL(1.0));
+    const dxStepBodyVec two = dxStepBodySet1 (REAL(2.0));
+    const dxStepBodyVec zero = dxStepBodySet1 (REAL(0.0));
+    const dxStepBodyVec sign = dxStepBodySet1 (REAL(-0.0));
+
+    for (unsigned int l = 0; l != dxSTEPBODY_LANES; l += dxSTEPBODY_VEC_SIZE) {
+        for (unsigned int j = 0; j != 3; ++j) {
+            dxStepBodyVec p = dxStepBodyAdd (dxStepBodyLoad (lanes->pos[j] + l), dxStepBodyMul (vh, dxStepBodyLoad (lanes->lvel[j] + l)));
+            dxStepBodyStore (lanes->pos[j] + l, p);
+        }
+
+        const dxStepBodyVec w0 = dxStepBodyLoad (lanes->avel[0] + l);
+        const dxStepBodyVec w1 = dxStepBodyLoad (lanes->avel[1] + l);
+        const dxStepBodyVec w2 = dxStepBodyLoad (lanes->avel[2] + l);
+        dxStepBodyVec q0 = dxStepBodyLoad (lanes->q[0] + l);
+        dxStepBodyVec q1 = dxStepBodyLoad (lanes->q[1] + l);
+        dxStepBodyVec q2 = dxStepBodyLoad (lanes->q[2] + l);
+        dxStepBodyVec q3 = dxStepBodyLoad (lanes->q[3] + l);
+
+        // dDQfromW(), the negations flip the sign bits like the unary minus
+        const dxStepBodyVec nw0 = dxStepBodyXor (w0, sign);
+        dxStepBodyVec dq0 = dxStepBodyMul (half, dxStepBodySub (dxStepBodySub (dxStepBodyMul (nw0, q1), dxStepBodyMul (w1, q2)), dxStepBodyMul (w2, q3)));
+        dxStepBodyVec dq1 = dxStepBodyMul (half, dxStepBodySub (dxStepBodyAdd (dxStepBodyMul (w0, q0), dxStepBodyMul (w1, q3)), dxStepBodyMul (w2, q2)));
+        dxStepBodyVec dq2 = dxStepBodyMul (half, dxStepBodyAdd (dxStepBodyAdd (dxStepBodyMul (nw0, q3), dxStepBodyMul (w1, q0)), dxStepBodyMul (w2, q1)));
+        dxStepBodyVec dq3 = dxStepBodyMul (half, dxStepBodyAdd (dxStepBodySub (dxStepBodyMul (w0, q2), dxStepBodyMul (w1, q1)), dxStepBodyMul (w2, q0)));
+        q0 = dxStepBodyAdd (q0, dxStepBodyMul (vh, dq0));
+        q1 = dxStepBodyAdd (q1, dxStepBodyMul (vh, dq1));
+        q2 = dxStepBodyAdd (q2, dxStepBodyMul (vh, dq2));
+        q3 = dxStepBodyAdd (q3, dxStepBodyMul (vh, dq3));
+
+        // dNormalize4(), lanes of zero length become the identity
+        dxStepBodyVec len = dxStepBodyAdd (dxStepBodyAdd (dxStepBodyAdd (dxStepBodyMul (q0, q0), dxStepBodyMul (q1, q1)), dxStepBodyMul (q2, q2)), dxStepBodyMul (q3, q3));
+        const dxStepBodyVec valid = dxStepBodyCmpGt (len, zero);
+        len = dxStepBodyDiv (one, dxStepBodySqrt (len));
+        q0 = dxStepBodyOr (dxStepBodyAnd (valid, dxStepBodyMul (q0, len)), dxStepBodyAndNot (valid, one));
+        q1 = dxStepBodyAnd (valid, dxStepBodyMul (q1, len));
+        q2 = dxStepBodyAnd (valid, dxStepBodyMul (q2, len));
+        q3 = dxStepBodyAnd (valid, dxStepBodyMul (q3, len));
+        dxStepBodyStore (lanes->q[0] + l, q0);
+        dxStepBodyStore (lanes->q[1] + l, q1);
+        dxStepBodyStore (lanes->q[2] + l, q2);
+        dxStepBodyStore (lanes->q[3] + l, q3);
+
+        // dRfromQ()
+        const dxStepBodyVec qq1 = dxStepBodyMul (dxStepBodyMul (two, q1), q1);
+        const dxStepBodyVec qq2 = dxStepBodyMul (dxStepBodyMul (two, q2), q2);
+        const dxStepBodyVec qq3 = dxStepBodyMul (dxStepBodyMul (two, q3), q3);
+        const dxStepBodyVec q12 = dxStepBodyMul (q1, q2), q03 = dxStepBodyMul (q0, q3);
+        const dxStepBodyVec q13 = dxStepBodyMul (q1, q3), q02 = dxStepBodyMul (q0, q2);
+        const dxStepBodyVec q23 = dxStepBodyMul (q2, q3), q01 = dxStepBodyMul (q0, q1);
+        dxStepBodyStore (lanes->R[0] + l, dxStepBodySub (dxStepBodySub (one, qq2), qq3));
+        dxStepBodyStore (lanes->R[1] + l, dxStepBodyMul (two, dxStepBodySub (q12, q03)));
+        dxStepBodyStore (lanes->R[2] + l, dxStepBodyMul (two, dxStepBodyAdd (q13, q02)));
+        dxStepBodyStore (lanes->R[3] + l, dxStepBodyMul (two, dxStepBodyAdd (q12, q03)));
+        dxStepBodyStore (lanes->R[4] + l, dxStepBodySub (dxStepBodySub (one, qq1), qq3));
+        dxStepBodyStore (lanes->R[5] + l, dxStepBodyMul (two, dxStepBodySub (q23, q01)));
+        dxStepBodyStore (lanes->R[6] + l, dxStepBodyMul (two, dxStepBodySub (q13, q02)));
+        dxStepBodyStore (lanes->R[7] + l, dxStepBodyMul (two, dxStepBodyAdd (q23, q01)));
+        dxStepBodyStore (lanes->R[8] + l, dxStepBodySub (dxStepBodySub (one, qq1), qq2));
+    }
+}
+
+#undef dxSTEPBODY_VEC_SIZE
+#undef dxStepBodyLoad
+#undef dxStepBodyStore
+#undef dxStepBodySet1
+#undef dxStepBodyAdd
+#undef dxStepBodySub
+#undef dxStepBodyMul
+#undef dxStepBodyDiv
+#undef dxStepBodySqrt
+#undef dxStepBodyXor
+#undef dxStepBodyAnd
+#undef dxStepBodyAndNot
+#undef dxStepBodyOr
+#undef dxStepBodyCmpGt
+
+#endif // #ifdef dxSTEPBODY_SIMD_SSE2
+
+
+static inline void dxStepBodyLanes_Integrate (dxStepBodyLanes *lanes, dReal h)
+{
+#ifdef dxSTEPBODY_SIMD_SSE2
+    dxStepBodyLanes_SSE2 (lanes, h);
+#else
+    dxStepBodyLanes_Scalar (lanes, h);
+#endif
+}
+
+
+#endif // #ifndef _ODE_STEPBODY_KERNELS_H_
@@ -86,6 +86,37 @@ public:
 
         return exchange_result;
     }
+
+    static bool CompareExchangeTargetValue(volatile atomicord_t *value_storage_ptr, 
+        atomicord_t comparand_value, atomicord_t new_value)
+    {
+        bool exchange_result = false;
+
+        atomicord_t original_value = *value_storage_ptr;
+
+        if (original_value == comparand_value)
+        {
+            *value_storage_ptr = new_value;
+
+            exchange_result = true;
+        }
+
+        return exchange_result;
+    }
+
+    static atomicord_t ExchangeTargetValue(volatile atomicord_t *value_storage_ptr, atomicord_t new_value)
+    {
+        atomicord_t original_value = *value_storage_ptr;
+        *value_storage_ptr = new_value;
+        return original_value;
+    }
+
+    static atomicptr_t ExchangeTargetPtr(volatile atomicptr_t *pointer_storage_ptr, atomicptr_t new_value)
+    {
+        atomicptr_t original_value = *pointer_storage_ptr;
+        *pointer_storage_ptr = new_value;
+        return original_value;
+    }
 };
 
 template<>
@@ -160,6 +191,23 @@ public:
     {
         return _OU_NAMESPACE::AtomicCompareExchangePointer(pointer_storage_ptr, comparand_value, new_value);
     }
+
+    static bool CompareExchangeTargetValue(volatile atomicord_t *value_storage_ptr, 
+        atomicord_t comparand_value, atomicord_t new_value)
+    {
+        return _OU_NAMESPACE::AtomicCompareExchange(value_storage_ptr, comparand_value, new_value);
+    }
+
+    // The exchanges are full memory barriers
+    static atomicord_t ExchangeTargetValue(volatile atomicord_t *value_storage_ptr, atomicord_t new_value)
+    {
+        return _OU_NAMESPACE::AtomicExchange(value_storage_ptr, new_value);
+    }
+
+    static atomicptr_t ExchangeTargetPtr(volatile atomicptr_t *pointer_storage_ptr, atomicptr_t new_value)
+    {
+        return _OU_NAMESPACE::AtomicExchangePointer(pointer_storage_ptr, new_value);
+    }
 };
 
 template<>
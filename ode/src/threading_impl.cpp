@@ -121,6 +121,24 @@ static const dxThreadingFunctionsInfo g_builtin_threading_functions =
     return (dThreadingImplementationID)impl;
 }
 
+/*extern */dThreadingImplementationID dThreadingAllocateMultiThreadedWorkStealingImplementation()
+{
+#if dBUILTIN_THREADING_IMPL_ENABLED
+    dxWorkStealingThreading *threading = new dxWorkStealingThreading();
+
+    if (threading != NULL && !threading->InitializeObject())
+    {
+        delete threading;
+        threading = NULL;
+    }
+#else
+    dxIThreadingImplementation *threading = NULL;
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+
+    dxIThreadingImplementation *impl = threading;
+    return (dThreadingImplementationID)impl;
+}
+
 /*extern */const dThreadingFunctionsInfo *dThreadingImplementationGetFunctions(dThreadingImplementationID impl)
 {
 #if dBUILTIN_THREADING_IMPL_ENABLED
@@ -48,11 +48,21 @@
 #include <pthread.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
 
 #if !defined(EOK)
 #define EOK   0
 #endif
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define dxFUTEX_AVAILABLE 1
+#else
+#define dxFUTEX_AVAILABLE 0
+#endif
+
 
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
@@ -549,6 +559,268 @@ void dxMutexMutex::UnlockMutex()
 }
 
 
+/************************************************************************/
+/* dxPthreadKeyPointer class implementation                             */
+/************************************************************************/
+
+class dxPthreadKeyPointer
+{
+public:
+    dxPthreadKeyPointer(): m_key_allocated(false) {}
+    ~dxPthreadKeyPointer() { DoFinalizeObject(); }
+
+    bool InitializeObject() { return DoInitializeObject(); }
+
+private:
+    bool DoInitializeObject();
+    void DoFinalizeObject();
+
+public:
+    void *GetPointerValue() const { return pthread_getspecific(m_key_instance); }
+    void SetPointerValue(void *pointer_value);
+
+private:
+    pthread_key_t       m_key_instance;
+    bool                m_key_allocated;
+};
+
+
+bool dxPthreadKeyPointer::DoInitializeObject()
+{
+    dIASSERT(!m_key_allocated);
+
+    bool init_result = false;
+
+    do
+    {
+        int key_result = pthread_key_create(&m_key_instance, NULL);
+        if (key_result != EOK)
+        {
+            errno = key_result;
+            break;
+        }
+
+        m_key_allocated = true;
+        init_result = true;
+    }
+    while (false);
+
+    return init_result;
+}
+
+void dxPthreadKeyPointer::DoFinalizeObject()
+{
+    if (m_key_allocated)
+    {
+        int key_result = pthread_key_delete(m_key_instance);
+        dICHECK(key_result == EOK || ((errno = key_result), false));
+
+        m_key_allocated = false;
+    }
+}
+
+void dxPthreadKeyPointer::SetPointerValue(void *pointer_value)
+{
+    int set_result = pthread_setspecific(m_key_instance, pointer_value);
+    dICHECK(set_result == EOK || ((errno = set_result), false));
+}
+
+
+/************************************************************************/
+/* dxFutexEventCount class implementation                               */
+/************************************************************************/
+
+/*
+ *  An event count for the idle threads: a thread reads the epoch, checks 
+ *  for work once more and sleeps only if nobody changes the epoch meanwhile. 
+ *  The wakers only make a system call when there are threads preparing to 
+ *  wait. On Linux the threads sleep on a futex, elsewhere on a condition 
+ *  variable.
+ */
+class dxFutexEventCount
+{
+public:
+    dxFutexEventCount(): m_wait_epoch(0), m_waiter_count(0), m_object_initialized(false) {}
+    ~dxFutexEventCount() { DoFinalizeObject(); }
+
+    bool InitializeObject() { return DoInitializeObject(); }
+
+private:
+    bool DoInitializeObject();
+    void DoFinalizeObject();
+
+public:
+    typedef dxOUAtomicsProvider::atomicord_t eventepoch_t;
+
+public:
+    eventepoch_t PrepareToWait();
+    void CancelWaiting();
+    void CommitWaiting(eventepoch_t wait_epoch);
+
+    void WakeupAThread();
+    void WakeupAllThreads();
+
+    static void PauseSpinning();
+
+private:
+    void WakeupWaiters(bool wake_all);
+
+private:
+    volatile eventepoch_t   m_wait_epoch;
+    volatile dxOUAtomicsProvider::atomicord_t m_waiter_count;
+#if !dxFUTEX_AVAILABLE
+    pthread_mutex_t         m_wakeup_mutex;
+    pthread_cond_t          m_wakeup_cond;
+#endif
+    bool                    m_object_initialized;
+};
+
+
+bool dxFutexEventCount::DoInitializeObject()
+{
+    dIASSERT(!m_object_initialized);
+
+    bool init_result = false;
+
+#if dxFUTEX_AVAILABLE
+    init_result = true;
+#else
+    bool mutex_initialized = false;
+
+    do
+    {
+        int mutex_result = pthread_mutex_init(&m_wakeup_mutex, NULL);
+        if (mutex_result != EOK)
+        {
+            errno = mutex_result;
+            break;
+        }
+
+        mutex_initialized = true;
+
+        int cond_result = pthread_cond_init(&m_wakeup_cond, NULL);
+        if (cond_result != EOK)
+        {
+            errno = cond_result;
+            break;
+        }
+
+        init_result = true;
+    }
+    while (false);
+
+    if (!init_result && mutex_initialized)
+    {
+        int mutex_destroy_result = pthread_mutex_destroy(&m_wakeup_mutex);
+        dICHECK(mutex_destroy_result == EOK || ((errno = mutex_destroy_result), false));
+    }
+#endif
+
+    m_object_initialized = init_result;
+    return init_result;
+}
+
+void dxFutexEventCount::DoFinalizeObject()
+{
+    if (m_object_initialized)
+    {
+        dIASSERT(m_waiter_count == 0);
+
+#if !dxFUTEX_AVAILABLE
+        int cond_result = pthread_cond_destroy(&m_wakeup_cond);
+        dICHECK(cond_result == EOK || ((errno = cond_result), false));
+
+        int mutex_result = pthread_mutex_destroy(&m_wakeup_mutex);
+        dICHECK(mutex_result == EOK || ((errno = mutex_result), false));
+#endif
+
+        m_object_initialized = false;
+    }
+}
+
+
+dxFutexEventCount::eventepoch_t dxFutexEventCount::PrepareToWait()
+{
+    // The increment is a memory barrier, so the epoch and the later checks are not read early
+    dxOUAtomicsProvider::IncrementTargetNoRet(&m_waiter_count);
+    return m_wait_epoch;
+}
+
+void dxFutexEventCount::CancelWaiting()
+{
+    dxOUAtomicsProvider::DecrementTargetNoRet(&m_waiter_count);
+}
+
+void dxFutexEventCount::CommitWaiting(eventepoch_t wait_epoch)
+{
+#if dxFUTEX_AVAILABLE
+    while (m_wait_epoch == wait_epoch)
+    {
+        // The call returns at once if the epoch has already changed
+        long futex_result = syscall(SYS_futex, (int *)&m_wait_epoch, FUTEX_WAIT_PRIVATE, (int)wait_epoch, NULL, NULL, 0);
+        dICHECK(futex_result == 0 || errno == EAGAIN || errno == EINTR);
+    }
+#else
+    int lock_result = pthread_mutex_lock(&m_wakeup_mutex);
+    dICHECK(lock_result == EOK || ((errno = lock_result), false));
+
+    while (m_wait_epoch == wait_epoch)
+    {
+        int cond_result = pthread_cond_wait(&m_wakeup_cond, &m_wakeup_mutex);
+        dICHECK(cond_result == EOK || ((errno = cond_result), false));
+    }
+
+    int unlock_result = pthread_mutex_unlock(&m_wakeup_mutex);
+    dICHECK(unlock_result == EOK || ((errno = unlock_result), false));
+#endif
+
+    dxOUAtomicsProvider::DecrementTargetNoRet(&m_waiter_count);
+}
+
+void dxFutexEventCount::WakeupAThread()
+{
+    // The callers make their jobs visible with an atomic operation, 
+    // so the waiter count is read after them
+    if (m_waiter_count != 0)
+    {
+        WakeupWaiters(false);
+    }
+}
+
+void dxFutexEventCount::WakeupAllThreads()
+{
+    WakeupWaiters(true);
+}
+
+void dxFutexEventCount::WakeupWaiters(bool wake_all)
+{
+#if dxFUTEX_AVAILABLE
+    dxOUAtomicsProvider::IncrementTargetNoRet(&m_wait_epoch);
+
+    long futex_result = syscall(SYS_futex, (int *)&m_wait_epoch, FUTEX_WAKE_PRIVATE, wake_all ? INT_MAX : 1, NULL, NULL, 0);
+    dICHECK(futex_result >= 0);
+#else
+    int lock_result = pthread_mutex_lock(&m_wakeup_mutex);
+    dICHECK(lock_result == EOK || ((errno = lock_result), false));
+
+    dxOUAtomicsProvider::IncrementTargetNoRet(&m_wait_epoch);
+
+    int signal_result = wake_all ? pthread_cond_broadcast(&m_wakeup_cond) : pthread_cond_signal(&m_wakeup_cond);
+    dICHECK(signal_result == EOK || ((errno = signal_result), false));
+
+    int unlock_result = pthread_mutex_unlock(&m_wakeup_mutex);
+    dICHECK(unlock_result == EOK || ((errno = unlock_result), false));
+#endif
+}
+
+/*static */void dxFutexEventCount::PauseSpinning()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#endif
+}
+
+
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
@@ -572,6 +844,15 @@ typedef dxtemplateJobListThreadedHandler<dxCondvarWakeup, dxMultiThreadedJobList
 typedef dxtemplateThreadingImplementation<dxMultiThreadedJobListContainer, dxMultiThreadedJobListHandler> dxMultiThreadedThreading;
 
 
+/************************************************************************/
+/* Work-stealing job list definition                                    */
+/************************************************************************/
+
+typedef dxtemplateJobStealingContainer<dxtemplateThreadedLull<dxCondvarWakeup, dxOUAtomicsProvider, false>, dxMutexMutex, dxOUAtomicsProvider, dxPthreadKeyPointer> dxWorkStealingJobListContainer;
+typedef dxtemplateJobStealingHandler<dxCondvarWakeup, dxFutexEventCount, dxWorkStealingJobListContainer> dxWorkStealingJobListHandler;
+typedef dxtemplateThreadingImplementation<dxWorkStealingJobListContainer, dxWorkStealingJobListHandler> dxWorkStealingThreading;
+
+
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
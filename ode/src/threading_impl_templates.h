@@ -206,31 +206,76 @@ private:
 };
 
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-class dxtemplateJobListContainer
+class dxtemplateJobInfoPool
 {
 public:
-    dxtemplateJobListContainer():
-        m_job_list(NULL),
+    dxtemplateJobInfoPool():
         m_info_pool((atomicptr_t)NULL),
         m_pool_access_lock(),
-        m_list_access_lock(),
         m_info_wait_lull(),
         m_info_count_known_to_be_preallocated(0)
     {
     }
 
+    ~dxtemplateJobInfoPool()
+    {
+        FreeJobInfoPoolInfos();
+        DoFinalizeObject();
+    }
+
+    bool InitializeObject() { return DoInitializeObject(); }
+
+private:
+    bool DoInitializeObject() { return m_pool_access_lock.InitializeObject() && m_info_wait_lull.InitializeObject(); }
+    void DoFinalizeObject() { /* Do nothing */ }
+
+private:
+    typedef typename tAtomicsProvider::atomicptr_t atomicptr_t;
+    typedef dxtemplateThreadingLockHelper<tThreadMutex> dxMutexLockHelper;
+
+public:
+    dxThreadedJobInfo *ExtractJobInfoFromPoolOrAllocate();
+    inline void ReleaseJobInfoIntoPool(dxThreadedJobInfo *job_instance);
+
+private:
+    void FreeJobInfoPoolInfos();
+
+public:
+    bool EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count);
+
+private:
+    bool DoPreallocateJobInfos(ddependencycount_t required_info_count);
+
+private:
+    volatile atomicptr_t    m_info_pool; // dxThreadedJobInfo *
+    tThreadMutex            m_pool_access_lock;
+    tThreadLull             m_info_wait_lull;
+    ddependencycount_t      m_info_count_known_to_be_preallocated;
+};
+
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
+class dxtemplateJobListContainer
+{
+public:
+    dxtemplateJobListContainer():
+        m_job_list(NULL),
+        m_info_pool(),
+        m_list_access_lock()
+    {
+    }
+
     ~dxtemplateJobListContainer()
     {
         dIASSERT(m_job_list == NULL); // Would not it be nice to wait for jobs to complete before deleting the list?
 
-        FreeJobInfoPoolInfos();
         DoFinalizeObject();
     }
 
     bool InitializeObject() { return DoInitializeObject(); }
 
 private:
-    bool DoInitializeObject() { return m_pool_access_lock.InitializeObject() && m_list_access_lock.InitializeObject() && m_info_wait_lull.InitializeObject(); }
+    bool DoInitializeObject() { return m_info_pool.InitializeObject() && m_list_access_lock.InitializeObject(); }
     void DoFinalizeObject() { /* Do nothing */ }
 
 public:
@@ -263,28 +308,18 @@ private:
     inline void InsertJobInfoIntoListHead(dxThreadedJobInfo *job_instance);
     inline void RemoveJobInfoFromList(dxThreadedJobInfo *job_instance);
 
-    dxThreadedJobInfo *ExtractJobInfoFromPoolOrAllocate();
-    inline void ReleaseJobInfoIntoPool(dxThreadedJobInfo *job_instance);
-
-private:
-    void FreeJobInfoPoolInfos();
-
 public:
-    bool EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count);
-
-private:
-    bool DoPreallocateJobInfos(ddependencycount_t required_info_count);
+    bool EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count) { return m_info_pool.EnsureNumberOfJobInfosIsPreallocated(required_info_count); }
 
 public:
     bool IsJobListReadyForShutdown() const { return m_job_list == NULL; }
 
 private:
+    typedef dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider> dxJobInfoPool;
+
     dxThreadedJobInfo       *m_job_list;
-    volatile atomicptr_t    m_info_pool; // dxThreadedJobInfo *
-    tThreadMutex            m_pool_access_lock;
+    dxJobInfoPool           m_info_pool;
     tThreadMutex            m_list_access_lock;
-    tThreadLull             m_info_wait_lull;
-    ddependencycount_t      m_info_count_known_to_be_preallocated;
 };
 
 
@@ -359,6 +394,220 @@ private:
 };
 
 
+/*
+ *  Work-stealing job scheduling. Every thread serving the implementation owns 
+ *  a deque of ready jobs which it pushes and pops at the bottom while idle 
+ *  threads steal from the top of the others. Jobs posted from threads that 
+ *  do not serve the implementation go to a lock-free injection stack which 
+ *  the serving threads take over as a whole. Jobs waiting for dependencies 
+ *  are not kept in any list - the thread that releases the last dependency 
+ *  pushes the job into its own deque. Idle threads spin for a while looking 
+ *  for jobs and then sleep on an event count.
+ */
+
+enum
+{
+    dxJOB_DEQUE_CAPACITY = 256, // Jobs a deque holds, the excess goes into the injection stack
+    dxJOB_WORKER_INFO_CACHE_LIMIT = 64, // Job infos a worker keeps for its own posts
+    dxJOB_STEALING_MAX_WORKERS = 64, // Threads to get a deque, the rest only steal
+    dxJOB_STEALING_IDLE_SPIN_COUNT = 256 // Job lookups of an idle thread before it goes to sleep
+};
+
+template<class tAtomicsProvider>
+class dxtemplateJobDeque
+{
+public:
+    dxtemplateJobDeque(): m_top(0), m_bottom(0) {}
+
+private:
+    typedef typename tAtomicsProvider::atomicord_t atomicord_t;
+
+public:
+    // Owner thread only
+    bool PushJob(dxThreadedJobInfo *job_instance);
+    dxThreadedJobInfo *PopJob();
+
+    // Any thread
+    dxThreadedJobInfo *StealJob();
+    bool IsDequeEmpty() const { return (int)(atomicord_t)(m_bottom - m_top) <= 0; }
+
+private:
+    volatile atomicord_t    m_top;
+    volatile atomicord_t    m_bottom;
+    dxThreadedJobInfo       *volatile m_jobs[dxJOB_DEQUE_CAPACITY];
+};
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+class dxtemplateJobStealingContainer
+{
+public:
+    dxtemplateJobStealingContainer():
+        m_injected_jobs((atomicptr_t)NULL),
+        m_worker_count(0),
+        m_info_pool(),
+        m_current_worker()
+    {
+        for (unsigned worker_index = 0; worker_index != dxJOB_STEALING_MAX_WORKERS; ++worker_index)
+        {
+            m_workers[worker_index] = (atomicptr_t)NULL;
+        }
+    }
+
+    ~dxtemplateJobStealingContainer()
+    {
+        dIASSERT(IsJobListReadyForShutdown());
+
+        FreeWorkers();
+        DoFinalizeObject();
+    }
+
+    bool InitializeObject() { return DoInitializeObject(); }
+
+private:
+    bool DoInitializeObject() { return m_info_pool.InitializeObject() && m_current_worker.InitializeObject(); }
+    void DoFinalizeObject() { /* Do nothing */ }
+
+public:
+    typedef tAtomicsProvider dxAtomicsProvider;
+    typedef typename tAtomicsProvider::atomicord_t atomicord_t;
+    typedef typename tAtomicsProvider::atomicptr_t atomicptr_t;
+    typedef tThreadMutex dxThreadMutex;
+    typedef void dWaitSignallingFunction(void *job_call_wait);
+
+private:
+    struct dxJobWorker:
+        public dBase
+    {
+        dxJobWorker(): m_job_deque(), m_info_cache(NULL), m_info_cache_count(0), m_worker_claimed(1), m_steal_start(0) {}
+
+        dxtemplateJobDeque<tAtomicsProvider> m_job_deque;
+        dxThreadedJobInfo       *m_info_cache;
+        unsigned                m_info_cache_count;
+        volatile atomicord_t    m_worker_claimed;
+        unsigned                m_steal_start;
+    };
+
+public:
+    void AttachWorkerThread();
+    void DetachWorkerThread();
+
+private:
+    dxJobWorker *GetCurrentWorker() const { return (dxJobWorker *)m_current_worker.GetPointerValue(); }
+    dxJobWorker *GetWorker(unsigned worker_index) const { return (dxJobWorker *)m_workers[worker_index]; }
+    unsigned GetWorkerSlotCount() const { atomicord_t worker_count = m_worker_count; return worker_count < dxJOB_STEALING_MAX_WORKERS ? (unsigned)worker_count : (unsigned)dxJOB_STEALING_MAX_WORKERS; }
+
+    void FreeWorkers();
+
+public:
+    dxThreadedJobInfo *ReleaseAJobAndPickNextPendingOne(
+        dxThreadedJobInfo *job_to_release, bool job_result, dWaitSignallingFunction *wait_signal_proc_ptr, 
+        bool &out_last_job_flag);
+
+private:
+    dxThreadedJobInfo *PickNextPendingJob(dxJobWorker *worker, bool &out_last_job_flag);
+    void ReleaseAJob(dxJobWorker *worker, dxThreadedJobInfo *job_instance, bool job_result, dWaitSignallingFunction *wait_signal_proc_ptr);
+
+    dxThreadedJobInfo *TakeInjectedJobs(dxJobWorker *worker);
+    dxThreadedJobInfo *StealJobFromOtherWorkers(dxJobWorker *worker);
+
+public:
+    inline dxThreadedJobInfo *AllocateJobInfoFromPool();
+    void QueueJobForProcessing(dxThreadedJobInfo *job_instance);
+
+    void AlterJobProcessingDependencies(dxThreadedJobInfo *job_instance, ddependencychange_t dependencies_count_change, 
+        bool &out_job_has_become_ready);
+
+private:
+    inline ddependencycount_t SmartAddJobDependenciesCount(dxThreadedJobInfo *job_instance, ddependencychange_t dependencies_count_change);
+
+    void PlaceReadyJob(dxJobWorker *worker, dxThreadedJobInfo *job_instance);
+    void PushJobChainIntoInjectionStack(dxThreadedJobInfo *first_job, dxThreadedJobInfo *last_job);
+
+    inline void ReleaseJobInfo(dxJobWorker *worker, dxThreadedJobInfo *job_instance);
+
+public:
+    bool EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count) { return m_info_pool.EnsureNumberOfJobInfosIsPreallocated(required_info_count); }
+
+public:
+    bool AreAnyJobsReady() const;
+    bool IsJobListReadyForShutdown() const { return !AreAnyJobsReady(); }
+
+private:
+    typedef dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider> dxJobInfoPool;
+
+    volatile atomicptr_t    m_injected_jobs; // dxThreadedJobInfo *
+    volatile atomicptr_t    m_workers[dxJOB_STEALING_MAX_WORKERS]; // dxJobWorker *
+    volatile atomicord_t    m_worker_count;
+    dxJobInfoPool           m_info_pool;
+    tThreadLocalPointer     m_current_worker; // dxJobWorker *
+};
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+class dxtemplateJobStealingHandler
+{
+public:
+    dxtemplateJobStealingHandler(tJobListContainer *list_container_ptr):
+        m_job_list_ptr(list_container_ptr),
+        m_idle_event_count(),
+        m_active_thread_count(0),
+        m_shutdown_requested(0)
+    {
+    }
+
+    ~dxtemplateJobStealingHandler()
+    {
+        dIASSERT(m_active_thread_count == 0);
+
+        DoFinalizeObject();
+    }
+
+    bool InitializeObject() { return DoInitializeObject(); }
+
+private:
+    bool DoInitializeObject() { return m_idle_event_count.InitializeObject(); }
+    void DoFinalizeObject() { /* Do nothing */ }
+
+public:
+    typedef dxtemplateCallWait<tThreadWakeup> dxCallWait;
+
+public:
+    inline void ProcessActiveJobAddition();
+    inline void PrepareForWaitingAJobCompletion();
+
+public:
+    inline unsigned RetrieveActiveThreadsCount();
+    inline void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/);
+
+private:
+    void PerformJobProcessingUntilShutdown();
+    void PerformJobProcessingSession();
+
+    void BlockAsIdleThread();
+    void ActivateAnIdleThread();
+
+public:
+    inline void ShutdownProcessing();
+    inline void CleanupForRestart();
+
+private:
+    bool IsShutdownRequested() const { return m_shutdown_requested != 0; }
+
+private:
+    typedef typename tJobListContainer::dxAtomicsProvider dxAtomicsProvider;
+    typedef typename tJobListContainer::atomicord_t atomicord_t;
+
+    atomicord_t GetActiveThreadsCount() const { return m_active_thread_count; }
+    void RegisterAsActiveThread() { dxAtomicsProvider::template AddValueToTarget<sizeof(atomicord_t)>((volatile void *)&m_active_thread_count, 1); }
+    void UnregisterAsActiveThread() { dxAtomicsProvider::template AddValueToTarget<sizeof(atomicord_t)>((volatile void *)&m_active_thread_count, -1); }
+
+private:
+    tJobListContainer       *m_job_list_ptr;
+    tIdleEventCount         m_idle_event_count;
+    volatile atomicord_t    m_active_thread_count;
+    volatile int            m_shutdown_requested;
+};
+
+
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
@@ -660,22 +909,24 @@ void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::Re
             break;
         }
 
-        void *job_call_wait = current_job->m_call_wait;
+        int call_fault = current_job->m_call_fault;
 
-        if (job_call_wait != NULL)
+        // The fault accumulator must be assigned before the wait is signaled
+        // as it may reside in the stack frame of the waiting thread
+        if (current_job->m_fault_accumulator_ptr)
         {
-            wait_signal_proc_ptr(job_call_wait);
+            *current_job->m_fault_accumulator_ptr = call_fault;
         }
 
-        int call_fault = current_job->m_call_fault;
+        void *job_call_wait = current_job->m_call_wait;
 
-        if (current_job->m_fault_accumulator_ptr)
+        if (job_call_wait != NULL)
         {
-            *current_job->m_fault_accumulator_ptr = call_fault;
+            wait_signal_proc_ptr(job_call_wait);
         }
 
         dxThreadedJobInfo *dependent_job = current_job->m_dependent_job;
-        ReleaseJobInfoIntoPool(current_job);
+        m_info_pool.ReleaseJobInfoIntoPool(current_job);
 
         if (dependent_job == NULL)
         {
@@ -697,7 +948,7 @@ template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
 dxThreadedJobInfo *dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::AllocateJobInfoFromPool()
 {
     // No locking is necessary
-    dxThreadedJobInfo *job_instance = ExtractJobInfoFromPoolOrAllocate();
+    dxThreadedJobInfo *job_instance = m_info_pool.ExtractJobInfoFromPoolOrAllocate();
     return job_instance;
 }
 
@@ -763,8 +1014,12 @@ void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::Re
     job_instance->m_prev_job_next_ptr = NULL;
 }
 
+/************************************************************************/
+/* Implementation of dxtemplateJobInfoPool                              */
+/************************************************************************/
+
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-dxThreadedJobInfo *dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::ExtractJobInfoFromPoolOrAllocate()
+dxThreadedJobInfo *dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider>::ExtractJobInfoFromPoolOrAllocate()
 {
     dxThreadedJobInfo *result_info;
 
@@ -818,7 +1073,7 @@ dxThreadedJobInfo *dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomic
 }
 
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::ReleaseJobInfoIntoPool(
+void dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider>::ReleaseJobInfoIntoPool(
     dxThreadedJobInfo *job_instance)
 {
     while (true)
@@ -836,7 +1091,7 @@ void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::Re
 }
 
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::FreeJobInfoPoolInfos()
+void dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider>::FreeJobInfoPoolInfos()
 {
     dxThreadedJobInfo *current_info = (dxThreadedJobInfo *)m_info_pool;
 
@@ -852,7 +1107,7 @@ void dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::Fr
 }
 
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-bool dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count)
+bool dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider>::EnsureNumberOfJobInfosIsPreallocated(ddependencycount_t required_info_count)
 {
     bool result = required_info_count <= m_info_count_known_to_be_preallocated 
         || DoPreallocateJobInfos(required_info_count);
@@ -860,7 +1115,7 @@ bool dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::En
 }
 
 template<class tThreadLull, class tThreadMutex, class tAtomicsProvider>
-bool dxtemplateJobListContainer<tThreadLull, tThreadMutex, tAtomicsProvider>::DoPreallocateJobInfos(ddependencycount_t required_info_count)
+bool dxtemplateJobInfoPool<tThreadLull, tThreadMutex, tAtomicsProvider>::DoPreallocateJobInfos(ddependencycount_t required_info_count)
 {
     dIASSERT(required_info_count > m_info_count_known_to_be_preallocated); // Also ensures required_info_count > 0
 
@@ -1022,6 +1277,642 @@ void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::Cleanup
 }
 
 
+/************************************************************************/
+/* Implementation of dxtemplateJobDeque                                 */
+/************************************************************************/
+
+template<class tAtomicsProvider>
+bool dxtemplateJobDeque<tAtomicsProvider>::PushJob(dxThreadedJobInfo *job_instance)
+{
+    bool push_result = false;
+
+    atomicord_t bottom = m_bottom;
+    atomicord_t top = m_top; // A stale top value can only make the deque look fuller
+
+    if ((int)(atomicord_t)(bottom - top) < dxJOB_DEQUE_CAPACITY)
+    {
+        m_jobs[bottom % dxJOB_DEQUE_CAPACITY] = job_instance;
+
+        // The exchange is a memory barrier that makes the job visible before the new bottom
+        tAtomicsProvider::ExchangeTargetValue(&m_bottom, bottom + 1);
+
+        push_result = true;
+    }
+
+    return push_result;
+}
+
+template<class tAtomicsProvider>
+dxThreadedJobInfo *dxtemplateJobDeque<tAtomicsProvider>::PopJob()
+{
+    atomicord_t bottom = m_bottom - 1;
+
+    // The bottom must be published before the top is read for the thieves to see the claim
+    tAtomicsProvider::ExchangeTargetValue(&m_bottom, bottom);
+
+    atomicord_t top = m_top;
+    int jobs_left = (int)(atomicord_t)(bottom - top);
+
+    dxThreadedJobInfo *popped_job = NULL;
+
+    if (jobs_left >= 0)
+    {
+        popped_job = m_jobs[bottom % dxJOB_DEQUE_CAPACITY];
+
+        if (jobs_left == 0)
+        {
+            // The last job could be being stolen at the same time
+            if (!tAtomicsProvider::CompareExchangeTargetValue(&m_top, top, top + 1))
+            {
+                popped_job = NULL;
+            }
+
+            m_bottom = top + 1;
+        }
+    }
+    else
+    {
+        m_bottom = top;
+    }
+
+    return popped_job;
+}
+
+template<class tAtomicsProvider>
+dxThreadedJobInfo *dxtemplateJobDeque<tAtomicsProvider>::StealJob()
+{
+    dxThreadedJobInfo *stolen_job = NULL;
+
+    while (true)
+    {
+        // Query values with memory barriers so that the job is read after the bottom
+        atomicord_t top = tAtomicsProvider::QueryTargetValue(&m_top);
+        atomicord_t bottom = tAtomicsProvider::QueryTargetValue(&m_bottom);
+
+        if ((int)(atomicord_t)(bottom - top) <= 0)
+        {
+            break;
+        }
+
+        dxThreadedJobInfo *top_job = m_jobs[top % dxJOB_DEQUE_CAPACITY];
+
+        if (tAtomicsProvider::CompareExchangeTargetValue(&m_top, top, top + 1))
+        {
+            stolen_job = top_job;
+            break;
+        }
+    }
+
+    return stolen_job;
+}
+
+
+/************************************************************************/
+/* Implementation of dxtemplateJobStealingContainer                     */
+/************************************************************************/
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::AttachWorkerThread()
+{
+    dxJobWorker *worker = NULL;
+
+    // Take over a deque of a thread that has left first
+    const unsigned slot_count = GetWorkerSlotCount();
+
+    for (unsigned worker_index = 0; worker_index != slot_count; ++worker_index)
+    {
+        dxJobWorker *slot_worker = GetWorker(worker_index);
+
+        if (slot_worker != NULL && slot_worker->m_worker_claimed == 0 
+            && tAtomicsProvider::CompareExchangeTargetValue(&slot_worker->m_worker_claimed, 0, 1))
+        {
+            worker = slot_worker;
+            break;
+        }
+    }
+
+    if (worker == NULL)
+    {
+        atomicord_t worker_index = (atomicord_t)tAtomicsProvider::template AddValueToTarget<sizeof(atomicord_t)>((volatile void *)&m_worker_count, 1);
+
+        // A thread without a deque is still able to process jobs by stealing them
+        if (worker_index < dxJOB_STEALING_MAX_WORKERS)
+        {
+            worker = new dxJobWorker();
+
+            if (worker != NULL)
+            {
+                tAtomicsProvider::ExchangeTargetPtr(&m_workers[worker_index], (atomicptr_t)worker);
+            }
+        }
+    }
+
+    m_current_worker.SetPointerValue(worker);
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::DetachWorkerThread()
+{
+    dxJobWorker *worker = GetCurrentWorker();
+
+    if (worker != NULL)
+    {
+        dIASSERT(worker->m_job_deque.IsDequeEmpty());
+
+        m_current_worker.SetPointerValue(NULL);
+        tAtomicsProvider::ExchangeTargetValue(&worker->m_worker_claimed, 0);
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::FreeWorkers()
+{
+    const unsigned slot_count = GetWorkerSlotCount();
+
+    for (unsigned worker_index = 0; worker_index != slot_count; ++worker_index)
+    {
+        dxJobWorker *worker = GetWorker(worker_index);
+
+        if (worker != NULL)
+        {
+            dIASSERT(worker->m_worker_claimed == 0);
+
+            dxThreadedJobInfo *current_info = worker->m_info_cache;
+
+            while (current_info != NULL)
+            {
+                dxThreadedJobInfo *info_save = current_info;
+                current_info = current_info->m_next_job;
+
+                delete info_save;
+            }
+
+            delete worker;
+            m_workers[worker_index] = (atomicptr_t)NULL;
+        }
+    }
+
+    m_worker_count = 0;
+}
+
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+dxThreadedJobInfo *dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::ReleaseAJobAndPickNextPendingOne(
+    dxThreadedJobInfo *job_to_release, bool job_result, dWaitSignallingFunction *wait_signal_proc_ptr, bool &out_last_job_flag)
+{
+    dxJobWorker *worker = GetCurrentWorker();
+
+    if (job_to_release != NULL)
+    {
+        ReleaseAJob(worker, job_to_release, job_result, wait_signal_proc_ptr);
+    }
+
+    dxThreadedJobInfo *picked_job = PickNextPendingJob(worker, out_last_job_flag);
+    return picked_job;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+dxThreadedJobInfo *dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::PickNextPendingJob(
+    dxJobWorker *worker, bool &out_last_job_flag)
+{
+    dxThreadedJobInfo *picked_job = worker != NULL ? worker->m_job_deque.PopJob() : NULL;
+
+    if (picked_job == NULL)
+    {
+        picked_job = TakeInjectedJobs(worker);
+
+        if (picked_job == NULL)
+        {
+            picked_job = StealJobFromOtherWorkers(worker);
+        }
+    }
+
+    if (picked_job != NULL)
+    {
+        // It is OK to assign in unsafe manner - dependencies count should not be changed
+        // after the job has become ready for execution
+        picked_job->m_dependencies_count = 1;
+        // Assign NULL to m_prev_job_next_ptr as an indicator that instance has been dequeued
+        picked_job->m_prev_job_next_ptr = NULL;
+    }
+
+    // The jobs left in the deque are for the idle threads to steal
+    out_last_job_flag = worker == NULL || worker->m_job_deque.IsDequeEmpty();
+    return picked_job;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::ReleaseAJob(
+    dxJobWorker *worker, dxThreadedJobInfo *job_instance, bool job_result, dWaitSignallingFunction *wait_signal_proc_ptr)
+{
+    dxThreadedJobInfo *current_job = job_instance;
+
+    if (!job_result)
+    {
+        // Accumulate call fault (be careful to not reset it!!!)
+        current_job->m_call_fault = 1;
+    }
+
+    bool job_dequeued = true;
+    dIASSERT(current_job->m_prev_job_next_ptr == NULL);
+
+    while (true)
+    {
+        dIASSERT(current_job->m_dependencies_count != 0);
+
+        ddependencycount_t new_dependencies_count = SmartAddJobDependenciesCount(current_job, -1);
+
+        if (new_dependencies_count != 0)
+        {
+            break;
+        }
+
+        if (!job_dequeued)
+        {
+            // The last dependency of a queued job has been released
+            PlaceReadyJob(worker, current_job);
+            break;
+        }
+
+        int call_fault = current_job->m_call_fault;
+
+        // The fault accumulator must be assigned before the wait is signaled
+        // as it may reside in the stack frame of the waiting thread
+        if (current_job->m_fault_accumulator_ptr)
+        {
+            *current_job->m_fault_accumulator_ptr = call_fault;
+        }
+
+        void *job_call_wait = current_job->m_call_wait;
+
+        if (job_call_wait != NULL)
+        {
+            wait_signal_proc_ptr(job_call_wait);
+        }
+
+        dxThreadedJobInfo *dependent_job = current_job->m_dependent_job;
+        ReleaseJobInfo(worker, current_job);
+
+        if (dependent_job == NULL)
+        {
+            break;
+        }
+
+        if (call_fault)
+        {
+            // Accumulate call fault (be careful to not reset it!!!)
+            dependent_job->m_call_fault = 1;
+        }
+
+        current_job = dependent_job;
+        job_dequeued = dependent_job->m_prev_job_next_ptr == NULL;
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+dxThreadedJobInfo *dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::TakeInjectedJobs(dxJobWorker *worker)
+{
+    dxThreadedJobInfo *picked_job = NULL;
+
+    // The whole stack is taken at once, so there is no ABA problem with the pointer exchanges
+    if (m_injected_jobs != (atomicptr_t)NULL)
+    {
+        picked_job = (dxThreadedJobInfo *)tAtomicsProvider::ExchangeTargetPtr(&m_injected_jobs, (atomicptr_t)NULL);
+    }
+
+    if (picked_job != NULL)
+    {
+        dxThreadedJobInfo *current_job = picked_job->m_next_job;
+
+        // Move the rest into the deque to be stolen from there
+        if (worker != NULL)
+        {
+            while (current_job != NULL)
+            {
+                // The next job must be read before the job can be stolen and released
+                dxThreadedJobInfo *next_job = current_job->m_next_job;
+
+                if (!worker->m_job_deque.PushJob(current_job))
+                {
+                    break;
+                }
+
+                current_job = next_job;
+            }
+        }
+
+        if (current_job != NULL)
+        {
+            dxThreadedJobInfo *last_job = current_job;
+
+            while (last_job->m_next_job != NULL)
+            {
+                last_job = last_job->m_next_job;
+            }
+
+            PushJobChainIntoInjectionStack(current_job, last_job);
+        }
+    }
+
+    return picked_job;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+dxThreadedJobInfo *dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::StealJobFromOtherWorkers(dxJobWorker *worker)
+{
+    dxThreadedJobInfo *stolen_job = NULL;
+
+    const unsigned slot_count = GetWorkerSlotCount();
+    const unsigned steal_start = worker != NULL ? worker->m_steal_start : 0;
+
+    for (unsigned slot_index = 0; slot_index != slot_count; ++slot_index)
+    {
+        unsigned worker_index = (steal_start + slot_index) % slot_count;
+        dxJobWorker *victim = GetWorker(worker_index);
+
+        if (victim != NULL && victim != worker)
+        {
+            stolen_job = victim->m_job_deque.StealJob();
+
+            if (stolen_job != NULL)
+            {
+                // Come back to the same victim next time as it is likely to have more jobs
+                if (worker != NULL)
+                {
+                    worker->m_steal_start = worker_index;
+                }
+
+                break;
+            }
+        }
+    }
+
+    return stolen_job;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+dxThreadedJobInfo *dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::AllocateJobInfoFromPool()
+{
+    dxJobWorker *worker = GetCurrentWorker();
+    dxThreadedJobInfo *job_instance = worker != NULL ? worker->m_info_cache : NULL;
+
+    if (job_instance != NULL)
+    {
+        worker->m_info_cache = job_instance->m_next_job;
+        worker->m_info_cache_count -= 1;
+    }
+    else
+    {
+        job_instance = m_info_pool.ExtractJobInfoFromPoolOrAllocate();
+    }
+
+    return job_instance;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::ReleaseJobInfo(
+    dxJobWorker *worker, dxThreadedJobInfo *job_instance)
+{
+    if (worker != NULL && worker->m_info_cache_count != dxJOB_WORKER_INFO_CACHE_LIMIT)
+    {
+        job_instance->m_next_job = worker->m_info_cache;
+        worker->m_info_cache = job_instance;
+        worker->m_info_cache_count += 1;
+    }
+    else
+    {
+        m_info_pool.ReleaseJobInfoIntoPool(job_instance);
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::QueueJobForProcessing(dxThreadedJobInfo *job_instance)
+{
+    // Any value other than NULL indicates that instance has not been dequeued yet
+    job_instance->m_prev_job_next_ptr = &job_instance->m_next_job;
+
+    // A job with dependencies is placed by the thread that releases the last of them
+    if (job_instance->m_dependencies_count == 0)
+    {
+        PlaceReadyJob(GetCurrentWorker(), job_instance);
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::AlterJobProcessingDependencies(dxThreadedJobInfo *job_instance, ddependencychange_t dependencies_count_change, 
+                                                                                                                                         bool &out_job_has_become_ready)
+{
+    // Dependencies should not be changed when job has already become ready for execution
+    dIASSERT(job_instance->m_dependencies_count != 0);
+    // It's OK that access is not atomic - that is to be handled by external logic
+    dIASSERT(dependencies_count_change < 0 ? (job_instance->m_dependencies_count >= (ddependencycount_t)(-dependencies_count_change)) : ((ddependencycount_t)(-(ddependencychange_t)job_instance->m_dependencies_count) > (ddependencycount_t)dependencies_count_change));
+
+    ddependencycount_t new_dependencies_count = SmartAddJobDependenciesCount(job_instance, dependencies_count_change);
+    out_job_has_become_ready = new_dependencies_count == 0;
+
+    if (out_job_has_become_ready)
+    {
+        dIASSERT(job_instance->m_prev_job_next_ptr != NULL);
+        PlaceReadyJob(GetCurrentWorker(), job_instance);
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+ddependencycount_t dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::SmartAddJobDependenciesCount(
+    dxThreadedJobInfo *job_instance, ddependencychange_t dependencies_count_change)
+{
+    ddependencycount_t new_dependencies_count = tAtomicsProvider::template AddValueToTarget<sizeof(ddependencycount_t)>((volatile void *)&job_instance->m_dependencies_count, dependencies_count_change) + dependencies_count_change;
+    return new_dependencies_count;
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::PlaceReadyJob(
+    dxJobWorker *worker, dxThreadedJobInfo *job_instance)
+{
+    if (worker == NULL || !worker->m_job_deque.PushJob(job_instance))
+    {
+        PushJobChainIntoInjectionStack(job_instance, job_instance);
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+void dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::PushJobChainIntoInjectionStack(
+    dxThreadedJobInfo *first_job, dxThreadedJobInfo *last_job)
+{
+    while (true)
+    {
+        dxThreadedJobInfo *head_job = (dxThreadedJobInfo *)m_injected_jobs;
+        last_job->m_next_job = head_job;
+
+        if (tAtomicsProvider::CompareExchangeTargetPtr(&m_injected_jobs, (atomicptr_t)head_job, (atomicptr_t)first_job))
+        {
+            break;
+        }
+    }
+}
+
+template<class tThreadLull, class tThreadMutex, class tAtomicsProvider, class tThreadLocalPointer>
+bool dxtemplateJobStealingContainer<tThreadLull, tThreadMutex, tAtomicsProvider, tThreadLocalPointer>::AreAnyJobsReady() const
+{
+    bool any_ready = m_injected_jobs != (atomicptr_t)NULL;
+
+    if (!any_ready)
+    {
+        const unsigned slot_count = GetWorkerSlotCount();
+
+        for (unsigned worker_index = 0; worker_index != slot_count; ++worker_index)
+        {
+            dxJobWorker *worker = GetWorker(worker_index);
+
+            if (worker != NULL && !worker->m_job_deque.IsDequeEmpty())
+            {
+                any_ready = true;
+                break;
+            }
+        }
+    }
+
+    return any_ready;
+}
+
+
+/************************************************************************/
+/* Implementation of dxtemplateJobStealingHandler                       */
+/************************************************************************/
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::ProcessActiveJobAddition()
+{
+    ActivateAnIdleThread();
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::PrepareForWaitingAJobCompletion()
+{
+    // Do nothing
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+unsigned dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::RetrieveActiveThreadsCount()
+{
+    return GetActiveThreadsCount();
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/)
+{
+    RegisterAsActiveThread();
+    m_job_list_ptr->AttachWorkerThread();
+
+    if (readiness_callback != NULL)
+    {
+        (*readiness_callback)(callback_context);
+    }
+
+    PerformJobProcessingUntilShutdown();
+
+    m_job_list_ptr->DetachWorkerThread();
+    UnregisterAsActiveThread();
+}
+
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::PerformJobProcessingUntilShutdown()
+{
+    while (true)
+    {
+        // It is expected that new jobs will not be queued any longer after shutdown had been requested
+        if (IsShutdownRequested() && m_job_list_ptr->IsJobListReadyForShutdown())
+        {
+            break;
+        }
+
+        PerformJobProcessingSession();
+
+        // It is expected that new jobs will not be queued any longer after shutdown had been requested
+        if (IsShutdownRequested() && m_job_list_ptr->IsJobListReadyForShutdown())
+        {
+            break;
+        }
+
+        BlockAsIdleThread();
+    }
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::PerformJobProcessingSession()
+{
+    dxThreadedJobInfo *current_job = NULL;
+    bool job_result = false;
+
+    while (true)
+    {
+        bool last_job_flag;
+        current_job = m_job_list_ptr->ReleaseAJobAndPickNextPendingOne(current_job, job_result, &dxCallWait::AbstractSignalTheWait, last_job_flag);
+
+        if (!current_job)
+        {
+            break;
+        }
+
+        if (!last_job_flag)
+        {
+            ActivateAnIdleThread();
+        }
+
+        job_result = current_job->InvokeCallFunction();
+    }
+}
+
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::BlockAsIdleThread()
+{
+    // Jobs tend to come in bursts, so look for them for a while before going to sleep
+    for (unsigned spin_index = 0; spin_index != dxJOB_STEALING_IDLE_SPIN_COUNT; ++spin_index)
+    {
+        if (m_job_list_ptr->AreAnyJobsReady() || IsShutdownRequested())
+        {
+            return;
+        }
+
+        tIdleEventCount::PauseSpinning();
+    }
+
+    typename tIdleEventCount::eventepoch_t wait_epoch = m_idle_event_count.PrepareToWait();
+
+    // The jobs queued before the epoch had been read are seen here and the later ones change the epoch
+    if (m_job_list_ptr->AreAnyJobsReady() || IsShutdownRequested())
+    {
+        m_idle_event_count.CancelWaiting();
+    }
+    else
+    {
+        m_idle_event_count.CommitWaiting(wait_epoch);
+    }
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::ActivateAnIdleThread()
+{
+    m_idle_event_count.WakeupAThread();
+}
+
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::ShutdownProcessing()
+{
+    m_shutdown_requested = true;
+    m_idle_event_count.WakeupAllThreads();
+}
+
+template<class tThreadWakeup, class tIdleEventCount, class tJobListContainer>
+void dxtemplateJobStealingHandler<tThreadWakeup, tIdleEventCount, tJobListContainer>::CleanupForRestart()
+{
+    m_shutdown_requested = false;
+}
+
+
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
@@ -263,6 +263,9 @@ typedef dxtemplateJobListContainer<dxtemplateThreadedLull<dxEventWakeup, dxOUAto
 typedef dxtemplateJobListThreadedHandler<dxEventWakeup, dxMultiThreadedJobListContainer> dxMultiThreadedJobListHandler;
 typedef dxtemplateThreadingImplementation<dxMultiThreadedJobListContainer, dxMultiThreadedJobListHandler> dxMultiThreadedThreading;
 
+// The work-stealing scheduler has not been ported to Windows yet, the shared job list is used instead
+typedef dxMultiThreadedThreading dxWorkStealingThreading;
+
 
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
@@ -26,6 +26,10 @@
 
 #include "odeou.h"
 
+#if !dTHREADING_INTF_DISABLED && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 
 #if !dTHREADING_INTF_DISABLED
 
@@ -41,6 +45,12 @@ atomicord32 ThrsafeExchange(volatile atomicord32 *paoDestination, atomicord32 ao
     return AtomicExchange(paoDestination, aoExchange);
 }
 
+static inline 
+atomicord32 ThrsafeExchangeAdd(volatile atomicord32 *paoDestination, atomicord32 aoAddend)
+{
+    return AtomicExchangeAdd(paoDestination, aoAddend);
+}
+
 static inline 
 bool ThrsafeCompareExchangePointer(volatile atomicptr *papDestination, atomicptr apComparand, atomicptr apExchange)
 {
@@ -53,6 +63,18 @@ atomicptr ThrsafeExchangePointer(volatile atomicptr *papDestination, atomicptr a
     return AtomicExchangePointer(papDestination, apExchange);
 }
 
+// OU has no 64-bit operations, the compiler's are used for the counters
+// that must not wrap on 32-bit targets
+static inline 
+bool ThrsafeCompareExchange64(volatile duint64 *puiDestination, duint64 uiComparand, duint64 uiExchange)
+{
+#if defined(_MSC_VER)
+    return (duint64)_InterlockedCompareExchange64((volatile __int64 *)puiDestination, (__int64)uiExchange, (__int64)uiComparand) == uiComparand;
+#else
+    return __sync_bool_compare_and_swap(puiDestination, uiComparand, uiExchange);
+#endif
+}
+
 
 #else // #if dTHREADING_INTF_DISABLED
 
@@ -70,6 +92,14 @@ atomicord32 ThrsafeExchange(volatile atomicord32 *paoDestination, atomicord32 ao
     return aoDestinationValue;
 }
 
+static inline 
+atomicord32 ThrsafeExchangeAdd(volatile atomicord32 *paoDestination, atomicord32 aoAddend)
+{
+    atomicord32 aoDestinationValue = *paoDestination;
+    *paoDestination = aoDestinationValue + aoAddend;
+    return aoDestinationValue;
+}
+
 static inline 
 bool ThrsafeCompareExchangePointer(volatile atomicptr *papDestination, atomicptr apComparand, atomicptr apExchange)
 {
@@ -84,6 +114,12 @@ atomicptr ThrsafeExchangePointer(volatile atomicptr *papDestination, atomicptr a
     return apDestinationValue;
 }
 
+static inline 
+bool ThrsafeCompareExchange64(volatile duint64 *puiDestination, duint64 uiComparand, duint64 uiExchange)
+{
+    return (*puiDestination == uiComparand) ? ((*puiDestination = uiExchange), true) : false;
+}
+
 
 #endif // #if dTHREADING_INTF_DISABLED
 
@@ -104,6 +140,32 @@ unsigned int ThrsafeIncrementIntUpToLimit(volatile unsigned int *storagePointer,
     return resultValue;
 }
 
+static inline 
+size_t ThrsafeAddSize(volatile size_t *storagePointer, size_t addend)
+{
+    size_t resultValue;
+    while (true) {
+        resultValue = *storagePointer;
+        if (ThrsafeCompareExchangePointer((volatile atomicptr *)storagePointer, (atomicptr)resultValue, (atomicptr)(resultValue + addend))) {
+            break;
+        }
+    }
+    return resultValue;
+}
+
+static inline 
+duint64 ThrsafeAddUint64(volatile duint64 *storagePointer, duint64 addend)
+{
+    duint64 resultValue;
+    while (true) {
+        resultValue = *storagePointer;
+        if (ThrsafeCompareExchange64(storagePointer, resultValue, resultValue + addend)) {
+            break;
+        }
+    }
+    return resultValue;
+}
+
 static inline 
 size_t ThrsafeIncrementSizeUpToLimit(volatile size_t *storagePointer, size_t limitValue)
 {
@@ -120,6 +182,18 @@ size_t ThrsafeIncrementSizeUpToLimit(volatile size_t *storagePointer, size_t lim
     return resultValue;
 }
 
+// picks one of slotCount slots for the calling thread from its stack
+// address, so that threads mostly use different slots of shared arrays
+static inline 
+unsigned dGetThreadSlot(unsigned slotCount)
+{
+    // stacks of threads are pages apart, the multiplication mixes the
+    // differing bits of the page number into the high bits
+    int local;
+    const unsigned page = (unsigned)((size_t)&local >> 12);
+    return ((page * 2654435761u) >> 24) % slotCount;
+}
+
 
 
 #endif // _ODE_THREADINGUTILS_H_
@@ -171,15 +171,38 @@ double dTimerTicksPerSecond()
 #endif
 
 //****************************************************************************
-// otherwise, do the implementation based on gettimeofday().
+// otherwise, do the implementation based on clock_gettime() with the
+// monotonic clock where the system has it, or on gettimeofday().
 
 #if !defined(PENTIUM) && !defined(WIN32)
 
 #ifndef macintosh
 
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(CLOCK_MONOTONIC)
+#define dTIMER_CLOCK_GETTIME
+#endif
+
+#ifdef dTIMER_CLOCK_GETTIME
+
+// cc[0] is nanoseconds here, so the count has nanosecond resolution and is
+// not thrown off by adjustments of the wall clock.
+#define dTIMER_TICKS_PER_SECOND 1000000000
+
+static inline void getClockCount (unsigned long cc[2])
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC,&ts);
+    cc[0] = ts.tv_nsec;
+    cc[1] = ts.tv_sec;
+}
+
+#else // !dTIMER_CLOCK_GETTIME
+
+#define dTIMER_TICKS_PER_SECOND 1000000
 
 static inline void getClockCount (unsigned long cc[2])
 {
@@ -189,8 +212,12 @@ static inline void getClockCount (unsigned long cc[2])
     cc[1] = tv.tv_sec;
 }
 
+#endif // dTIMER_CLOCK_GETTIME
+
 #else // macintosh
 
+#define dTIMER_TICKS_PER_SECOND 1000000
+
 #include <CoreServices/CoreServices.h>
 #include <ode/Timer.h>
 
@@ -212,7 +239,7 @@ static inline void serialize()
 
 static inline double loadClockCount (unsigned long a[2])
 {
-    return a[1]*1.0e6 + a[0];
+    return a[1]*double(dTIMER_TICKS_PER_SECOND) + a[0];
 }
 
 
@@ -236,7 +263,7 @@ double dTimerResolution()
 
 double dTimerTicksPerSecond()
 {
-    return 1000000;
+    return dTIMER_TICKS_PER_SECOND;
 }
 
 #endif
@@ -26,6 +26,7 @@
 #include "joints/joint.h"
 #include "util.h"
 #include "threadingutils.h"
+#include "stepbody_kernels.h"
 
 #include <new>
 
@@ -33,6 +34,9 @@
 #define dMIN(A,B)  ((A)>(B) ? (B) : (A))
 #define dMAX(A,B)  ((B)>(A) ? (B) : (A))
 
+// number of bodies integrated before their geoms are notified
+#define dxSTEPBODIES_CHUNK_SIZE 64
+
 
 //****************************************************************************
 // Malloc based world stepping memory manager
@@ -336,6 +340,73 @@ void dxWorldProcessContext::UnlockForStepbodySerialization()
 }
 
 
+//****************************************************************************
+// step statistics
+
+static inline dxStepStatisticsShard &dxGetStepStatisticsShard(dxWorld *world)
+{
+    return world->step_stats_shards[dGetThreadSlot(dSTEP_STATISTICS_SHARDS)];
+}
+
+void dxStepStageTimer::SwitchEnabled(dxStepStage stage)
+{
+    if (m_stage != dxSTEP__NONE) {
+        dStopwatchStop(&m_stopwatch);
+
+        // stages of different islands and threads add to the shard of their thread
+        const size_t nanoseconds = (size_t)(dStopwatchTime(&m_stopwatch) * 1e9 + 0.5);
+        ThrsafeAddSize(&dxGetStepStatisticsShard(m_world).stage_time[m_stage], nanoseconds);
+    }
+
+    m_stage = stage;
+
+    if (stage != dxSTEP__NONE) {
+        dStopwatchReset(&m_stopwatch);
+        dStopwatchStart(&m_stopwatch);
+    }
+}
+
+void dxAddStepStatisticsRows (dxWorld *world, unsigned int m)
+{
+    if (world->step_stats_enabled) {
+        dxStepStatisticsShard &shard = dxGetStepStatisticsShard(world);
+        ThrsafeAddSize(&shard.rows, m);
+
+        size_t maxRows;
+        while ((maxRows = shard.max_island_rows) < m) {
+            if (ThrsafeCompareExchangePointer((volatile atomicptr *)&shard.max_island_rows, (atomicptr)maxRows, (atomicptr)(size_t)m)) {
+                break;
+            }
+        }
+    }
+}
+
+void dxFoldStepStatistics (dxWorld *world)
+{
+    static double dWorldStepStatistics::*const stageTimes[dxSTEP__MAX] = {
+        &dWorldStepStatistics::stage0_bodies_time,  // dxSTEP_STAGE0_BODIES
+        &dWorldStepStatistics::stage0_joints_time,  // dxSTEP_STAGE0_JOINTS
+        &dWorldStepStatistics::stage1_time,         // dxSTEP_STAGE1
+        &dWorldStepStatistics::stage2a_time,        // dxSTEP_STAGE2A
+        &dWorldStepStatistics::stage2b_time,        // dxSTEP_STAGE2B
+        &dWorldStepStatistics::stage2c_time,        // dxSTEP_STAGE2C
+        &dWorldStepStatistics::stage3_time,         // dxSTEP_STAGE3
+        &dWorldStepStatistics::lcp_time,            // dxSTEP_LCP
+        &dWorldStepStatistics::integration_time,    // dxSTEP_INTEGRATION
+    };
+
+    dWorldStepStatistics &stats = world->step_stats;
+    for (unsigned i = 0; i != dSTEP_STATISTICS_SHARDS; ++i) {
+        const dxStepStatisticsShard &shard = world->step_stats_shards[i];
+        for (unsigned stage = 0; stage != dxSTEP__MAX; ++stage) {
+            stats.*stageTimes[stage] += shard.stage_time[stage] * 1e-9;
+        }
+        stats.rows += (unsigned int)shard.rows;
+        if (shard.max_island_rows > stats.max_island_rows) stats.max_island_rows = (unsigned int)shard.max_island_rows;
+    }
+}
+
+
 //****************************************************************************
 // Threading call contexts
 
@@ -376,6 +447,31 @@ struct dxIslandsProcessingCallContext
 };
 
 
+// integrates the bodies of all the islands once they have been stepped,
+// the chunks of dxSTEPBODIES_CHUNK_SIZE bodies being taken by the threads
+// in turn
+struct dxStepBodiesCallContext
+{
+    dxStepBodiesCallContext(dxWorld *world, dxBody *const *body, unsigned int nb, dReal stepSize):
+        m_world(world), m_body(body), m_nb(nb), m_stepSize(stepSize), m_chunkToProcessStorage(0)
+    {
+    }
+
+    unsigned int GetChunkCount() const { return (m_nb + (dxSTEPBODIES_CHUNK_SIZE - 1)) / dxSTEPBODIES_CHUNK_SIZE; }
+
+    static int ThreadedProcessGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+
+    static int ThreadedProcessJob_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    void ThreadedProcessJob();
+
+    dxWorld                         *const m_world;
+    dxBody *const                   *const m_body;
+    unsigned int                    const m_nb;
+    dReal                           const m_stepSize;
+    size_t                          volatile m_chunkToProcessStorage;
+};
+
+
 struct dxSingleIslandCallContext
 {
     dxSingleIslandCallContext(dxIslandsProcessingCallContext *islandsProcessingContext, 
@@ -392,10 +488,10 @@ struct dxSingleIslandCallContext
         m_islandIndex = islandIndex; 
     }
 
-    void AssignIslandSelection(dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, 
+    void AssignIslandSelection(size_t islandOrdinal, dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, 
         unsigned islandBodiesCount, unsigned islandJointsCount)
     {
-        m_stepperCallContext.AssignIslandSelection(islandBodiesStart, islandJointsStart, islandBodiesCount, islandJointsCount);
+        m_stepperCallContext.AssignIslandSelection(islandOrdinal, islandBodiesStart, islandJointsStart, islandBodiesCount, islandJointsCount);
     }
 
     dxBody *const *GetSelectedIslandBodiesEnd() const { return m_stepperCallContext.GetSelectedIslandBodiesEnd(); }
@@ -575,102 +671,88 @@ static inline dReal sinc (dReal x)
 }
 
 
-// given a body b, apply its linear and angular rotation over the time
-// interval h, thereby adjusting its position and orientation.
+// cap the angular velocity of a body flagged with dxBodyMaxAngularSpeed
 
-void dxStepBody (dxBody *b, dReal h)
+static inline void dxStepBodyCapAngularSpeed (dxBody *b)
 {
-    // cap the angular velocity
-    if (b->flags & dxBodyMaxAngularSpeed) {
-        const dReal max_ang_speed = b->max_angular_speed;
-        const dReal aspeed = dCalcVectorDot3( b->avel, b->avel );
-        if (aspeed > max_ang_speed*max_ang_speed) {
-            const dReal coef = max_ang_speed/dSqrt(aspeed);
-            dScaleVector3(b->avel, coef);
-        }
+    const dReal max_ang_speed = b->max_angular_speed;
+    const dReal aspeed = dCalcVectorDot3( b->avel, b->avel );
+    if (aspeed > max_ang_speed*max_ang_speed) {
+        const dReal coef = max_ang_speed/dSqrt(aspeed);
+        dScaleVector3(b->avel, coef);
     }
-    // end of angular velocity cap
+}
 
 
+// given a body b flagged with dxBodyFlagFiniteRotation, apply its linear
+// and angular rotation over the time interval h, thereby adjusting its
+// position and orientation.
+
+static void dxStepBodyFiniteRotation (dxBody *b, dReal h)
+{
     // handle linear velocity
     for (unsigned int j=0; j<3; j++) b->posr.pos[j] += h * b->lvel[j];
 
-    if (b->flags & dxBodyFlagFiniteRotation) {
-        dVector3 irv;	// infitesimal rotation vector
-        dQuaternion q;	// quaternion for finite rotation
-
-        if (b->flags & dxBodyFlagFiniteRotationAxis) {
-            // split the angular velocity vector into a component along the finite
-            // rotation axis, and a component orthogonal to it.
-            dVector3 frv;		// finite rotation vector
-            dReal k = dCalcVectorDot3 (b->finite_rot_axis,b->avel);
-            frv[0] = b->finite_rot_axis[0] * k;
-            frv[1] = b->finite_rot_axis[1] * k;
-            frv[2] = b->finite_rot_axis[2] * k;
-            irv[0] = b->avel[0] - frv[0];
-            irv[1] = b->avel[1] - frv[1];
-            irv[2] = b->avel[2] - frv[2];
-
-            // make a rotation quaternion q that corresponds to frv * h.
-            // compare this with the full-finite-rotation case below.
-            h *= REAL(0.5);
-            dReal theta = k * h;
-            q[0] = dCos(theta);
-            dReal s = sinc(theta) * h;
-            q[1] = frv[0] * s;
-            q[2] = frv[1] * s;
-            q[3] = frv[2] * s;
-        }
-        else {
-            // make a rotation quaternion q that corresponds to w * h
-            dReal wlen = dSqrt (b->avel[0]*b->avel[0] + b->avel[1]*b->avel[1] +
-                b->avel[2]*b->avel[2]);
-            h *= REAL(0.5);
-            dReal theta = wlen * h;
-            q[0] = dCos(theta);
-            dReal s = sinc(theta) * h;
-            q[1] = b->avel[0] * s;
-            q[2] = b->avel[1] * s;
-            q[3] = b->avel[2] * s;
-        }
-
-        // do the finite rotation
-        dQuaternion q2;
-        dQMultiply0 (q2,q,b->q);
-        for (unsigned int j=0; j<4; j++) b->q[j] = q2[j];
-
-        // do the infitesimal rotation if required
-        if (b->flags & dxBodyFlagFiniteRotationAxis) {
-            dReal dq[4];
-            dWtoDQ (irv,b->q,dq);
-            for (unsigned int j=0; j<4; j++) b->q[j] += h * dq[j];
-        }
+    dVector3 irv;	// infitesimal rotation vector
+    dQuaternion q;	// quaternion for finite rotation
+
+    if (b->flags & dxBodyFlagFiniteRotationAxis) {
+        // split the angular velocity vector into a component along the finite
+        // rotation axis, and a component orthogonal to it.
+        dVector3 frv;		// finite rotation vector
+        dReal k = dCalcVectorDot3 (b->finite_rot_axis,b->avel);
+        frv[0] = b->finite_rot_axis[0] * k;
+        frv[1] = b->finite_rot_axis[1] * k;
+        frv[2] = b->finite_rot_axis[2] * k;
+        irv[0] = b->avel[0] - frv[0];
+        irv[1] = b->avel[1] - frv[1];
+        irv[2] = b->avel[2] - frv[2];
+
+        // make a rotation quaternion q that corresponds to frv * h.
+        // compare this with the full-finite-rotation case below.
+        h *= REAL(0.5);
+        dReal theta = k * h;
+        q[0] = dCos(theta);
+        dReal s = sinc(theta) * h;
+        q[1] = frv[0] * s;
+        q[2] = frv[1] * s;
+        q[3] = frv[2] * s;
     }
     else {
-        // the normal way - do an infitesimal rotation
+        // make a rotation quaternion q that corresponds to w * h
+        dReal wlen = dSqrt (b->avel[0]*b->avel[0] + b->avel[1]*b->avel[1] +
+            b->avel[2]*b->avel[2]);
+        h *= REAL(0.5);
+        dReal theta = wlen * h;
+        q[0] = dCos(theta);
+        dReal s = sinc(theta) * h;
+        q[1] = b->avel[0] * s;
+        q[2] = b->avel[1] * s;
+        q[3] = b->avel[2] * s;
+    }
+
+    // do the finite rotation
+    dQuaternion q2;
+    dQMultiply0 (q2,q,b->q);
+    for (unsigned int j=0; j<4; j++) b->q[j] = q2[j];
+
+    // do the infitesimal rotation if required
+    if (b->flags & dxBodyFlagFiniteRotationAxis) {
         dReal dq[4];
-        dWtoDQ (b->avel,b->q,dq);
+        dWtoDQ (irv,b->q,dq);
         for (unsigned int j=0; j<4; j++) b->q[j] += h * dq[j];
     }
 
     // normalize the quaternion and convert it to a rotation matrix
     dNormalize4 (b->q);
     dQtoR (b->q,b->posr.R);
+}
 
-    // notify all attached geoms that this body has moved
-    dxWorldProcessContext *world_process_context = b->world->UnsafeGetWorldProcessingContext(); 
-    for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom)) {
-        world_process_context->LockForStepbodySerialization();
-        dGeomMoved (geom);
-        world_process_context->UnlockForStepbodySerialization();
-    }
 
-    // notify the user
-    if (b->moved_callback != NULL) {
-        b->moved_callback(b);
-    }
+// apply the velocity damping of a body after it has moved
 
-    // damping
+static inline void dxStepBodyDamping (dxBody *b)
+{
     if (b->flags & dxBodyLinearDamping) {
         const dReal lin_threshold = b->dampingp.linear_threshold;
         const dReal lin_speed = dCalcVectorDot3( b->lvel, b->lvel );
@@ -690,6 +772,109 @@ void dxStepBody (dxBody *b, dReal h)
 }
 
 
+static void dxStepBodiesLanes (dxStepBodyLanes *lanes, dxBody *const *laneBodies, unsigned int laneCount, dReal h)
+{
+    // unused lanes keep the values of the previous block, which are valid
+    dxStepBodyLanes_Integrate (lanes, h);
+
+    for (unsigned int l = 0; l != laneCount; ++l) {
+        dxBody *b = laneBodies[l];
+        for (unsigned int j = 0; j != 3; ++j) b->posr.pos[j] = lanes->pos[j][l];
+        for (unsigned int j = 0; j != 4; ++j) b->q[j] = lanes->q[j][l];
+        dReal *R = b->posr.R;
+        R[0] = lanes->R[0][l]; R[1] = lanes->R[1][l]; R[2] = lanes->R[2][l]; R[3] = REAL(0.0);
+        R[4] = lanes->R[3][l]; R[5] = lanes->R[4][l]; R[6] = lanes->R[5][l]; R[7] = REAL(0.0);
+        R[8] = lanes->R[6][l]; R[9] = lanes->R[7][l]; R[10] = lanes->R[8][l]; R[11] = REAL(0.0);
+    }
+}
+
+
+// given a list of bodies, apply their linear and angular rotation over the
+// time interval h, thereby adjusting their positions and orientations.
+// dxProcessIslands() passes the bodies of all the islands of a step at once,
+// so that small islands fill the lanes together. the bodies are handled in
+// chunks: the bodies without finite
+// rotation are integrated dxSTEPBODY_LANES at a time by the kernels of
+// stepbody_kernels.h, and the geoms of the chunk are notified in one pass
+// after all its bodies have moved, followed by the user callbacks and the
+// damping.
+
+void dxStepBodies (dxBody *const *body, unsigned int nb, dReal h)
+{
+    if (nb == 0) {
+        return;
+    }
+
+    dxWorldProcessContext *world_process_context = body[0]->world->UnsafeGetWorldProcessingContext(); 
+
+    dxStepBodyLanes lanes;
+    dxBody *laneBodies[dxSTEPBODY_LANES];
+    memset(&lanes, 0, sizeof(lanes));
+    for (unsigned int l = 0; l != dxSTEPBODY_LANES; ++l) lanes.q[0][l] = REAL(1.0);
+
+    for (unsigned int chunkStart = 0; chunkStart < nb; chunkStart += dxSTEPBODIES_CHUNK_SIZE) {
+        dxBody *const *const chunk = body + chunkStart;
+        const unsigned int chunkSize = dMIN(nb - chunkStart, (unsigned int)dxSTEPBODIES_CHUNK_SIZE);
+        bool chunkHasGeoms = false;
+
+        unsigned int laneCount = 0;
+        for (unsigned int i = 0; i != chunkSize; ++i) {
+            dxBody *b = chunk[i];
+
+            if (b->flags & dxBodyMaxAngularSpeed) {
+                dxStepBodyCapAngularSpeed (b);
+            }
+
+            if (b->flags & dxBodyFlagFiniteRotation) {
+                dxStepBodyFiniteRotation (b, h);
+            }
+            else {
+                for (unsigned int j = 0; j != 3; ++j) {
+                    lanes.pos[j][laneCount] = b->posr.pos[j];
+                    lanes.lvel[j][laneCount] = b->lvel[j];
+                    lanes.avel[j][laneCount] = b->avel[j];
+                }
+                for (unsigned int j = 0; j != 4; ++j) lanes.q[j][laneCount] = b->q[j];
+                laneBodies[laneCount] = b;
+
+                if (++laneCount == dxSTEPBODY_LANES) {
+                    dxStepBodiesLanes (&lanes, laneBodies, laneCount, h);
+                    laneCount = 0;
+                }
+            }
+
+            chunkHasGeoms = chunkHasGeoms || b->geom != NULL;
+        }
+
+        if (laneCount != 0) {
+            dxStepBodiesLanes (&lanes, laneBodies, laneCount, h);
+        }
+
+        // notify all attached geoms that their bodies have moved
+        if (chunkHasGeoms) {
+            world_process_context->LockForStepbodySerialization();
+            for (unsigned int i = 0; i != chunkSize; ++i) {
+                for (dxGeom *geom = chunk[i]->geom; geom; geom = dGeomGetBodyNext (geom)) {
+                    dGeomMoved (geom);
+                }
+            }
+            world_process_context->UnlockForStepbodySerialization();
+        }
+
+        for (unsigned int i = 0; i != chunkSize; ++i) {
+            dxBody *b = chunk[i];
+
+            // notify the user
+            if (b->moved_callback != NULL) {
+                b->moved_callback(b);
+            }
+
+            dxStepBodyDamping (b);
+        }
+    }
+}
+
+
 //****************************************************************************
 // island processing
 
@@ -701,6 +886,279 @@ enum dxISLANDSIZESELEMENT
     dxISE__MAX
 };
 
+//****************************************************************************
+// island connectivity
+//
+// the bodies of a world are linked into disjoint sets (union-find) by their
+// enabled joints that are not in joint groups. the links are kept across the 
+// steps: joints that get attached or enabled just join the sets of their 
+// bodies, while the detachment, destruction or disabling of such a joint may
+// split a set, so it invalidates the links and they are rebuilt at the next 
+// step. the rebuild may run in multiple threads. the kinematic state of the 
+// bodies is not looked at: a joint between kinematic bodies only joins their 
+// islands, it does not add any constraint rows.
+//
+// joints in groups (contacts, mostly) are usually destroyed at every step, 
+// so they are not kept in the links. they join the sets of their bodies 
+// for the step only, by island_step_parent links between the set roots which
+// are valid in the step they are stamped with, and their removal costs nothing.
+
+enum
+{
+    dxISLANDLINKS_BLOCK_SIZE = 256,                                 // joints picked by a thread at a time
+    dxISLANDLINKS_PARALLEL_MIN_JOINTS = 16 * dxISLANDLINKS_BLOCK_SIZE // fewer joints are linked serially
+};
+
+static inline 
+dxBody *dxIslandLinksFind (dxBody *b)
+{
+    dxBody *parent;
+    while ((parent = b->island_parent) != b) {
+        // path halving
+        dxBody *grandparent = parent->island_parent;
+        b->island_parent = grandparent;
+        b = grandparent;
+    }
+    return b;
+}
+
+static inline 
+void dxIslandLinksUnion (dxBody *b1, dxBody *b2)
+{
+    dxBody *root1 = dxIslandLinksFind(b1);
+    dxBody *root2 = dxIslandLinksFind(b2);
+    if (root1 != root2) {
+        // link the root with the higher address to the one with the lower address, 
+        // the same way as the concurrent version does
+        if ((size_t)root1 < (size_t)root2) {
+            root2->island_parent = root1;
+        } else {
+            root1->island_parent = root2;
+        }
+    }
+}
+
+static inline 
+dxBody *dxIslandLinksFindConcurrently (dxBody *b)
+{
+    while (true) {
+        dxBody *parent = *(dxBody *volatile *)&b->island_parent;
+        if (parent == b) {
+            break;
+        }
+        dxBody *grandparent = *(dxBody *volatile *)&parent->island_parent;
+        if (grandparent != parent) {
+            // path halving. the link may only be changed if it has not been changed by another thread.
+            ThrsafeCompareExchangePointer((volatile atomicptr *)&b->island_parent, (atomicptr)parent, (atomicptr)grandparent);
+        }
+        b = grandparent;
+    }
+    return b;
+}
+
+static 
+void dxIslandLinksUnionConcurrently (dxBody *b1, dxBody *b2)
+{
+    dxBody *root1 = b1, *root2 = b2;
+    while (true) {
+        root1 = dxIslandLinksFindConcurrently(root1);
+        root2 = dxIslandLinksFindConcurrently(root2);
+        if (root1 == root2) {
+            break;
+        }
+        // roots are always linked to lower addresses to prevent cycles. 
+        // the link only succeeds if the root has not been linked elsewhere meanwhile.
+        if ((size_t)root1 < (size_t)root2) {
+            if (ThrsafeCompareExchangePointer((volatile atomicptr *)&root2->island_parent, (atomicptr)root2, (atomicptr)root1)) {
+                break;
+            }
+        } else {
+            if (ThrsafeCompareExchangePointer((volatile atomicptr *)&root1->island_parent, (atomicptr)root1, (atomicptr)root2)) {
+                break;
+            }
+        }
+    }
+}
+
+static inline 
+bool dxIslandLinksJointConnectsBodies (dxJoint *joint)
+{
+    return joint->node[1].body != NULL && (joint->flags & (dJOINT_DISABLED | dJOINT_INGROUP)) == 0;
+}
+
+static inline 
+bool dxIslandLinksGroupJointConnectsBodies (dxJoint *joint)
+{
+    return joint->node[1].body != NULL && (joint->flags & (dJOINT_DISABLED | dJOINT_INGROUP)) == dJOINT_INGROUP;
+}
+
+/*extern */
+void dxIslandLinksAddJoint (dxJoint *joint)
+{
+    if (joint->world->island_links_valid && dxIslandLinksJointConnectsBodies(joint)) {
+        dxIslandLinksUnion(joint->node[0].body, joint->node[1].body);
+    }
+}
+
+/*extern */
+void dxIslandLinksRemoveJoint (dxJoint *joint)
+{
+    // one of the bodies may already be detached if the joint goes with a destroyed body
+    if ((joint->flags & (dJOINT_DISABLED | dJOINT_INGROUP)) == 0 && (joint->node[0].body || joint->node[1].body)) {
+        // the bodies may get split into separate islands
+        joint->world->island_links_valid = 0;
+    }
+}
+
+// find the set that the body is in for the step, with its group joints.
+// a set root that is used the first time in the step gets its step link
+// and its tag reset.
+
+static inline 
+dxBody *dxIslandLinksFindForStep (dxBody *b, unsigned step)
+{
+    dxBody *root = dxIslandLinksFind(b);
+    if (root->island_step != step) {
+        root->island_step = step;
+        root->island_step_parent = root;
+        root->tag = 0;
+    } else {
+        dxBody *parent;
+        while ((parent = root->island_step_parent) != root) {
+            // path halving
+            dxBody *grandparent = parent->island_step_parent;
+            root->island_step_parent = grandparent;
+            root = grandparent;
+        }
+    }
+    return root;
+}
+
+static inline 
+void dxIslandLinksUnionForStep (dxBody *b1, dxBody *b2, unsigned step)
+{
+    dxBody *root1 = dxIslandLinksFindForStep(b1, step);
+    dxBody *root2 = dxIslandLinksFindForStep(b2, step);
+    if (root1 != root2) {
+        root2->island_step_parent = root1;
+    }
+}
+
+// start a new step for the island_step_parent links
+
+static 
+unsigned dxIslandLinksBeginStep (dxWorld *world)
+{
+    unsigned step = ++world->island_step;
+    if (step == 0) {
+        // the counter has wrapped around, old stamps could be taken for current
+        for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) b->island_step = 0;
+        step = world->island_step = 1;
+    }
+    return step;
+}
+
+struct dxIslandLinksCallContext
+{
+    dxIslandLinksCallContext(dxJoint *const *joints, unsigned int jointCount):
+        m_joints(joints), m_jointCount(jointCount), m_blockCount((jointCount + (dxISLANDLINKS_BLOCK_SIZE - 1)) / dxISLANDLINKS_BLOCK_SIZE), 
+        m_blockIndex(0)
+    {
+    }
+
+    static int ThreadedLinksGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    static int ThreadedLinks_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
+    void ThreadedLinks();
+
+    dxJoint *const          *m_joints;
+    unsigned int            m_jointCount;
+    unsigned int            m_blockCount;
+    volatile unsigned int   m_blockIndex;
+};
+
+int dxIslandLinksCallContext::ThreadedLinksGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxIslandLinksCallContext::ThreadedLinks_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<dxIslandLinksCallContext *>(callContext)->ThreadedLinks();
+    return true;
+}
+
+void dxIslandLinksCallContext::ThreadedLinks()
+{
+    const unsigned int blockCount = m_blockCount;
+
+    unsigned int blockIndex;
+    while ((blockIndex = ThrsafeIncrementIntUpToLimit(&m_blockIndex, blockCount)) != blockCount) {
+        const unsigned int blockBegin = blockIndex * dxISLANDLINKS_BLOCK_SIZE;
+        const unsigned int blockEnd = dMIN(blockBegin + dxISLANDLINKS_BLOCK_SIZE, m_jointCount);
+
+        dxJoint *const *const jointsEnd = m_joints + blockEnd;
+        for (dxJoint *const *jointsCurr = m_joints + blockBegin; jointsCurr != jointsEnd; ++jointsCurr) {
+            dxJoint *joint = *jointsCurr;
+            dxIslandLinksUnionConcurrently(joint->node[0].body, joint->node[1].body);
+        }
+    }
+}
+
+// rebuild the links of all bodies from scratch. 
+// jointsBuffer must have room for all the joints of the world.
+
+static 
+void dxIslandLinksRebuild (dxWorld *world, dxWorldProcessContext *context, dxJoint **jointsBuffer)
+{
+    for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) b->island_parent = b;
+
+    dxJoint **jointscurr = jointsBuffer;
+    for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) {
+        if (dxIslandLinksJointConnectsBodies(j)) {
+            *jointscurr++ = j;
+        }
+    }
+
+    unsigned int jointCount = (unsigned int)(jointscurr - jointsBuffer);
+    dIASSERT((size_t)(jointscurr - jointsBuffer) <= (size_t)UINT_MAX);
+
+    unsigned linksThreadCount = 1;
+    if (jointCount >= dxISLANDLINKS_PARALLEL_MIN_JOINTS) {
+        unsigned islandsAllowedThreadCount = world->GetThreadingIslandsMaxThreadsCount();
+        unsigned linksBlockCount = (jointCount + (dxISLANDLINKS_BLOCK_SIZE - 1)) / dxISLANDLINKS_BLOCK_SIZE;
+        linksThreadCount = dMIN(islandsAllowedThreadCount, linksBlockCount);
+    }
+
+    bool linked = false;
+
+    if (linksThreadCount > 1 && world->PreallocateResourcesForThreadedCalls(1 + linksThreadCount)) {
+        dxIslandLinksCallContext callContext(jointsBuffer, jointCount);
+        dCallWaitID pcwGroupCallWait = context->GetIslandsSteppingWait();
+
+        dCallReleaseeID groupReleasee;
+        world->PostThreadedCall(NULL, &groupReleasee, linksThreadCount, NULL, pcwGroupCallWait, 
+            &dxIslandLinksCallContext::ThreadedLinksGroup_Callback, (void *)&callContext, 0, "World Island Links Group");
+
+        world->PostThreadedCallsGroup(NULL, linksThreadCount, groupReleasee, 
+            &dxIslandLinksCallContext::ThreadedLinks_Callback, (void *)&callContext, "World Island Links");
+
+        world->WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "World Island Links Wait");
+        linked = true;
+    }
+
+    if (!linked) {
+        dxJoint *const *const jointsend = jointsBuffer + jointCount;
+        for (dxJoint *const *jointscurr = jointsBuffer; jointscurr != jointsend; ++jointscurr) {
+            dxJoint *joint = *jointscurr;
+            dxIslandLinksUnion(joint->node[0].body, joint->node[1].body);
+        }
+    }
+
+    world->island_links_valid = 1;
+}
+
+
 // This estimates dynamic memory requirements for dxProcessIslands
 static size_t EstimateIslandProcessingMemoryRequirements(dxWorld *world)
 {
@@ -713,15 +1171,16 @@ static size_t EstimateIslandProcessingMemoryRequirements(dxWorld *world)
     size_t jointssize = dEFFICIENT_SIZE((size_t)(unsigned)world->nj * sizeof(dxJoint*));
     res += bodiessize + jointssize;
 
-    size_t sesize = (bodiessize < jointssize) ? bodiessize : jointssize;
-    res += sesize;
+    size_t setislandssize = dEFFICIENT_SIZE((size_t)(unsigned)world->nb * sizeof(int));
+    size_t cursorssize = dEFFICIENT_SIZE((size_t)(unsigned)world->nb * 2 * sizeof(int));
+    res += setislandssize + cursorssize;
 
     return res;
 }
 
 static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
     dxWorldProcessIslandsInfo &islandsinfo, dxWorldProcessMemArena *memarena, 
-    dxWorld *world, dReal stepsize, dmemestimate_fn_t stepperestimate)
+    dxWorld *world, dxWorldProcessContext *context, dReal stepsize, dmemestimate_fn_t stepperestimate)
 {
     size_t maxreq = 0;
 
@@ -731,98 +1190,135 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
     unsigned int nb = world->nb, nj = world->nj;
     // Make array for island body/joint counts
     unsigned int *islandsizes = memarena->AllocateArray<unsigned int>(2 * (size_t)nb);
-    unsigned int *sizescurr;
 
     // make arrays for body and joint lists (for a single island) to go into
     dxBody **body = memarena->AllocateArray<dxBody *>(nb);
     dxJoint **joint = memarena->AllocateArray<dxJoint *>(nj);
 
-    BEGIN_STATE_SAVE(memarena, stackstate) {
-        // allocate a stack of unvisited bodies in the island. the maximum size of
-        // the stack can be the lesser of the number of bodies or joints, because
-        // new bodies are only ever added to the stack by going through untagged
-        // joints. all the bodies in the stack must be tagged!
-        unsigned int stackalloc = (nj < nb) ? nj : nb;
-        dxBody **stack = memarena->AllocateArray<dxBody *>(stackalloc);
+    if (!world->island_links_valid) {
+        // the joint list is free to be used as a temporary buffer at this point
+        dxIslandLinksRebuild(world, context, joint);
+    }
 
-        {
-            // set all body/joint tags to 0
-            for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) b->tag = 0;
-            for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) j->tag = 0;
+    unsigned int islandcount = 0;
+
+    BEGIN_STATE_SAVE(memarena, setsstate) {
+        const unsigned step = dxIslandLinksBeginStep(world);
+
+        // reset the joint tags and join the sets of the bodies of group joints for the step
+        for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) {
+            j->tag = 0;
+            if (dxIslandLinksGroupJointConnectsBodies(j)) {
+                dxIslandLinksUnionForStep(j->node[0].body, j->node[1].body, step);
+            }
         }
 
-        sizescurr = islandsizes;
-        dxBody **bodystart = body;
-        dxJoint **jointstart = joint;
-        for (dxBody *bb=world->firstbody; bb; bb=(dxBody*)bb->next) {
-            // get bb = the next enabled, untagged body, and tag it
-            if (!bb->tag) {
-                if (!(bb->flags & dxBodyDisabled)) {
-                    bb->tag = 1;
-
-                    dxBody **bodycurr = bodystart;
-                    dxJoint **jointcurr = jointstart;
-
-                    // tag all bodies and joints starting from bb.
-                    *bodycurr++ = bb;
-
-                    unsigned int stacksize = 0;
-                    dxBody *b = bb;
-
-                    while (true) {
-                        // traverse and tag all body's joints, add untagged connected bodies
-                        // to stack
-                        for (dxJointNode *n=b->firstjoint; n; n=n->next) {
-                            dxJoint *njoint = n->joint;
-                            if (!njoint->tag) {
-                                if (njoint->isEnabled()) {
-                                    njoint->tag = 1;
-                                    *jointcurr++ = njoint;
-
-                                    dxBody *nbody = n->body;
-                                    // Body disabled flag is not checked here. This is how auto-enable works.
-                                    if (nbody && nbody->tag <= 0) {
-                                        nbody->tag = 1;
-                                        // Make sure all bodies are in the enabled state.
-                                        nbody->flags &= ~dxBodyDisabled;
-                                        stack[stacksize++] = nbody;
-                                    }
-                                } else {
-                                    njoint->tag = -1; // Used in Step to prevent search over disabled joints (not needed for QuickStep so far)
-                                }
-                            }
-                        }
-                        dIASSERT(stacksize <= (unsigned int)world->nb);
-                        dIASSERT(stacksize <= (unsigned int)world->nj);
-
-                        if (stacksize == 0) {
-                            break;
-                        }
-
-                        b = stack[--stacksize];	// pop body off stack
-                        *bodycurr++ = b;	// put body on body list
+        // number the sets in the order of their first bodies and count their bodies. 
+        // the set numbers (starting from 1) go to the tags of all the bodies, and the roots.
+        // setislands records which sets have enabled bodies for now.
+        unsigned int *setislands = memarena->AllocateArray<unsigned int>(nb);
+        unsigned int setcount = 0;
+        for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) {
+            dxBody *root = dxIslandLinksFindForStep(b, step);
+            int set = root->tag;
+            if (set == 0) {
+                set = root->tag = ++setcount;
+                unsigned int *setsizes = islandsizes + (size_t)(set - 1) * dxISE__MAX;
+                setsizes[dxISE_BODIES_COUNT] = 0;
+                setsizes[dxISE_JOINTS_COUNT] = 0;
+                setislands[set - 1] = 0;
+            }
+            b->tag = set;
+            islandsizes[(size_t)(set - 1) * dxISE__MAX + dxISE_BODIES_COUNT] += 1;
+            if (!(b->flags & dxBodyDisabled)) {
+                setislands[set - 1] = 1;
+            }
+        }
+        dIASSERT(setcount <= nb);
+
+        // every set that contains an enabled body makes an island. 
+        // islands of disabled bodies only are not included in the simulation.
+        for (unsigned int set = 0; set != setcount; ++set) {
+            if (setislands[set] != 0) {
+                if (islandcount != set) {
+                    islandsizes[(size_t)islandcount * dxISE__MAX + dxISE_BODIES_COUNT] = islandsizes[(size_t)set * dxISE__MAX + dxISE_BODIES_COUNT];
+                }
+                setislands[set] = ++islandcount;
+            }
+        }
+
+        // tag and count the joints of the islands
+        for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) {
+            dxBody *b1 = j->node[0].body;
+            if (b1) {
+                dxBody *b2 = j->node[1].body;
+                unsigned int island = setislands[b1->tag - 1];
+                if (j->isEnabled()) {
+                    if (island != 0) {
+                        j->tag = island;
+                        islandsizes[(size_t)(island - 1) * dxISE__MAX + dxISE_JOINTS_COUNT] += 1;
                     }
+                } else if (island != 0 || (b2 && setislands[b2->tag - 1] != 0)) {
+                    j->tag = -1; // Used in Step to prevent search over disabled joints (not needed for QuickStep so far)
+                }
+            }
+        }
 
-                    unsigned int bcount = (unsigned int)(bodycurr - bodystart);
-                    unsigned int jcount = (unsigned int)(jointcurr - jointstart);
-                    dIASSERT((size_t)(bodycurr - bodystart) <= (size_t)UINT_MAX);
-                    dIASSERT((size_t)(jointcurr - jointstart) <= (size_t)UINT_MAX);
+        // distribute the bodies and joints over the islands, keeping the world list order
+        unsigned int *bodycursors = memarena->AllocateArray<unsigned int>(islandcount);
+        unsigned int *jointcursors = memarena->AllocateArray<unsigned int>(islandcount);
 
-                    sizescurr[dxISE_BODIES_COUNT] = bcount;
-                    sizescurr[dxISE_JOINTS_COUNT] = jcount;
-                    sizescurr += dxISE__MAX;
+        {
+            unsigned int bodystart = 0, jointstart = 0;
+            const unsigned int *sizescurr = islandsizes;
+            for (unsigned int island = 0; island != islandcount; sizescurr += dxISE__MAX, ++island) {
+                bodycursors[island] = bodystart;
+                jointcursors[island] = jointstart;
+                bodystart += sizescurr[dxISE_BODIES_COUNT];
+                jointstart += sizescurr[dxISE_JOINTS_COUNT];
+            }
+        }
 
-                    size_t islandreq = stepperestimate(bodystart, bcount, jointstart, jcount);
-                    maxreq = (maxreq > islandreq) ? maxreq : islandreq;
+        // tag the bodies of the islands and make sure all of them are in the enabled state.
+        // the bodies that are left out are disabled.
+        for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) {
+            unsigned int island = setislands[b->tag - 1];
+            if (island != 0) {
+                body[bodycursors[island - 1]++] = b;
+                b->tag = 1;
+                b->flags &= ~dxBodyDisabled;
+            } else {
+                b->tag = -1;
+            }
+        }
 
-                    bodystart = bodycurr;
-                    jointstart = jointcurr;
-                } else {
-                    bb->tag = -1; // Not used so far (assigned to retain consistency with joints)
-                }
+        for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) {
+            if (j->tag > 0) {
+                joint[jointcursors[j->tag - 1]++] = j;
+                j->tag = 1;
             }
         }
-    } END_STATE_SAVE(memarena, stackstate);
+    } END_STATE_SAVE(memarena, setsstate);
+
+    unsigned int islandbodycount;
+    {
+        dxBody **bodystart = body;
+        dxJoint **jointstart = joint;
+        const unsigned int *sizescurr = islandsizes;
+        for (unsigned int island = 0; island != islandcount; sizescurr += dxISE__MAX, ++island) {
+            unsigned int bcount = sizescurr[dxISE_BODIES_COUNT];
+            unsigned int jcount = sizescurr[dxISE_JOINTS_COUNT];
+
+            size_t islandreq = stepperestimate(bodystart, bcount, jointstart, jcount);
+            maxreq = (maxreq > islandreq) ? maxreq : islandreq;
+
+            bodystart += bcount;
+            jointstart += jcount;
+        }
+        dIASSERT((size_t)(bodystart - body) <= (size_t)nb);
+        dIASSERT((size_t)(jointstart - joint) <= (size_t)nj);
+        islandbodycount = (unsigned int)(bodystart - body);
+    }
 
 # ifndef dNODEBUG
     // if debugging, check that all objects (except for disabled bodies,
@@ -851,8 +1347,7 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
     }
 # endif
 
-    size_t islandcount = ((size_t)(sizescurr - islandsizes) / dxISE__MAX);
-    islandsinfo.AssignInfo(islandcount, islandsizes, body, joint);
+    islandsinfo.AssignInfo(islandcount, islandsizes, body, islandbodycount, joint);
 
     return maxreq;
 }
@@ -903,6 +1398,9 @@ bool dxProcessIslands (dxWorld *world, const dxWorldProcessIslandsInfo &islandsI
         dIASSERT(activeThreadCount >= islandsAllowedThreadCount);
 
         unsigned stepperAllowedThreadCount = islandsAllowedThreadCount; // For now, set stepper allowed threads equal to island stepping threads
+        if (world->step_stats_enabled) {
+            world->step_stats.allowed_threads = islandsAllowedThreadCount;
+        }
 
         unsigned simultaneousCallsCount = EstimateIslandProcessingSimultaneousCallsMaximumCount(activeThreadCount, islandsAllowedThreadCount, stepperAllowedThreadCount, maxCallCountEstimator);
         if (!world->PreallocateResourcesForThreadedCalls(simultaneousCallsCount)) {
@@ -928,6 +1426,27 @@ bool dxProcessIslands (dxWorld *world, const dxWorldProcessIslandsInfo &islandsI
             break;
         }
 
+        // update the positions and orientations of the bodies of all the islands together
+        dxStepBodiesCallContext stepBodiesContext(world, islandsInfo.GetBodiesArray(), islandsInfo.GetBodiesCount(), stepSize);
+        const unsigned stepBodiesThreadCount = dMIN(islandsAllowedThreadCount, stepBodiesContext.GetChunkCount());
+        if (stepBodiesThreadCount > 1) {
+            dCallReleaseeID stepBodiesGroupReleasee;
+            world->PostThreadedCall(&summaryFault, &stepBodiesGroupReleasee, stepBodiesThreadCount, NULL, pcwGroupCallWait, 
+                &dxStepBodiesCallContext::ThreadedProcessGroup_Callback, (void *)&stepBodiesContext, 0, "World Bodies Integration Group");
+
+            world->PostThreadedCallsGroup(NULL, stepBodiesThreadCount, stepBodiesGroupReleasee, 
+                &dxStepBodiesCallContext::ThreadedProcessJob_Callback, (void *)&stepBodiesContext, "World Bodies Integration");
+
+            world->WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "World Bodies Integration Wait");
+
+            if (summaryFault != 0) {
+                break;
+            }
+        }
+        else {
+            stepBodiesContext.ThreadedProcessJob();
+        }
+
         result = true;
     }
     while (false);
@@ -1003,7 +1522,7 @@ void dxIslandsProcessingCallContext::ThreadedProcessIslandSearch(dxSingleIslandC
 
             if (islandIndex == islandToProcess) {
                 // Store selected island details
-                stepperCallContext->AssignIslandSelection(islandBodiesStart, islandJointsStart, bcount, jcount);
+                stepperCallContext->AssignIslandSelection(islandIndex, islandBodiesStart, islandJointsStart, bcount, jcount);
 
                 // Store next island index to continue search from
                 ++islandIndex;
@@ -1061,6 +1580,31 @@ size_t dxIslandsProcessingCallContext::ObtainNextIslandToBeProcessed(size_t isla
 }
 
 
+int dxStepBodiesCallContext::ThreadedProcessGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    // Do nothing - it's just a wrapper call
+    return true;
+}
+
+int dxStepBodiesCallContext::ThreadedProcessJob_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+{
+    static_cast<dxStepBodiesCallContext *>(callContext)->ThreadedProcessJob();
+    return true;
+}
+
+void dxStepBodiesCallContext::ThreadedProcessJob()
+{
+    dxStepStageTimer stageTimer(m_world, dxSTEP_INTEGRATION);
+
+    const unsigned int chunkCount = GetChunkCount();
+    size_t chunk;
+    while ((chunk = ThrsafeIncrementSizeUpToLimit(&m_chunkToProcessStorage, chunkCount)) != chunkCount) {
+        const unsigned int chunkStart = (unsigned int)chunk * dxSTEPBODIES_CHUNK_SIZE;
+        dxStepBodies (m_body + chunkStart, dMIN(m_nb - chunkStart, (unsigned int)dxSTEPBODIES_CHUNK_SIZE), m_stepSize);
+    }
+}
+
+
 //****************************************************************************
 // World processing context management
 
@@ -1186,9 +1730,26 @@ bool dxReallocateWorldProcessContext (dxWorld *world, dxWorldProcessIslandsInfo
         }
         dIASSERT(islandsArena->IsStructureValid());
 
-        size_t stepperReq = BuildIslandsAndEstimateStepperMemoryRequirements(islandsInfo, islandsArena, world, stepSize, stepperEstimate);
+        const bool statsEnabled = world->step_stats_enabled != 0;
+        dStopwatch islandsStopwatch;
+        if (statsEnabled) {
+            dStopwatchReset(&islandsStopwatch);
+            dStopwatchStart(&islandsStopwatch);
+        }
+
+        size_t stepperReq = BuildIslandsAndEstimateStepperMemoryRequirements(islandsInfo, islandsArena, world, context, stepSize, stepperEstimate);
         dIASSERT(stepperReq == dEFFICIENT_SIZE(stepperReq));
 
+        if (statsEnabled) {
+            dStopwatchStop(&islandsStopwatch);
+
+            dWorldStepStatistics &stats = world->step_stats;
+            stats.islands_time = dStopwatchTime(&islandsStopwatch);
+            stats.islands = (unsigned int)islandsInfo.GetIslandsCount();
+            stats.islands_memory_estimate = islandsReq;
+            stats.stepper_memory_estimate = stepperReq;
+        }
+
         size_t stepperReqWithCallContext = stepperReq + dEFFICIENT_SIZE(sizeof(dxSingleIslandCallContext));
 
         unsigned islandThreadsCount = world->GetThreadingIslandsMaxThreadsCount();
@@ -23,6 +23,7 @@
 #ifndef _ODE_UTIL_H_
 #define _ODE_UTIL_H_
 
+#include <ode/timer.h>
 #include "objects.h"
 
 
@@ -61,7 +62,10 @@
 #endif
 
 void dInternalHandleAutoDisabling (dxWorld *world, dReal stepsize);
-void dxStepBody (dxBody *b, dReal h);
+void dxStepBodies (dxBody *const *body, unsigned int nb, dReal h);
+
+void dxIslandLinksAddJoint (dxJoint *joint);
+void dxIslandLinksRemoveJoint (dxJoint *joint);
 
 
 struct dxWorldProcessMemoryManager:
@@ -271,23 +275,26 @@ private:
 
 struct dxWorldProcessIslandsInfo
 {
-    void AssignInfo(size_t islandcount, unsigned int const *islandsizes, dxBody *const *bodies, dxJoint *const *joints)
+    void AssignInfo(size_t islandcount, unsigned int const *islandsizes, dxBody *const *bodies, unsigned int bodycount, dxJoint *const *joints)
     {
         m_IslandCount = islandcount;
         m_pIslandSizes = islandsizes;
         m_pBodies = bodies;
+        m_BodyCount = bodycount;
         m_pJoints = joints;
     }
 
     size_t GetIslandsCount() const { return m_IslandCount; }
     unsigned int const *GetIslandSizes() const { return m_pIslandSizes; }
     dxBody *const *GetBodiesArray() const { return m_pBodies; }
+    unsigned int GetBodiesCount() const { return m_BodyCount; } // of all the islands
     dxJoint *const *GetJointsArray() const { return m_pJoints; }
 
 private:
     size_t                  m_IslandCount;
     unsigned int const      *m_pIslandSizes;
     dxBody *const           *m_pBodies;
+    unsigned int            m_BodyCount;
     dxJoint *const          *m_pJoints;
 };
 
@@ -297,13 +304,14 @@ struct dxStepperProcessingCallContext
         dxWorldProcessMemArena *stepperArena, dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart): 
         m_world(world), m_stepSize(stepSize), m_stepperArena(stepperArena), m_finalReleasee(NULL), 
         m_islandBodiesStart(islandBodiesStart), m_islandJointsStart(islandJointsStart), m_islandBodiesCount(0), m_islandJointsCount(0),
-        m_stepperAllowedThreads(stepperAllowedThreads)
+        m_islandOrdinal(0), m_stepperAllowedThreads(stepperAllowedThreads)
     {
     }
 
-    void AssignIslandSelection(dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, 
+    void AssignIslandSelection(size_t islandOrdinal, dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, 
         unsigned islandBodiesCount, unsigned islandJointsCount)
     {
+        m_islandOrdinal = islandOrdinal;
         m_islandBodiesStart = islandBodiesStart;
         m_islandJointsStart = islandJointsStart;
         m_islandBodiesCount = islandBodiesCount;
@@ -326,9 +334,41 @@ struct dxStepperProcessingCallContext
     dxJoint *const          *m_islandJointsStart;
     unsigned                m_islandBodiesCount;
     unsigned                m_islandJointsCount;
+    size_t                  m_islandOrdinal;    // index of the island among the islands of the step
     unsigned                m_stepperAllowedThreads;
 };
 
+// measures the time spent in a stage of world stepping and adds it to
+// the step statistics shard of the calling thread, if the statistics are
+// enabled. the timer can be switched to another stage, or stopped with
+// dxSTEP__NONE.
+
+class dxStepStageTimer
+{
+public:
+    dxStepStageTimer(dxWorld *world, dxStepStage stage): m_world(world), m_stage(dxSTEP__NONE) { Switch(stage); }
+    ~dxStepStageTimer() { Switch(dxSTEP__NONE); }
+
+    void Switch(dxStepStage stage)
+    {
+        if (m_world->step_stats_enabled) {
+            SwitchEnabled(stage);
+        }
+    }
+
+private:
+    void SwitchEnabled(dxStepStage stage);
+
+private:
+    dxWorld     *m_world;
+    dxStepStage m_stage;
+    dStopwatch  m_stopwatch;
+};
+
+void dxAddStepStatisticsRows (dxWorld *world, unsigned int m);
+// adds the shards of the step statistics to the statistics of the step
+void dxFoldStepStatistics (dxWorld *world);
+
 #define BEGIN_STATE_SAVE(memarena, state) void *state = memarena->SaveState();
 #define END_STATE_SAVE(memarena, state) memarena->RestoreState(state)
 
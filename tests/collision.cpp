@@ -1,6 +1,12 @@
 #include <UnitTest++.h>
 #include <ode/ode.h>
 
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
 TEST(test_collision_trimesh_sphere_exact)
 {
     /*
@@ -125,3 +131,1298 @@ TEST(test_collision_heightfield_ray_fail)
     }
 }
 
+static float heightfieldSamples[17 * 13];
+
+static void buildTestHeightfield(dHeightfieldDataID data, int wrap)
+{
+    dRandSetSeed(5);
+    for (int i = 0; i != 17 * 13; ++i) {
+        heightfieldSamples[i] = (float)(dRandReal() * 2);
+    }
+    // a plateau far above the rest
+    for (int z = 8; z != 11; ++z) {
+        for (int x = 2; x != 5; ++x) {
+            heightfieldSamples[z * 17 + x] = 6;
+        }
+    }
+    dGeomHeightfieldDataBuildSingle(data, heightfieldSamples, 0, 16, 12, 17, 13, 1, 0, 1, wrap);
+}
+
+TEST(test_collision_heightfield_placeable_matches_local)
+{
+    /*
+     * Colliding with a rotated heightfield must give the contacts of the
+     * axis aligned heightfield moved to the heightfield frame, and must
+     * leave the other geom as it was.
+     */
+    dHeightfieldDataID data = dGeomHeightfieldDataCreate();
+    buildTestHeightfield(data, 0);
+    dGeomID local = dCreateHeightfield(0, data, 1);
+    dGeomID placed = dCreateHeightfield(0, data, 1);
+    dMatrix3 R;
+    dRFromAxisAndAngle(R, REAL(0.3), 1, REAL(0.2), REAL(0.7));
+    dGeomSetRotation(placed, R);
+    dGeomSetPosition(placed, 3, -2, 5);
+
+    dGeomID localBox = dCreateBox(0, REAL(1.5), REAL(0.7), REAL(1.1));
+    dGeomID placedBox = dCreateBox(0, REAL(1.5), REAL(0.7), REAL(1.1));
+
+    int totalContacts = 0;
+    dRandSetSeed(9);
+    for (int i = 0; i != 50; ++i) {
+        dVector3 pos = { dRandReal() * 14 - 7, dRandReal() * 2, dRandReal() * 10 - 5 }, worldPos;
+        dMatrix3 boxR, worldR;
+        dRFromAxisAndAngle(boxR, dRandReal() - REAL(0.5), dRandReal(), dRandReal() - REAL(0.5), dRandReal() * 3);
+        dGeomSetPosition(localBox, pos[0], pos[1], pos[2]);
+        dGeomSetRotation(localBox, boxR);
+        dMultiply0_331(worldPos, R, pos);
+        dMultiply0_333(worldR, R, boxR);
+        dGeomSetPosition(placedBox, worldPos[0] + 3, worldPos[1] - 2, worldPos[2] + 5);
+        dGeomSetRotation(placedBox, worldR);
+
+        dReal aabbBefore[6], aabbAfter[6];
+        dGeomGetAABB(placedBox, aabbBefore);
+        dVector3 posBefore;
+        dGeomCopyPosition(placedBox, posBefore);
+
+        dContactGeom localContacts[10], placedContacts[10];
+        int localCount = dCollide(local, localBox, 10, localContacts, sizeof(dContactGeom));
+        int placedCount = dCollide(placed, placedBox, 10, placedContacts, sizeof(dContactGeom));
+        CHECK_EQUAL(localCount, placedCount);
+        totalContacts += localCount;
+
+        for (int c = 0; c < localCount && c < placedCount; ++c) {
+            dVector3 expectedPos, expectedNormal;
+            dMultiply0_331(expectedPos, R, localContacts[c].pos);
+            dMultiply0_331(expectedNormal, R, localContacts[c].normal);
+            CHECK_CLOSE(expectedPos[0] + 3, placedContacts[c].pos[0], 1e-3);
+            CHECK_CLOSE(expectedPos[1] - 2, placedContacts[c].pos[1], 1e-3);
+            CHECK_CLOSE(expectedPos[2] + 5, placedContacts[c].pos[2], 1e-3);
+            CHECK_CLOSE(expectedNormal[0], placedContacts[c].normal[0], 1e-3);
+            CHECK_CLOSE(expectedNormal[1], placedContacts[c].normal[1], 1e-3);
+            CHECK_CLOSE(expectedNormal[2], placedContacts[c].normal[2], 1e-3);
+            CHECK_CLOSE(localContacts[c].depth, placedContacts[c].depth, 1e-3);
+            CHECK(placedContacts[c].g1 == placed && placedContacts[c].g2 == placedBox);
+        }
+
+        dGeomGetAABB(placedBox, aabbAfter);
+        CHECK_ARRAY_EQUAL(aabbBefore, aabbAfter, 6);
+        CHECK_ARRAY_EQUAL(posBefore, dGeomGetPosition(placedBox), 3);
+    }
+    CHECK(totalContacts > 0);
+
+    dGeomDestroy(localBox);
+    dGeomDestroy(placedBox);
+    dGeomDestroy(local);
+    dGeomDestroy(placed);
+    dGeomHeightfieldDataDestroy(data);
+}
+
+TEST(test_collision_heightfield_height_bounds_culling)
+{
+    /*
+     * Zones skipped by the block height bounds must not lose contacts: data
+     * with explicit bounds has no block bounds and serves as the reference.
+     */
+    for (int wrap = 0; wrap != 2; ++wrap) {
+        dHeightfieldDataID culled = dGeomHeightfieldDataCreate();
+        dHeightfieldDataID reference = dGeomHeightfieldDataCreate();
+        buildTestHeightfield(culled, wrap);
+        buildTestHeightfield(reference, wrap);
+        dGeomHeightfieldDataSetBounds(reference, 0, 6);
+        dGeomID culledField = dCreateHeightfield(0, culled, 0);
+        dGeomID referenceField = dCreateHeightfield(0, reference, 0);
+
+        int totalContacts = 0;
+        dRandSetSeed(11);
+        for (int i = 0; i != 200; ++i) {
+            dGeomID sphere = dCreateSphere(0, REAL(0.3) + dRandReal());
+            dGeomSetPosition(sphere, dRandReal() * 40 - 20, dRandReal() * 8 - 1, dRandReal() * 30 - 15);
+
+            dContactGeom culledContacts[10], referenceContacts[10];
+            int culledCount = dCollide(culledField, sphere, 10, culledContacts, sizeof(dContactGeom));
+            int referenceCount = dCollide(referenceField, sphere, 10, referenceContacts, sizeof(dContactGeom));
+            CHECK_EQUAL(referenceCount, culledCount);
+            totalContacts += referenceCount;
+
+            for (int c = 0; c < culledCount && c < referenceCount; ++c) {
+                CHECK_ARRAY_EQUAL(referenceContacts[c].pos, culledContacts[c].pos, 3);
+                CHECK_EQUAL(referenceContacts[c].depth, culledContacts[c].depth);
+            }
+            dGeomDestroy(sphere);
+        }
+        CHECK(totalContacts > 0);
+
+        dGeomDestroy(culledField);
+        dGeomDestroy(referenceField);
+        dGeomHeightfieldDataDestroy(culled);
+        dGeomHeightfieldDataDestroy(reference);
+    }
+}
+
+struct TestTileSource
+{
+    int tileSamples;
+    int loads;
+    dReal mapped[4 * 4];  // tile (0, 0) is returned without copying
+};
+
+static const dReal *loadTestTile(void *userData, int tileX, int tileZ, dReal *buffer)
+{
+    TestTileSource *source = (TestTileSource *)userData;
+    source->loads++;
+    dReal *heights = (tileX == 0 && tileZ == 0) ? source->mapped : buffer;
+    for (int z = 0; z != source->tileSamples; ++z) {
+        for (int x = 0; x != source->tileSamples; ++x) {
+            int sx = tileX * source->tileSamples + x, sz = tileZ * source->tileSamples + z;
+            heights[z * source->tileSamples + x] = (sx < 17 && sz < 13) ? heightfieldSamples[sz * 17 + sx] : 0;
+        }
+    }
+    return heights;
+}
+
+TEST(test_collision_heightfield_tiled_matches_contiguous)
+{
+    /*
+     * Tiled data must give the contacts of the same samples in one array,
+     * keep at most the requested number of tiles and load none for geoms
+     * above the tile bounds.
+     */
+    const int TileSamples = 4, TilesX = 5, TilesZ = 4, MaxResidentTiles = 4;
+    for (int wrap = 0; wrap != 2; ++wrap) {
+        dHeightfieldDataID contiguous = dGeomHeightfieldDataCreate();
+        buildTestHeightfield(contiguous, wrap);
+
+        dReal tileBounds[TilesX * TilesZ * 2];
+        for (int t = 0; t != TilesX * TilesZ; ++t) {
+            tileBounds[t * 2] = dInfinity;
+            tileBounds[t * 2 + 1] = -dInfinity;
+        }
+        for (int z = 0; z != 13; ++z) {
+            for (int x = 0; x != 17; ++x) {
+                dReal *bounds = tileBounds + ((z / TileSamples) * TilesX + x / TileSamples) * 2;
+                bounds[0] = heightfieldSamples[z * 17 + x] < bounds[0] ? heightfieldSamples[z * 17 + x] : bounds[0];
+                bounds[1] = heightfieldSamples[z * 17 + x] > bounds[1] ? heightfieldSamples[z * 17 + x] : bounds[1];
+            }
+        }
+
+        TestTileSource source;
+        source.tileSamples = TileSamples;
+        source.loads = 0;
+        dHeightfieldDataID tiled = dGeomHeightfieldDataCreate();
+        dGeomHeightfieldDataBuildTiled(tiled, &source, &loadTestTile, tileBounds, TileSamples, MaxResidentTiles,
+            16, 12, 17, 13, 1, 0, 1, wrap);
+        dGeomID contiguousField = dCreateHeightfield(0, contiguous, 0);
+        dGeomID tiledField = dCreateHeightfield(0, tiled, 0);
+
+        dContactGeom contiguousContacts[10], tiledContacts[10];
+        dGeomID sphere = dCreateSphere(0, 1);
+        dGeomSetPosition(sphere, 0, 8, 0);
+        CHECK_EQUAL(0, dCollide(tiledField, sphere, 10, tiledContacts, sizeof(dContactGeom)));
+        CHECK_EQUAL(0, source.loads);
+        // over the low tiles next to the plateau
+        dGeomSetPosition(sphere, 4, REAL(3.5), -4);
+        CHECK_EQUAL(0, dCollide(tiledField, sphere, 10, tiledContacts, sizeof(dContactGeom)));
+        CHECK_EQUAL(0, source.loads);
+        dGeomDestroy(sphere);
+
+        int totalContacts = 0;
+        dRandSetSeed(11);
+        for (int i = 0; i != 200; ++i) {
+            sphere = dCreateSphere(0, REAL(0.3) + dRandReal());
+            dGeomSetPosition(sphere, dRandReal() * 40 - 20, dRandReal() * 8 - 1, dRandReal() * 30 - 15);
+
+            int contiguousCount = dCollide(contiguousField, sphere, 10, contiguousContacts, sizeof(dContactGeom));
+            int tiledCount = dCollide(tiledField, sphere, 10, tiledContacts, sizeof(dContactGeom));
+            CHECK_EQUAL(contiguousCount, tiledCount);
+            totalContacts += contiguousCount;
+
+            for (int c = 0; c < contiguousCount && c < tiledCount; ++c) {
+                CHECK_ARRAY_EQUAL(contiguousContacts[c].pos, tiledContacts[c].pos, 3);
+                CHECK_EQUAL(contiguousContacts[c].depth, tiledContacts[c].depth);
+            }
+            CHECK(dGeomHeightfieldDataGetResidentTileCount(tiled) <= MaxResidentTiles);
+            dGeomDestroy(sphere);
+        }
+        CHECK(totalContacts > 0);
+        CHECK(source.loads > MaxResidentTiles);
+
+        dGeomDestroy(contiguousField);
+        dGeomDestroy(tiledField);
+        dGeomHeightfieldDataDestroy(contiguous);
+        dGeomHeightfieldDataDestroy(tiled);
+    }
+}
+
+
+
+TEST(test_collision_heightfield_tiled_threads_match_contiguous)
+{
+    /*
+     * Threads colliding with the same tiled data at a time must get the
+     * contacts of the contiguous data while tiles are loaded and dropped
+     * under them.
+     */
+    const int TileSamples = 4, TilesX = 5, TilesZ = 4, MaxResidentTiles = 2;
+    const int GeomCount = 400, MaxContacts = 10;
+    const unsigned ThreadCount = 4;
+
+    dHeightfieldDataID contiguous = dGeomHeightfieldDataCreate();
+    buildTestHeightfield(contiguous, 1);
+
+    dReal tileBounds[TilesX * TilesZ * 2];
+    for (int t = 0; t != TilesX * TilesZ * 2; t += 2) {
+        // loose bounds, every geom reads the samples
+        tileBounds[t] = -10;
+        tileBounds[t + 1] = 10;
+    }
+    TestTileSource source;
+    source.tileSamples = TileSamples;
+    source.loads = 0;
+    dHeightfieldDataID tiled = dGeomHeightfieldDataCreate();
+    dGeomHeightfieldDataBuildTiled(tiled, &source, &loadTestTile, tileBounds, TileSamples, MaxResidentTiles,
+        16, 12, 17, 13, 1, 0, 1, 1);
+    dGeomID contiguousField = dCreateHeightfield(0, contiguous, 0);
+    dGeomID tiledField = dCreateHeightfield(0, tiled, 0);
+
+    std::vector<dGeomPair> pairs(GeomCount);
+    dRandSetSeed(13);
+    for (int i = 0; i != GeomCount; ++i) {
+        dGeomID sphere = dCreateSphere(0, REAL(0.3) + dRandReal());
+        dGeomSetPosition(sphere, dRandReal() * 40 - 20, dRandReal() * 8 - 1, dRandReal() * 30 - 15);
+        pairs[i].o1 = tiledField;
+        pairs[i].o2 = sphere;
+    }
+
+    std::vector<dContactGeom> expected(GeomCount * MaxContacts);
+    std::vector<int> expectedCounts(GeomCount);
+    int expectedTotal = 0;
+    for (int i = 0; i != GeomCount; ++i) {
+        expectedCounts[i] = dCollide(contiguousField, pairs[i].o2, MaxContacts, &expected[i * MaxContacts], sizeof(dContactGeom));
+        expectedTotal += expectedCounts[i];
+    }
+    CHECK(expectedTotal > 0);
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+    }
+
+    std::vector<dContactGeom> contacts(GeomCount * MaxContacts);
+    std::vector<int> counts(GeomCount, -1);
+    int total = dCollideBatch(&pairs[0], GeomCount, MaxContacts, &contacts[0], sizeof(dContactGeom),
+        &counts[0], threading != NULL ? dThreadingImplementationGetFunctions(threading) : NULL, threading, ThreadCount);
+    CHECK_EQUAL(expectedTotal, total);
+    for (int i = 0; i != GeomCount; ++i) {
+        CHECK_EQUAL(expectedCounts[i], counts[i]);
+        for (int c = 0; c < expectedCounts[i] && c < counts[i]; ++c) {
+            CHECK_ARRAY_EQUAL(expected[i * MaxContacts + c].pos, contacts[i * MaxContacts + c].pos, 3);
+            CHECK_EQUAL(expected[i * MaxContacts + c].depth, contacts[i * MaxContacts + c].depth);
+        }
+    }
+    CHECK(dGeomHeightfieldDataGetResidentTileCount(tiled) <= MaxResidentTiles);
+    CHECK(source.loads > MaxResidentTiles);
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+
+    for (int i = 0; i != GeomCount; ++i) {
+        dGeomDestroy(pairs[i].o2);
+    }
+    dGeomDestroy(contiguousField);
+    dGeomDestroy(tiledField);
+    dGeomHeightfieldDataDestroy(contiguous);
+    dGeomHeightfieldDataDestroy(tiled);
+}
+
+
+typedef std::set<std::pair<size_t, size_t> > CollisionPairSet;
+
+static void collectPairCallback(void *data, dGeomID g1, dGeomID g2)
+{
+    CollisionPairSet *pairs = (CollisionPairSet *)data;
+    size_t i1 = (size_t)dGeomGetData(g1), i2 = (size_t)dGeomGetData(g2);
+    std::pair<size_t, size_t> pair(i1 < i2 ? i1 : i2, i1 < i2 ? i2 : i1);
+    // count duplicates as a pair of an index with itself, which can't occur otherwise
+    if (!pairs->insert(pair).second || i1 == i2) {
+        pairs->insert(std::make_pair(i1, i1));
+    }
+}
+
+// returns the number of mismatches found on the space
+typedef int SpaceFrameCallback(dSpaceID space, int frame);
+
+/*
+ * Drives a space and a simple space with the same geoms and checks that they
+ * report the same pairs, each of them once, for dSpaceCollide() and for
+ * repeated dSpaceCollide2() probes from small to larger than the space. The
+ * geoms are added a hundred at once and then a few at a time, move mostly in
+ * small steps and sometimes far, get disabled, replaced, removed and added
+ * back, next to long rods and geoms with infinite AABBs. The callback, if
+ * any, is called on the space after every frame. The space is destroyed.
+ * Returns the number of frames and probes where the pairs differed, plus
+ * the mismatches the callback found.
+ */
+static int checkSpaceMatchesSimpleSpace(dSpaceID space, SpaceFrameCallback *frameCallback = NULL)
+{
+    int mismatches = 0;
+    const int GeomCount = 200;
+    const int SpaceCount = 2;
+
+    dSpaceID spaces[SpaceCount] = { dSimpleSpaceCreate(0), space };
+    dGeomID geoms[SpaceCount][GeomCount], planes[SpaceCount], walls[SpaceCount], probes[SpaceCount];
+    dReal positions[GeomCount][3];
+
+    dRandSetSeed(6);
+    for (int i = 0; i != GeomCount; ++i) {
+        // a few big boxes, and rods far longer than the others along x
+        dReal size = (i % 20 == 0) ? REAL(2.5) : REAL(0.2) + dRandReal() * REAL(0.6);
+        dReal lx = (i % 25 == 0) ? REAL(12.0) : size;
+        for (int s = 0; s != SpaceCount; ++s) {
+            geoms[s][i] = dCreateBox(0, lx, size, size);
+            dGeomSetData(geoms[s][i], (void *)(size_t)i);
+        }
+        positions[i][0] = dRandReal() * 12 - 6;
+        positions[i][1] = dRandReal() * 12 - 6;
+        positions[i][2] = dRandReal() * 4 - 1;
+    }
+    for (int s = 0; s != SpaceCount; ++s) {
+        // the planes are tilted, their AABBs are infinite on every side, as
+        // the SAP space pairs infinite AABBs without testing them
+        planes[s] = dCreatePlane(spaces[s], 0, REAL(0.1), 1, 1);
+        dGeomSetData(planes[s], (void *)(size_t)GeomCount);
+        probes[s] = dCreateBox(0, 1, 1, 1);
+        dGeomSetData(probes[s], (void *)(size_t)(GeomCount + 1));
+        // a second infinite geom, added and removed on the way
+        walls[s] = dCreatePlane(0, 1, REAL(0.1), 0, 3);
+        dGeomSetData(walls[s], (void *)(size_t)(GeomCount + 2));
+    }
+
+    for (int frame = 0; frame != 16; ++frame) {
+        // a hundred geoms at once first, then a few at a time
+        int addedCount = frame == 0 ? 100 : frame < 6 ? 20 : 0;
+        for (int i = 0; i != GeomCount && addedCount != 0; ++i) {
+            if (dGeomGetSpace(geoms[0][i]) == 0) {
+                for (int s = 0; s != SpaceCount; ++s) {
+                    dSpaceAdd(spaces[s], geoms[s][i]);
+                }
+                --addedCount;
+            }
+        }
+
+        for (int i = 0; i != GeomCount; ++i) {
+            if (dRandInt(2) == 0) {
+                // mostly small steps, sometimes far
+                dReal step = dRandInt(10) == 0 ? REAL(4.0) : REAL(0.2);
+                for (int k = 0; k != 3; ++k) {
+                    positions[i][k] += (dRandReal() * 2 - 1) * step;
+                }
+            }
+            for (int s = 0; s != SpaceCount; ++s) {
+                dGeomSetPosition(geoms[s][i], positions[i][0], positions[i][1], positions[i][2]);
+            }
+        }
+
+        for (int s = 0; s != SpaceCount; ++s) {
+            if (frame == 5) {
+                dGeomDisable(geoms[s][3]);
+                dSpaceAdd(spaces[s], walls[s]);
+            }
+            if (frame == 6) {
+                dGeomDestroy(geoms[s][9]);
+                geoms[s][9] = dCreateSphere(spaces[s], REAL(0.5));
+                dGeomSetData(geoms[s][9], (void *)(size_t)9);
+            }
+            if (frame == 8) {
+                for (int i = 0; i < GeomCount; i += 7) {
+                    dSpaceRemove(spaces[s], geoms[s][i]);
+                }
+                dSpaceRemove(spaces[s], walls[s]);
+            }
+            if (frame == 11) {
+                for (int i = 0; i < GeomCount; i += 14) {
+                    dSpaceAdd(spaces[s], geoms[s][i]);
+                }
+            }
+        }
+
+        CollisionPairSet pairs[SpaceCount];
+        for (int s = 0; s != SpaceCount; ++s) {
+            dSpaceCollide(spaces[s], &pairs[s], &collectPairCallback);
+        }
+        if (pairs[0].empty() || pairs[0] != pairs[1]) {
+            ++mismatches;
+        }
+
+        // the probes repeat within a frame, from small to larger than the space
+        for (int query = 0; query != 6; ++query) {
+            dReal size = query == 5 ? REAL(30.0) : REAL(0.5) + dRandReal() * REAL(2.0);
+            dReal x = dRandReal() * 10 - 5, y = dRandReal() * 10 - 5, z = dRandReal();
+
+            CollisionPairSet probePairs[SpaceCount];
+            for (int s = 0; s != SpaceCount; ++s) {
+                dGeomBoxSetLengths(probes[s], size, size, size);
+                dGeomSetPosition(probes[s], x, y, z);
+                dSpaceCollide2((dGeomID)spaces[s], probes[s], &probePairs[s], &collectPairCallback);
+            }
+            if (probePairs[0].empty() || probePairs[0] != probePairs[1]) {
+                ++mismatches;
+            }
+        }
+
+        if (frameCallback != NULL) {
+            mismatches += frameCallback(space, frame);
+        }
+    }
+
+    for (int s = 0; s != SpaceCount; ++s) {
+        for (int i = 0; i != GeomCount; ++i) {
+            dGeomDestroy(geoms[s][i]);
+        }
+        dGeomDestroy(probes[s]);
+        dGeomDestroy(walls[s]);
+        dSpaceDestroy(spaces[s]);
+    }
+    return mismatches;
+}
+
+static int setHashSpaceLevels(dSpaceID space, int frame)
+{
+    if (frame == 8) {
+        dHashSpaceSetLevels(space, -1, 1);
+    }
+    return 0;
+}
+
+TEST(test_collision_hash_space_matches_simple_space)
+{
+    CHECK_EQUAL(0, checkSpaceMatchesSimpleSpace(dHashSpaceCreate(0), &setHashSpaceLevels));
+}
+
+
+static void collectPairBatchCallback(void *data, const dGeomPair *pairs, int count)
+{
+    for (int i = 0; i != count; ++i) {
+        collectPairCallback(data, pairs[i].o1, pairs[i].o2);
+    }
+}
+
+// counts the calls posted through a copy of the functions of an implementation
+static dThreadedCallPostFunction *originalPostCall;
+static std::map<std::string, unsigned> postedCalls;
+
+static void countingPostCall(dThreadingImplementationID impl, int *out_summary_fault,
+    dCallReleaseeID *out_post_releasee, ddependencycount_t dependencies_count, dCallReleaseeID dependent_releasee,
+    dCallWaitID call_wait, dThreadedCallFunction *call_func, void *call_context, dcallindex_t instance_index,
+    const char *call_name)
+{
+    if (call_name != NULL) {
+        ++postedCalls[call_name];
+    }
+    originalPostCall(impl, out_summary_fault, out_post_releasee, dependencies_count, dependent_releasee,
+        call_wait, call_func, call_context, instance_index, call_name);
+}
+
+static void makeCountingFunctions(dThreadingFunctionsInfo *counting, dThreadingImplementationID impl)
+{
+    *counting = *dThreadingImplementationGetFunctions(impl);
+    originalPostCall = counting->post_call;
+    counting->post_call = &countingPostCall;
+}
+
+static void mergePairs(CollisionPairSet &merged, const CollisionPairSet &pairs)
+{
+    for (CollisionPairSet::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+        // a pair reported by two threads shows up as a duplicate too
+        if (!merged.insert(*it).second) {
+            merged.insert(std::make_pair(it->first, it->first));
+        }
+    }
+}
+
+TEST(test_collision_parallel_collide_matches_serial)
+{
+    /*
+     * Every space must report the same pairs when the pair search is split 
+     * across threads, each pair once, with the callbacks and with the batches.
+     */
+    const int GeomCount = 300;
+    const unsigned ThreadCount = 4;
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    // the calls are posted through a copy of the functions that counts them
+    dThreadingFunctionsInfo countingFunctions;
+    const dThreadingFunctionsInfo *functions = NULL;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        makeCountingFunctions(&countingFunctions, threading);
+        functions = &countingFunctions;
+    }
+    postedCalls.clear();
+
+    dVector3 center = { 0, 0, 0 }, extents = { 10, 10, 10 };
+    const int SpaceCount = 6;
+    dSpaceID spaces[SpaceCount] = {
+        dSimpleSpaceCreate(0), dHashSpaceCreate(0), 
+        dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY), dQuadTreeSpaceCreate(0, center, extents, 4),
+        dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY | dSAP_INCREMENTAL), dDynamicTreeSpaceCreate(0)
+    };
+
+    dRandSetSeed(2);
+    for (int i = 0; i != GeomCount; ++i) {
+        dReal size = (i % 25 == 0) ? REAL(4.0) : REAL(0.2) + dRandReal() * REAL(0.8);
+        dReal x = dRandReal() * 16 - 8, y = dRandReal() * 16 - 8, z = dRandReal() * 4 - 1;
+        for (int s = 0; s != SpaceCount; ++s) {
+            dGeomID box = dCreateBox(spaces[s], size, size, size);
+            dGeomSetPosition(box, x, y, z);
+            dGeomSetData(box, (void *)(size_t)i);
+        }
+    }
+    for (int s = 0; s != SpaceCount; ++s) {
+        dGeomSetData(dCreatePlane(spaces[s], 0, 0, 1, 0), (void *)(size_t)GeomCount);
+        dGeomSetData(dCreatePlane(spaces[s], 0, 1, 0, -20), (void *)(size_t)(GeomCount + 1));
+    }
+
+    for (int s = 0; s != SpaceCount; ++s) {
+        CollisionPairSet serialPairs;
+        dSpaceCollide(spaces[s], &serialPairs, &collectPairCallback);
+        CHECK(!serialPairs.empty());
+
+        CollisionPairSet threadPairs[ThreadCount], batchPairs[ThreadCount];
+        void *threadData[ThreadCount], *batchData[ThreadCount];
+        for (unsigned t = 0; t != ThreadCount; ++t) {
+            threadData[t] = &threadPairs[t];
+            batchData[t] = &batchPairs[t];
+        }
+
+        dSpaceCollideParallel(spaces[s], functions, threading, threadData, ThreadCount, &collectPairCallback);
+        dSpaceCollideParallelBatched(spaces[s], functions, threading, batchData, ThreadCount, &collectPairBatchCallback);
+
+        CollisionPairSet parallelPairs, batchedPairs;
+        for (unsigned t = 0; t != ThreadCount; ++t) {
+            mergePairs(parallelPairs, threadPairs[t]);
+            mergePairs(batchedPairs, batchPairs[t]);
+        }
+
+        CHECK_EQUAL(serialPairs.size(), parallelPairs.size());
+        CHECK(serialPairs == parallelPairs);
+        CHECK_EQUAL(serialPairs.size(), batchedPairs.size());
+        CHECK(serialPairs == batchedPairs);
+    }
+
+    if (threading != NULL) {
+        // the pair search of each space and call is split over the threads
+        CHECK_EQUAL(2u * SpaceCount, postedCalls["Space Collide Group"]);
+        CHECK_EQUAL(2u * SpaceCount * ThreadCount, postedCalls["Space Collide"]);
+    }
+
+    for (int s = 0; s != SpaceCount; ++s) {
+        dSpaceDestroy(spaces[s]);
+    }
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+}
+
+struct TemporaryGeomChurn
+{
+    int pairs;
+    int mismatches;
+};
+
+static void createTemporaryGeomsCallback(void *data, dGeomID g1, dGeomID g2)
+{
+    TemporaryGeomChurn *churn = (TemporaryGeomChurn *)data;
+    churn->pairs++;
+
+    // geoms without a body, as the colliders create them, and one more that
+    // outlives them
+    const dReal *p1 = dGeomGetPosition(g1), *p2 = dGeomGetPosition(g2);
+    dGeomID kept = dCreateSphere(0, REAL(0.25));
+    dGeomSetPosition(kept, p2[0], p2[1], p2[2]);
+    for (int i = 0; i != 4; ++i) {
+        dGeomID box = dCreateBox(0, 1, 1, 1);
+        dGeomID ray = dCreateRay(0, 1);
+        dGeomSetPosition(box, p1[0] + i, p1[1], p1[2]);
+        dGeomSetPosition(ray, p2[0], p2[1] + i, p2[2]);
+        if (dGeomGetPosition(box)[0] != p1[0] + i || dGeomGetPosition(ray)[1] != p2[1] + i) {
+            churn->mismatches++;
+        }
+        dGeomDestroy(ray);
+        dGeomDestroy(box);
+    }
+    if (dGeomGetPosition(kept)[0] != p2[0] || dGeomSphereGetRadius(kept) != REAL(0.25)) {
+        churn->mismatches++;
+    }
+    dGeomDestroy(kept);
+}
+
+TEST(test_collision_geoms_created_in_threads)
+{
+    /*
+     * Geoms created and destroyed by several threads at a time must each get
+     * storage of their own.
+     */
+    const int GeomCount = 200;
+    const unsigned ThreadCount = 4;
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    const dThreadingFunctionsInfo *functions = threading != NULL ? dThreadingImplementationGetFunctions(threading) : NULL;
+    dThreadingThreadPoolID pool = NULL;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+    }
+
+    dSpaceID space = dHashSpaceCreate(0);
+    dRandSetSeed(6);
+    for (int i = 0; i != GeomCount; ++i) {
+        dGeomID sphere = dCreateSphere(space, REAL(0.5));
+        dGeomSetPosition(sphere, dRandReal() * 10, dRandReal() * 10, dRandReal() * 2);
+    }
+
+    TemporaryGeomChurn churn[ThreadCount];
+    void *threadData[ThreadCount];
+    for (unsigned t = 0; t != ThreadCount; ++t) {
+        churn[t].pairs = 0;
+        churn[t].mismatches = 0;
+        threadData[t] = &churn[t];
+    }
+    for (int repeat = 0; repeat != 10; ++repeat) {
+        dSpaceCollideParallel(space, functions, threading, threadData, ThreadCount, &createTemporaryGeomsCallback);
+    }
+
+    int pairs = 0;
+    for (unsigned t = 0; t != ThreadCount; ++t) {
+        pairs += churn[t].pairs;
+        CHECK_EQUAL(0, churn[t].mismatches);
+    }
+    CHECK(pairs > 0);
+
+    dSpaceDestroy(space);
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+}
+
+TEST(test_collision_collect_pairs_matches_collide)
+{
+    const int GeomCount = 100;
+
+    dSpaceID space = dHashSpaceCreate(0);
+
+    dRandSetSeed(3);
+    for (int i = 0; i != GeomCount; ++i) {
+        dGeomID sphere = dCreateSphere(space, REAL(0.3) + dRandReal() * REAL(0.4));
+        dGeomSetPosition(sphere, dRandReal() * 6 - 3, dRandReal() * 6 - 3, dRandReal() * 2);
+        dGeomSetData(sphere, (void *)(size_t)i);
+    }
+    dGeomSetData(dCreatePlane(space, 0, 0, 1, 0), (void *)(size_t)GeomCount);
+
+    CollisionPairSet collidePairs;
+    dSpaceCollide(space, &collidePairs, &collectPairCallback);
+
+    // count only, then collect into an array of the right size
+    int pairCount = dSpaceCollectPairs(space, NULL, 0);
+    CHECK_EQUAL((int)collidePairs.size(), pairCount);
+
+    std::vector<dGeomPair> pairs(pairCount + 1);
+    CHECK_EQUAL(pairCount, dSpaceCollectPairs(space, &pairs[0], pairCount + 1));
+
+    CollisionPairSet collectedPairs;
+    for (int i = 0; i != pairCount; ++i) {
+        collectPairCallback(&collectedPairs, pairs[i].o1, pairs[i].o2);
+    }
+    CHECK(collidePairs == collectedPairs);
+
+    // a short array gets the first pairs and the total count
+    std::vector<dGeomPair> fewPairs(pairCount / 2);
+    CHECK_EQUAL(pairCount, dSpaceCollectPairs(space, &fewPairs[0], (int)fewPairs.size()));
+    for (size_t i = 0; i != fewPairs.size(); ++i) {
+        CHECK(fewPairs[i].o1 == pairs[i].o1 && fewPairs[i].o2 == pairs[i].o2);
+    }
+
+    dSpaceDestroy(space);
+}
+
+TEST(test_collision_batch_matches_collide)
+{
+    /*
+     * Each pair must get the contacts dCollide() gives, in its own slice of
+     * the buffer, whether the pairs are collided serially or in threads.
+     */
+    const int GeomCount = 120, MaxContacts = 4;
+    const unsigned ThreadCount = 4;
+
+    dSpaceID space = dHashSpaceCreate(0);
+    dRandSetSeed(4);
+    for (int i = 0; i != GeomCount; ++i) {
+        dReal size = REAL(0.4) + dRandReal() * REAL(0.6);
+        dGeomID geom = (i % 3 == 0) ? dCreateSphere(space, size / 2)
+            : (i % 3 == 1) ? dCreateBox(space, size, size, size) : dCreateCapsule(space, size / 4, size);
+        dGeomSetPosition(geom, dRandReal() * 6 - 3, dRandReal() * 6 - 3, dRandReal() * 2);
+        dMatrix3 R;
+        dRFromAxisAndAngle(R, dRandReal(), dRandReal(), dRandReal(), dRandReal() * 3);
+        dGeomSetRotation(geom, R);
+    }
+    dCreatePlane(space, 0, 0, 1, 0);
+
+    int pairCount = dSpaceCollectPairs(space, NULL, 0);
+    std::vector<dGeomPair> pairs(pairCount + 1);
+    dSpaceCollectPairs(space, &pairs[0], pairCount);
+    // a geom paired with itself gets no contacts
+    pairs[pairCount].o1 = pairs[pairCount].o2 = pairs[0].o1;
+    ++pairCount;
+
+    std::vector<dContactGeom> expected(pairCount * MaxContacts);
+    std::vector<int> expectedCounts(pairCount);
+    int expectedTotal = 0;
+    for (int i = 0; i != pairCount; ++i) {
+        expectedCounts[i] = dCollide(pairs[i].o1, pairs[i].o2, MaxContacts, &expected[i * MaxContacts], sizeof(dContactGeom));
+        expectedTotal += expectedCounts[i];
+    }
+    CHECK(expectedTotal > 0);
+    CHECK_EQUAL(0, expectedCounts[pairCount - 1]);
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    // the collisions are posted through a copy of the functions that counts them
+    dThreadingFunctionsInfo countingFunctions;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        makeCountingFunctions(&countingFunctions, threading);
+    }
+    postedCalls.clear();
+
+    for (int threaded = 0; threaded != 2; ++threaded) {
+        std::vector<dContactGeom> contacts(pairCount * MaxContacts);
+        std::vector<int> counts(pairCount, -1);
+        int total = dCollideBatch(&pairs[0], pairCount, MaxContacts, &contacts[0], sizeof(dContactGeom),
+            &counts[0], threaded && threading != NULL ? &countingFunctions : NULL, threaded ? threading : NULL, ThreadCount);
+        CHECK_EQUAL(expectedTotal, total);
+
+        for (int i = 0; i != pairCount; ++i) {
+            CHECK_EQUAL(expectedCounts[i], counts[i]);
+            for (int c = 0; c < expectedCounts[i] && c < counts[i]; ++c) {
+                const dContactGeom &e = expected[i * MaxContacts + c], &a = contacts[i * MaxContacts + c];
+                CHECK_ARRAY_EQUAL(e.pos, a.pos, 3);
+                CHECK_ARRAY_EQUAL(e.normal, a.normal, 3);
+                CHECK_EQUAL(e.depth, a.depth);
+                CHECK(e.g1 == a.g1 && e.g2 == a.g2);
+                CHECK(e.side1 == a.side1 && e.side2 == a.side2);
+            }
+        }
+    }
+    if (threading != NULL) {
+        CHECK_EQUAL(1u, postedCalls["Collide Batch Group"]);
+        CHECK_EQUAL(ThreadCount, postedCalls["Collide Batch"]);
+    }
+
+    dSpaceDestroy(space);
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+}
+
+TEST(test_collision_incremental_sap_matches_simple_space)
+{
+    CHECK_EQUAL(0, checkSpaceMatchesSimpleSpace(dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY | dSAP_INCREMENTAL)));
+}
+
+TEST(test_collision_incremental_sap_space_aabb_covers_its_geoms)
+{
+    dSpaceID space = dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY | dSAP_INCREMENTAL);
+    dGeomID sphere = dCreateSphere(space, 1);
+    dGeomSetPosition(sphere, -2, 0, 1);
+    dGeomID box = dCreateBox(space, 2, 4, 6);
+    dGeomSetPosition(box, 3, 1, -1);
+
+    dReal aabb[6];
+    dGeomGetAABB((dGeomID)space, aabb);
+    const dReal expected[6] = { -3, 4, -1, 3, -4, 2 };
+    CHECK_ARRAY_CLOSE(expected, aabb, 6, 1e-6);
+
+    dSpaceDestroy(space);
+}
+
+TEST(test_collision_sap_space_matches_simple_space)
+{
+    CHECK_EQUAL(0, checkSpaceMatchesSimpleSpace(dSweepAndPruneSpaceCreate(0, dSAP_AXES_XYZ)));
+}
+
+TEST(test_collision_sap_space_takes_back_a_removed_geom)
+{
+    dSpaceID space = dSweepAndPruneSpaceCreate(0, dSAP_AXES_XYZ);
+    dGeomID box = dCreateBox(space, 1, 1, 1);
+    dGeomSetData(box, (void *)(size_t)1);
+    dGeomID other = dCreateBox(space, 1, 1, 1);
+    dGeomSetData(other, (void *)(size_t)2);
+    dGeomSetPosition(other, REAL(0.5), 0, 0);
+
+    CollisionPairSet pairs;
+    dSpaceCollide(space, &pairs, &collectPairCallback);
+    CHECK_EQUAL(1u, (unsigned)pairs.size());
+
+    // the collision left the geom in the clean list, the first add puts it
+    // in the dirty list, so it is removed from each of them once
+    for (int i = 0; i != 2; ++i) {
+        dSpaceRemove(space, box);
+        CHECK(dGeomGetSpace(box) == 0);
+        dSpaceAdd(space, box);
+        CHECK(dGeomGetSpace(box) == space);
+    }
+
+    pairs.clear();
+    dSpaceCollide(space, &pairs, &collectPairCallback);
+    CHECK_EQUAL(1u, (unsigned)pairs.size());
+    CHECK(pairs.count(std::make_pair((size_t)1, (size_t)2)) == 1);
+
+    dSpaceDestroy(space);
+}
+
+static void collectGeomCallback(void *data, dGeomID o)
+{
+    std::set<size_t> *geoms = (std::set<size_t> *)data;
+    geoms->insert((size_t)dGeomGetData(o));
+}
+
+/*
+ * The queries of the dynamic tree space must find the geoms whose AABBs meet
+ * a box or a segment along y, as found by brute force.
+ */
+static int checkDynamicTreeSpaceQueries(dSpaceID space, int /*frame*/)
+{
+    dReal x = dRandReal() * 10 - 5, y = dRandReal() * 10 - 5;
+    dReal probeAABB[6] = { x - REAL(1.5), x + REAL(1.5), y - REAL(1.5), y + REAL(1.5), REAL(-1.5), REAL(1.5) };
+    dVector3 origin = { dRandReal() * 10 - 5, -8, dRandReal() * 2 };
+    dVector3 dir = { 0, 1, 0 };
+    dReal length = 16;
+
+    std::set<size_t> boxFound, boxExpected, rayFound, rayExpected;
+    int boxCount = dDynamicTreeSpaceQueryAABB(space, probeAABB, &boxFound, &collectGeomCallback);
+    int rayCount = dDynamicTreeSpaceQueryRay(space, origin, dir, length, &rayFound, &collectGeomCallback);
+
+    for (int i = 0; i != dSpaceGetNumGeoms(space); ++i) {
+        dGeomID g = dSpaceGetGeom(space, i);
+        if (!dGeomIsEnabled(g)) continue;
+        dReal aabb[6];
+        dGeomGetAABB(g, aabb);
+        if (aabb[0] <= probeAABB[1] && probeAABB[0] <= aabb[1] 
+            && aabb[2] <= probeAABB[3] && probeAABB[2] <= aabb[3] 
+            && aabb[4] <= probeAABB[5] && probeAABB[4] <= aabb[5]) {
+            boxExpected.insert((size_t)dGeomGetData(g));
+        }
+        if (origin[0] >= aabb[0] && origin[0] <= aabb[1] 
+            && origin[2] >= aabb[4] && origin[2] <= aabb[5] 
+            && origin[1] + length >= aabb[2] && origin[1] <= aabb[3]) {
+            rayExpected.insert((size_t)dGeomGetData(g));
+        }
+    }
+    int mismatches = 0;
+    if ((int)boxFound.size() != boxCount || boxExpected.empty() || boxExpected != boxFound) {
+        ++mismatches;
+    }
+    if ((int)rayFound.size() != rayCount || rayExpected != rayFound) {
+        ++mismatches;
+    }
+    return mismatches;
+}
+
+TEST(test_collision_dynamic_tree_space_matches_simple_space)
+{
+    dSpaceID space = dDynamicTreeSpaceCreate(0);
+    CHECK_EQUAL(dDynamicTreeSpaceClass, dSpaceGetClass(space));
+    dDynamicTreeSpaceSetMargin(space, REAL(0.25));
+    CHECK_EQUAL(REAL(0.25), dDynamicTreeSpaceGetMargin(space));
+    CHECK_EQUAL(0, checkSpaceMatchesSimpleSpace(space, &checkDynamicTreeSpaceQueries));
+}
+
+TEST(test_collision_raycast_batch_matches_closest_collide)
+{
+    /*
+     * Every space must give each ray of a batch the closest hit that colliding
+     * the ray with all the geoms gives, also with contained spaces and
+     * disabled geoms, and when the rays are cast in parallel.
+     */
+    const int GeomCount = 400, SubGeomCount = 20;
+    const int RayCount = 600;
+    const unsigned ThreadCount = 4;
+    const dReal MaxLength = 12;
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    // the rays are posted through a copy of the functions that counts them
+    dThreadingFunctionsInfo countingFunctions;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        makeCountingFunctions(&countingFunctions, threading);
+    }
+    postedCalls.clear();
+
+    dVector3 center = { 0, 0, 0 }, extents = { 10, 10, 10 };
+    const int SpaceCount = 5;
+    dSpaceID spaces[SpaceCount] = {
+        dSimpleSpaceCreate(0), dHashSpaceCreate(0), dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY),
+        dQuadTreeSpaceCreate(0, center, extents, 4), dDynamicTreeSpaceCreate(0)
+    };
+    dSpaceID subspaces[SpaceCount];
+    for (int s = 0; s != SpaceCount; ++s) {
+        subspaces[s] = dSimpleSpaceCreate(spaces[s]);
+    }
+    std::vector<dGeomID> geoms;	// the geoms of the simple space, by index
+
+    dRandSetSeed(7);
+    for (int i = 0; i != GeomCount + SubGeomCount; ++i) {
+        dReal size = REAL(0.2) + dRandReal() * REAL(0.8);
+        dReal x = dRandReal() * 16 - 8, y = dRandReal() * 16 - 8, z = dRandReal() * 6;
+        for (int s = 0; s != SpaceCount; ++s) {
+            // the last geoms are in the contained space
+            dSpaceID space = i < GeomCount ? spaces[s] : subspaces[s];
+            dGeomID g = (i % 2 == 0) ? dCreateBox(space, size, size, size) : dCreateSphere(space, size);
+            dGeomSetPosition(g, x, y, z);
+            dGeomSetData(g, (void *)(size_t)i);
+            if (i == 11) dGeomDisable(g);
+            if (s == 0) geoms.push_back(g);
+        }
+    }
+    for (int s = 0; s != SpaceCount; ++s) {
+        dGeomID plane = dCreatePlane(spaces[s], 0, 0, 1, 0);
+        dGeomSetData(plane, (void *)(size_t)(GeomCount + SubGeomCount));
+        if (s == 0) geoms.push_back(plane);
+    }
+
+    std::vector<dReal> origins(RayCount * 3), dirs(RayCount * 3);
+    for (int r = 0; r != RayCount; ++r) {
+        origins[r * 3 + 0] = dRandReal() * 20 - 10;
+        origins[r * 3 + 1] = dRandReal() * 20 - 10;
+        origins[r * 3 + 2] = dRandReal() * 4 + 1;
+        for (int k = 0; k != 3; ++k) {
+            dirs[r * 3 + k] = dRandReal() * 2 - 1;
+        }
+    }
+
+    // the closest hit of each ray among all the geoms
+    std::vector<dRaycastHit> expected(RayCount);
+    dGeomID ray = dCreateRay(0, MaxLength);
+    dGeomRaySetClosestHit(ray, 1);
+    int expectedHitCount = 0;
+    for (int r = 0; r != RayCount; ++r) {
+        const dReal *o = &origins[r * 3], *d = &dirs[r * 3];
+        dGeomRaySet(ray, o[0], o[1], o[2], d[0], d[1], d[2]);
+        expected[r].geom = NULL;
+        expected[r].depth = MaxLength;
+        for (size_t i = 0; i != geoms.size(); ++i) {
+            dContactGeom contact;
+            if (dGeomIsEnabled(geoms[i]) && dCollide(ray, geoms[i], 1, &contact, sizeof(contact)) != 0 &&
+                contact.depth < expected[r].depth) {
+                expected[r].geom = geoms[i];
+                expected[r].depth = contact.depth;
+            }
+        }
+        if (expected[r].geom != NULL) expectedHitCount++;
+    }
+    dGeomDestroy(ray);
+    CHECK(expectedHitCount > RayCount / 4);
+
+    for (int s = 0; s != SpaceCount; ++s) {
+        for (int parallel = 0; parallel != 2; ++parallel) {
+            std::vector<dRaycastHit> hits(RayCount);
+            int hitCount = dSpaceRaycastBatch(spaces[s], &origins[0], &dirs[0], MaxLength, RayCount, &hits[0],
+                parallel && threading != NULL ? &countingFunctions : NULL, parallel ? threading : NULL, 
+                parallel ? ThreadCount : 1);
+            CHECK_EQUAL(expectedHitCount, hitCount);
+
+            for (int r = 0; r != RayCount; ++r) {
+                CHECK_EQUAL(expected[r].geom == NULL, hits[r].geom == NULL);
+                if (expected[r].geom != NULL && hits[r].geom != NULL) {
+                    CHECK_EQUAL((size_t)dGeomGetData(expected[r].geom), (size_t)dGeomGetData(hits[r].geom));
+                    CHECK_CLOSE(expected[r].depth, hits[r].depth, REAL(1e-4));
+
+                    // the hit lies on the ray
+                    for (int k = 0; k != 3; ++k) {
+                        dReal along = origins[r * 3 + k] + dirs[r * 3 + k] / dSqrt(dCalcVectorDot3(&dirs[r * 3], &dirs[r * 3])) * hits[r].depth;
+                        CHECK_CLOSE(along, hits[r].pos[k], REAL(1e-3));
+                    }
+                }
+            }
+        }
+    }
+    if (threading != NULL) {
+        CHECK_EQUAL((unsigned)SpaceCount, postedCalls["Space Raycast Group"]);
+        CHECK_EQUAL(SpaceCount * ThreadCount, postedCalls["Space Raycast"]);
+    }
+
+    for (int s = 0; s != SpaceCount; ++s) {
+        dSpaceDestroy(spaces[s]);
+    }
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+}
+
+TEST(test_collision_hash_space_raycast_tests_each_geom_once)
+{
+    /*
+     * The hash space walks the cells along a ray and must test a geom once
+     * however many cells of its AABB the ray crosses, also when a cell holds
+     * many AABBs. The ray passes by the spheres through their AABBs, so each
+     * test is a call of the ray collider.
+     */
+    const int SphereCount = 30;
+
+    dSpaceID space = dHashSpaceCreate(0);
+    for (int i = 0; i != SphereCount; ++i) {
+        dGeomID sphere = dCreateSphere(space, REAL(0.9));
+        dGeomSetPosition(sphere, REAL(0.5), REAL(0.5), REAL(0.5));
+    }
+
+    dReal origin[3] = { -5, REAL(1.3), REAL(1.3) }, dir[3] = { 1, 0, 0 };
+    dRaycastHit hit;
+
+    dResetCollisionStatistics();
+    dSetCollisionStatisticsEnabled(1);
+    CHECK_EQUAL(0, dSpaceRaycastBatch(space, origin, dir, 10, 1, &hit, NULL, NULL, 1));
+    dSetCollisionStatisticsEnabled(0);
+    CHECK(hit.geom == NULL);
+
+    dCollisionStatistics stats;
+    dGetCollisionStatistics(&stats);
+    duint64 calls = stats.collider_calls[dRayClass][dSphereClass] + stats.collider_calls[dSphereClass][dRayClass];
+    CHECK_EQUAL((duint64)SphereCount, calls);
+
+    dResetCollisionStatistics();
+    dSpaceDestroy(space);
+}
+
+TEST(test_collision_statistics)
+{
+    /*
+     * The simple space tests every pair of its geoms. dCollide() and
+     * dCollideBatch() count the calls and contacts at the entry of the
+     * collider, whichever order the geoms of a pair come in. Only the
+     * batch and the space calls are timed. Threads add to the same totals.
+     */
+    const unsigned ThreadCount = 4;
+    const int SphereCount = 30;
+    const int MaxContacts = 4;
+
+    dSpaceID space = dSimpleSpaceCreate(0);
+
+    dRandSetSeed(5);
+    for (int i = 0; i != SphereCount; ++i) {
+        dGeomID sphere = dCreateSphere(space, REAL(0.5));
+        dGeomSetPosition(sphere, dRandReal() * 4 - 2, dRandReal() * 4 - 2, dRandReal());
+    }
+    dCreatePlane(space, 0, 0, 1, 0);
+
+    dCollisionStatistics stats;
+    CHECK(!dGetCollisionStatisticsEnabled());
+
+    // nothing is gathered while disabled
+    dResetCollisionStatistics();
+    CollisionPairSet ignoredPairs;
+    dSpaceCollide(space, &ignoredPairs, &collectPairCallback);
+    dGetCollisionStatistics(&stats);
+    CHECK_EQUAL(0u, (unsigned)stats.aabb_tests);
+
+    dSetCollisionStatisticsEnabled(1);
+    CHECK(dGetCollisionStatisticsEnabled());
+
+    std::vector<dGeomPair> pairs(SphereCount * SphereCount);
+    int pairCount = dSpaceCollectPairs(space, &pairs[0], (int)pairs.size());
+    dGetCollisionStatistics(&stats);
+    CHECK_EQUAL((SphereCount + 1) * SphereCount / 2, (int)stats.aabb_tests);
+    CHECK_EQUAL(pairCount, (int)stats.near_callbacks);
+    CHECK(stats.space_collide_time > 0);
+
+    dResetCollisionStatistics();
+    std::vector<dContactGeom> contacts(pairCount * MaxContacts);
+    int planeCalls = 0, total = 0;
+    for (int i = 0; i != pairCount; ++i) {
+        // the sphere-plane pairs are passed in both orders
+        dGeomID o1 = pairs[i].o1, o2 = pairs[i].o2;
+        if (dGeomGetClass(o1) == dPlaneClass || dGeomGetClass(o2) == dPlaneClass) {
+            if (planeCalls++ % 2 != 0) std::swap(o1, o2);
+        }
+        total += dCollide(o1, o2, MaxContacts, &contacts[0], sizeof(dContactGeom));
+    }
+    dGetCollisionStatistics(&stats);
+    CHECK(planeCalls > 1);
+    CHECK_EQUAL(0u, (unsigned)stats.aabb_tests);
+    CHECK_EQUAL(pairCount, (int)(stats.collider_calls[dSphereClass][dSphereClass] + stats.collider_calls[dSphereClass][dPlaneClass]));
+    CHECK_EQUAL(planeCalls, (int)stats.collider_calls[dSphereClass][dPlaneClass]);
+    CHECK_EQUAL(0u, (unsigned)stats.collider_calls[dPlaneClass][dSphereClass]);
+    CHECK_EQUAL(total, (int)(stats.collider_contacts[dSphereClass][dSphereClass] + stats.collider_contacts[dSphereClass][dPlaneClass]));
+    CHECK(stats.collider_calls[dSphereClass][dSphereClass] != 0);
+    CHECK(stats.collider_time[dSphereClass][dSphereClass] > 0);
+    CHECK(stats.collider_time[dSphereClass][dPlaneClass] > 0);
+    CHECK_EQUAL(0.0, stats.collider_time[dPlaneClass][dSphereClass]);
+    CHECK_EQUAL(0.0, stats.space_collide_time);
+
+    // the batch adds the same counts again
+    duint64 sphereCalls = stats.collider_calls[dSphereClass][dSphereClass];
+    double sphereTime = stats.collider_time[dSphereClass][dSphereClass];
+    std::vector<int> counts(pairCount);
+    CHECK_EQUAL(total, dCollideBatch(&pairs[0], pairCount, MaxContacts, &contacts[0], sizeof(dContactGeom), &counts[0], NULL, NULL, 1));
+    dGetCollisionStatistics(&stats);
+    CHECK_EQUAL(2 * pairCount, (int)(stats.collider_calls[dSphereClass][dSphereClass] + stats.collider_calls[dSphereClass][dPlaneClass]));
+    CHECK_EQUAL(2 * sphereCalls, stats.collider_calls[dSphereClass][dSphereClass]);
+    CHECK_EQUAL(2 * total, (int)(stats.collider_contacts[dSphereClass][dSphereClass] + stats.collider_contacts[dSphereClass][dPlaneClass]));
+    CHECK(stats.collider_time[dSphereClass][dSphereClass] > sphereTime);
+
+    // and so does a batch collided by several threads
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+    }
+    CHECK_EQUAL(total, dCollideBatch(&pairs[0], pairCount, MaxContacts, &contacts[0], sizeof(dContactGeom), &counts[0], 
+        threading != NULL ? dThreadingImplementationGetFunctions(threading) : NULL, threading, ThreadCount));
+    dGetCollisionStatistics(&stats);
+    CHECK_EQUAL(3 * sphereCalls, stats.collider_calls[dSphereClass][dSphereClass]);
+    CHECK_EQUAL(3 * total, (int)(stats.collider_contacts[dSphereClass][dSphereClass] + stats.collider_contacts[dSphereClass][dPlaneClass]));
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+
+    dResetCollisionStatistics();
+    dGetCollisionStatistics(&stats);
+    CHECK_EQUAL(0u, (unsigned)stats.collider_calls[dSphereClass][dSphereClass]);
+
+    dSetCollisionStatisticsEnabled(0);
+    dSpaceDestroy(space);
+}
+
+TEST(test_collision_trimesh_threaded_build_matches_serial)
+{
+    /*
+     * A terrain large enough to have its top nodes binned in parallel and
+     * its subtrees built by different threads. Vertical rays through the
+     * centers of the triangles must hit their own triangle, and both trees
+     * must give the same contacts.
+     */
+    const int GridSize = 200;
+    const int VertexCount = (GridSize + 1) * (GridSize + 1);
+    const int TriangleCount = GridSize * GridSize * 2;
+    const unsigned ThreadCount = 4;
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = NULL;
+    if (threading != NULL) {
+        pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+    }
+
+    std::vector<float> vertices(VertexCount * 3);
+    for (int i = 0; i <= GridSize; ++i) {
+        for (int j = 0; j <= GridSize; ++j) {
+            float *v = &vertices[(i * (GridSize + 1) + j) * 3];
+            v[0] = i * 0.1f;
+            v[1] = j * 0.1f;
+            v[2] = 0.3f * sinf(i * 0.37f) * cosf(j * 0.21f);
+        }
+    }
+    std::vector<dTriIndex> indices;
+    for (int i = 0; i != GridSize; ++i) {
+        for (int j = 0; j != GridSize; ++j) {
+            dTriIndex a = i * (GridSize + 1) + j, b = a + 1, c = a + GridSize + 1, d = c + 1;
+            dTriIndex quad[6] = { a, c, b, b, c, d };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    dTriMeshDataID serialData = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(serialData, &vertices[0], 3 * sizeof(float), VertexCount,
+                                &indices[0], TriangleCount * 3, 3 * sizeof(dTriIndex));
+    // the build posts through a copy of the functions that counts its calls
+    dThreadingFunctionsInfo countingFunctions;
+    postedCalls.clear();
+    dTriMeshDataID threadedData = dGeomTriMeshDataCreate();
+    if (threading != NULL) {
+        makeCountingFunctions(&countingFunctions, threading);
+        dGeomTriMeshDataSetBuildThreading(threadedData, &countingFunctions, threading, ThreadCount);
+    }
+    dGeomTriMeshDataBuildSingle(threadedData, &vertices[0], 3 * sizeof(float), VertexCount,
+                                &indices[0], TriangleCount * 3, 3 * sizeof(dTriIndex));
+    if (threading != NULL) {
+        // several parallel stages, each run by more than one posted call
+        CHECK(postedCalls["TriMesh Build Group"] > 1);
+        CHECK(postedCalls["TriMesh Build"] >= 2 * postedCalls["TriMesh Build Group"]);
+    }
+    dGeomID serial = dCreateTriMesh(0, serialData, 0, 0, 0);
+    dGeomID threaded = dCreateTriMesh(0, threadedData, 0, 0, 0);
+
+    dGeomID ray = dCreateRay(0, 10);
+    dGeomRaySetClosestHit(ray, 1);
+    for (int t = 0; t < TriangleCount; t += 7) {
+        dReal center[3] = { 0, 0, 0 };
+        for (int k = 0; k != 3; ++k) {
+            const float *v = &vertices[indices[t * 3 + k] * 3];
+            for (int c = 0; c != 3; ++c) center[c] += v[c] / 3;
+        }
+        dGeomRaySet(ray, center[0], center[1], 5, 0, 0, -1);
+
+        dContactGeom serialHit, threadedHit;
+        CHECK_EQUAL(1, dCollide(ray, serial, 1, &serialHit, sizeof(serialHit)));
+        CHECK_EQUAL(1, dCollide(ray, threaded, 1, &threadedHit, sizeof(threadedHit)));
+        // the ray comes first, so the triangle is the second side
+        CHECK_EQUAL(t, serialHit.side2);
+        CHECK_CLOSE(5 - center[2], serialHit.depth, 1e-3);
+        CHECK_EQUAL(serialHit.side2, threadedHit.side2);
+        CHECK_EQUAL(serialHit.depth, threadedHit.depth);
+    }
+
+    // sphere contacts depend on the order the triangles are found in
+    const int MaxContacts = 16;
+    dGeomID sphere = dCreateSphere(0, REAL(0.25));
+    dRandSetSeed(3);
+    for (int s = 0; s != 200; ++s) {
+        dGeomSetPosition(sphere, dRandReal() * GridSize * REAL(0.1), dRandReal() * GridSize * REAL(0.1), dRandReal() * REAL(0.8) - REAL(0.2));
+        dContactGeom serialContacts[MaxContacts], threadedContacts[MaxContacts];
+        int serialCount = dCollide(sphere, serial, MaxContacts, serialContacts, sizeof(dContactGeom));
+        int threadedCount = dCollide(sphere, threaded, MaxContacts, threadedContacts, sizeof(dContactGeom));
+        CHECK_EQUAL(serialCount, threadedCount);
+        for (int i = 0; i < serialCount && i < threadedCount; ++i) {
+            CHECK_EQUAL(serialContacts[i].side2, threadedContacts[i].side2);
+            CHECK_EQUAL(serialContacts[i].depth, threadedContacts[i].depth);
+        }
+    }
+
+    dGeomDestroy(sphere);
+    dGeomDestroy(ray);
+    dGeomDestroy(threaded);
+    dGeomDestroy(serial);
+    dGeomTriMeshDataDestroy(threadedData);
+    dGeomTriMeshDataDestroy(serialData);
+
+    if (threading != NULL) {
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+}
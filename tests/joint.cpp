@@ -32,6 +32,7 @@
 #include <ode/ode.h>
 #include "../ode/src/config.h"
 #include "../ode/src/joints/joints.h"
+#include "../ode/src/contact_cache.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3052,3 +3053,653 @@ SUITE(JointPiston)
 
 
 } // End of SUITE(JointPiston)
+
+
+
+// =============================================================================
+// =============================================================================
+//
+// Testing the warm starting of the Contact Joint
+//
+// =============================================================================
+// =============================================================================
+
+SUITE(JointContactWarmStarting)
+{
+    struct ContactWarmStarting_Fixture_1
+    {
+        ContactWarmStarting_Fixture_1()
+        {
+            wId = dWorldCreate();
+            dWorldSetGravity(wId, 0, 0, -10);
+            dWorldSetQuickStepWarmStarting(wId, 1);
+
+            jgId = dJointGroupCreate(0);
+
+            bId = dBodyCreate(wId);
+            dBodySetPosition(bId, 0, 0, 1);
+
+            gSphere = dCreateSphere(0, 1);
+            dGeomSetBody(gSphere, bId);
+            gPlane = dCreatePlane(0, 0, 0, 1, 0);
+        }
+
+        ~ContactWarmStarting_Fixture_1()
+        {
+            dJointGroupDestroy(jgId);
+            dGeomDestroy(gPlane);
+            dGeomDestroy(gSphere);
+            dWorldDestroy(wId);
+        }
+
+        dxJointContact *createContact(dReal shift)
+        {
+            dContact contact;
+            contact.surface.mode = 0;
+            contact.surface.mu = 0;
+            dCollide(gSphere, gPlane, 1, &contact.geom, sizeof(dContact));
+            contact.geom.pos[0] += shift;
+
+            dJointID jId = dJointCreateContact(wId, jgId, &contact);
+            dJointAttach(jId, bId, 0);
+            return (dxJointContact *)jId;
+        }
+
+        dWorldID wId;
+        dJointGroupID jgId;
+
+        dBodyID bId;
+        dGeomID gSphere;
+        dGeomID gPlane;
+    };
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_ContactLambdaIsReused)
+    {
+        dxJointContact *joint = createContact(0);
+        CHECK_EQUAL(dReal(0.0), joint->lambda[0]);
+
+        dWorldQuickStep(wId, REAL(0.01));
+        const dReal lambda = joint->lambda[0];
+        CHECK(lambda > 0);
+
+        dJointGroupEmpty(jgId);
+
+        joint = createContact(0);
+        CHECK_EQUAL(lambda, joint->lambda[0]);
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_ContactLambdaIsNotReusedForMovedContact)
+    {
+        dxJointContact *joint = createContact(0);
+        dWorldQuickStep(wId, REAL(0.01));
+        CHECK(joint->lambda[0] > 0);
+
+        dJointGroupEmpty(jgId);
+
+        joint = createContact(2 * dWorldGetContactWarmStartingDistance(wId));
+        CHECK_EQUAL(dReal(0.0), joint->lambda[0]);
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_ContactLambdaIsNotReusedWhenDisabled)
+    {
+        dxJointContact *joint = createContact(0);
+        dWorldQuickStep(wId, REAL(0.01));
+        CHECK(joint->lambda[0] > 0);
+
+        dJointGroupEmpty(jgId);
+        dWorldSetQuickStepWarmStarting(wId, 0);
+
+        joint = createContact(0);
+        CHECK_EQUAL(dReal(0.0), joint->lambda[0]);
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_ContactLambdaIsNotReusedForNewGeom)
+    {
+        dxJointContact *joint = createContact(0);
+        dWorldQuickStep(wId, REAL(0.01));
+        CHECK(joint->lambda[0] > 0);
+
+        dJointGroupEmpty(jgId);
+
+        // the replacement may get the address of the destroyed geom
+        dGeomDestroy(gSphere);
+        gSphere = dCreateSphere(0, 1);
+        dGeomSetBody(gSphere, bId);
+
+        joint = createContact(0);
+        CHECK_EQUAL(dReal(0.0), joint->lambda[0]);
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_CacheIsReplacedAfterEachStep)
+    {
+        for (int step = 0; step != 10; ++step) {
+            createContact(0);
+            createContact(REAL(0.5));
+            if (step % 2 == 0) {
+                dWorldQuickStep(wId, REAL(0.01));
+            } else {
+                dWorldStep(wId, REAL(0.01));
+            }
+            dJointGroupEmpty(jgId);
+
+            CHECK_EQUAL(2, wId->contact_cache->getEntryCount());
+        }
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_CacheIsReplacedWithoutSteps)
+    {
+        for (int round = 0; round != 10; ++round) {
+            for (int i = 0; i != 100; ++i) {
+                createContact(0);
+            }
+            dJointGroupEmpty(jgId);
+
+            CHECK_EQUAL(100, wId->contact_cache->getEntryCount());
+        }
+    }
+
+    TEST_FIXTURE(ContactWarmStarting_Fixture_1, test_ToleranceStopsIterationsEarly)
+    {
+        dWorldSetQuickStepNumIterations(wId, 40);
+        dWorldSetQuickStepTolerance(wId, REAL(1e-3));
+
+        dQuickStepIslandStatistics stats;
+        for (int step = 0; step != 10; ++step) {
+            createContact(0);
+            dWorldQuickStep(wId, REAL(0.01));
+            dJointGroupEmpty(jgId);
+
+            CHECK_EQUAL(1U, dWorldGetQuickStepIslandCount(wId));
+            dWorldGetQuickStepIslandStatistics(wId, 0, &stats);
+            CHECK_EQUAL(1U, stats.bodies);
+            CHECK_EQUAL(1U, stats.rows);
+            CHECK(stats.iterations >= 1 && stats.iterations <= 40);
+        }
+
+        // the resting contact has converged and is reused from the cache
+        CHECK(stats.iterations < 40);
+        CHECK(stats.residual < REAL(1e-3));
+    }
+
+} // End of SUITE(JointContactWarmStarting)
+
+SUITE(JointContactBatch)
+{
+    struct ContactBatch_Fixture_1
+    {
+        ContactBatch_Fixture_1()
+        {
+            wId = dWorldCreate();
+            jgId = dJointGroupCreate(0);
+            for (int i = 0; i != 3; ++i) {
+                bId[i] = dBodyCreate(wId);
+                buffers[i] = dContactBufferCreate();
+            }
+        }
+
+        ~ContactBatch_Fixture_1()
+        {
+            for (int i = 0; i != 3; ++i) {
+                dContactBufferDestroy(buffers[i]);
+            }
+            dJointGroupDestroy(jgId);
+            dWorldDestroy(wId);
+        }
+
+        static dContact makeContact(dReal depth)
+        {
+            dContact contact;
+            memset(&contact, 0, sizeof(contact));
+            contact.surface.mode = dContactBounce;
+            contact.surface.mu = 1;
+            contact.surface.bounce = REAL(0.5);
+            contact.geom.normal[2] = 1;
+            contact.geom.depth = depth;
+            return contact;
+        }
+
+        dWorldID wId;
+        dJointGroupID jgId;
+        dBodyID bId[3];
+        dContactBufferID buffers[3];
+    };
+
+    TEST_FIXTURE(ContactBatch_Fixture_1, test_BatchCreatesAttachedContactJoints)
+    {
+        dContact c0 = makeContact(REAL(0.1)), c1 = makeContact(REAL(0.2)), c2 = makeContact(REAL(0.3));
+        dContactBufferAdd(buffers[0], &c0, bId[0], bId[1]);
+        dContactBufferAdd(buffers[0], &c1, bId[1], 0);
+        dContactBufferAdd(buffers[2], &c2, 0, bId[2]);
+        CHECK_EQUAL(2, dContactBufferGetCount(buffers[0]));
+        CHECK_EQUAL(0, dContactBufferGetCount(buffers[1]));
+
+        CHECK_EQUAL(3, dJointGroupAddContactsBatch(wId, jgId, buffers, 3));
+        for (int i = 0; i != 3; ++i) {
+            CHECK_EQUAL(0, dContactBufferGetCount(buffers[i]));
+        }
+
+        CHECK_EQUAL(1, dBodyGetNumJoints(bId[0]));
+        CHECK_EQUAL(2, dBodyGetNumJoints(bId[1]));
+        CHECK_EQUAL(1, dBodyGetNumJoints(bId[2]));
+
+        dJointID j0 = dBodyGetJoint(bId[0], 0);
+        CHECK_EQUAL(dJointTypeContact, dJointGetType(j0));
+        CHECK_EQUAL(bId[0], dJointGetBody(j0, 0));
+        CHECK_EQUAL(bId[1], dJointGetBody(j0, 1));
+        CHECK_EQUAL(REAL(0.1), ((dxJointContact *)j0)->contact.geom.depth);
+        CHECK_EQUAL(REAL(0.5), ((dxJointContact *)j0)->contact.surface.bounce);
+
+        dJointID j2 = dBodyGetJoint(bId[2], 0);
+        CHECK_EQUAL((dBodyID)0, dJointGetBody(j2, 0));
+        CHECK_EQUAL(bId[2], dJointGetBody(j2, 1));
+        CHECK_EQUAL(REAL(0.3), ((dxJointContact *)j2)->contact.geom.depth);
+
+        // the joints belong to the group
+        dJointGroupEmpty(jgId);
+        for (int i = 0; i != 3; ++i) {
+            CHECK_EQUAL(0, dBodyGetNumJoints(bId[i]));
+        }
+    }
+
+    TEST_FIXTURE(ContactBatch_Fixture_1, test_BatchMatchesSingleContacts)
+    {
+        // the same contacts, created one by one in a second world
+        dWorldID w2 = dWorldCreate();
+        dJointGroupID jg2 = dJointGroupCreate(0);
+        dBodyID b2[3];
+        for (int i = 0; i != 3; ++i) {
+            b2[i] = dBodyCreate(w2);
+            dBodySetPosition(bId[i], 0, 0, i);
+            dBodySetPosition(b2[i], 0, 0, i);
+        }
+        dWorldSetGravity(wId, 0, 0, -10);
+        dWorldSetGravity(w2, 0, 0, -10);
+
+        for (int step = 0; step != 5; ++step) {
+            for (int i = 0; i != 3; ++i) {
+                dContact contact = makeContact(REAL(0.01));
+                contact.geom.pos[2] = dReal(i) - REAL(0.5);
+                dContactBufferAdd(buffers[i], &contact, bId[i], i ? bId[i - 1] : 0);
+
+                dJointID j = dJointCreateContact(w2, jg2, &contact);
+                dJointAttach(j, b2[i], i ? b2[i - 1] : 0);
+            }
+            dJointGroupAddContactsBatch(wId, jgId, buffers, 3);
+
+            // the solver shuffles the rows with the global random generator
+            dRandSetSeed(step);
+            dWorldQuickStep(wId, REAL(0.01));
+            dRandSetSeed(step);
+            dWorldQuickStep(w2, REAL(0.01));
+            dJointGroupEmpty(jgId);
+            dJointGroupEmpty(jg2);
+        }
+
+        for (int i = 0; i != 3; ++i) {
+            const dReal *p1 = dBodyGetPosition(bId[i]), *p2 = dBodyGetPosition(b2[i]);
+            CHECK_ARRAY_EQUAL(p2, p1, 3);
+        }
+
+        dJointGroupDestroy(jg2);
+        dWorldDestroy(w2);
+    }
+
+    TEST_FIXTURE(ContactBatch_Fixture_1, test_BatchSpansSeveralGroupArenas)
+    {
+        /*
+         * A batch larger than an arena of the group is allocated in several
+         * runs. The joints must be laid out as if allocated one by one, so
+         * that emptying the group finds them all, also between joints
+         * created alone and when the arenas are reused.
+         */
+        const int ContactCount = 400;
+
+        for (int round = 0; round != 2; ++round) {
+            dContact single = makeContact(-1);
+            dJointAttach(dJointCreateContact(wId, jgId, &single), bId[2], 0);
+
+            for (int i = 0; i != ContactCount; ++i) {
+                dContact contact = makeContact(dReal(i));
+                dContactBufferAdd(buffers[i % 3], &contact, bId[0], bId[1]);
+            }
+            CHECK_EQUAL(ContactCount, dJointGroupAddContactsBatch(wId, jgId, buffers, 3));
+
+            dJointAttach(dJointCreateContact(wId, jgId, &single), bId[2], 0);
+
+            CHECK_EQUAL(ContactCount, dBodyGetNumJoints(bId[0]));
+            CHECK_EQUAL(ContactCount, dBodyGetNumJoints(bId[1]));
+            CHECK_EQUAL(2, dBodyGetNumJoints(bId[2]));
+
+            // every contact made it into its own joint
+            bool seen[ContactCount] = { false };
+            for (int i = 0; i != ContactCount; ++i) {
+                dJointID j = dBodyGetJoint(bId[0], i);
+                CHECK_EQUAL(bId[1], dJointGetBody(j, 1));
+                int depth = (int)((dxJointContact *)j)->contact.geom.depth;
+                CHECK(depth >= 0 && depth < ContactCount && !seen[depth]);
+                if (depth >= 0 && depth < ContactCount) seen[depth] = true;
+            }
+
+            dJointGroupEmpty(jgId);
+            for (int i = 0; i != 3; ++i) {
+                CHECK_EQUAL(0, dBodyGetNumJoints(bId[i]));
+            }
+        }
+    }
+
+} // End of SUITE(JointContactBatch)
+
+SUITE(WorldIslands)
+{
+    struct Islands_Fixture_1
+    {
+        Islands_Fixture_1()
+        {
+            wId = dWorldCreate();
+            for (int i = 0; i != 4; ++i) {
+                bId[i] = dBodyCreate(wId);
+                dBodySetPosition(bId[i], i * REAL(2.0), 0, 0);
+            }
+        }
+
+        ~Islands_Fixture_1()
+        {
+            dWorldDestroy(wId);
+        }
+
+        dJointID createBall(dBodyID b1, dBodyID b2)
+        {
+            dJointID jId = dJointCreateBall(wId, 0);
+            dJointAttach(jId, b1, b2);
+            return jId;
+        }
+
+        unsigned step()
+        {
+            dWorldQuickStep(wId, REAL(0.01));
+            return dWorldGetQuickStepIslandCount(wId);
+        }
+
+        dWorldID wId;
+        dBodyID bId[4];
+    };
+
+    TEST_FIXTURE(Islands_Fixture_1, test_JointsJoinAndSplitIslands)
+    {
+        CHECK_EQUAL(4U, step());
+
+        // attaching joints joins islands without a rebuild
+        dJointID j01 = createBall(bId[0], bId[1]);
+        CHECK_EQUAL(3U, step());
+        dJointID j23 = createBall(bId[2], bId[3]);
+        dJointID j12 = createBall(bId[1], bId[2]);
+        CHECK_EQUAL(1U, step());
+
+        // joints anchored to the world do not connect bodies
+        createBall(bId[3], 0);
+        CHECK_EQUAL(1U, step());
+
+        dJointDestroy(j12);
+        CHECK_EQUAL(2U, step());
+
+        dJointDisable(j01);
+        CHECK_EQUAL(3U, step());
+        dJointEnable(j01);
+        CHECK_EQUAL(2U, step());
+
+        dJointAttach(j23, bId[0], bId[3]);
+        CHECK_EQUAL(2U, step());
+
+        dQuickStepIslandStatistics stats;
+        dWorldGetQuickStepIslandStatistics(wId, 0, &stats);
+        CHECK_EQUAL(3U, stats.bodies);
+        dWorldGetQuickStepIslandStatistics(wId, 1, &stats);
+        CHECK_EQUAL(1U, stats.bodies);
+    }
+
+    TEST_FIXTURE(Islands_Fixture_1, test_KinematicBodiesKeepTheirIslands)
+    {
+        createBall(bId[0], bId[1]);
+        createBall(bId[1], bId[2]);
+        CHECK_EQUAL(2U, step());
+
+        // a joint between kinematic bodies keeps them in one island,
+        // but it adds no rows
+        dBodySetKinematic(bId[0]);
+        dBodySetKinematic(bId[1]);
+        CHECK_EQUAL(2U, step());
+
+        // the islands are in the world body list order, where the last created body is first
+        dQuickStepIslandStatistics stats;
+        dWorldGetQuickStepIslandStatistics(wId, 1, &stats);
+        CHECK_EQUAL(3U, stats.bodies);
+        CHECK_EQUAL(3U, stats.rows);
+
+        dBodySetDynamic(bId[0]);
+        CHECK_EQUAL(2U, step());
+        dWorldGetQuickStepIslandStatistics(wId, 1, &stats);
+        CHECK_EQUAL(6U, stats.rows);
+    }
+
+    TEST_FIXTURE(Islands_Fixture_1, test_MassChangesKeepTheLinks)
+    {
+        createBall(bId[0], bId[1]);
+        step();
+        CHECK(wId->island_links_valid);
+
+        dMass mass;
+        dMassSetSphere(&mass, 1, REAL(0.5));
+        dBodySetMass(bId[0], &mass);
+        CHECK(wId->island_links_valid);
+
+        dBodySetKinematic(bId[0]);
+        CHECK(wId->island_links_valid);
+        dBodySetDynamic(bId[0]);
+        CHECK(wId->island_links_valid);
+        CHECK_EQUAL(3U, step());
+    }
+
+    TEST_FIXTURE(Islands_Fixture_1, test_GroupJointsJoinIslandsWithoutLinks)
+    {
+        createBall(bId[0], bId[1]);
+        CHECK_EQUAL(3U, step());
+
+        dJointGroupID gId = dJointGroupCreate(0);
+        dJointID j12 = dJointCreateBall(wId, gId);
+        dJointAttach(j12, bId[1], bId[2]);
+        dJointAttach(dJointCreateBall(wId, gId), bId[3], bId[2]);
+        CHECK_EQUAL(1U, step());
+
+        // removing group joints does not need a rebuild of the links
+        dJointDisable(j12);
+        CHECK(wId->island_links_valid);
+        CHECK_EQUAL(2U, step());
+
+        dJointGroupEmpty(gId);
+        CHECK(wId->island_links_valid);
+        CHECK_EQUAL(3U, step());
+
+        dJointAttach(dJointCreateBall(wId, gId), bId[3], bId[0]);
+        CHECK_EQUAL(2U, step());
+        dBodyDestroy(bId[3]);
+        CHECK(wId->island_links_valid);
+        CHECK_EQUAL(2U, step());
+
+        dJointGroupDestroy(gId);
+    }
+
+    TEST(test_GroupJointsOutliveTheirWorld)
+    {
+        dWorldID wId = dWorldCreate();
+        dJointGroupID gId = dJointGroupCreate(0);
+        dJointID jId = dJointCreateBall(wId, gId);
+        dJointAttach(jId, dBodyCreate(wId), dBodyCreate(wId));
+        dWorldDestroy(wId);
+
+        dJointDisable(jId);
+        CHECK(!dJointIsEnabled(jId));
+        dJointEnable(jId);
+        CHECK(dJointIsEnabled(jId));
+
+        dJointGroupDestroy(gId);
+    }
+
+    TEST_FIXTURE(Islands_Fixture_1, test_DisabledBodiesAreEnabledByTheirIsland)
+    {
+        createBall(bId[0], bId[1]);
+        dBodyDisable(bId[1]);
+        dBodyDisable(bId[2]);
+        dBodyDisable(bId[3]);
+        CHECK_EQUAL(1U, step());
+        CHECK(dBodyIsEnabled(bId[1]));
+        CHECK(!dBodyIsEnabled(bId[2]));
+
+        createBall(bId[1], bId[2]);
+        CHECK_EQUAL(1U, step());
+        CHECK(dBodyIsEnabled(bId[2]));
+        CHECK(!dBodyIsEnabled(bId[3]));
+
+        dBodyDestroy(bId[1]);
+        CHECK_EQUAL(2U, step());
+        CHECK(!dBodyIsEnabled(bId[3]));
+    }
+
+    TEST_FIXTURE(Islands_Fixture_1, test_StepStatisticsAreCollectedWhenEnabled)
+    {
+        createBall(bId[0], bId[1]);
+        createBall(bId[1], bId[2]);
+
+        dWorldStepStatistics stats;
+        CHECK_EQUAL(0, dWorldGetStepStatisticsEnabled(wId));
+        step();
+        dWorldGetStepStatistics(wId, &stats);
+        CHECK_EQUAL(0U, stats.islands);
+        CHECK_EQUAL(0.0, stats.step_time);
+
+        dWorldSetStepStatisticsEnabled(wId, 1);
+        CHECK_EQUAL(1, dWorldGetStepStatisticsEnabled(wId));
+
+        CHECK_EQUAL(2U, step());
+        dWorldGetStepStatistics(wId, &stats);
+        CHECK_EQUAL(2U, stats.islands);
+        CHECK_EQUAL(6U, stats.rows);
+        CHECK_EQUAL(6U, stats.max_island_rows);
+        CHECK(stats.allowed_threads >= 1);
+        CHECK(stats.islands_memory_estimate != 0);
+        CHECK(stats.stepper_memory_estimate != 0);
+        CHECK(stats.step_time > 0.0);
+        CHECK(stats.lcp_time > 0.0);
+        CHECK(stats.integration_time > 0.0);
+        CHECK(stats.lcp_time + stats.integration_time <= stats.step_time);
+
+        dWorldStep(wId, REAL(0.01));
+        dWorldGetStepStatistics(wId, &stats);
+        CHECK_EQUAL(2U, stats.islands);
+        CHECK_EQUAL(6U, stats.rows);
+
+        dWorldSetStepStatisticsEnabled(wId, 0);
+        step();
+        dWorldGetStepStatistics(wId, &stats);
+        CHECK_EQUAL(0U, stats.rows);
+    }
+
+    TEST(test_StepStatisticsAddUpOverIslandThreads)
+    {
+        dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+        if (threading == NULL) {
+            return;
+        }
+        dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(4, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+
+        // pairs of bodies joined by a ball joint, each an island of 3 rows
+        const int PairCount = 32;
+        dWorldID wId = dWorldCreate();
+        dWorldSetStepThreadingImplementation(wId, dThreadingImplementationGetFunctions(threading), threading);
+        for (int i = 0; i != PairCount; ++i) {
+            dBodyID b1 = dBodyCreate(wId), b2 = dBodyCreate(wId);
+            dBodySetPosition(b1, i * REAL(4.0), 0, 0);
+            dBodySetPosition(b2, i * REAL(4.0) + 1, 0, 0);
+            dJointID jId = dJointCreateBall(wId, 0);
+            dJointAttach(jId, b1, b2);
+            dJointSetBallAnchor(jId, i * REAL(4.0) + REAL(0.5), 0, 0);
+        }
+
+        dWorldSetStepStatisticsEnabled(wId, 1);
+        for (int n = 0; n != 3; ++n) {
+            dWorldQuickStep(wId, REAL(0.01));
+
+            dWorldStepStatistics stats;
+            dWorldGetStepStatistics(wId, &stats);
+            CHECK_EQUAL((unsigned)PairCount, stats.islands);
+            CHECK_EQUAL(3U * PairCount, stats.rows);
+            CHECK_EQUAL(3U, stats.max_island_rows);
+            CHECK(stats.allowed_threads > 1);
+        }
+
+        dWorldDestroy(wId);
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+
+} // End of SUITE(WorldIslands)
+
+SUITE(WorldObjectPools)
+{
+    TEST(test_ObjectsSurviveDestructionOfTheirNeighbours)
+    {
+        const int count = 64;
+        dWorldID wId = dWorldCreate();
+        dBodyID bId[count];
+        dJointID jId[count];
+        dGeomID gId[count];
+        dReal radius[count];
+
+        for (int i = 0; i != count; ++i) {
+            bId[i] = dBodyCreate(wId);
+            dBodySetPosition(bId[i], i * REAL(2.0), 0, 0);
+            jId[i] = dJointCreateBall(wId, 0);
+            dJointAttach(jId[i], bId[i], 0);
+            radius[i] = REAL(0.5);
+            gId[i] = dCreateSphere(0, radius[i]);
+            dGeomSetBody(gId[i], bId[i]);
+        }
+
+        // objects destroyed in the middle of the run are replaced by new
+        // ones, possibly in the storage they left, over several rounds
+        for (int round = 0; round != 3; ++round) {
+            for (int i = round % 2; i < count; i += 2) {
+                dGeomDestroy(gId[i]);
+                dJointDestroy(jId[i]);
+                dBodyDestroy(bId[i]);
+
+                bId[i] = dBodyCreate(wId);
+                dBodySetPosition(bId[i], i * REAL(2.0), dReal(round + 1), 0);
+                jId[i] = dJointCreateBall(wId, 0);
+                dJointAttach(jId[i], bId[i], 0);
+                radius[i] = REAL(0.6) + round * REAL(0.1);
+                gId[i] = dCreateSphere(0, radius[i]);
+                dGeomSetBody(gId[i], bId[i]);
+            }
+
+            for (int i = 0; i != count; ++i) {
+                const dReal *pos = dBodyGetPosition(bId[i]);
+                CHECK_EQUAL(i * REAL(2.0), pos[0]);
+                CHECK(dGeomGetBody(gId[i]) == bId[i]);
+                CHECK_EQUAL(pos[1], dGeomGetPosition(gId[i])[1]);
+                CHECK(dJointGetBody(jId[i], 0) == bId[i]);
+                CHECK(dJointGetBody(jId[i], 1) == 0);
+                CHECK_EQUAL(radius[i], dGeomSphereGetRadius(gId[i]));
+            }
+        }
+
+        dWorldQuickStep(wId, REAL(0.01));
+
+        for (int i = 0; i != count; ++i) {
+            dGeomDestroy(gId[i]);
+        }
+        dWorldDestroy(wId);
+    }
+
+} // End of SUITE(WorldObjectPools)
@@ -0,0 +1,284 @@
+/*************************************************************************
+  *                                                                       *
+  * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+  * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+  *                                                                       *
+  * This library is free software; you can redistribute it and/or         *
+  * modify it under the terms of EITHER:                                  *
+  *   (1) The GNU Lesser General Public License as published by the Free  *
+  *       Software Foundation; either version 2.1 of the License, or (at  *
+  *       your option) any later version. The text of the GNU Lesser      *
+  *       General Public License is included with this library in the     *
+  *       file LICENSE.TXT.                                               *
+  *   (2) The BSD-style license that is included with this library in     *
+  *       the file LICENSE-BSD.TXT.                                       *
+  *                                                                       *
+  * This library is distributed in the hope that it will be useful,       *
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+  * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+  *                                                                       *
+  *************************************************************************/
+//234567890123456789012345678901234567890123456789012345678901234567890123456789
+//        1         2         3         4         5         6         7
+
+////////////////////////////////////////////////////////////////////////////////
+// This file create unit test for the sparse LCP solver found in:
+// ode/src/lcp_sparse.cpp
+//
+// The solutions are compared with the ones of dSolveLCP() on the full matrix.
+////////////////////////////////////////////////////////////////////////////////
+#include <UnitTest++.h>
+#include <ode/ode.h>
+#include <algorithm>
+#include <vector>
+#include "../ode/src/config.h"
+#include "../ode/src/matrix.h"
+#include "../ode/src/lcp.h"
+#include "../ode/src/lcp_sparse.h"
+#include "../ode/src/util.h"
+
+
+#ifdef dSINGLE
+#define SPARSE_LCP_TOLERANCE REAL(1e-2)
+#else
+#define SPARSE_LCP_TOLERANCE REAL(1e-6)
+#endif
+
+SUITE(SparseLCP)
+{
+    // A random articulation: a tree of bodies linked with five row joints,
+    // a few joints closing loops and some contacts of bodies with the world
+    // having a normal row and two friction rows.
+    struct SparseLCP_System
+    {
+        SparseLCP_System(unsigned int bodies, unsigned int loops, unsigned int contacts, bool friction)
+        {
+            dRandSetSeed(bodies + 7 * loops + 31 * contacts);
+
+            nb = bodies;
+            m = 0;
+            invMass.resize(nb);
+            invI.resize(12 * (size_t)nb);
+            for (unsigned int b = 0; b != nb; ++b) {
+                invMass[b] = REAL(0.5) + dRandReal();
+                dReal *I = &invI[12 * (size_t)b];
+                // symmetric and diagonally dominant
+                for (unsigned int i = 0; i != 3; ++i) {
+                    for (unsigned int j = 0; j <= i; ++j) {
+                        I[i*4 + j] = I[j*4 + i] = i == j ? REAL(1.0) + dRandReal() : (dRandReal() - REAL(0.5)) * REAL(0.3);
+                    }
+                    I[i*4 + 3] = 0;
+                }
+            }
+
+            for (unsigned int b = 1; b != nb; ++b) {
+                AddJoint(b, dRandInt(b), 5, false);
+            }
+            for (unsigned int l = 0; l != loops; ++l) {
+                int b1 = dRandInt(nb), b2 = dRandInt(nb);
+                AddJoint(b1, b1 != b2 ? b2 : -1, 5, false);
+            }
+            for (unsigned int c = 0; c != contacts; ++c) {
+                AddJoint(dRandInt(nb), -1, 3, friction);
+            }
+            mindex.push_back(m);
+
+            J.resize(2 * 8 * (size_t)m);
+            JinvM.resize(2 * 8 * (size_t)m);
+            for (unsigned int ji = 0; ji != jb.size() / 2; ++ji) {
+                const unsigned int ofs = mindex[ji], infom = mindex[ji + 1] - ofs;
+                for (unsigned int s = 0; s != 2; ++s) {
+                    const int b = jb[2 * ji + s];
+                    for (unsigned int r = 0; r != infom; ++r) {
+                        dReal *Jrow = &J[2 * 8 * (size_t)ofs + 8 * (s * infom + r)];
+                        dReal *JinvMrow = &JinvM[2 * 8 * (size_t)ofs + 8 * (s * infom + r)];
+                        for (unsigned int k = 0; k != 8; ++k) {
+                            Jrow[k] = (b != -1 && k != 3 && k != 7) ? dRandReal() - REAL(0.5) : 0;
+                            JinvMrow[k] = 0;
+                        }
+                        if (b != -1) {
+                            for (unsigned int k = 0; k != 3; ++k) JinvMrow[k] = Jrow[k] * invMass[b];
+                            dMultiply0_133 (JinvMrow + 4, Jrow + 4, &invI[12 * (size_t)b]);
+                        }
+                    }
+                }
+            }
+
+            Adcfm.resize(m);
+            rhs.resize(m);
+            for (unsigned int r = 0; r != m; ++r) {
+                Adcfm[r] = REAL(1e-3) * (REAL(1.0) + dRandReal());
+                rhs[r] = (dRandReal() - REAL(0.5)) * REAL(10.0);
+            }
+
+            system.nb = nb;
+            system.nj = (unsigned int)(jb.size() / 2);
+            system.m = m;
+            system.mindex = &mindex[0];
+            system.jb = &jb[0];
+            system.J = &J[0];
+            system.JinvM = &JinvM[0];
+            system.invI = &invI[0];
+            system.invMass = &invMass[0];
+            system.Adcfm = &Adcfm[0];
+        }
+
+        void AddJoint(int b1, int b2, unsigned int rows, bool friction)
+        {
+            mindex.push_back(m);
+            jb.push_back(b1);
+            jb.push_back(b2);
+            for (unsigned int r = 0; r != rows; ++r) {
+                if (rows == 3) {
+                    // a contact
+                    lo.push_back(r == 0 ? 0 : friction ? -REAL(0.5) : -REAL(1.0));
+                    hi.push_back(r == 0 ? dInfinity : friction ? REAL(0.5) : REAL(1.0));
+                    findex.push_back(r != 0 && friction ? (int)m : -1);
+                }
+                else {
+                    lo.push_back(-dInfinity);
+                    hi.push_back(dInfinity);
+                    findex.push_back(-1);
+                }
+            }
+            m += rows;
+        }
+
+        // Forms A = J*invM*J' + diag(Adcfm)
+        void FormA(dReal *A, unsigned int mskip) const
+        {
+            dSetZero(A, m * (size_t)mskip);
+            const unsigned int nj = system.nj;
+            for (unsigned int ji = 0; ji != nj; ++ji) {
+                for (unsigned int jj = 0; jj != nj; ++jj) {
+                    for (unsigned int si = 0; si != 2; ++si) {
+                        for (unsigned int sj = 0; sj != 2; ++sj) {
+                            if (jb[2 * ji + si] == -1 || jb[2 * ji + si] != jb[2 * jj + sj]) continue;
+                            const unsigned int ofsi = mindex[ji], mi = mindex[ji + 1] - ofsi;
+                            const unsigned int ofsj = mindex[jj], mj = mindex[jj + 1] - ofsj;
+                            for (unsigned int r = 0; r != mi; ++r) {
+                                for (unsigned int c = 0; c != mj; ++c) {
+                                    const dReal *Jrow = &J[2 * 8 * (size_t)ofsi + 8 * (si * mi + r)];
+                                    const dReal *JinvMrow = &JinvM[2 * 8 * (size_t)ofsj + 8 * (sj * mj + c)];
+                                    dReal sum = 0;
+                                    for (unsigned int k = 0; k != 8; ++k) sum += Jrow[k] * JinvMrow[k];
+                                    A[(ofsi + r) * (size_t)mskip + ofsj + c] += sum;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            for (unsigned int r = 0; r != m; ++r) {
+                A[r * (size_t)mskip + r] += Adcfm[r];
+            }
+        }
+
+        // Returns the largest violation of the LCP conditions by `x'
+        dReal GetLCPViolation(const dReal *x) const
+        {
+            const unsigned int mskip = dPAD(m);
+            std::vector<dReal> A(m * (size_t)mskip);
+            FormA(&A[0], mskip);
+
+            dReal violation = 0;
+            for (unsigned int r = 0; r != m; ++r) {
+                dReal w = -rhs[r];
+                for (unsigned int c = 0; c != m; ++c) w += A[r * (size_t)mskip + c] * x[c];
+
+                dReal rlo = lo[r], rhi = hi[r];
+                if (findex[r] >= 0) {
+                    rlo *= dFabs(x[findex[r]]);
+                    rhi *= dFabs(x[findex[r]]);
+                }
+                const dReal tol = REAL(1e-6) * (dFabs(x[r]) + REAL(1.0));
+                dReal v = 0;
+                if (x[r] < rlo - tol || x[r] > rhi + tol) v = dFabs(x[r] - std::max(rlo, std::min(rhi, x[r])));
+                else if (x[r] > rlo + tol && x[r] < rhi - tol) v = dFabs(w);
+                else if (x[r] <= rlo + tol && rlo != rhi) v = std::max(-w, REAL(0.0));
+                else if (x[r] >= rhi - tol && rlo != rhi) v = std::max(w, REAL(0.0));
+                violation = std::max(violation, v);
+            }
+            return violation;
+        }
+
+        // Returns the largest difference of solutions by dSolveLCPSparse() and
+        // dSolveLCP(), or -1 if the sparse solver fails
+        dReal CompareWithDense(dReal *xsparse) const
+        {
+            const unsigned int mskip = dPAD(m);
+            const size_t memreq = dEFFICIENT_SIZE(sizeof(dReal) * m * (size_t)mskip)
+                + 4 * dEFFICIENT_SIZE(sizeof(dReal) * m) + dEFFICIENT_SIZE(sizeof(int) * m)
+                + dEstimateSolveLCPMemoryReq(m, false);
+            dxWorldProcessMemArena *arena = dxAllocateTemporaryWorldProcessMemArena(memreq, NULL, NULL);
+            arena->ResetState();
+
+            void *state = arena->SaveState();
+            bool solved = dSolveLCPSparse(arena, memreq, &system, xsparse, &rhs[0], &lo[0], &hi[0], &findex[0]);
+            arena->RestoreState(state);
+
+            dReal difference = -1;
+            if (solved) {
+                std::vector<dReal> A(m * (size_t)mskip), xdense(m), b(rhs), dlo(lo), dhi(hi);
+                std::vector<int> dfindex(findex);
+                FormA(&A[0], mskip);
+                dSolveLCP(arena, m, &A[0], &xdense[0], &b[0], NULL, 0, &dlo[0], &dhi[0], &dfindex[0]);
+
+                difference = 0;
+                for (unsigned int r = 0; r != m; ++r) {
+                    difference = std::max(difference, dFabs(xsparse[r] - xdense[r]) / (dFabs(xdense[r]) + REAL(1.0)));
+                }
+            }
+
+            dxFreeTemporaryWorldProcessMemArena(arena);
+            return difference;
+        }
+
+        unsigned int nb, m;
+        std::vector<unsigned int> mindex;
+        std::vector<int> jb, findex;
+        std::vector<dReal> invMass, invI, J, JinvM, Adcfm, rhs, lo, hi;
+        dxSparseLCPSystem system;
+    };
+
+    TEST(test_SparseLCP_Chain)
+    {
+        SparseLCP_System chain(40, 0, 0, false);
+        std::vector<dReal> x(chain.m);
+        dReal difference = chain.CompareWithDense(&x[0]);
+        CHECK(difference >= 0 && difference < SPARSE_LCP_TOLERANCE);
+        CHECK(chain.GetLCPViolation(&x[0]) < SPARSE_LCP_TOLERANCE);
+    }
+
+    TEST(test_SparseLCP_LoopsAndContacts)
+    {
+        SparseLCP_System system(30, 6, 12, false);
+        std::vector<dReal> x(system.m);
+        dReal difference = system.CompareWithDense(&x[0]);
+        CHECK(difference >= 0 && difference < SPARSE_LCP_TOLERANCE);
+        CHECK(system.GetLCPViolation(&x[0]) < SPARSE_LCP_TOLERANCE);
+    }
+
+    TEST(test_SparseLCP_Friction)
+    {
+        // dSolveLCP() fixes the friction bounds as it goes, so the result
+        // need not satisfy the LCP conditions. It must be the same though.
+        SparseLCP_System system(30, 3, 20, true);
+        std::vector<dReal> x(system.m);
+        dReal difference = system.CompareWithDense(&x[0]);
+        CHECK(difference >= 0 && difference < SPARSE_LCP_TOLERANCE);
+    }
+
+    TEST(test_SparseLCP_MemoryLimit)
+    {
+        SparseLCP_System system(20, 2, 4, true);
+        std::vector<dReal> x(system.m, REAL(123.0));
+        dxWorldProcessMemArena *arena = dxAllocateTemporaryWorldProcessMemArena(1024, NULL, NULL);
+        arena->ResetState();
+        bool solved = dSolveLCPSparse(arena, 64, &system.system, &x[0], &system.rhs[0], &system.lo[0], &system.hi[0], &system.findex[0]);
+        dxFreeTemporaryWorldProcessMemArena(arena);
+        CHECK(!solved);
+        CHECK_EQUAL(REAL(123.0), x[0]);
+    }
+}
@@ -0,0 +1,694 @@
+/*************************************************************************
+  *                                                                       *
+  * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+  * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+  *                                                                       *
+  * This library is free software; you can redistribute it and/or         *
+  * modify it under the terms of EITHER:                                  *
+  *   (1) The GNU Lesser General Public License as published by the Free  *
+  *       Software Foundation; either version 2.1 of the License, or (at  *
+  *       your option) any later version. The text of the GNU Lesser      *
+  *       General Public License is included with this library in the     *
+  *       file LICENSE.TXT.                                               *
+  *   (2) The BSD-style license that is included with this library in     *
+  *       the file LICENSE-BSD.TXT.                                       *
+  *                                                                       *
+  * This library is distributed in the hope that it will be useful,       *
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+  * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+  *                                                                       *
+  *************************************************************************/
+//234567890123456789012345678901234567890123456789012345678901234567890123456789
+//        1         2         3         4         5         6         7
+
+////////////////////////////////////////////////////////////////////////////////
+// This file create unit test for the row kernels found in:
+// ode/src/quickstep_kernels.h
+// and the body integrator kernels found in:
+// ode/src/stepbody_kernels.h
+// and for the results of the QuickStep stepper on a whole scene and for
+// its convergence tolerance.
+//
+// The SIMD kernels must produce results bitwise identical to the scalar ones.
+////////////////////////////////////////////////////////////////////////////////
+#include <UnitTest++.h>
+#include <ode/ode.h>
+#include <float.h>
+#include "../ode/src/config.h"
+#include "../ode/src/quickstep_kernels.h"
+#include "../ode/src/stepbody_kernels.h"
+
+
+// Bitwise comparison is only meaningful when the scalar code is not evaluated 
+// with extended precision or contracted into fused multiply-adds
+#if (!defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0) && !defined(__FMA__)
+#define CHECK_KERNEL_RESULT(expected, actual) CHECK_EQUAL(expected, actual)
+#else
+#define CHECK_KERNEL_RESULT(expected, actual) CHECK_CLOSE(expected, actual, dReal(1e-4) * (dFabs(expected) + 1))
+#endif
+
+
+SUITE(QuickStepKernels)
+{
+    struct Kernels_Fixture_1
+    {
+        Kernels_Fixture_1()
+        {
+            dRandSetSeed(1);
+
+            // values of different magnitudes and signs so that the summation 
+            // order matters for the rounding
+            const dReal scales[] = { REAL(1e-3), REAL(1e-1), REAL(1.0), REAL(1e1), REAL(1e3) };
+            const int scale_count = (int)(sizeof(scales) / sizeof(scales[0]));
+            for (unsigned int i = 0; i != sizeof(a) / sizeof(a[0]); ++i) {
+                a[i] = (dRandReal() - REAL(0.5)) * scales[dRandInt(scale_count)];
+                b[i] = (dRandReal() - REAL(0.5)) * scales[dRandInt(scale_count)];
+            }
+        }
+
+        // unaligned offsets are used as the rows are not aligned in the solver
+        dReal a[6 * 64 + 12];
+        dReal b[6 * 64 + 12];
+    };
+
+    TEST_FIXTURE(Kernels_Fixture_1, test_Dot6)
+    {
+        for (unsigned int offset = 0; offset != 6 * 64; ++offset) {
+            dReal expected = dxQuickStepDot6_Scalar(a + offset, b + offset);
+            dReal actual = dxQuickStepDot6(a + offset, b + offset);
+            CHECK_KERNEL_RESULT(expected, actual);
+        }
+    }
+
+    TEST_FIXTURE(Kernels_Fixture_1, test_Axpy6)
+    {
+        for (unsigned int offset = 0; offset != 6 * 64; ++offset) {
+            dReal expected[8], actual[8];
+            for (unsigned int i = 0; i != 8; ++i) expected[i] = actual[i] = b[offset + i];
+
+            dReal alpha = a[offset + 6];
+            dxQuickStepAxpy6_Scalar(expected, a + offset, alpha);
+            dxQuickStepAxpy6(actual, a + offset, alpha);
+
+            for (unsigned int i = 0; i != 8; ++i) {
+                CHECK_KERNEL_RESULT(expected[i], actual[i]);
+            }
+        }
+    }
+
+    TEST_FIXTURE(Kernels_Fixture_1, test_Multiply0_331)
+    {
+        for (unsigned int offset = 0; offset != 6 * 64; ++offset) {
+            dReal expected[4], actual[4];
+            expected[3] = actual[3] = REAL(7.0);
+
+            dxQuickStepMultiply0_331_Scalar(expected, a + offset, b + offset);
+            dxQuickStepMultiply0_331(actual, a + offset, b + offset);
+
+            for (unsigned int i = 0; i != 4; ++i) {
+                CHECK_KERNEL_RESULT(expected[i], actual[i]);
+            }
+        }
+    }
+
+    TEST_FIXTURE(Kernels_Fixture_1, test_Multiply0_331_MatchesMultiply0_331)
+    {
+        dReal expected[3], actual[3];
+        dMultiply0_331(expected, a, b);
+        dxQuickStepMultiply0_331(actual, a, b);
+
+        for (unsigned int i = 0; i != 3; ++i) {
+            CHECK_KERNEL_RESULT(expected[i], actual[i]);
+        }
+    }
+
+} // End of SUITE(QuickStepKernels)
+
+SUITE(StepBodyKernels)
+{
+    struct Lanes_Fixture_1
+    {
+        Lanes_Fixture_1()
+        {
+            dRandSetSeed(1);
+
+            for (unsigned int l = 0; l != dxSTEPBODY_LANES; ++l) {
+                for (unsigned int j = 0; j != 3; ++j) {
+                    lanes.pos[j][l] = (dRandReal() - REAL(0.5)) * REAL(100.0);
+                    lanes.lvel[j][l] = (dRandReal() - REAL(0.5)) * REAL(10.0);
+                    lanes.avel[j][l] = (dRandReal() - REAL(0.5)) * REAL(10.0);
+                }
+                dQuaternion q;
+                for (unsigned int j = 0; j != 4; ++j) q[j] = dRandReal() - REAL(0.5);
+                dNormalize4(q);
+                for (unsigned int j = 0; j != 4; ++j) lanes.q[j][l] = q[j];
+            }
+        }
+
+        dxStepBodyLanes lanes;
+    };
+
+    TEST_FIXTURE(Lanes_Fixture_1, test_IntegrateMatchesScalar)
+    {
+        dxStepBodyLanes expected = lanes, actual = lanes;
+        for (unsigned int step = 0; step != 16; ++step) {
+            dxStepBodyLanes_Scalar(&expected, REAL(0.01));
+            dxStepBodyLanes_Integrate(&actual, REAL(0.01));
+        }
+
+        for (unsigned int l = 0; l != dxSTEPBODY_LANES; ++l) {
+            for (unsigned int j = 0; j != 3; ++j) CHECK_KERNEL_RESULT(expected.pos[j][l], actual.pos[j][l]);
+            for (unsigned int j = 0; j != 4; ++j) CHECK_KERNEL_RESULT(expected.q[j][l], actual.q[j][l]);
+            for (unsigned int j = 0; j != 9; ++j) CHECK_KERNEL_RESULT(expected.R[j][l], actual.R[j][l]);
+        }
+    }
+
+    TEST_FIXTURE(Lanes_Fixture_1, test_ZeroQuaternionBecomesIdentity)
+    {
+        for (unsigned int j = 0; j != 4; ++j) lanes.q[j][1] = REAL(0.0);
+        for (unsigned int j = 0; j != 3; ++j) lanes.avel[j][1] = REAL(0.0);
+
+        dxStepBodyLanes_Integrate(&lanes, REAL(0.01));
+
+        CHECK_EQUAL(REAL(1.0), lanes.q[0][1]);
+        CHECK_EQUAL(REAL(0.0), lanes.q[1][1]);
+        CHECK_EQUAL(REAL(0.0), lanes.q[2][1]);
+        CHECK_EQUAL(REAL(0.0), lanes.q[3][1]);
+        CHECK_EQUAL(REAL(1.0), lanes.R[0][1]);
+        CHECK_EQUAL(REAL(1.0), lanes.R[4][1]);
+        CHECK_EQUAL(REAL(1.0), lanes.R[8][1]);
+    }
+
+} // End of SUITE(StepBodyKernels)
+
+SUITE(QuickStepScenes)
+{
+    // boxes dropped in a stack onto a plane, spinning, next to a chain of
+    // capsules hanging from the world by powered hinges
+    struct Scene_Fixture_1
+    {
+        enum { BoxCount = 6, LinkCount = 4, BodyCount = BoxCount + LinkCount };
+
+        Scene_Fixture_1()
+        {
+            // the constraints are reordered randomly
+            dRandSetSeed(1);
+            world = dWorldCreate();
+            dWorldSetGravity(world, 0, 0, REAL(-9.81));
+            space = dSimpleSpaceCreate(0);
+            contacts = dJointGroupCreate(0);
+            dCreatePlane(space, 0, 0, 1, 0);
+
+            for (int i = 0; i != BoxCount; ++i) {
+                dBodyID b = dBodyCreate(world);
+                dMass m;
+                dMassSetBox(&m, 1, REAL(1.0), REAL(0.6), REAL(0.4));
+                dBodySetMass(b, &m);
+                dBodySetPosition(b, REAL(0.1) * i, 0, REAL(0.25) + REAL(0.45) * i);
+                dBodySetAngularVel(b, 0, 0, REAL(0.5) * i);
+                dGeomSetBody(dCreateBox(space, REAL(1.0), REAL(0.6), REAL(0.4)), b);
+                bodies[i] = b;
+            }
+
+            dBodyID prev = 0;
+            for (int i = 0; i != LinkCount; ++i) {
+                dBodyID b = dBodyCreate(world);
+                dMass m;
+                dMassSetCapsule(&m, 1, 1, REAL(0.1), REAL(0.8));
+                dBodySetMass(b, &m);
+                dBodySetPosition(b, 3, 0, 4 - REAL(0.9) * i);
+                dBodySetAngularVel(b, 3, 0, 1);
+                dJointID h = dJointCreateHinge(world, 0);
+                dJointAttach(h, b, prev);
+                dJointSetHingeAnchor(h, 3, 0, REAL(4.45) - REAL(0.9) * i);
+                dJointSetHingeAxis(h, 0, 1, 0);
+                dJointSetHingeParam(h, dParamVel, REAL(0.5));
+                dJointSetHingeParam(h, dParamFMax, REAL(2.0));
+                bodies[BoxCount + i] = b;
+                prev = b;
+            }
+        }
+
+        ~Scene_Fixture_1()
+        {
+            dJointGroupDestroy(contacts);
+            dSpaceDestroy(space);
+            dWorldDestroy(world);
+        }
+
+        static void nearCallback(void *data, dGeomID g1, dGeomID g2)
+        {
+            Scene_Fixture_1 *scene = (Scene_Fixture_1 *)data;
+            dContact contact[4];
+            int n = dCollide(g1, g2, 4, &contact[0].geom, sizeof(dContact));
+            for (int i = 0; i != n; ++i) {
+                contact[i].surface.mode = dContactApprox1;
+                contact[i].surface.mu = REAL(0.8);
+                dJointID c = dJointCreateContact(scene->world, scene->contacts, &contact[i]);
+                dJointAttach(c, dGeomGetBody(g1), dGeomGetBody(g2));
+            }
+        }
+
+        void step(int count)
+        {
+            for (int i = 0; i != count; ++i) {
+                dSpaceCollide(space, this, &nearCallback);
+                dWorldQuickStep(world, REAL(0.01));
+                dJointGroupEmpty(contacts);
+            }
+        }
+
+        dWorldID world;
+        dSpaceID space;
+        dJointGroupID contacts;
+        dBodyID bodies[BodyCount];
+    };
+
+    // positions and linear velocities after 60 steps, as computed by the
+    // stepper before it gathered the body state into arrays of its own
+#if defined(dDOUBLE)
+    static const dReal s_sceneReferenceStates[Scene_Fixture_1::BodyCount][6] = {
+        { 0.00028331979249968277, 0.00038828746404880374, 0.19948130548260434, 0.0081832985549721605, 0.0041871365652648516, -0.00027507387381844883 },
+        { 0.10097317589018089, 0.00060138961793983095, 0.59922555043860171, 0.02083450192498178, 0.0075178752857655165, -0.0012524579811482306 },
+        { 0.20328975656544979, -9.6019836803700717e-05, 0.99875665488509346, 0.034241298684689274, 0.0073015778740562623, 0.0027901829175570464 },
+        { 0.30043557092421708, 8.0829828882426923e-05, 1.3983133323215333, 0.049474010303473467, 0.014847509971242727, -0.0081482233881750299 },
+        { 0.39682189405137469, -0.00047029425238854648, 1.7978772837714678, 0.068572188120857802, 0.026244409760994979, -0.016758462513621883 },
+        { 0.49607274159501713, -0.0021880200807734827, 2.1973781089330151, 0.088891653008858179, 0.033469201801606098, -0.013434656920794694 },
+        { 2.9355593086148293, 0.00011976850357551025, 4.0043932310687715, -0.18346474431698623, -0.0012382009399323438, 0.028310764225942808 },
+        { 2.6822334816685327, 0.00044817014823221444, 3.1510712152586402, -0.6917390792414615, -0.0022936623978974634, 0.22183401186518181 },
+        { 2.1979799292308284, 0.00084354681384081768, 2.4020933805277851, -1.5224178451421713, -0.0046794764862532869, 0.7780132000692046 },
+        { 1.5242154879452576, 0.0011671426577397033, 1.8187846089345356, -2.4364735335749046, -0.0069221655013566447, 1.8604850835376345 }
+    };
+#else
+    static const dReal s_sceneReferenceStates[Scene_Fixture_1::BodyCount][6] = {
+        { 0.000917605008, 0.000268214033, 0.198930532, -0.0341771059, -0.00908621587, -0.0440123752 },
+        { 0.104464613, 0.0011320191, 0.600970566, -0.029202966, -0.00206410885, -0.155018046 },
+        { 0.208519772, 0.0026458085, 0.99989593, -0.0881099179, -0.00348009705, -0.139413923 },
+        { 0.312924951, 0.000317287748, 1.39810729, -0.157615617, -0.0071883467, -0.105741635 },
+        { 0.412876338, 0.00377749698, 1.7965765, -0.233408913, -0.0125849582, -0.0779770315 },
+        { 0.519315958, 0.0186688304, 2.19518375, -0.311630577, -0.0190934502, -0.0546959788 },
+        { 2.93408251, 9.09631417e-05, 4.00458813, -0.172063798, 2.88017909e-05, 0.0261132643 },
+        { 2.67833352, 0.000395916373, 3.15163755, -0.701431274, -0.00199156883, 0.211254314 },
+        { 2.19282079, 0.000765118166, 2.40326333, -1.52609611, -0.00459552556, 0.780871153 },
+        { 1.51814032, 0.00108113652, 1.82167482, -2.44817638, -0.00745949568, 1.87010062 }
+    };
+#endif
+
+    TEST_FIXTURE(Scene_Fixture_1, test_StatesMatchReference)
+    {
+        step(60);
+
+        for (int i = 0; i != BodyCount; ++i) {
+            const dReal *pos = dBodyGetPosition(bodies[i]), *vel = dBodyGetLinearVel(bodies[i]);
+            for (int j = 0; j != 3; ++j) {
+                CHECK_KERNEL_RESULT(s_sceneReferenceStates[i][j], pos[j]);
+                CHECK_KERNEL_RESULT(s_sceneReferenceStates[i][3 + j], vel[j]);
+            }
+        }
+    }
+
+    // a wall of bricks laid in staggered courses on a plane, all in one
+    // island, stepped with the serial or the parallel SOR solver
+    struct BrickWallScene
+    {
+        enum { BrickWidth = 12, CourseCount = 8, BrickCount = BrickWidth * CourseCount };
+
+        BrickWallScene(dThreadingImplementationID threading)
+        {
+            dRandSetSeed(1);
+            world = dWorldCreate();
+            dWorldSetGravity(world, 0, 0, REAL(-9.81));
+            dWorldSetQuickStepNumIterations(world, 20);
+            dWorldSetContactSurfaceLayer(world, REAL(0.001));
+            if (threading != NULL) {
+                dWorldSetStepThreadingImplementation(world, dThreadingImplementationGetFunctions(threading), threading);
+                dWorldSetQuickStepParallelSOR(world, 1);
+            }
+            space = dSimpleSpaceCreate(0);
+            contacts = dJointGroupCreate(0);
+            dCreatePlane(space, 0, 0, 1, 0);
+
+            for (int i = 0; i != BrickCount; ++i) {
+                int course = i / BrickWidth;
+                dBodyID b = dBodyCreate(world);
+                dMass m;
+                dMassSetBox(&m, 1, REAL(1.0), REAL(0.4), REAL(0.5));
+                dBodySetMass(b, &m);
+                dBodySetPosition(b, REAL(1.02) * (i % BrickWidth) + REAL(0.51) * (course % 2), 0, REAL(0.249) + REAL(0.499) * course);
+                dGeomSetBody(dCreateBox(space, REAL(1.0), REAL(0.4), REAL(0.5)), b);
+                bodies[i] = b;
+            }
+        }
+
+        ~BrickWallScene()
+        {
+            dWorldSetStepThreadingImplementation(world, NULL, NULL);
+            dJointGroupDestroy(contacts);
+            dSpaceDestroy(space);
+            dWorldDestroy(world);
+        }
+
+        static void nearCallback(void *data, dGeomID g1, dGeomID g2)
+        {
+            BrickWallScene *scene = (BrickWallScene *)data;
+            dContact contact[4];
+            int n = dCollide(g1, g2, 4, &contact[0].geom, sizeof(dContact));
+            for (int i = 0; i != n; ++i) {
+                contact[i].surface.mode = dContactApprox1;
+                contact[i].surface.mu = REAL(0.8);
+                dJointID c = dJointCreateContact(scene->world, scene->contacts, &contact[i]);
+                dJointAttach(c, dGeomGetBody(g1), dGeomGetBody(g2));
+            }
+        }
+
+        // steps the scene and returns the largest residual of the steps
+        dReal step(int count)
+        {
+            dReal maxResidual = 0;
+            for (int i = 0; i != count; ++i) {
+                dSpaceCollide(space, this, &nearCallback);
+                dWorldQuickStep(world, REAL(0.01));
+                dJointGroupEmpty(contacts);
+
+                dQuickStepIslandStatistics stats;
+                dWorldGetQuickStepIslandStatistics(world, 0, &stats);
+                if (stats.residual > maxResidual) maxResidual = stats.residual;
+            }
+            return maxResidual;
+        }
+
+        // the largest distance a brick has sunk below its course
+        dReal maxSinking() const
+        {
+            dReal sinking = 0;
+            for (int i = 0; i != BrickCount; ++i) {
+                dReal z = REAL(0.249) + REAL(0.499) * (i / BrickWidth);
+                if (z - dBodyGetPosition(bodies[i])[2] > sinking) sinking = z - dBodyGetPosition(bodies[i])[2];
+            }
+            return sinking;
+        }
+
+        dWorldID world;
+        dSpaceID space;
+        dJointGroupID contacts;
+        dBodyID bodies[BrickCount];
+    };
+
+    TEST(test_ParallelSORMatchesSerialOnAWall)
+    {
+        /*
+         * The rows of the wall are colored into batches large enough to be
+         * posted to the threads. The parallel solver must hold the wall up
+         * as well as the serial one, and as its batches share no bodies,
+         * it must give the same result on every run.
+         */
+        const unsigned ThreadCount = 4;
+        const int StepCount = 30;
+
+        dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+        if (threading == NULL) {
+            return; // built without threading, there is no parallel path
+        }
+        dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+
+        {
+            BrickWallScene serial(NULL), parallel(threading), parallelAgain(threading);
+            dReal serialResidual = serial.step(StepCount);
+            dReal parallelResidual = parallel.step(StepCount);
+            parallelAgain.step(StepCount);
+
+            CHECK_EQUAL(1U, dWorldGetQuickStepIslandCount(parallel.world));
+            dQuickStepIslandStatistics stats;
+            dWorldGetQuickStepIslandStatistics(parallel.world, 0, &stats);
+            CHECK_EQUAL((unsigned)BrickWallScene::BrickCount, stats.bodies);
+            CHECK(stats.rows > 1000);
+
+            CHECK(serial.maxSinking() < REAL(0.01));
+            CHECK(parallel.maxSinking() < REAL(0.01));
+            CHECK(parallelResidual < 2 * serialResidual);
+
+            bool sameAsSerial = true;
+            for (int i = 0; i != BrickWallScene::BrickCount; ++i) {
+                const dReal *pos = dBodyGetPosition(parallel.bodies[i]);
+                const dReal *serialPos = dBodyGetPosition(serial.bodies[i]);
+                const dReal *againPos = dBodyGetPosition(parallelAgain.bodies[i]);
+                for (int j = 0; j != 3; ++j) {
+                    CHECK_CLOSE(serialPos[j], pos[j], REAL(0.01));
+                    CHECK_EQUAL(againPos[j], pos[j]);
+                    sameAsSerial = sameAsSerial && serialPos[j] == pos[j];
+                }
+            }
+            // the rows are not reordered randomly, so the path taken shows
+            CHECK(!sameAsSerial);
+        }
+
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+
+    TEST(test_StepperMemoryKeepsASingleCopyOfIMJ)
+    {
+        /*
+         * The rows keep J in their original order, and the scaled J and iMJ
+         * only in the row layout. With the other arrays of a row this fits
+         * in 64 values per row, a separate copy of iMJ would not.
+         */
+        BrickWallScene wall(NULL);
+        dWorldSetStepStatisticsEnabled(wall.world, 1);
+        wall.step(1);
+
+        dWorldStepStatistics stats;
+        dWorldGetStepStatistics(wall.world, &stats);
+        CHECK(stats.max_island_rows > 1000);
+        CHECK(stats.stepper_memory_estimate < (size_t)stats.max_island_rows * 64 * sizeof(dReal));
+    }
+
+    // the threads notify different bodies, each counts into its own data
+    static void countMovedBody(dBodyID b)
+    {
+        ++*(int *)dBodyGetData(b);
+    }
+
+    TEST(test_FreeBodiesAreIntegratedAcrossIslands)
+    {
+        /*
+         * Free bodies make an island each, the bodies of all the islands are
+         * integrated together, in several chunks shared by the threads.
+         * Without gravity a body moves by its velocity times the step.
+         */
+        const int BodyCount = 300;
+        const unsigned ThreadCount = 4;
+        const dReal StepSize = REAL(0.01);
+
+        dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+        dThreadingThreadPoolID pool = NULL;
+
+        dWorldID world = dWorldCreate();
+        if (threading != NULL) {
+            pool = dThreadingAllocateThreadPool(ThreadCount, 0, dAllocateFlagBasicData, NULL);
+            dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+            dWorldSetStepThreadingImplementation(world, dThreadingImplementationGetFunctions(threading), threading);
+            dWorldSetStepIslandsProcessingMaxThreadCount(world, ThreadCount);
+        }
+
+        dRandSetSeed(3);
+        dBodyID bodies[BodyCount];
+        dReal expected[BodyCount][3];
+        int moved[BodyCount] = { 0 };
+        for (int i = 0; i != BodyCount; ++i) {
+            dBodyID b = dBodyCreate(world);
+            dBodySetData(b, &moved[i]);
+            dBodySetPosition(b, dRandReal(), dRandReal(), dRandReal());
+            dBodySetLinearVel(b, dRandReal() - REAL(0.5), dRandReal() - REAL(0.5), dRandReal() - REAL(0.5));
+            dBodySetMovedCallback(b, &countMovedBody);
+            const dReal *pos = dBodyGetPosition(b), *vel = dBodyGetLinearVel(b);
+            for (int j = 0; j != 3; ++j) expected[i][j] = pos[j] + StepSize * vel[j];
+            bodies[i] = b;
+        }
+
+        dWorldQuickStep(world, StepSize);
+        CHECK_EQUAL((unsigned)BodyCount, dWorldGetQuickStepIslandCount(world));
+        for (int i = 0; i != BodyCount; ++i) {
+            CHECK_EQUAL(1, moved[i]);
+            const dReal *pos = dBodyGetPosition(bodies[i]);
+            for (int j = 0; j != 3; ++j) {
+                CHECK_KERNEL_RESULT(expected[i][j], pos[j]);
+            }
+        }
+
+        dWorldDestroy(world);
+        if (threading != NULL) {
+            dThreadingImplementationShutdownProcessing(threading);
+            dThreadingFreeThreadPool(pool);
+            dThreadingFreeImplementation(threading);
+        }
+    }
+
+} // End of SUITE(QuickStepScenes)
+
+SUITE(QuickStepTolerance)
+{
+    // a column of boxes resting on a plane, every pair of them touching
+    // at four contacts, stepped with warm starting
+    struct BoxColumn
+    {
+        enum { BoxCount = 4 };
+
+        BoxColumn(int iterations, dReal tolerance)
+        {
+            dRandSetSeed(1);
+            world = dWorldCreate();
+            dWorldSetGravity(world, 0, 0, REAL(-9.81));
+            dWorldSetQuickStepNumIterations(world, iterations);
+            dWorldSetQuickStepTolerance(world, tolerance);
+            dWorldSetQuickStepWarmStarting(world, 1);
+            dWorldSetContactSurfaceLayer(world, REAL(0.001));
+            space = dSimpleSpaceCreate(0);
+            contacts = dJointGroupCreate(0);
+            dCreatePlane(space, 0, 0, 1, 0);
+
+            for (int i = 0; i != BoxCount; ++i) {
+                dBodyID b = dBodyCreate(world);
+                dMass m;
+                dMassSetBox(&m, 1, REAL(0.8), REAL(0.8), REAL(0.4));
+                dBodySetMass(b, &m);
+                dBodySetPosition(b, 0, 0, REAL(0.199) + REAL(0.399) * i);
+                dGeomSetBody(dCreateBox(space, REAL(0.8), REAL(0.8), REAL(0.4)), b);
+                bodies[i] = b;
+            }
+        }
+
+        ~BoxColumn()
+        {
+            dJointGroupDestroy(contacts);
+            dSpaceDestroy(space);
+            dWorldDestroy(world);
+        }
+
+        static void nearCallback(void *data, dGeomID g1, dGeomID g2)
+        {
+            BoxColumn *column = (BoxColumn *)data;
+            dContact contact[4];
+            int n = dCollide(g1, g2, 4, &contact[0].geom, sizeof(dContact));
+            for (int i = 0; i != n; ++i) {
+                contact[i].surface.mode = dContactApprox1;
+                contact[i].surface.mu = REAL(0.8);
+                dJointID c = dJointCreateContact(column->world, column->contacts, &contact[i]);
+                dJointAttach(c, dGeomGetBody(g1), dGeomGetBody(g2));
+            }
+        }
+
+        // steps the column and returns the number of its islands
+        unsigned step(dQuickStepIslandStatistics *stats)
+        {
+            dSpaceCollide(space, this, &nearCallback);
+            dWorldQuickStep(world, REAL(0.01));
+            dJointGroupEmpty(contacts);
+
+            dWorldGetQuickStepIslandStatistics(world, 0, stats);
+            return dWorldGetQuickStepIslandCount(world);
+        }
+
+        dWorldID world;
+        dSpaceID space;
+        dJointGroupID contacts;
+        dBodyID bodies[BoxCount];
+    };
+
+    TEST(test_ZeroToleranceRunsAllIterations)
+    {
+        BoxColumn column(15, 0);
+        dQuickStepIslandStatistics stats;
+        for (int i = 0; i != 20; ++i) {
+            CHECK_EQUAL(1U, column.step(&stats));
+            CHECK_EQUAL((unsigned)BoxColumn::BoxCount, stats.bodies);
+            CHECK(stats.rows >= 3U * 4 * BoxColumn::BoxCount);
+            CHECK_EQUAL(15U, stats.iterations);
+        }
+    }
+
+    TEST(test_IterationsStopOnceTheResidualIsBelowTheTolerance)
+    {
+        /*
+         * An island stops iterating as soon as the residual drops below the
+         * tolerance, and otherwise runs all its iterations. Once the column
+         * has settled and its contacts are warm started, it takes fewer.
+         */
+        const unsigned Iterations = 80;
+        const dReal Tolerance = REAL(1e-3);
+
+        BoxColumn column(Iterations, Tolerance);
+        dQuickStepIslandStatistics stats;
+        unsigned earlyStops = 0;
+        for (int i = 0; i != 100; ++i) {
+            CHECK_EQUAL(1U, column.step(&stats));
+            CHECK(stats.iterations >= 1 && stats.iterations <= Iterations);
+            if (stats.iterations < Iterations) {
+                CHECK(stats.residual < Tolerance);
+                ++earlyStops;
+            }
+        }
+        CHECK(earlyStops > 50);
+
+        // stopping early has not let the column sink
+        const dReal *top = dBodyGetPosition(column.bodies[BoxColumn::BoxCount - 1]);
+        CHECK_CLOSE(REAL(0.199) + REAL(0.399) * (BoxColumn::BoxCount - 1), top[2], REAL(0.01));
+    }
+
+    TEST(test_ResidualShrinksWithTheIterations)
+    {
+        /*
+         * Two settled columns take the same step with a few and with many
+         * iterations. The longer solve must end with a smaller residual.
+         * The step starts cold: the cached forces of a settled column are
+         * close to the solution already, and leave little to improve on.
+         */
+        BoxColumn few(40, 0), many(40, 0);
+        dQuickStepIslandStatistics fewStats, manyStats;
+
+        // the constraints are reordered randomly, so both columns start
+        // each run from the same seed
+        dRandSetSeed(1);
+        for (int i = 0; i != 30; ++i) few.step(&fewStats);
+        dRandSetSeed(1);
+        for (int i = 0; i != 30; ++i) many.step(&manyStats);
+        CHECK_EQUAL(fewStats.residual, manyStats.residual);
+
+        dWorldSetQuickStepNumIterations(few.world, 5);
+        dWorldSetQuickStepNumIterations(many.world, 80);
+        dWorldSetQuickStepWarmStarting(few.world, 0);
+        dWorldSetQuickStepWarmStarting(many.world, 0);
+        dRandSetSeed(2);
+        few.step(&fewStats);
+        dRandSetSeed(2);
+        many.step(&manyStats);
+        CHECK_EQUAL(5U, fewStats.iterations);
+        CHECK_EQUAL(80U, manyStats.iterations);
+        CHECK(manyStats.residual < fewStats.residual / 10);
+    }
+
+    TEST(test_WarmStartedContactsTakeTheCachedForcesAsTheyAre)
+    {
+        /*
+         * A settled column is stepped once without iterations, so its
+         * contacts keep the forces they were seeded with from the contact
+         * cache. Taken as they are, these still hold the boxes up; scaled
+         * down, the boxes would start to fall.
+         */
+        BoxColumn column(40, 0);
+        dQuickStepIslandStatistics stats;
+        for (int i = 0; i != 50; ++i) column.step(&stats);
+        CHECK_EQUAL(REAL(0.9), dWorldGetQuickStepWarmStartingFactor(column.world));
+
+        dWorldSetQuickStepNumIterations(column.world, 0);
+        column.step(&stats);
+        for (int i = 0; i != BoxColumn::BoxCount; ++i) {
+            const dReal *vel = dBodyGetLinearVel(column.bodies[i]);
+            CHECK_CLOSE(0, vel[2], REAL(0.002));
+        }
+    }
+
+} // End of SUITE(QuickStepTolerance)
@@ -0,0 +1,176 @@
+/*************************************************************************
+  *                                                                       *
+  * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+  * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+  *                                                                       *
+  * This library is free software; you can redistribute it and/or         *
+  * modify it under the terms of EITHER:                                  *
+  *   (1) The GNU Lesser General Public License as published by the Free  *
+  *       Software Foundation; either version 2.1 of the License, or (at  *
+  *       your option) any later version. The text of the GNU Lesser      *
+  *       General Public License is included with this library in the     *
+  *       file LICENSE.TXT.                                               *
+  *   (2) The BSD-style license that is included with this library in     *
+  *       the file LICENSE-BSD.TXT.                                       *
+  *                                                                       *
+  * This library is distributed in the hope that it will be useful,       *
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+  * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+  *                                                                       *
+  *************************************************************************/
+//234567890123456789012345678901234567890123456789012345678901234567890123456789
+//        1         2         3         4         5         6         7
+
+////////////////////////////////////////////////////////////////////////////////
+// This file create unit test for the built-in threading implementations:
+// ode/src/threading_impl.cpp
+//
+// The calls are posted in trees of dependencies the way the stepper does it
+// and every call must run exactly once before the master call is released.
+////////////////////////////////////////////////////////////////////////////////
+#include <UnitTest++.h>
+#include <ode/ode.h>
+
+
+namespace
+{
+    enum
+    {
+        CHILD_CALL_COUNT = 500,
+        TREE_REPEAT_COUNT = 20,
+        POOL_THREAD_COUNT = 4
+    };
+
+    struct CallTreeContext
+    {
+        dThreadingImplementationID impl;
+        const dThreadingFunctionsInfo *functions;
+        dCallReleaseeID finalReleasee;
+        int childRuns[CHILD_CALL_COUNT];
+        int grandchildRuns[CHILD_CALL_COUNT];
+        int finalChildRuns;
+        int finalRuns;
+    };
+
+    int grandchildCall(void *call_context, dcallindex_t instance_index, dCallReleaseeID)
+    {
+        CallTreeContext *context = (CallTreeContext *)call_context;
+        context->grandchildRuns[instance_index] += 1;
+        return 1;
+    }
+
+    int childCall(void *call_context, dcallindex_t instance_index, dCallReleaseeID this_releasee)
+    {
+        CallTreeContext *context = (CallTreeContext *)call_context;
+        context->childRuns[instance_index] += 1;
+
+        // Every other child delays its own release until its sub-call completes
+        if (instance_index % 2 == 0) {
+            context->functions->alter_call_dependencies_count(context->impl, this_releasee, 1);
+            context->functions->post_call(context->impl, NULL, NULL, 0, this_releasee, NULL, 
+                &grandchildCall, context, instance_index, "grandchild");
+        }
+        return 1;
+    }
+
+    int finalCall(void *call_context, dcallindex_t, dCallReleaseeID)
+    {
+        CallTreeContext *context = (CallTreeContext *)call_context;
+        context->finalRuns += 1;
+
+        // All the children must have completed by now
+        int completed = 0;
+        for (int i = 0; i != CHILD_CALL_COUNT; ++i) {
+            completed += context->childRuns[i] == 1 && (i % 2 != 0 || context->grandchildRuns[i] == 1);
+        }
+        context->finalChildRuns = completed;
+        return 1;
+    }
+
+    int rootCall(void *call_context, dcallindex_t, dCallReleaseeID this_releasee)
+    {
+        CallTreeContext *context = (CallTreeContext *)call_context;
+
+        // The final call waits for all the children and the root waits for the final call
+        dCallReleaseeID finalReleasee;
+        context->functions->alter_call_dependencies_count(context->impl, this_releasee, 1);
+        context->functions->post_call(context->impl, NULL, &finalReleasee, CHILD_CALL_COUNT, this_releasee, NULL, 
+            &finalCall, context, 0, "final");
+
+        for (int i = 0; i != CHILD_CALL_COUNT; ++i) {
+            context->functions->post_call(context->impl, NULL, NULL, 0, finalReleasee, NULL, 
+                &childCall, context, i, "child");
+        }
+        return 1;
+    }
+
+    // Returns the number of the call trees that did not complete as expected
+    int runCallTrees(dThreadingImplementationID impl)
+    {
+        const dThreadingFunctionsInfo *functions = dThreadingImplementationGetFunctions(impl);
+
+        dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(POOL_THREAD_COUNT, 0, dAllocateFlagBasicData, NULL);
+        if (pool == NULL) {
+            return TREE_REPEAT_COUNT;
+        }
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, impl);
+
+        int failed_trees = functions->retrieve_thread_count(impl) == POOL_THREAD_COUNT ? 0 : 1;
+        dCallWaitID call_wait = functions->alloc_call_wait(impl);
+
+        for (int repeat = 0; repeat != TREE_REPEAT_COUNT; ++repeat) {
+            CallTreeContext context;
+            context.impl = impl;
+            context.functions = functions;
+            context.finalChildRuns = 0;
+            context.finalRuns = 0;
+            for (int i = 0; i != CHILD_CALL_COUNT; ++i) {
+                context.childRuns[i] = 0;
+                context.grandchildRuns[i] = 0;
+            }
+
+            int summary_fault = 0;
+            functions->reset_call_wait(impl, call_wait);
+            functions->post_call(impl, &summary_fault, NULL, 0, NULL, call_wait, &rootCall, &context, 0, "root");
+            functions->wait_call(impl, NULL, call_wait, NULL, "root wait");
+
+            bool tree_ok = summary_fault == 0 && context.finalRuns == 1 && context.finalChildRuns == CHILD_CALL_COUNT;
+            for (int i = 0; i != CHILD_CALL_COUNT; ++i) {
+                tree_ok = tree_ok && context.childRuns[i] == 1 && context.grandchildRuns[i] == (i % 2 == 0 ? 1 : 0);
+            }
+            failed_trees += tree_ok ? 0 : 1;
+        }
+
+        functions->free_call_wait(impl, call_wait);
+
+        dThreadingImplementationShutdownProcessing(impl);
+        dThreadingFreeThreadPool(pool);
+        return failed_trees;
+    }
+}
+
+TEST(test_threading_multi_threaded_call_trees)
+{
+    dThreadingImplementationID impl = dThreadingAllocateMultiThreadedImplementation();
+
+    if (impl != NULL) {
+        CHECK_EQUAL(0, runCallTrees(impl));
+        dThreadingFreeImplementation(impl);
+    }
+}
+
+TEST(test_threading_work_stealing_call_trees)
+{
+    dThreadingImplementationID impl = dThreadingAllocateMultiThreadedWorkStealingImplementation();
+
+    if (impl != NULL) {
+        CHECK_EQUAL(0, runCallTrees(impl));
+
+        // The implementation must be possible to serve again after a shutdown
+        dThreadingImplementationCleanupForRestart(impl);
+        CHECK_EQUAL(0, runCallTrees(impl));
+
+        dThreadingFreeImplementation(impl);
+    }
+}